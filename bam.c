@@ -23,8 +23,6 @@
  */
 
 #include <limits.h>
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 #include "bam.h"
@@ -57,6 +55,16 @@
                                                         (_handle))
 
 
+// ******** WIDGET FLAGS ********
+
+#define BAM_WIDGET_FLAG_COLORS                      0x00000001ul
+#define BAM_WIDGET_FLAG_BUSY                        0x00000002ul
+#define BAM_WIDGET_FLAG_LOW_PRIORITY                0x00000004ul
+#define BAM_WIDGET_FLAG_BASE                        0x00000008ul
+#define BAM_WIDGET_FLAG_OVERLAY                     0x00000010ul
+#define BAM_WIDGET_FLAG_THROTTLED                   0x00000020ul
+
+
 // ******** PANIC ********
 
 static void panic(bam_t* bam, bam_panic_code_t code) {
@@ -77,6 +85,33 @@ static int max_int(int a, int b) {
 }
 
 
+// ******** TIME ********
+
+#ifndef BAM_IDLE_TIMEOUT
+#define BAM_IDLE_TIMEOUT                            10000u
+#endif // BAM_IDLE_TIMEOUT
+
+#ifndef BAM_MAX_COALESCED_MOVES
+#define BAM_MAX_COALESCED_MOVES                     16
+#endif // BAM_MAX_COALESCED_MOVES
+
+
+static bam_tick_t tick_elapsed(bam_tick_t now, bam_tick_t then) {
+    return (bam_tick_t) (now - then);
+}
+
+
+static bool tick_reached(bam_tick_t now, bam_tick_t deadline) {
+    // ticks wrap, so deadline is considered reached if it is no more than half the tick range in the past
+    return ((int16_t) (bam_tick_t) (now - deadline)) >= 0;
+}
+
+
+static bam_tick_t tick_until(bam_tick_t now, bam_tick_t deadline) {
+    return tick_reached(now, deadline) ? 0 : (bam_tick_t) (deadline - now);
+}
+
+
 // ******** RECTANGLE ********
 
 static void rect_init(bam_rect_t* rect, int x, int y, int width, int height) {
@@ -148,6 +183,35 @@ static void rect_set_pos(bam_rect_t* rect, int x, int y) {
 }
 
 
+static void rect_union(bam_rect_t* rect, const bam_rect_t* other) {
+    BAM_ASSERT(rect);
+    BAM_ASSERT(other);
+
+    if (rect_empty(other)) {
+        return;
+    }
+
+    if (rect_empty(rect)) {
+        *rect = *other;
+        return;
+    }
+
+    rect->x1 = min_int(rect->x1, other->x1);
+    rect->y1 = min_int(rect->y1, other->y1);
+    rect->x2 = max_int(rect->x2, other->x2);
+    rect->y2 = max_int(rect->y2, other->y2);
+}
+
+
+static bool rect_equal(const bam_rect_t* rect, const bam_rect_t* other) {
+    BAM_ASSERT(rect);
+    BAM_ASSERT(other);
+
+    return rect->x1 == other->x1 && rect->y1 == other->y1 &&
+           rect->x2 == other->x2 && rect->y2 == other->y2;
+}
+
+
 static void rect_intersect(bam_rect_t* rect, const bam_rect_t* other) {
     BAM_ASSERT(rect);
     BAM_ASSERT(other);
@@ -203,11 +267,11 @@ static const void* unicode_decode_utf8(const void* input, bam_unichar_t* unichar
 
 // ******** FONT/GLYPH METRICS ********
 
-static int16_t metrics_calc_string_width(bam_t* bam, const uint8_t* text_start, const uint8_t* text_end,
+static int32_t metrics_calc_string_width(bam_t* bam, const uint8_t* text_start, const uint8_t* text_end,
                                          bam_font_t font) {
     const bam_vtable_t* vtable = bam->vtable;
     const uint8_t* text_i = text_start;
-    int16_t cursor_x = 0;
+    int32_t cursor_x = 0;
 
     while (text_i < text_end) {
         bam_unichar_t codepoint = 0;
@@ -216,7 +280,7 @@ static int16_t metrics_calc_string_width(bam_t* bam, const uint8_t* text_start,
         text_i = unicode_decode_utf8(text_i, &codepoint);
 
         if (vtable->get_glyph_metrics(&glyph_metrics, font, codepoint, bam->user_data)) {
-            cursor_x = (int16_t) (cursor_x + glyph_metrics.x_advance);
+            cursor_x += glyph_metrics.x_advance;
         }
     }
 
@@ -224,6 +288,37 @@ static int16_t metrics_calc_string_width(bam_t* bam, const uint8_t* text_start,
 }
 
 
+// ******** COLORS ********
+
+static bam_color_t color_lerp(const bam_t* bam, bam_color_t from, bam_color_t to, int weight, int scale) {
+    bam_color_t color = 0;
+
+    // without backend's help, colors are taken to be four 8-bit channels
+    if (bam->vtable->lerp_color) {
+        return bam->vtable->lerp_color(from, to, weight, scale, bam->user_data);
+    }
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        int a = (int) ((from >> shift) & 0xFFu);
+        int b = (int) ((to >> shift) & 0xFFu);
+
+        color |= ((bam_color_t) (a + (int) ((((int64_t) b - a) * weight) / scale))) << shift;
+    }
+
+    return color;
+}
+
+
+static uint8_t color_coverage(const bam_t* bam, bam_color_t color) {
+    // only backend knows its color format, without its help lowest 8 bits of a color are taken to be its coverage
+    if (bam->vtable->get_coverage) {
+        return bam->vtable->get_coverage(color, bam->user_data);
+    }
+
+    return (uint8_t) (color & 0xFFu);
+}
+
+
 // ******** DRAWING ********
 
 static void draw_set_translation(bam_t* bam, int x, int y) {
@@ -245,21 +340,28 @@ static void draw_set_clip(bam_t* bam, const bam_rect_t* rect) {
 }
 
 
-static void draw_glyph(bam_t* bam, int x, int y, const bam_glyph_metrics_t* metrics,
+static void draw_glyph(bam_t* bam, int32_t x, int32_t y, const bam_glyph_metrics_t* metrics,
                        const bam_color_pair_t* colors) {
     bam_draw_state_t* draw_state = &bam->draw_state;
+    const bam_rect_t* clip = &draw_state->clip;
 
     bam_rect_t dest_rect;
     bam_rect_t src_rect;
 
-    x = (int16_t) (x + draw_state->translate_x + metrics->x_bearing);
-    y = (int16_t) (y + draw_state->translate_y - metrics->y_bearing);
+    x += draw_state->translate_x + metrics->x_bearing;
+    y += draw_state->translate_y - metrics->y_bearing;
+
+    // reject glyphs lying entirely outside of clipping rectangle in 32-bit arithmetic, which also guarantees that
+    // remaining glyphs fit in bam_coord_t
+    if (x >= clip->x2 || y >= clip->y2 || (x + metrics->width) <= clip->x1 || (y + metrics->height) <= clip->y1) {
+        return;
+    }
 
-    rect_init(&dest_rect, x, y, metrics->width, metrics->height);
+    rect_init(&dest_rect, (int) x, (int) y, metrics->width, metrics->height);
     rect_intersect(&dest_rect, &draw_state->clip);
 
     if (!rect_empty(&dest_rect)) {
-        rect_init(&src_rect, (int16_t) (dest_rect.x1 - x), (int16_t) (dest_rect.y1 - y),
+        rect_init(&src_rect, (int) (dest_rect.x1 - x), (int) (dest_rect.y1 - y),
                   rect_width(&dest_rect), rect_height(&dest_rect));
 
         if (!rect_empty(&src_rect)) {
@@ -269,6 +371,42 @@ static void draw_glyph(bam_t* bam, int x, int y, const bam_glyph_metrics_t* metr
 }
 
 
+static void draw_text_run(bam_t* bam, int32_t x, int32_t y, const uint8_t* text_i, const uint8_t* text_e,
+                          bam_font_t font, const bam_color_pair_t* colors) {
+    const bam_vtable_t* vtable = bam->vtable;
+
+    // x and y are position of first glyph's origin on baseline
+    while (text_i < text_e) {
+        bam_unichar_t codepoint = 0;
+        bam_glyph_metrics_t glyph_metrics;
+
+        text_i = unicode_decode_utf8(text_i, &codepoint);
+
+        if (vtable->get_glyph_metrics(&glyph_metrics, font, codepoint, bam->user_data)) {
+            draw_glyph(bam, x, y, &glyph_metrics, colors);
+            x += glyph_metrics.x_advance;
+        }
+    }
+}
+
+
+static int text_calc_top(const bam_widget_t* widget, const bam_rect_t* inner, int line_height) {
+    int block_height = widget->n_lines * line_height;
+
+    // calculate y coordinate of top of first line of wrapped text based on style's v_align property
+    switch (widget->style->v_align) {
+    case BAM_V_ALIGN_MIDDLE:
+        return ((inner->y1 + inner->y2) / 2) - (block_height / 2);
+
+    case BAM_V_ALIGN_BOTTOM:
+        return inner->y2 - block_height;
+
+    default:
+        return inner->y1;
+    }
+}
+
+
 static void draw_text(bam_t* bam, int x, int y, bam_h_align_t h_align, bam_v_align_t v_align,
                       const void* text, bam_font_t font, const bam_color_pair_t* colors) {
     const bam_vtable_t* vtable = bam->vtable;
@@ -278,15 +416,17 @@ static void draw_text(bam_t* bam, int x, int y, bam_h_align_t h_align, bam_v_ali
 
     const uint8_t* text_i = text;
     const uint8_t* text_e = text_i + strlen(text);
-    int16_t width = metrics_calc_string_width(bam, text_i, text_e, font);
+    int32_t width = metrics_calc_string_width(bam, text_i, text_e, font);
+    int32_t pen_x = x;
+    int32_t pen_y = y;
 
     switch (h_align) {
     case BAM_H_ALIGN_CENTER:
-        x = (int16_t) (x - (width / 2));
+        pen_x -= width / 2;
         break;
 
     case BAM_H_ALIGN_RIGHT:
-        x = (int16_t) (x - width);
+        pen_x -= width;
 
     default:
         break;
@@ -294,31 +434,64 @@ static void draw_text(bam_t* bam, int x, int y, bam_h_align_t h_align, bam_v_ali
 
     switch (v_align) {
     case BAM_V_ALIGN_TOP:
-        y = (int16_t) (y + font_metrics.ascent);
+        pen_y += font_metrics.ascent;
         break;
 
     case BAM_V_ALIGN_MIDDLE:
-        y = (int16_t) (y + font_metrics.center);
+        pen_y += font_metrics.center;
         break;
 
     case BAM_V_ALIGN_BOTTOM:
-        y = (int16_t) (y - font_metrics.descent);
+        pen_y -= font_metrics.descent;
         break;
 
     default:
         break;
     }
 
-    while (text_i < text_e) {
-        bam_unichar_t codepoint = 0;
-        bam_glyph_metrics_t glyph_metrics;
+    draw_text_run(bam, pen_x, pen_y, text_i, text_e, font, colors);
+}
 
-        text_i = unicode_decode_utf8(text_i, &codepoint);
 
-        if (vtable->get_glyph_metrics(&glyph_metrics, font, codepoint, bam->user_data)) {
-            draw_glyph(bam, x, y, &glyph_metrics, colors);
-            x = (int16_t) (x + glyph_metrics.x_advance);
+static void draw_wrapped_text(bam_t* bam, const bam_widget_t* widget, const bam_rect_t* inner,
+                              const bam_color_pair_t* colors) {
+    const bam_style_t* style = widget->style;
+    const uint8_t* text = (const uint8_t*) widget->text;
+    const int clip_y1 = bam->draw_state.clip.y1 - bam->draw_state.translate_y;
+    const int clip_y2 = bam->draw_state.clip.y2 - bam->draw_state.translate_y;
+    bam_font_metrics_t font_metrics;
+    int line_height;
+    int top;
+    int first;
+    int last;
+
+    bam->vtable->get_font_metrics(&font_metrics, style->font, bam->user_data);
+    line_height = max_int(1, font_metrics.line_height);
+    top = text_calc_top(widget, inner, line_height);
+
+    // only visit lines that intersect the clip region
+    first = max_int(0, (clip_y1 - top) / line_height);
+    last = min_int(widget->n_lines, ((clip_y2 - top) + line_height - 1) / line_height);
+
+    for (int i = first; i < last; i++) {
+        const bam_text_line_t* line = &widget->lines[i];
+        int x;
+
+        switch (style->h_align) {
+        case BAM_H_ALIGN_CENTER:
+            x = ((inner->x1 + inner->x2) / 2) - (line->width / 2);
+            break;
+
+        case BAM_H_ALIGN_RIGHT:
+            x = inner->x2 - 1 - line->width;
+            break;
+
+        default:
+            x = inner->x1;
         }
+
+        draw_text_run(bam, x, top + (i * line_height) + font_metrics.ascent, text + line->offset,
+                      text + line->offset + line->length, style->font, colors);
     }
 }
 
@@ -338,74 +511,89 @@ static void draw_fill(bam_t* bam, const bam_rect_t* rect, bam_color_t color) {
 }
 
 
-static void draw_widget(bam_t* bam, const bam_widget_t* widget) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_PTR(bam, widget);
-    BAM_ASSERT(((unsigned int) widget->state) < BAM_N_STATES);
-
+static void widget_calc_inner(const bam_widget_t* widget, bam_rect_t* inner) {
     const bam_style_t* style = widget->style;
-    const bam_color_pair_t* colors;
-    bam_draw_state_t saved_draw_state = bam->draw_state;
-    bam_rect_t inner;
 
-    // if widget does not have valid bounding rectangle, do nothing
-    if ( rect_empty(&widget->rect) ) {
-        return;
+    *inner = widget->rect;
+    inner->x1 += style->h_padding;
+    inner->y1 += style->v_padding;
+    inner->x2 -= style->h_padding;
+    inner->y2 -= style->v_padding;
+}
+
+
+static void draw_aligned_text(bam_t* bam, const bam_style_t* style, const bam_rect_t* inner, const char* text,
+                              const bam_color_pair_t* colors) {
+    int text_x;
+    int text_y;
+
+    // calculate horizontal text position based on style's h_align property
+    switch (style->h_align) {
+    case BAM_H_ALIGN_CENTER:
+        text_x = (inner->x1 + inner->x2) / 2;
+        break;
+
+    case BAM_H_ALIGN_RIGHT:
+        text_x = inner->x2 - 1;
+        break;
+
+    default:
+        text_x = inner->x1;
     }
 
-    // get colors for state
-    colors = &style->colors[widget->state];
+    // calculate vertical text position based on style's v_align property
+    switch (style->v_align) {
+    case BAM_V_ALIGN_MIDDLE:
+        text_y = (inner->y1 + inner->y2) / 2;
+        break;
 
-    // fill widget background
-    draw_fill(bam, &widget->rect, colors->background);
+    case BAM_V_ALIGN_BOTTOM:
+        text_y = inner->y2 - 1;
+        break;
 
-    // calculate widget's inner region (i.e. with padding applied)
-    inner = widget->rect;
-    inner.x1 += style->h_padding;
-    inner.y1 += style->v_padding;
-    inner.x2 -= style->h_padding;
-    inner.y2 -= style->v_padding;
+    default:
+        text_y = inner->y1;
+    }
 
-    // only proceed with rest of drawing if there is space inside inner region
-    if (!rect_empty(&inner)) {
-        // clip remaining drawing to widget's inner region
-        draw_set_clip(bam, &inner);
+    draw_text(bam, text_x, text_y, style->h_align, style->v_align, text, style->font, colors);
+}
 
-        // if widget has text, draw it
-        if (widget->text[0]) {
-            int text_x;
-            int text_y;
 
-            // calculate horizontal text position based on style's h_align property
-            switch (style->h_align) {
-            case BAM_H_ALIGN_CENTER:
-                text_x = (inner.x1 + inner.x2) / 2;
-                break;
+static void keypad_draw(bam_t* bam, const bam_widget_t* widget);
 
-            case BAM_H_ALIGN_RIGHT:
-                text_x = inner.x2 - 1;
-                break;
 
-            default:
-                text_x = inner.x1;
-            }
+static void draw_background(bam_t* bam, const bam_rect_t* rect, const bam_style_t* style, bam_color_t color,
+                            bam_state_t state);
 
-            // calculate vertical text position based on style's v_align property
-            switch (style->v_align) {
-            case BAM_V_ALIGN_MIDDLE:
-                text_y = (inner.y1 + inner.y2) / 2;
-                break;
 
-            case BAM_V_ALIGN_BOTTOM:
-                text_y = inner.y2 - 1;
-                break;
+static void draw_widget_content(bam_t* bam, const bam_widget_t* widget, const bam_color_pair_t* colors) {
+    const bam_style_t* style = widget->style;
+    bam_draw_state_t saved_draw_state = bam->draw_state;
+    bam_state_t state = (widget->flags & BAM_WIDGET_FLAG_BUSY) ? BAM_STATE_DISABLED : widget->state;
+    bam_rect_t inner;
 
-            default:
-                text_y = inner.y1;
-            }
+    // fill widget background (a gradient's end color is chosen by state, in the same way as widget's colors)
+    draw_background(bam, &widget->rect, style, colors->background, state);
+
+    // calculate widget's inner region (i.e. with padding applied)
+    widget_calc_inner(widget, &inner);
+
+    // only proceed with rest of drawing if there is space inside inner region
+    if (!rect_empty(&inner)) {
+        // clip remaining drawing to widget's inner region
+        draw_set_clip(bam, &inner);
+
+        // if widget has custom drawing callback, invoke it before drawing text
+        if (widget->draw_callback) {
+            widget->draw_callback(bam, widget - bam->widget_buffer_begin, &inner, widget->draw_user_data);
+        }
 
-            draw_text(bam, text_x, text_y, style->h_align, style->v_align, widget->text,
-                      style->font, colors);
+        // if widget has wrapped text, draw only the lines visible in the clip region, otherwise draw text as a
+        // single line
+        if (widget->lines) {
+            draw_wrapped_text(bam, widget, &inner, colors);
+        } else if (widget->text[0]) {
+            draw_aligned_text(bam, style, &inner, widget->text, colors);
         }
     }
 
@@ -414,554 +602,6487 @@ static void draw_widget(bam_t* bam, const bam_widget_t* widget) {
 }
 
 
-// ******** DIRTY BUFFER ********
-
-#define BAM__UINT32_MASK            0xFFFFFFFFul
+static const uint8_t* widget_cache_find(const bam_t* bam, const bam_widget_t* widget);
+static void widget_cache_draw(bam_t* bam, const bam_widget_t* widget, const uint8_t* coverage,
+                              const bam_color_pair_t* colors);
 
-typedef void (* bam_draw_fill_t)(const bam_rect_t* dest_rect, bam_color_t color, void* user_data);
 
-typedef void (* bam_blt_tile_t)(int x, int y, void* user_data);
+static void draw_widget(bam_t* bam, const bam_widget_t* widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_PTR(bam, widget);
+    BAM_ASSERT(((unsigned int) widget->state) < BAM_N_STATES);
 
+    const bam_style_t* style = widget->style;
+    const bam_color_pair_t* colors;
+    const uint8_t* coverage;
 
-static void dirty_mark_rect(bam_t* bam, const bam_rect_t* rect) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT(rect);
+    // if widget does not have valid bounding rectangle, do nothing
+    if ( rect_empty(&widget->rect) ) {
+        return;
+    }
 
-    const int disp_width = bam->disp_width;
-    const int disp_height = bam->disp_height;
-    const int tile_width = bam->tile_width;
-    const int tile_height = bam->tile_height;
-    const size_t dirty_buffer_pitch = bam->dirty_buffer_pitch;
+    // keypads draw their own keys and leave the gaps between them showing the display's background
+    if (widget->keypad) {
+        keypad_draw(bam, widget);
+        return;
+    }
 
-    bam_rect_t clip;
-    uint32_t left_word;
-    uint32_t right_word;
-    uint32_t* left_ptr;
-    uint32_t* right_ptr;
+    // get colors for state, unless widget's colors have been overridden (busy widgets look disabled until their work
+    // completes)
+    if (widget->flags & BAM_WIDGET_FLAG_COLORS) {
+        colors = &widget->colors;
+    } else if (widget->flags & BAM_WIDGET_FLAG_BUSY) {
+        colors = &style->colors[BAM_STATE_DISABLED];
+    } else {
+        colors = &style->colors[widget->state];
+    }
 
-    clip.x1 = max_int(0, rect->x1);
-    clip.y1 = max_int(0, rect->y1);
-    clip.x2 = min_int(disp_width, rect->x2);
-    clip.y2 = min_int(disp_height, rect->y2);
+    // widget's cached appearance only needs to be colored, rather than laid out and drawn again
+    coverage = widget_cache_find(bam, widget);
 
-    clip.x1 /= tile_width;
-    clip.y1 /= tile_height;
-    clip.x2 = (clip.x2 + tile_width - 1) / tile_width;
-    clip.y2 = (clip.y2 + tile_height - 1) / tile_height;
+    if (coverage) {
+        widget_cache_draw(bam, widget, coverage, colors);
+    } else {
+        draw_widget_content(bam, widget, colors);
+    }
+}
 
-    if (!rect_empty(&clip)) {
-        clip.x2--;
-        clip.y2--;
 
-        left_word = BAM__UINT32_MASK >> (clip.x1 & (BAM__UINT32_N_BITS - 1));
+// ******** PRIMITIVES ********
 
-        left_ptr = bam->dirty_buffer_begin + ((size_t) clip.y1 * dirty_buffer_pitch) +
-                   ((size_t) clip.x1 / BAM__UINT32_N_BITS);
+#define BAM_SPAN_BUFFER_SIZE                        64
 
-        right_word = BAM__UINT32_MASK << (BAM__UINT32_N_BITS - 1 - (clip.x2 & (BAM__UINT32_N_BITS - 1)));
+#define BAM_COVERAGE_FULL                           255
 
-        right_ptr = bam->dirty_buffer_begin + ((size_t) clip.y1 * dirty_buffer_pitch) +
-                    ((size_t) clip.x2 / BAM__UINT32_N_BITS);
 
-        if (left_ptr == right_ptr) {
-            left_word &= right_word;
+typedef struct {
+    bam_t* bam;
+    bam_color_t color;
+    int x;
+    int y;
+    int length;
+    uint8_t coverage[BAM_SPAN_BUFFER_SIZE];
+} bam_span_t;
+
+
+// sin(0..90 degrees) as 2.14 fixed point
+static const int16_t PRIM_SIN_LUT[91] = {
+            0,   286,   572,   857,  1143,  1428,  1713,  1997,  2280,  2563,
+         2845,  3126,  3406,  3686,  3964,  4240,  4516,  4790,  5063,  5334,
+         5604,  5872,  6138,  6402,  6664,  6924,  7182,  7438,  7692,  7943,
+         8192,  8438,  8682,  8923,  9162,  9397,  9630,  9860, 10087, 10311,
+        10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+        12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+        14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+        15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+        16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+        16384
+};
 
-            for (int y = clip.y1; y <= clip.y2; y++) {
-                BAM_ASSERT_DIRTY_BUFFER_PTR(bam, left_ptr);
-                *left_ptr |= left_word;
-                left_ptr += dirty_buffer_pitch;
-            }
-        } else {
-            for (int y = clip.y1; y <= clip.y2; y++) {
-                BAM_ASSERT_DIRTY_BUFFER_PTR(bam, left_ptr);
-                *left_ptr |= left_word;
 
-                for (uint32_t* mid_ptr = left_ptr + 1; mid_ptr < right_ptr; mid_ptr++) {
-                    BAM_ASSERT_DIRTY_BUFFER_PTR(bam, mid_ptr);
-                    *mid_ptr = BAM__UINT32_MASK;
-                }
+static int prim_sin(int angle) {
+    angle %= 360;
 
-                BAM_ASSERT_DIRTY_BUFFER_PTR(bam, right_ptr);
-                *right_ptr |= right_word;
+    if (angle < 0) {
+        angle += 360;
+    }
 
-                left_ptr += dirty_buffer_pitch;
-                right_ptr += dirty_buffer_pitch;
-            }
-        }
+    if (angle <= 90) {
+        return PRIM_SIN_LUT[angle];
+    } else if (angle <= 180) {
+        return PRIM_SIN_LUT[180 - angle];
+    } else if (angle <= 270) {
+        return -PRIM_SIN_LUT[angle - 180];
+    } else {
+        return -PRIM_SIN_LUT[360 - angle];
     }
 }
 
 
-static void dirty_mark_all(bam_t* bam) {
-    BAM_ASSERT_CTX(bam);
+static int prim_cos(int angle) {
+    return prim_sin(angle + 90);
+}
 
-    bam_rect_t rect;
 
-    rect_init(&rect, 0, 0, bam->disp_width, bam->disp_height);
-    dirty_mark_rect(bam, &rect);
-}
+static uint32_t prim_isqrt(uint64_t value) {
+    uint64_t result = 0;
+    uint64_t bit = 1ull << 62;
 
+    while (bit > value) {
+        bit >>= 2;
+    }
 
-static void dirty_clean(bam_t* bam) {
-    BAM_ASSERT_CTX(bam);
+    while (bit) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
 
-    void* const user_data = bam->user_data;
-    const bam_draw_fill_t draw_fill_func = bam->vtable->draw_fill;
-    const bam_blt_tile_t blt_tile_func = bam->vtable->blt_tile;
-    const int tile_width = bam->tile_width;
-    const int tile_height = bam->tile_height;
-    const bam_color_t background_color = bam->background_color;
-    const size_t dirty_buffer_pitch = bam->dirty_buffer_pitch;
-    const bam_widget_t* const widgets_begin = bam->widget_buffer_begin;
-    const bam_widget_t* const widgets_end = bam->widget_buffer_ptr;
-    uint32_t* dirty_i = bam->dirty_buffer_begin;
-    uint32_t* dirty_m = dirty_i + dirty_buffer_pitch;
-    uint32_t* dirty_e = bam->dirty_buffer_end;
-    int word_x = 0;
-    int offset_y = 0;
-    bam_rect_t rect;
+        bit >>= 2;
+    }
 
-    rect_init(&rect, 0, 0, bam->tile_width, bam->tile_height);
+    return (uint32_t) result;
+}
 
-    do {
-        BAM_ASSERT_DIRTY_BUFFER_PTR(bam, dirty_i);
 
-        uint32_t word = *dirty_i;
+static int64_t prim_div_floor(int64_t a, int64_t b) {
+    int64_t q = a / b;
+
+    if ((a % b != 0) && ((a < 0) != (b < 0))) {
+        q--;
+    }
+
+    return q;
+}
+
+
+static uint8_t prim_clamp_coverage(int64_t value) {
+    // value is coverage in 8.8 fixed point, where 256 represents a fully covered pixel
+    if (value <= 0) {
+        return 0;
+    } else if (value >= BAM_COVERAGE_FULL) {
+        return BAM_COVERAGE_FULL;
+    }
+
+    return (uint8_t) value;
+}
+
+
+static uint8_t prim_mul_coverage(uint8_t a, uint8_t b) {
+    return (uint8_t) (((unsigned int) a * b + (BAM_COVERAGE_FULL - 1)) / BAM_COVERAGE_FULL);
+}
+
+
+static int span_classify(uint8_t coverage, bool blend) {
+    // 0 = skip, 1 = fill, 2 = blend
+    if (blend) {
+        return (coverage == 0) ? 0 : (coverage == BAM_COVERAGE_FULL) ? 1 : 2;
+    }
+
+    return (coverage >= 128) ? 1 : 0;
+}
+
+
+static void span_flush(bam_span_t* span) {
+    bam_t* bam = span->bam;
+    const bam_vtable_t* vtable = bam->vtable;
+    bool blend = vtable->draw_coverage != NULL && bam->quality < BAM_QUALITY_NO_ANTI_ALIASING;
+    int i = 0;
+
+    // split span into runs of uncovered, fully covered and partially covered pixels, so that backends only have
+    // to blend pixels on the edges of primitives
+    while (i < span->length) {
+        int start = i;
+        int run_class = span_classify(span->coverage[i], blend);
+        bam_rect_t rect;
+
+        while (i < span->length && span_classify(span->coverage[i], blend) == run_class) {
+            i++;
+        }
+
+        rect_init(&rect, span->x + start, span->y, i - start, 1);
+
+        if (run_class == 1) {
+            vtable->draw_fill(&rect, span->color, bam->user_data);
+        } else if (run_class == 2) {
+            vtable->draw_coverage(&rect, span->coverage + start, span->color, bam->user_data);
+        }
+    }
+
+    span->x += span->length;
+    span->length = 0;
+}
+
+
+static void span_begin(bam_span_t* span, bam_t* bam, int x, int y, bam_color_t color) {
+    span->bam = bam;
+    span->color = color;
+    span->x = x;
+    span->y = y;
+    span->length = 0;
+}
+
+
+static void span_push(bam_span_t* span, uint8_t coverage) {
+    span->coverage[span->length++] = coverage;
+
+    if (span->length >= BAM_SPAN_BUFFER_SIZE) {
+        span_flush(span);
+    }
+}
+
+
+static uint8_t mask_calc_coverage(int i, int j, int outer_radius, int inner_radius) {
+    // distance from circle's center to center of pixel (i, j) in 8.8 fixed point
+    uint64_t sum = (uint64_t) ((2 * i) + 1) * ((2 * i) + 1) + (uint64_t) ((2 * j) + 1) * ((2 * j) + 1);
+    int64_t distance = prim_isqrt(sum * 16384);
+    uint8_t coverage = prim_clamp_coverage(((int64_t) outer_radius * 256) + 128 - distance);
+
+    if (inner_radius > 0) {
+        coverage -= prim_clamp_coverage(((int64_t) inner_radius * 256) + 128 - distance);
+    }
+
+    return coverage;
+}
+
+
+static const uint8_t* mask_get(bam_t* bam, int outer_radius, int inner_radius) {
+    size_t size = (size_t) outer_radius * outer_radius;
+    bam_mask_cache_entry_t* entry;
+    uint8_t* mask;
+
+    // masks hold coverage for a single quadrant of a circle or ring, indexed by distance from its center
+    for (size_t i = 0; i < bam->n_mask_cache_entries; i++) {
+        entry = &bam->mask_cache[i];
+
+        if (entry->outer_radius == outer_radius && entry->inner_radius == inner_radius) {
+            return entry->mask;
+        }
+    }
+
+    // mask cannot be cached if it is too large, so caller must calculate coverage for each pixel instead
+    if (outer_radius > UINT16_MAX || size > (size_t) (bam->mask_buffer_end - bam->mask_buffer_begin)) {
+        return NULL;
+    }
+
+    // if cache is full, evict all entries
+    if (bam->n_mask_cache_entries >= BAM__MASK_CACHE_N_ENTRIES ||
+        size > (size_t) (bam->mask_buffer_end - bam->mask_buffer_ptr)) {
+        bam->mask_buffer_ptr = bam->mask_buffer_begin;
+        bam->n_mask_cache_entries = 0;
+    }
+
+    mask = bam->mask_buffer_ptr;
+    bam->mask_buffer_ptr += size;
+
+    for (int j = 0; j < outer_radius; j++) {
+        for (int i = 0; i < outer_radius; i++) {
+            mask[(j * outer_radius) + i] = mask_calc_coverage(i, j, outer_radius, inner_radius);
+        }
+    }
+
+    entry = &bam->mask_cache[bam->n_mask_cache_entries++];
+    entry->outer_radius = (uint16_t) outer_radius;
+    entry->inner_radius = (uint16_t) inner_radius;
+    entry->mask = mask;
+
+    return mask;
+}
+
+
+static uint8_t mask_coverage(const uint8_t* mask, int i, int j, int outer_radius, int inner_radius) {
+    if (i >= outer_radius || j >= outer_radius) {
+        return 0;
+    }
+
+    return mask ? mask[(j * outer_radius) + i] : mask_calc_coverage(i, j, outer_radius, inner_radius);
+}
+
+
+static bool prim_clip_bounds(const bam_t* bam, bam_rect_t* bounds) {
+    // bounds must already be translated into draw state's coordinate space
+    rect_intersect(bounds, &bam->draw_state.clip);
+    return !rect_empty(bounds);
+}
+
+
+static void prim_draw_line(bam_t* bam, int x1, int y1, int x2, int y2, int thickness, bam_color_t color) {
+    const int tx = bam->draw_state.translate_x;
+    const int ty = bam->draw_state.translate_y;
+    int64_t dx;
+    int64_t dy;
+    int64_t length;
+    int64_t inv_length;
+    int64_t half_width;
+    int64_t limit;
+    int pad = (thickness / 2) + 2;
+    bam_rect_t bounds;
+    bam_span_t span;
+
+    x1 += tx;
+    y1 += ty;
+    x2 += tx;
+    y2 += ty;
+
+    dx = x2 - x1;
+    dy = y2 - y1;
+
+    // length of line in 8.8 fixed point
+    length = prim_isqrt((uint64_t) ((dx * dx) + (dy * dy)) << 16);
+
+    if (length == 0 || thickness <= 0) {
+        return;
+    }
+
+    inv_length = (1ll << 31) / length;
+    half_width = (int64_t) thickness * 128;
+
+    // largest perpendicular distance, in the units of the per-pixel cross product, that can have any coverage
+    limit = (((half_width + 128) * length) / 32768) + 1;
+
+    bounds.x1 = min_int(x1, x2) - pad;
+    bounds.y1 = min_int(y1, y2) - pad;
+    bounds.x2 = max_int(x1, x2) + pad + 1;
+    bounds.y2 = max_int(y1, y2) + pad + 1;
+
+    if (!prim_clip_bounds(bam, &bounds)) {
+        return;
+    }
+
+    for (int y = bounds.y1; y < bounds.y2; y++) {
+        // pixel offsets from first endpoint are doubled so that cross/dot products stay integral
+        int64_t v = 2 * (int64_t) (y - y1);
+        int64_t u = 2 * (int64_t) (bounds.x1 - x1);
+        int64_t perp = (v * dx) - (u * dy);
+        int64_t along = (u * dx) + (v * dy);
+        int64_t perp_step = -2 * dy;
+        int64_t along_step = 2 * dx;
+        int64_t start = 0;
+        int64_t end = bounds.x2 - bounds.x1;
+
+        // only visit pixels on this row that are close enough to the line to be covered
+        if (perp_step == 0) {
+            if (perp <= -limit || perp >= limit) {
+                continue;
+            }
+        } else {
+            int64_t a = prim_div_floor(-limit - perp, perp_step);
+            int64_t b = prim_div_floor(limit - perp, perp_step);
+
+            start = (a < b ? a : b) - 1;
+            end = (a > b ? a : b) + 2;
+
+            start = start < 0 ? 0 : start;
+            end = end > (bounds.x2 - bounds.x1) ? (bounds.x2 - bounds.x1) : end;
+        }
+
+        perp += perp_step * start;
+        along += along_step * start;
+
+        span_begin(&span, bam, bounds.x1 + (int) start, y, color);
+
+        for (int64_t x = start; x < end; x++) {
+            int64_t perp_q8 = (perp * inv_length) >> 16;
+            int64_t along_q8 = (along * inv_length) >> 16;
+            uint8_t coverage = prim_clamp_coverage(half_width + 128 - (perp_q8 < 0 ? -perp_q8 : perp_q8));
+            uint8_t cap_a = prim_clamp_coverage(along_q8 + 256);
+            uint8_t cap_b = prim_clamp_coverage(length - along_q8 + 256);
+
+            span_push(&span, prim_mul_coverage(coverage, cap_a < cap_b ? cap_a : cap_b));
+
+            perp += perp_step;
+            along += along_step;
+        }
+
+        span_flush(&span);
+    }
+}
+
+
+static void prim_draw_arc(bam_t* bam, int cx, int cy, int radius, int thickness, int start_angle, int end_angle,
+                          bam_color_t color) {
+    int inner_radius = max_int(0, radius - thickness);
+    int sweep = end_angle - start_angle;
+    bool full = sweep >= 360 || sweep <= -360;
+    const uint8_t* mask;
+    int sx;
+    int sy;
+    int ex;
+    int ey;
+    bam_rect_t bounds;
+    bam_span_t span;
+
+    if (radius <= 0 || thickness <= 0) {
+        return;
+    }
+
+    sweep %= 360;
+
+    if (sweep < 0) {
+        sweep += 360;
+    }
+
+    if (sweep == 0 && !full) {
+        return;
+    }
+
+    cx += bam->draw_state.translate_x;
+    cy += bam->draw_state.translate_y;
+
+    rect_init(&bounds, cx - radius, cy - radius, 2 * radius, 2 * radius);
+
+    if (!prim_clip_bounds(bam, &bounds)) {
+        return;
+    }
+
+    mask = mask_get(bam, radius, inner_radius);
+
+    // unit vectors of start and end angles (clockwise from 3 o'clock) in 2.14 fixed point
+    sx = prim_cos(start_angle);
+    sy = prim_sin(start_angle);
+    ex = prim_cos(end_angle);
+    ey = prim_sin(end_angle);
+
+    for (int y = bounds.y1; y < bounds.y2; y++) {
+        int j = (y >= cy) ? (y - cy) : (cy - y - 1);
+        int oy = (2 * (y - cy)) + 1;
+
+        span_begin(&span, bam, bounds.x1, y, color);
+
+        for (int x = bounds.x1; x < bounds.x2; x++) {
+            int i = (x >= cx) ? (x - cx) : (cx - x - 1);
+            uint8_t coverage = mask_coverage(mask, i, j, radius, inner_radius);
+
+            if (coverage && !full) {
+                int ox = (2 * (x - cx)) + 1;
+
+                // signed distances of pixel from start and end edges of arc, in 8.8 fixed point
+                int64_t ds = (((int64_t) sx * oy) - ((int64_t) sy * ox)) >> 7;
+                int64_t de = (((int64_t) ex * oy) - ((int64_t) ey * ox)) >> 7;
+                uint8_t after_start = prim_clamp_coverage(ds + 128);
+                uint8_t before_end = prim_clamp_coverage(128 - de);
+                uint8_t angular;
+
+                // arcs of up to half a circle are the intersection of two half-planes, larger arcs their union
+                if (sweep <= 180) {
+                    angular = after_start < before_end ? after_start : before_end;
+                } else {
+                    angular = after_start > before_end ? after_start : before_end;
+                }
+
+                coverage = prim_mul_coverage(coverage, angular);
+            }
+
+            span_push(&span, coverage);
+        }
+
+        span_flush(&span);
+    }
+}
+
+
+static void prim_draw_round_rect(bam_t* bam, const bam_rect_t* rect, int radius, bam_color_t color) {
+    bam_rect_t bounds = *rect;
+    bam_rect_t inner;
+    const uint8_t* mask;
+    bam_span_t span;
+
+    rect_translate(&bounds, bam->draw_state.translate_x, bam->draw_state.translate_y);
+    inner = bounds;
+
+    radius = min_int(radius, min_int(rect_width(&bounds), rect_height(&bounds)) / 2);
+
+    if (!prim_clip_bounds(bam, &bounds)) {
+        return;
+    }
+
+    if (radius <= 0) {
+        bam->vtable->draw_fill(&bounds, color, bam->user_data);
+        return;
+    }
+
+    mask = mask_get(bam, radius, 0);
+
+    // inner is rectangle bounded by the centers of the four corners
+    inner.x1 += radius;
+    inner.y1 += radius;
+    inner.x2 -= radius;
+    inner.y2 -= radius;
+
+    for (int y = bounds.y1; y < bounds.y2; y++) {
+        int j;
+
+        if (y >= inner.y1 && y < inner.y2) {
+            // rows between corners are a single fill
+            bam_rect_t row;
+
+            rect_init(&row, bounds.x1, y, rect_width(&bounds), 1);
+            bam->vtable->draw_fill(&row, color, bam->user_data);
+            continue;
+        }
+
+        j = (y < inner.y1) ? (inner.y1 - y - 1) : (y - inner.y2);
+
+        span_begin(&span, bam, bounds.x1, y, color);
+
+        for (int x = bounds.x1; x < bounds.x2; x++) {
+            if (x < inner.x1) {
+                span_push(&span, mask_coverage(mask, inner.x1 - x - 1, j, radius, 0));
+            } else if (x >= inner.x2) {
+                span_push(&span, mask_coverage(mask, x - inner.x2, j, radius, 0));
+            } else {
+                span_push(&span, BAM_COVERAGE_FULL);
+            }
+        }
+
+        span_flush(&span);
+    }
+}
+
+
+// ******** IMAGES ********
+
+static void image_draw_rle_row(bam_t* bam, const bam_image_t* image, int row, int x, int y,
+                               int clip_x1, int clip_x2) {
+    const bam_vtable_t* vtable = bam->vtable;
+    const uint32_t* packet = image->data + image->row_index[row];
+    int col = 0;
+
+    // clip_x1 and clip_x2 are columns of image row to draw, x and y are destination of row's first column
+    while (col < clip_x2) {
+        uint32_t header = *packet++;
+        int count = (int) (header & BAM_IMAGE_RLE_COUNT_MASK);
+        int run_x1 = max_int(col, clip_x1);
+        int run_x2 = min_int(col + count, clip_x2);
+        bam_rect_t rect;
+
+        // packets entirely to the left of clip region are skipped without being decoded
+        if (run_x1 < run_x2) {
+            rect_init(&rect, x + run_x1, y, run_x2 - run_x1, 1);
+
+            if (header & BAM_IMAGE_RLE_REPEAT) {
+                vtable->draw_fill(&rect, packet[0], bam->user_data);
+            } else {
+                vtable->draw_pixels(&rect, packet + (run_x1 - col), (size_t) count, bam->user_data);
+            }
+        }
+
+        packet += (header & BAM_IMAGE_RLE_REPEAT) ? 1 : count;
+        col += count;
+    }
+}
+
+
+static void image_draw(bam_t* bam, const bam_image_t* image, int x, int y) {
+    BAM_ASSERT(bam->vtable->draw_pixels);
+
+    bam_rect_t dest_rect;
+
+    x += bam->draw_state.translate_x;
+    y += bam->draw_state.translate_y;
+
+    rect_init(&dest_rect, x, y, image->width, image->height);
+    rect_intersect(&dest_rect, &bam->draw_state.clip);
+
+    if (rect_empty(&dest_rect)) {
+        return;
+    }
+
+    if (image->format == BAM_IMAGE_FORMAT_RLE) {
+        // row index allows decoding to start at first row inside clip region
+        for (int dest_y = dest_rect.y1; dest_y < dest_rect.y2; dest_y++) {
+            image_draw_rle_row(bam, image, dest_y - y, x, dest_y, dest_rect.x1 - x, dest_rect.x2 - x);
+        }
+    } else {
+        const uint32_t* pixels = image->data + ((size_t) (dest_rect.y1 - y) * image->width) + (dest_rect.x1 - x);
+
+        bam->vtable->draw_pixels(&dest_rect, pixels, (size_t) image->width, bam->user_data);
+    }
+}
+
+
+// ******** FILLS ********
+
+static bam_color_t fill_lerp_color(const bam_t* bam, bam_color_t from, bam_color_t to, int i, int length) {
+    // gradient ends exactly on both of its colors
+    return color_lerp(bam, from, to, i, max_int(1, length - 1));
+}
+
+
+static const bam_color_t* fill_get_table(bam_t* bam, bam_color_t from, bam_color_t to, int length) {
+    size_t size = (size_t) length;
+    bam_fill_cache_entry_t* entry;
+    bam_color_t* colors;
+
+    // tables hold a gradient's color for each row (or column) of the area it fills
+    for (size_t i = 0; i < bam->n_fill_cache_entries; i++) {
+        entry = &bam->fill_cache[i];
+
+        if (entry->from == from && entry->to == to && entry->length == length) {
+            return entry->colors;
+        }
+    }
+
+    // table cannot be cached if it is too large, so caller must calculate color of each row (or column) instead
+    if (size > (size_t) (bam->fill_buffer_end - bam->fill_buffer_begin)) {
+        return NULL;
+    }
+
+    // if cache is full, evict all entries
+    if (bam->n_fill_cache_entries >= BAM__FILL_CACHE_N_ENTRIES ||
+        size > (size_t) (bam->fill_buffer_end - bam->fill_buffer_ptr)) {
+        bam->fill_buffer_ptr = bam->fill_buffer_begin;
+        bam->n_fill_cache_entries = 0;
+    }
+
+    colors = bam->fill_buffer_ptr;
+    bam->fill_buffer_ptr += size;
+
+    for (int i = 0; i < length; i++) {
+        colors[i] = fill_lerp_color(bam, from, to, i, length);
+    }
+
+    entry = &bam->fill_cache[bam->n_fill_cache_entries++];
+    entry->from = from;
+    entry->to = to;
+    entry->length = length;
+    entry->colors = colors;
+
+    return colors;
+}
+
+
+static void fill_draw_gradient(bam_t* bam, const bam_rect_t* rect, bam_color_t from, bam_color_t to,
+                               bool vertical) {
+    const bam_vtable_t* vtable = bam->vtable;
+    const int origin_x = rect->x1 + bam->draw_state.translate_x;
+    const int origin_y = rect->y1 + bam->draw_state.translate_y;
+    const int length = vertical ? rect_height(rect) : rect_width(rect);
+    const bam_color_t* table;
+    bam_rect_t dest = *rect;
+    bam_rect_t run;
+
+    rect_translate(&dest, bam->draw_state.translate_x, bam->draw_state.translate_y);
+    rect_intersect(&dest, &bam->draw_state.clip);
+
+    if (rect_empty(&dest)) {
+        return;
+    }
+
+    table = fill_get_table(bam, from, to, length);
+
+    if (vertical) {
+        // one flat fill per row
+        for (int y = dest.y1; y < dest.y2; y++) {
+            bam_color_t color = table ? table[y - origin_y] : fill_lerp_color(bam, from, to, y - origin_y, length);
+
+            rect_init(&run, dest.x1, y, rect_width(&dest), 1);
+            vtable->draw_fill(&run, color, bam->user_data);
+        }
+    } else if (table && vtable->draw_pixels) {
+        // one copy of table per row
+        for (int y = dest.y1; y < dest.y2; y++) {
+            rect_init(&run, dest.x1, y, rect_width(&dest), 1);
+            vtable->draw_pixels(&run, table + (dest.x1 - origin_x), (size_t) length, bam->user_data);
+        }
+    } else {
+        // one flat fill per column
+        for (int x = dest.x1; x < dest.x2; x++) {
+            bam_color_t color = table ? table[x - origin_x] : fill_lerp_color(bam, from, to, x - origin_x, length);
+
+            rect_init(&run, x, dest.y1, 1, rect_height(&dest));
+            vtable->draw_fill(&run, color, bam->user_data);
+        }
+    }
+}
+
+
+static void fill_draw_pattern(bam_t* bam, const bam_rect_t* rect, const bam_image_t* pattern) {
+    bam_draw_state_t saved_draw_state = bam->draw_state;
+    bam_rect_t clip;
+    int x1;
+    int y1;
+
+    // pattern is tiled from rect's top-left corner, and clipped to rect
+    draw_set_clip(bam, rect);
+
+    clip = bam->draw_state.clip;
+    rect_translate(&clip, -bam->draw_state.translate_x, -bam->draw_state.translate_y);
+
+    // only copies of pattern that overlap clip region are drawn
+    x1 = rect->x1 + ((clip.x1 - rect->x1) / pattern->width) * pattern->width;
+    y1 = rect->y1 + ((clip.y1 - rect->y1) / pattern->height) * pattern->height;
+
+    for (int y = y1; y < clip.y2; y += pattern->height) {
+        for (int x = x1; x < clip.x2; x += pattern->width) {
+            image_draw(bam, pattern, x, y);
+        }
+    }
+
+    bam->draw_state = saved_draw_state;
+}
+
+
+static void draw_background(bam_t* bam, const bam_rect_t* rect, const bam_style_t* style, bam_color_t color,
+                            bam_state_t state) {
+    const bam_fill_t* fill = style->fill;
+
+    if (!fill) {
+        draw_fill(bam, rect, color);
+        return;
+    }
+
+    switch (fill->type) {
+    case BAM_FILL_TYPE_VERTICAL_GRADIENT:
+        fill_draw_gradient(bam, rect, color, fill->end_colors[state], true);
+        break;
+
+    case BAM_FILL_TYPE_HORIZONTAL_GRADIENT:
+        fill_draw_gradient(bam, rect, color, fill->end_colors[state], false);
+        break;
+
+    case BAM_FILL_TYPE_PATTERN:
+        BAM_ASSERT(fill->pattern && fill->pattern->width > 0 && fill->pattern->height > 0);
+        fill_draw_pattern(bam, rect, fill->pattern);
+        break;
+    }
+}
+
+
+// ******** DIRTY BUFFER ********
+
+#define BAM__UINT32_MASK            0xFFFFFFFFul
+
+typedef void (* bam_blt_tile_t)(int x, int y, void* user_data);
+
+
+static bam_layer_t dirty_widget_layer(const bam_widget_t* widget) {
+    if (widget->flags & BAM_WIDGET_FLAG_BASE) {
+        return BAM_LAYER_BASE;
+    } else if (widget->flags & BAM_WIDGET_FLAG_OVERLAY) {
+        return BAM_LAYER_OVERLAY;
+    } else {
+        return BAM_LAYER_DYNAMIC;
+    }
+}
+
+
+static void dirty_draw_layer(bam_t* bam, const bam_rect_t* rect, bam_layer_t layer) {
+    for (const bam_widget_t* widget_i = bam->widget_buffer_begin; widget_i < bam->widget_buffer_ptr; widget_i++) {
+        if (dirty_widget_layer(widget_i) == layer && rect_overlaps(rect, &widget_i->rect)) {
+            draw_widget(bam, widget_i);
+        }
+    }
+}
+
+
+static void dirty_draw_rect(bam_t* bam, const bam_rect_t* rect) {
+    // base layer is copied from its cache, if it has one, rather than being drawn widget by widget
+    if (bam->base_cache) {
+        image_draw(bam, bam->base_cache, 0, 0);
+    } else {
+        draw_fill(bam, rect, bam->background_color);
+        dirty_draw_layer(bam, rect, BAM_LAYER_BASE);
+    }
+
+    dirty_draw_layer(bam, rect, BAM_LAYER_DYNAMIC);
+    dirty_draw_layer(bam, rect, BAM_LAYER_OVERLAY);
+}
+
+
+// ******** DAMAGE TREE ********
+
+#define BAM_DAMAGE_NONE                 0
+
+#define BAM_DAMAGE_STATE_CLEAN          0
+#define BAM_DAMAGE_STATE_FULL           1
+#define BAM_DAMAGE_STATE_PARTIAL        2
+
+
+static void damage_child_rect(const bam_rect_t* rect, int child, bam_rect_t* child_rect) {
+    int mid_x = (rect->x1 + rect->x2) / 2;
+    int mid_y = (rect->y1 + rect->y2) / 2;
+
+    // children are numbered top-left, top-right, bottom-left, bottom-right
+    child_rect->x1 = (child & 1) ? mid_x : rect->x1;
+    child_rect->x2 = (child & 1) ? rect->x2 : mid_x;
+    child_rect->y1 = (child & 2) ? mid_y : rect->y1;
+    child_rect->y2 = (child & 2) ? rect->y2 : mid_y;
+}
+
+
+static void damage_free_children(bam_t* bam, bam_damage_node_t* node) {
+    bam_damage_node_t* children;
+
+    if (node->state != BAM_DAMAGE_STATE_PARTIAL) {
+        return;
+    }
+
+    // children are allocated in groups of four, and free groups are linked through their first node
+    children = bam->damage_nodes + node->children;
+
+    for (int i = 0; i < 4; i++) {
+        damage_free_children(bam, &children[i]);
+    }
+
+    children[0].children = bam->damage_free;
+    bam->damage_free = node->children;
+}
+
+
+static void damage_mark(bam_t* bam, bam_damage_node_t* node, const bam_rect_t* node_rect, const bam_rect_t* rect) {
+    bam_damage_node_t* children;
+    int n_full = 0;
+
+    if (node->state == BAM_DAMAGE_STATE_FULL || !rect_overlaps(node_rect, rect)) {
+        return;
+    }
+
+    // node is damaged as a whole if rect covers it, it is already as small as allowed, or there are no nodes left to
+    // subdivide it with (which coarsens damage, rather than losing it)
+    if ((rect->x1 <= node_rect->x1 && rect->y1 <= node_rect->y1 && rect->x2 >= node_rect->x2 &&
+         rect->y2 >= node_rect->y2) ||
+        rect_width(node_rect) <= bam->damage_min_width || rect_height(node_rect) <= bam->damage_min_height ||
+        (node->state == BAM_DAMAGE_STATE_CLEAN && bam->damage_free == BAM_DAMAGE_NONE)) {
+        damage_free_children(bam, node);
+        node->state = BAM_DAMAGE_STATE_FULL;
+        return;
+    }
+
+    if (node->state == BAM_DAMAGE_STATE_CLEAN) {
+        node->children = bam->damage_free;
+        node->state = BAM_DAMAGE_STATE_PARTIAL;
+
+        children = bam->damage_nodes + node->children;
+        bam->damage_free = children[0].children;
+
+        for (int i = 0; i < 4; i++) {
+            children[i].state = BAM_DAMAGE_STATE_CLEAN;
+        }
+    }
+
+    children = bam->damage_nodes + node->children;
+
+    for (int i = 0; i < 4; i++) {
+        bam_rect_t child_rect;
+
+        damage_child_rect(node_rect, i, &child_rect);
+        damage_mark(bam, &children[i], &child_rect, rect);
+
+        if (children[i].state == BAM_DAMAGE_STATE_FULL) {
+            n_full++;
+        }
+    }
+
+    // node whose children are all damaged is merged into a single damaged area
+    if (n_full == 4) {
+        damage_free_children(bam, node);
+        node->state = BAM_DAMAGE_STATE_FULL;
+    }
+}
+
+
+static bool damage_test(const bam_t* bam, const bam_damage_node_t* node, const bam_rect_t* node_rect,
+                        const bam_rect_t* rect) {
+    if (node->state == BAM_DAMAGE_STATE_CLEAN || !rect_overlaps(node_rect, rect)) {
+        return false;
+    }
+
+    if (node->state == BAM_DAMAGE_STATE_PARTIAL) {
+        for (int i = 0; i < 4; i++) {
+            bam_rect_t child_rect;
+
+            damage_child_rect(node_rect, i, &child_rect);
+
+            if (damage_test(bam, bam->damage_nodes + node->children + i, &child_rect, rect)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+
+static void damage_render_region(bam_t* bam, const bam_rect_t* region) {
+    bam_draw_state_t saved_draw_state = bam->draw_state;
+
+    // region is drawn into top-left of tile, which is then copied to display
+    draw_set_translation(bam, -region->x1, -region->y1);
+    draw_set_clip(bam, region);
+    dirty_draw_rect(bam, region);
+
+    bam->draw_state = saved_draw_state;
+    bam->vtable->blt_region(region, bam->user_data);
+}
+
+
+static void damage_clean(bam_t* bam, bam_damage_node_t* node, const bam_rect_t* node_rect) {
+    if (node->state == BAM_DAMAGE_STATE_PARTIAL) {
+        for (int i = 0; i < 4; i++) {
+            bam_rect_t child_rect;
+
+            damage_child_rect(node_rect, i, &child_rect);
+            damage_clean(bam, bam->damage_nodes + node->children + i, &child_rect);
+        }
+
+        damage_free_children(bam, node);
+    } else if (node->state == BAM_DAMAGE_STATE_FULL) {
+        // damaged areas larger than a tile are rendered a tile at a time
+        for (int y = node_rect->y1; y < node_rect->y2; y += bam->tile_height) {
+            for (int x = node_rect->x1; x < node_rect->x2; x += bam->tile_width) {
+                bam_rect_t region;
+
+                region.x1 = x;
+                region.y1 = y;
+                region.x2 = min_int(x + bam->tile_width, node_rect->x2);
+                region.y2 = min_int(y + bam->tile_height, node_rect->y2);
+
+                damage_render_region(bam, &region);
+            }
+        }
+    }
+
+    node->state = BAM_DAMAGE_STATE_CLEAN;
+}
+
+
+static void damage_root_rect(const bam_t* bam, bam_rect_t* rect) {
+    rect_init(rect, 0, 0, bam->disp_width, bam->disp_height);
+}
+
+
+static void dirty_mark_rect(bam_t* bam, const bam_rect_t* rect) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(rect);
+
+    const int disp_width = bam->disp_width;
+    const int disp_height = bam->disp_height;
+    const int tile_width = bam->tile_width;
+    const int tile_height = bam->tile_height;
+    const size_t dirty_buffer_pitch = bam->dirty_buffer_pitch;
+
+    bam_rect_t clip;
+    uint32_t left_word;
+    uint32_t right_word;
+    uint32_t* left_ptr;
+    uint32_t* right_ptr;
+
+    clip.x1 = max_int(0, rect->x1);
+    clip.y1 = max_int(0, rect->y1);
+    clip.x2 = min_int(disp_width, rect->x2);
+    clip.y2 = min_int(disp_height, rect->y2);
+
+    // damage tree, if in use, replaces tile bitmap
+    if (bam->damage_nodes) {
+        bam_rect_t root_rect;
+
+        if (!rect_empty(&clip)) {
+            bam->dirty_pending = true;
+            damage_root_rect(bam, &root_rect);
+            damage_mark(bam, &bam->damage_nodes[0], &root_rect, &clip);
+        }
+
+        return;
+    }
+
+    clip.x1 /= tile_width;
+    clip.y1 /= tile_height;
+    clip.x2 = (clip.x2 + tile_width - 1) / tile_width;
+    clip.y2 = (clip.y2 + tile_height - 1) / tile_height;
+
+    if (!rect_empty(&clip)) {
+        bam->dirty_pending = true;
+
+        clip.x2--;
+        clip.y2--;
+
+        left_word = BAM__UINT32_MASK >> (clip.x1 & (BAM__UINT32_N_BITS - 1));
+
+        left_ptr = bam->dirty_buffer_begin + ((size_t) clip.y1 * dirty_buffer_pitch) +
+                   ((size_t) clip.x1 / BAM__UINT32_N_BITS);
+
+        right_word = BAM__UINT32_MASK << (BAM__UINT32_N_BITS - 1 - (clip.x2 & (BAM__UINT32_N_BITS - 1)));
+
+        right_ptr = bam->dirty_buffer_begin + ((size_t) clip.y1 * dirty_buffer_pitch) +
+                    ((size_t) clip.x2 / BAM__UINT32_N_BITS);
+
+        if (left_ptr == right_ptr) {
+            left_word &= right_word;
+
+            for (int y = clip.y1; y <= clip.y2; y++) {
+                BAM_ASSERT_DIRTY_BUFFER_PTR(bam, left_ptr);
+                *left_ptr |= left_word;
+                left_ptr += dirty_buffer_pitch;
+            }
+        } else {
+            for (int y = clip.y1; y <= clip.y2; y++) {
+                BAM_ASSERT_DIRTY_BUFFER_PTR(bam, left_ptr);
+                *left_ptr |= left_word;
+
+                for (uint32_t* mid_ptr = left_ptr + 1; mid_ptr < right_ptr; mid_ptr++) {
+                    BAM_ASSERT_DIRTY_BUFFER_PTR(bam, mid_ptr);
+                    *mid_ptr = BAM__UINT32_MASK;
+                }
+
+                BAM_ASSERT_DIRTY_BUFFER_PTR(bam, right_ptr);
+                *right_ptr |= right_word;
+
+                left_ptr += dirty_buffer_pitch;
+                right_ptr += dirty_buffer_pitch;
+            }
+        }
+    }
+}
+
+
+static void dirty_mark_all(bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    bam_rect_t rect;
+
+    rect_init(&rect, 0, 0, bam->disp_width, bam->disp_height);
+    dirty_mark_rect(bam, &rect);
+}
+
+
+static void dirty_clear_all(bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    if (bam->damage_nodes) {
+        damage_free_children(bam, &bam->damage_nodes[0]);
+        bam->damage_nodes[0].state = BAM_DAMAGE_STATE_CLEAN;
+    }
+
+    for (uint32_t* dirty_i = bam->dirty_buffer_begin; dirty_i < bam->dirty_buffer_end; dirty_i++) {
+        *dirty_i = 0;
+    }
+
+    bam->dirty_pending = false;
+    bam->reconcile_pending = false;
+}
+
+
+static bool dirty_test_rect(const bam_t* bam, const bam_rect_t* rect) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(rect);
+
+    const int tile_width = bam->tile_width;
+    const int tile_height = bam->tile_height;
+    int col1 = max_int(0, rect->x1) / tile_width;
+    int row1 = max_int(0, rect->y1) / tile_height;
+    int col2 = (min_int(bam->disp_width, rect->x2) + tile_width - 1) / tile_width;
+    int row2 = (min_int(bam->disp_height, rect->y2) + tile_height - 1) / tile_height;
+
+    if (!bam->dirty_pending) {
+        return false;
+    }
+
+    // until a rebuilt screen has been reconciled, any part of display may differ from its widgets
+    if (bam->reconcile_pending) {
+        return true;
+    }
+
+    if (bam->damage_nodes) {
+        bam_rect_t root_rect;
+
+        damage_root_rect(bam, &root_rect);
+        return damage_test(bam, &bam->damage_nodes[0], &root_rect, rect);
+    }
+
+    // test whether any tile overlapping rect is dirty
+    for (int row = row1; row < row2; row++) {
+        const uint32_t* row_ptr = bam->dirty_buffer_begin + ((size_t) row * bam->dirty_buffer_pitch);
+
+        for (int col = col1; col < col2; col++) {
+            if (row_ptr[col / BAM__UINT32_N_BITS] & (0x80000000ul >> (col & (BAM__UINT32_N_BITS - 1)))) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+static void reconcile_process(bam_t* bam);
+
+
+static void dirty_add_stale(bam_t* bam) {
+    const size_t n_frames = bam->flip_n_frames;
+    const size_t frame_size = bam->flip_frame_size;
+    uint32_t* const dirty_buffer = bam->dirty_buffer_begin;
+    int age = bam->vtable->get_buffer_age(bam->user_data);
+    const uint32_t* frame_i;
+
+    // record this frame's damage as newest in history
+    bam->flip_newest = (bam->flip_newest + 1) % n_frames;
+    memcpy(bam->flip_history + (bam->flip_newest * frame_size), dirty_buffer, frame_size * sizeof(uint32_t));
+
+    if (bam->flip_n_valid < n_frames) {
+        bam->flip_n_valid++;
+    }
+
+    // back buffer was last presented age frames ago, so misses damage of every frame since, unless its age is
+    // unknown or older than history, in which case all of it is stale
+    if (age <= 0 || (size_t) age > bam->flip_n_valid) {
+        dirty_mark_all(bam);
+        return;
+    }
+
+    for (size_t i = 1; i < (size_t) age; i++) {
+        frame_i = bam->flip_history + (((bam->flip_newest + n_frames - i) % n_frames) * frame_size);
+
+        for (size_t j = 0; j < frame_size; j++) {
+            dirty_buffer[j] |= frame_i[j];
+        }
+    }
+}
+
+
+static void dirty_clean(bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    void* const user_data = bam->user_data;
+    const bam_blt_tile_t blt_tile_func = bam->vtable->blt_tile;
+    const int tile_width = bam->tile_width;
+    const int tile_height = bam->tile_height;
+    const size_t dirty_buffer_pitch = bam->dirty_buffer_pitch;
+    uint32_t* dirty_i = bam->dirty_buffer_begin;
+    uint32_t* dirty_m = dirty_i + dirty_buffer_pitch;
+    uint32_t* dirty_e = bam->dirty_buffer_end;
+    int word_x = 0;
+    int offset_y = 0;
+    bam_rect_t rect;
+
+    // a rebuilt screen is compared with the one it replaced, so that only areas that differ are marked dirty
+    reconcile_process(bam);
+
+    // nothing to do if no tiles have been marked since last clean
+    if (!bam->dirty_pending) {
+        return;
+    }
+
+    // with page flipping, areas of back buffer that are stale must be rendered along with those marked dirty
+    if (bam->flip_history) {
+        dirty_add_stale(bam);
+    }
+
+    bam->dirty_pending = false;
+
+    if (bam->damage_nodes) {
+        damage_root_rect(bam, &rect);
+        damage_clean(bam, &bam->damage_nodes[0], &rect);
+        return;
+    }
+
+    rect_init(&rect, 0, 0, bam->tile_width, bam->tile_height);
+
+    do {
+        BAM_ASSERT_DIRTY_BUFFER_PTR(bam, dirty_i);
+
+        uint32_t word = *dirty_i;
 
         *dirty_i = 0ull;
 
-        while (word) {
-            int clz = __builtin_clz(word);
-            int offset_x = word_x + (clz * tile_width);
-            bam_draw_state_t saved_draw_state = bam->draw_state;
+        while (word) {
+            int clz = __builtin_clz(word);
+            int offset_x = word_x + (clz * tile_width);
+            bam_draw_state_t saved_draw_state = bam->draw_state;
+
+            word &= ~(0x80000000ul >> clz);
+
+            draw_set_translation(bam, -offset_x, -offset_y);
+            rect_set_pos(&rect, offset_x, offset_y);
+            draw_set_clip(bam, &rect);
+            dirty_draw_rect(bam, &rect);
+
+            bam->draw_state = saved_draw_state;
+            rect_set_pos(&rect, 0, 0);
+
+            blt_tile_func(offset_x, offset_y, user_data);
+        }
+
+        dirty_i++;
+
+        if (dirty_i >= dirty_m) {
+            word_x = 0;
+            offset_y += tile_height;
+            dirty_m += dirty_buffer_pitch;
+        } else {
+            word_x += 32 * tile_width;
+        }
+    } while (dirty_i < dirty_e);
+
+    if (bam->flip_history) {
+        bam->vtable->flip(user_data);
+    }
+}
+
+
+// ******** GOVERNOR ********
+
+#ifndef BAM_GOVERNOR_RESTORE_FRAMES
+#define BAM_GOVERNOR_RESTORE_FRAMES     8
+#endif // BAM_GOVERNOR_RESTORE_FRAMES
+
+#ifndef BAM_GOVERNOR_DEFER_FRAMES
+#define BAM_GOVERNOR_DEFER_FRAMES       4
+#endif // BAM_GOVERNOR_DEFER_FRAMES
+
+
+static void governor_flush_deferred(bam_t* bam) {
+    dirty_mark_rect(bam, &bam->deferred_rect);
+    rect_init_empty(&bam->deferred_rect);
+}
+
+
+static void governor_defer_rect(bam_t* bam, const bam_rect_t* rect) {
+    // deferred area is released a few frame budgets after first update was deferred
+    if (rect_empty(&bam->deferred_rect)) {
+        bam->deferred_deadline = (bam_tick_t) (bam->vtable->get_monotonic_time(bam->user_data) +
+                                               (bam->frame_budget * BAM_GOVERNOR_DEFER_FRAMES));
+    }
+
+    rect_union(&bam->deferred_rect, rect);
+}
+
+
+static void governor_mark_area(bam_t* bam, const bam_rect_t* rect) {
+    // every widget change that isn't held back reaches dirty tracking through here, whether it is of a single widget
+    // or of a batch of them
+    dirty_mark_rect(bam, rect);
+}
+
+
+static void governor_mark_rect(bam_t* bam, const bam_widget_t* widget, const bam_rect_t* rect) {
+    // while governor is deferring low-priority widgets, their updates are held back (the pressed widget is never
+    // held back, so that input feedback doesn't lag)
+    if ((widget->flags & BAM_WIDGET_FLAG_LOW_PRIORITY) && bam->quality >= BAM_QUALITY_DEFER_LOW_PRIORITY &&
+        widget != bam->pressed_widget) {
+        governor_defer_rect(bam, rect);
+    } else {
+        governor_mark_area(bam, rect);
+    }
+}
+
+
+static void governor_set_quality(bam_t* bam, bam_quality_t quality) {
+    const bam_vtable_t* vtable = bam->vtable;
+    bam_governor_stats_t* stats = &bam->governor_stats;
+    bam_quality_t prev_quality = bam->quality;
+
+    if (quality == prev_quality) {
+        return;
+    }
+
+    bam->quality = quality;
+    bam->calm_frames = 0;
+
+    // record transition
+    if (quality > prev_quality) {
+        stats->n_degrades++;
+    } else {
+        stats->n_restores++;
+    }
+
+    stats->n_entries[quality]++;
+    stats->last_transition_time = vtable->get_monotonic_time(bam->user_data);
+
+    if ((prev_quality >= BAM_QUALITY_NO_ANTI_ALIASING) != (quality >= BAM_QUALITY_NO_ANTI_ALIASING)) {
+        if (vtable->set_anti_aliasing) {
+            vtable->set_anti_aliasing(quality < BAM_QUALITY_NO_ANTI_ALIASING, bam->user_data);
+        }
+
+        // anything drawn without anti-aliasing must be redrawn once it is restored, and that frame is not a fair
+        // measure of load so isn't counted by governor
+        if (quality < BAM_QUALITY_NO_ANTI_ALIASING) {
+            dirty_mark_all(bam);
+            bam->governor_settling = true;
+        }
+    }
+
+    // deferred updates are released as soon as governor stops deferring
+    if (quality < BAM_QUALITY_DEFER_LOW_PRIORITY) {
+        governor_flush_deferred(bam);
+    }
+}
+
+
+static void governor_update(bam_t* bam, bam_tick_t frame_time) {
+    bam_governor_stats_t* stats = &bam->governor_stats;
+    const bam_tick_t budget = bam->frame_budget;
+
+    // nothing to do if governor is disabled
+    if (budget == 0) {
+        return;
+    }
+
+    bam->last_frame_end = bam->vtable->get_monotonic_time(bam->user_data);
+
+    stats->n_frames++;
+    stats->last_frame_time = frame_time;
+    stats->max_frame_time = max_int(stats->max_frame_time, frame_time);
+
+    if (bam->governor_settling) {
+        bam->governor_settling = false;
+        return;
+    }
+
+    // degrade by one level for every frame that overruns budget, but only restore a level once frames have
+    // comfortably fitted budget for a while, so that quality doesn't oscillate
+    if (frame_time > budget) {
+        stats->n_overruns++;
+        bam->calm_frames = 0;
+
+        if (bam->quality < BAM_QUALITY_NO_ANTI_ALIASING) {
+            governor_set_quality(bam, (bam_quality_t) (bam->quality + 1));
+        }
+    } else if (frame_time <= (budget / 2) && bam->quality > BAM_QUALITY_FULL) {
+        if (++bam->calm_frames >= BAM_GOVERNOR_RESTORE_FRAMES) {
+            governor_set_quality(bam, (bam_quality_t) (bam->quality - 1));
+        }
+    } else {
+        bam->calm_frames = 0;
+    }
+}
+
+
+static void governor_process(bam_t* bam) {
+    bam_tick_t now;
+
+    if (bam->frame_budget == 0 || (bam->quality == BAM_QUALITY_FULL && rect_empty(&bam->deferred_rect))) {
+        return;
+    }
+
+    now = bam->vtable->get_monotonic_time(bam->user_data);
+
+    // release deferred updates once they have waited long enough
+    if (!rect_empty(&bam->deferred_rect) && tick_reached(now, bam->deferred_deadline)) {
+        governor_flush_deferred(bam);
+    }
+
+    // if no frames have been rendered for a while the load has gone, so restore full quality straight away
+    if (bam->quality > BAM_QUALITY_FULL &&
+        tick_elapsed(now, bam->last_frame_end) >= (bam->frame_budget * BAM_GOVERNOR_RESTORE_FRAMES)) {
+        governor_set_quality(bam, BAM_QUALITY_FULL);
+    }
+}
+
+
+static bam_tick_t governor_calc_timeout(const bam_t* bam, bam_tick_t now, bam_tick_t timeout) {
+    if (bam->frame_budget == 0) {
+        return timeout;
+    }
+
+    if (!rect_empty(&bam->deferred_rect)) {
+        timeout = min_int(timeout, tick_until(now, bam->deferred_deadline));
+    }
+
+    if (bam->quality > BAM_QUALITY_FULL) {
+        timeout = min_int(timeout, tick_until(now, (bam_tick_t) (bam->last_frame_end +
+                                                                  (bam->frame_budget * BAM_GOVERNOR_RESTORE_FRAMES))));
+    }
+
+    return timeout;
+}
+
+
+// ******** REFRESH THROTTLING ********
+
+static bool throttle_defer(bam_t* bam, bam_widget_t* widget, const bam_rect_t* rect) {
+    bam_tick_t now = bam->vtable->get_monotonic_time(bam->user_data);
+
+    // first change after interval has expired is applied straight away, and starts a new interval (time since last
+    // refresh is used rather than a deadline, as a deadline compared modulo 2^16 would appear not to have been
+    // reached again after a long idle period)
+    if (!(widget->flags & BAM_WIDGET_FLAG_THROTTLED) &&
+        tick_elapsed(now, widget->last_refresh) >= widget->refresh_interval) {
+        widget->last_refresh = now;
+        return false;
+    }
+
+    // later changes only accumulate the area they affect (widget may have moved), and are applied together once
+    // interval expires, by which time widget holds its latest value
+    if (widget->flags & BAM_WIDGET_FLAG_THROTTLED) {
+        rect_union(&widget->throttled_rect, rect);
+    } else {
+        widget->flags |= BAM_WIDGET_FLAG_THROTTLED;
+        widget->throttled_rect = *rect;
+        bam->n_throttled_widgets++;
+    }
+
+    return true;
+}
+
+
+static void throttle_release(bam_t* bam, bam_widget_t* widget, bam_tick_t now) {
+    widget->flags &= ~BAM_WIDGET_FLAG_THROTTLED;
+    widget->last_refresh = now;
+    bam->n_throttled_widgets--;
+
+    governor_mark_rect(bam, widget, &widget->throttled_rect);
+}
+
+
+static void throttle_process(bam_t* bam) {
+    bam_tick_t now;
+
+    if (bam->n_throttled_widgets == 0) {
+        return;
+    }
+
+    now = bam->vtable->get_monotonic_time(bam->user_data);
+
+    for (bam_widget_t* widget = bam->widget_buffer_begin; widget < bam->widget_buffer_ptr; widget++) {
+        if ((widget->flags & BAM_WIDGET_FLAG_THROTTLED) &&
+            tick_elapsed(now, widget->last_refresh) >= widget->refresh_interval) {
+            throttle_release(bam, widget, now);
+        }
+    }
+}
+
+
+static bam_tick_t throttle_calc_timeout(const bam_t* bam, bam_tick_t now, bam_tick_t timeout) {
+    if (bam->n_throttled_widgets == 0) {
+        return timeout;
+    }
+
+    for (const bam_widget_t* widget = bam->widget_buffer_begin; widget < bam->widget_buffer_ptr; widget++) {
+        if (widget->flags & BAM_WIDGET_FLAG_THROTTLED) {
+            bam_tick_t elapsed = tick_elapsed(now, widget->last_refresh);
+
+            timeout = min_int(timeout, (elapsed < widget->refresh_interval) ? widget->refresh_interval - elapsed : 0);
+        }
+    }
+
+    return timeout;
+}
+
+
+// ******** TEXT LAYOUT ********
+
+static uint32_t text_hash(const uint8_t* text_i, const uint8_t* text_e) {
+    // FNV-1a, kept at full width because previous text may have been overwritten in place, so a collision can't be
+    // resolved by comparing bytes
+    uint32_t hash = 2166136261ul;
+
+    while (text_i < text_e) {
+        hash = (hash ^ *text_i++) * 16777619ul;
+    }
+
+    return hash;
+}
+
+
+static void widget_make_rect_dirty(bam_t* bam, const bam_widget_t* widget, const bam_rect_t* rect);
+
+
+static void text_mark_line(bam_t* bam, const bam_widget_t* widget, const bam_rect_t* inner, int top, int index,
+                           int line_height) {
+    bam_rect_t rect;
+
+    rect.x1 = inner->x1;
+    rect.y1 = top + (index * line_height);
+    rect.x2 = inner->x2;
+    rect.y2 = rect.y1 + line_height;
+    rect_intersect(&rect, &widget->rect);
+
+    widget_make_rect_dirty(bam, widget, &rect);
+}
+
+
+static void text_store_line(bam_t* bam, bam_widget_t* widget, size_t index, const uint8_t* line_start,
+                            const uint8_t* line_end, int width, const bam_rect_t* inner, int top, int line_height,
+                            bool mark_changes) {
+    bam_text_line_t* line = &widget->lines[index];
+    bam_text_line_t new_line;
+
+    new_line.offset = (uint32_t) (line_start - (const uint8_t*) widget->text);
+    new_line.length = (uint32_t) (line_end - line_start);
+    new_line.width = (bam_coord_t) width;
+    new_line.hash = text_hash(line_start, line_end);
+
+    // line only needs redrawing if its appearance has changed (if its index hasn't, neither has its position)
+    if (index < widget->n_lines && line->length == new_line.length && line->width == new_line.width &&
+        line->hash == new_line.hash) {
+        line->offset = new_line.offset;
+        return;
+    }
+
+    *line = new_line;
+
+    if (mark_changes) {
+        text_mark_line(bam, widget, inner, top, (int) index, line_height);
+    }
+}
+
+
+static void text_wrap(bam_t* bam, bam_widget_t* widget, bool mark_changes) {
+    const bam_vtable_t* vtable = bam->vtable;
+    const bam_font_t font = widget->style->font;
+    const uint8_t* text_i = (const uint8_t*) widget->text;
+    const uint8_t* line_start = text_i;
+    const uint8_t* break_ptr = NULL;
+    bam_font_metrics_t font_metrics;
+    bam_rect_t inner;
+    int max_width;
+    int width = 0;
+    int break_width = 0;
+    int after_break_width = 0;
+    int line_height;
+    int top;
+    size_t n_lines = 0;
+
+    widget_calc_inner(widget, &inner);
+    max_width = rect_width(&inner);
+
+    vtable->get_font_metrics(&font_metrics, font, bam->user_data);
+    line_height = max_int(1, font_metrics.line_height);
+
+    // changed lines are marked at their current position, if the block of text moves that is dealt with below
+    top = text_calc_top(widget, &inner, line_height);
+
+    // break text into lines at spaces or newlines, falling back to breaking between characters if a word doesn't fit
+    while (*text_i && n_lines < widget->max_lines) {
+        const uint8_t* char_ptr = text_i;
+        bam_unichar_t codepoint = 0;
+        bam_glyph_metrics_t glyph_metrics;
+        int advance = 0;
+
+        text_i = unicode_decode_utf8(text_i, &codepoint);
+
+        if (codepoint == '\n') {
+            text_store_line(bam, widget, n_lines++, line_start, char_ptr, width, &inner, top, line_height,
+                            mark_changes);
+
+            line_start = text_i;
+            break_ptr = NULL;
+            width = 0;
+            continue;
+        }
+
+        if (vtable->get_glyph_metrics(&glyph_metrics, font, codepoint, bam->user_data)) {
+            advance = glyph_metrics.x_advance;
+        }
+
+        if (width + advance > max_width && char_ptr > line_start) {
+            text_store_line(bam, widget, n_lines++, line_start, break_ptr ? break_ptr : char_ptr,
+                            break_ptr ? break_width : width, &inner, top, line_height, mark_changes);
+
+            // next line starts after the space the line was broken at, or at the character that didn't fit
+            if (break_ptr) {
+                line_start = break_ptr + 1;
+                width -= after_break_width;
+            } else {
+                line_start = char_ptr;
+                width = 0;
+            }
+
+            break_ptr = NULL;
+
+            if (n_lines >= widget->max_lines) {
+                break;
+            }
+        }
+
+        if (codepoint == ' ' && char_ptr > line_start) {
+            break_ptr = char_ptr;
+            break_width = width;
+            after_break_width = width + advance;
+        }
+
+        width += advance;
+    }
+
+    if (n_lines < widget->max_lines && (text_i > line_start || n_lines == 0)) {
+        text_store_line(bam, widget, n_lines++, line_start, text_i, width, &inner, top, line_height, mark_changes);
+    }
+
+    // mark lines that no longer exist
+    if (mark_changes) {
+        for (size_t i = n_lines; i < widget->n_lines; i++) {
+            text_mark_line(bam, widget, &inner, top, (int) i, line_height);
+        }
+    }
+
+    widget->n_lines = (uint16_t) n_lines;
+
+    // if a change in line count has moved the block of text vertically, every line has moved
+    if (mark_changes && text_calc_top(widget, &inner, line_height) != top) {
+        widget_make_rect_dirty(bam, widget, &widget->rect);
+    }
+}
+
+
+// ******** WIDGET API ********
+
+static void animation_cancel_all(bam_t* bam);
+
+
+static bam_widget_t* widget_from_handle(const bam_t* bam, bam_widget_handle_t handle) {
+    return bam->widget_buffer_begin + handle;
+}
+
+
+static const bam_style_t* widget_get_style(const bam_t* bam, const bam_style_t* style) {
+    return style ? style : bam->default_style;
+}
+
+
+static void widget_make_rect_dirty(bam_t* bam, const bam_widget_t* widget, const bam_rect_t* rect) {
+    // base layer cache no longer matches base widgets, so they are drawn individually until it is rendered again
+    if (widget->flags & BAM_WIDGET_FLAG_BASE) {
+        bam->base_cache = NULL;
+    }
+
+    // while a screen is being rebuilt, areas that have changed are found by reconciliation instead
+    if (bam->reconcile_pending) {
+        return;
+    }
+
+    // changes to widgets with a refresh interval are applied at most once per interval (except to the pressed
+    // widget, so that input feedback doesn't lag)
+    if (widget->refresh_interval > 0 && widget != bam->pressed_widget &&
+        throttle_defer(bam, widget_from_handle(bam, widget - bam->widget_buffer_begin), rect)) {
+        return;
+    }
+
+    governor_mark_rect(bam, widget, rect);
+}
+
+
+static void widget_make_dirty(bam_t* bam, const bam_widget_t* widget) {
+    widget_make_rect_dirty(bam, widget, &widget->rect);
+}
+
+
+static void widget_cache_prepare(bam_t* bam, const bam_widget_t* widget);
+
+
+static void widget_make_state_dirty(bam_t* bam, const bam_widget_t* widget) {
+    // a change of state only changes widget's colors, so its appearance is cached (if it isn't already) and redrawn
+    // from cache
+    widget_cache_prepare(bam, widget);
+    widget_make_dirty(bam, widget);
+}
+
+
+static bam_widget_t* widget_create(bam_t* bam, const bam_rect_t* rect, const bam_style_t* style, const char* text,
+                                   bool enabled) {
+    BAM_ASSERT(!rect_empty(rect));
+
+    bam_widget_t* widget;
+
+    // check if there is room in buffer for new widget
+    if (bam->widget_buffer_ptr >= bam->widget_buffer_end) {
+        panic(bam, BAM_PANIC_CODE_OUT_OF_MEMORY);
+    }
+
+    // allocate new widget
+    widget = bam->widget_buffer_ptr;
+    bam->widget_buffer_ptr++;
+
+    // initialise widget
+    widget->style = style ? style : bam->default_style;
+    widget->text = text ? text : "";
+    widget->state = enabled ? BAM_STATE_ENABLED : BAM_STATE_DISABLED;
+    widget->callback = NULL;
+    widget->user_data = NULL;
+    widget->flags = 0;
+    widget->draw_callback = NULL;
+    widget->draw_user_data = NULL;
+    widget->drag_callback = NULL;
+    widget->drag_user_data = NULL;
+    widget->lines = NULL;
+    widget->max_lines = 0;
+    widget->n_lines = 0;
+    widget->keypad = NULL;
+    widget->work = NULL;
+    widget->refresh_interval = 0;
+    widget->last_refresh = 0;
+    widget->rect = *rect;
+
+    rect_init_empty(&widget->throttled_rect);
+
+    return widget;
+}
+
+
+static void widget_reserve(bam_t* bam, size_t n_widgets) {
+    // a batch is checked for room up front, so that it is never left half-created
+    if ((size_t) (bam->widget_buffer_end - bam->widget_buffer_ptr) < n_widgets) {
+        panic(bam, BAM_PANIC_CODE_OUT_OF_MEMORY);
+    }
+}
+
+
+static void widget_make_batch_dirty(bam_t* bam, const bam_rect_t* rect) {
+    // new widgets have no flags, refresh interval or base layer, so only a screen rebuild can stop their area being
+    // marked, and governor never holds it back
+    if (!bam->reconcile_pending) {
+        governor_mark_area(bam, rect);
+    }
+}
+
+
+bam_widget_handle_t bam_add_widget(bam_t* bam, int x, int y, int width, int height,
+                                   const bam_style_t* style, const char* text, bool enabled) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(width > 0);
+    BAM_ASSERT(height > 0);
+
+    bam_widget_t* widget;
+    bam_rect_t rect;
+
+    rect_init(&rect, x, y, width, height);
+    widget = widget_create(bam, &rect, style, text, enabled);
+
+    // mark area of display where widget is placed as dirty
+    widget_make_dirty(bam, widget);
+
+    // return handle to new widget
+    return widget - bam->widget_buffer_begin;
+}
+
+
+bam_widget_handle_t bam_add_widgets(bam_t* bam, const bam_widget_desc_t* descs, size_t n_descs) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(descs || n_descs == 0);
+
+    bam_widget_handle_t first = (bam_widget_handle_t) (bam->widget_buffer_ptr - bam->widget_buffer_begin);
+    bam_rect_t dirty_rect;
+
+    widget_reserve(bam, n_descs);
+    rect_init_empty(&dirty_rect);
+
+    // widgets are created in one pass, and the area they cover is marked dirty once (handles are consecutive, so
+    // only the first needs returning)
+    for (const bam_widget_desc_t* desc_i = descs; desc_i < descs + n_descs; desc_i++) {
+        bam_widget_t* widget = widget_create(bam, &desc_i->bounds, desc_i->style, desc_i->text, desc_i->enabled);
+
+        widget->metadata = desc_i->metadata;
+        widget->callback = desc_i->callback;
+        widget->user_data = desc_i->user_data;
+
+        rect_union(&dirty_rect, &widget->rect);
+    }
+
+    widget_make_batch_dirty(bam, &dirty_rect);
+
+    return first;
+}
+
+
+static bool reconcile_record(bam_t* bam);
+
+
+void bam_delete_widgets(bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    // clear pressed widget pointer
+    bam->pressed_widget = NULL;
+
+    // animations refer to widgets by handle, so cancel them all
+    animation_cancel_all(bam);
+
+    // record widgets for reconciliation with their replacements, if possible, otherwise assume widgets were
+    // covering most of the display, so mark whole display as dirty
+    if (!reconcile_record(bam)) {
+        dirty_mark_all(bam);
+    }
+
+    // reset widget buffer top
+    bam->widget_buffer_ptr = bam->widget_buffer_begin;
+    bam->n_throttled_widgets = 0;
+
+    // base layer cache belongs to widgets just deleted
+    bam->base_cache = NULL;
+}
+
+
+void bam_force_widget_redraw(bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    // text may have been modified in place, so wrapped text must be broken into lines again
+    if (_widget->lines) {
+        text_wrap(bam, _widget, false);
+    }
+
+    widget_make_dirty(bam, _widget);
+}
+
+
+void bam_set_widget_callback(bam_t* bam, bam_widget_handle_t widget, bam_widget_callback_t callback,
+                             void* user_data) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    _widget->callback = callback;
+    _widget->user_data = user_data;
+}
+
+
+void bam_set_widget_bounds(bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    widget_make_dirty(bam, _widget);
+    _widget->rect = *bounds;
+
+    if (_widget->lines) {
+        text_wrap(bam, _widget, false);
+    }
+
+    widget_make_dirty(bam, _widget);
+}
+
+
+const bam_rect_t* bam_get_widget_bounds(bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    return &(widget_from_handle(bam, widget)->rect);
+}
+
+
+void bam_set_widget_style(bam_t* bam, bam_widget_handle_t widget, const bam_style_t* style) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+    const bam_style_t* new_style = widget_get_style(bam, style);
+
+    // set widget's style if different to its current style
+    if (_widget->style != new_style) {
+        _widget->style = new_style;
+
+        if (_widget->lines) {
+            text_wrap(bam, _widget, false);
+        }
+
+        widget_make_dirty(bam, _widget);
+    }
+}
+
+
+const bam_style_t* bam_get_widget_style(const bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    return widget_from_handle(bam, widget)->style;
+}
+
+
+void bam_set_widget_text(bam_t* bam, bam_widget_handle_t widget, const char* text) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    // set widget's text if different to its current text
+    text = text ? text : "";
+
+    // wrapped text is always broken into lines again, as it may have been modified in place, but only lines that
+    // have changed are marked dirty
+    if (_widget->lines) {
+        _widget->text = text;
+        text_wrap(bam, _widget, true);
+    } else if (strcmp(_widget->text, text) != 0) {
+        _widget->text = text;
+        widget_make_dirty(bam, _widget);
+    }
+}
+
+
+const char* bam_get_widget_text(const bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    return widget_from_handle(bam, widget)->text;
+}
+
+
+void bam_set_widget_enabled(bam_t* bam, bam_widget_handle_t widget, bool enabled) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+    bam_state_t new_state = enabled ? BAM_STATE_ENABLED : BAM_STATE_DISABLED;
+
+    // set widget's state if it has changed
+    if (_widget->state != new_state) {
+        _widget->state = new_state;
+        widget_make_state_dirty(bam, _widget);
+    }
+}
+
+
+bool bam_get_widget_enabled(const bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    return widget_from_handle(bam, widget)->state == BAM_STATE_ENABLED;
+}
+
+
+void bam_set_widget_metadata(bam_t* bam, bam_widget_handle_t widget, uintptr_t metadata) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    widget_from_handle(bam, widget)->metadata = metadata;
+}
+
+
+uintptr_t bam_get_widget_metadata(bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    return widget_from_handle(bam, widget)->metadata;
+}
+
+
+void bam_set_widget_colors(bam_t* bam, bam_widget_handle_t widget, const bam_color_pair_t* colors) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    // passing NULL reverts widget to using its style's colors
+    if (colors) {
+        if (!(_widget->flags & BAM_WIDGET_FLAG_COLORS) ||
+            _widget->colors.foreground != colors->foreground ||
+            _widget->colors.background != colors->background) {
+            _widget->flags |= BAM_WIDGET_FLAG_COLORS;
+            _widget->colors = *colors;
+            widget_make_dirty(bam, _widget);
+        }
+    } else if (_widget->flags & BAM_WIDGET_FLAG_COLORS) {
+        _widget->flags &= ~BAM_WIDGET_FLAG_COLORS;
+        widget_make_dirty(bam, _widget);
+    }
+}
+
+
+static bam_widget_t* widget_find_at_point(const bam_t* bam, int x, int y) {
+    bam_widget_t* widget_begin = bam->widget_buffer_begin;
+    bam_widget_t* widget_i = bam->widget_buffer_ptr;
+
+    while (widget_i != widget_begin) {
+        widget_i--;
+
+        if (rect_contains_point(&widget_i->rect, x, y)) {
+            return widget_i;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void keypad_set_pressed_key(bam_t* bam, const bam_widget_t* widget, size_t key);
+
+
+static void widget_set_pressed(bam_t* bam, bam_widget_t* widget) {
+    // keypads track which of their keys is pressed themselves, so only that key needs to be redrawn
+    if (bam->pressed_widget) {
+        if (bam->pressed_widget->keypad) {
+            keypad_set_pressed_key(bam, bam->pressed_widget, BAM_KEYPAD_NO_KEY);
+        } else {
+            bam->pressed_widget->state = BAM_STATE_ENABLED;
+            widget_make_state_dirty(bam, bam->pressed_widget);
+        }
+    }
+
+    bam->pressed_widget = widget;
+    bam->pressed_inside = true;
+
+    if (bam->pressed_widget && !bam->pressed_widget->keypad) {
+        bam->pressed_widget->state = BAM_STATE_PRESSED;
+        widget_make_state_dirty(bam, bam->pressed_widget);
+    }
+}
+
+
+static size_t keypad_find_key(const bam_widget_t* widget, int x, int y);
+static void keypad_mark_key(bam_t* bam, const bam_widget_t* widget, size_t key);
+
+
+static void widget_track_pressed(bam_t* bam, int x, int y) {
+    bam_widget_t* widget = bam->pressed_widget;
+    bool inside = (widget_find_at_point(bam, x, y) == widget);
+
+    // a keypad is only pressed while the pointer is over the key that was originally pressed (and never once that
+    // key has been disabled, as keypad_find_key() would otherwise match its absence to gaps between keys)
+    if (inside && widget->keypad) {
+        inside = widget->keypad->pressed_key != BAM_KEYPAD_NO_KEY &&
+                 keypad_find_key(widget, x, y) == widget->keypad->pressed_key;
+    }
+
+    // nothing to do if pointer has not crossed the pressed widget's (or key's) boundary
+    if (inside == bam->pressed_inside) {
+        return;
+    }
+
+    // show widget as released while the pointer is outside of it, and as pressed again when it returns (only the
+    // pressed widget, or the pressed key of a keypad, is damaged)
+    bam->pressed_inside = inside;
+
+    if (widget->keypad) {
+        keypad_mark_key(bam, widget, widget->keypad->pressed_key);
+    } else {
+        widget->state = inside ? BAM_STATE_PRESSED : BAM_STATE_ENABLED;
+        widget_make_state_dirty(bam, widget);
+    }
+}
+
+
+void bam_set_widget_draw_callback(bam_t* bam, bam_widget_handle_t widget, bam_widget_draw_callback_t callback,
+                                  void* user_data) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    _widget->draw_callback = callback;
+    _widget->draw_user_data = user_data;
+    widget_make_dirty(bam, _widget);
+}
+
+
+void bam_set_widget_drag_callback(bam_t* bam, bam_widget_handle_t widget, bam_widget_drag_callback_t callback,
+                                  void* user_data) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    _widget->drag_callback = callback;
+    _widget->drag_user_data = user_data;
+}
+
+
+void bam_set_widget_low_priority(bam_t* bam, bam_widget_handle_t widget, bool low_priority) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    if (low_priority) {
+        _widget->flags |= BAM_WIDGET_FLAG_LOW_PRIORITY;
+    } else {
+        _widget->flags &= ~BAM_WIDGET_FLAG_LOW_PRIORITY;
+    }
+}
+
+
+void bam_set_widget_refresh_interval(bam_t* bam, bam_widget_handle_t widget, bam_tick_t interval) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    bam_tick_t now = bam->vtable->get_monotonic_time(bam->user_data);
+
+    _widget->refresh_interval = interval;
+
+    // changes held back under previous interval are applied straight away, otherwise next change is
+    if (_widget->flags & BAM_WIDGET_FLAG_THROTTLED) {
+        throttle_release(bam, _widget, now);
+    } else {
+        _widget->last_refresh = (bam_tick_t) (now - interval);
+    }
+}
+
+
+void bam_set_widget_wrap(bam_t* bam, bam_widget_handle_t widget, bam_text_line_t* line_buffer,
+                         size_t line_buffer_size) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+    BAM_ASSERT(line_buffer || line_buffer_size == 0);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    // passing a NULL line buffer reverts widget to drawing its text as a single line
+    _widget->lines = line_buffer_size > 0 ? line_buffer : NULL;
+    _widget->max_lines = (uint16_t) (line_buffer_size < UINT16_MAX ? line_buffer_size : UINT16_MAX);
+    _widget->n_lines = 0;
+
+    if (_widget->lines) {
+        text_wrap(bam, _widget, false);
+    }
+
+    widget_make_dirty(bam, _widget);
+}
+
+
+size_t bam_get_widget_line_count(const bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    const bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    return _widget->lines ? _widget->n_lines : 1;
+}
+
+
+// ******** DRAWING API ********
+
+void bam_init_mask_cache(bam_t* bam, uint8_t* mask_buffer, size_t mask_buffer_size) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(mask_buffer || mask_buffer_size == 0);
+
+    bam->mask_buffer_begin = mask_buffer;
+    bam->mask_buffer_end = mask_buffer + mask_buffer_size;
+    bam->mask_buffer_ptr = mask_buffer;
+    bam->n_mask_cache_entries = 0;
+}
+
+
+void bam_init_fill_cache(bam_t* bam, bam_color_t* fill_buffer, size_t fill_buffer_size) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(fill_buffer || fill_buffer_size == 0);
+
+    bam->fill_buffer_begin = fill_buffer;
+    bam->fill_buffer_end = fill_buffer + fill_buffer_size;
+    bam->fill_buffer_ptr = fill_buffer;
+    bam->n_fill_cache_entries = 0;
+}
+
+
+void bam_draw_fill(bam_t* bam, const bam_rect_t* rect, bam_color_t color) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(rect);
+
+    draw_fill(bam, rect, color);
+}
+
+
+void bam_draw_line(bam_t* bam, int x1, int y1, int x2, int y2, int thickness, bam_color_t color) {
+    BAM_ASSERT_CTX(bam);
+
+    prim_draw_line(bam, x1, y1, x2, y2, thickness, color);
+}
+
+
+void bam_draw_arc(bam_t* bam, int cx, int cy, int radius, int thickness, int start_angle, int end_angle,
+                  bam_color_t color) {
+    BAM_ASSERT_CTX(bam);
+
+    prim_draw_arc(bam, cx, cy, radius, thickness, start_angle, end_angle, color);
+}
+
+
+void bam_draw_round_rect(bam_t* bam, const bam_rect_t* rect, int radius, bam_color_t color) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(rect);
+
+    prim_draw_round_rect(bam, rect, radius, color);
+}
+
+
+void bam_draw_image(bam_t* bam, const bam_image_t* image, int x, int y) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(image);
+
+    image_draw(bam, image, x, y);
+}
+
+
+// ******** IMAGE API ********
+
+static bool image_check_rle_row(const uint32_t* data, size_t begin, size_t end, int width) {
+    size_t pos = begin;
+    size_t col = 0;
+
+    // every packet must advance along row and lie within row's own data, and packets must cover row exactly
+    while (col < (size_t) width) {
+        uint32_t header;
+        size_t count;
+        size_t n_words;
+
+        if (pos >= end) {
+            return false;
+        }
+
+        header = data[pos++];
+        count = header & BAM_IMAGE_RLE_COUNT_MASK;
+        n_words = (header & BAM_IMAGE_RLE_REPEAT) ? 1 : count;
+
+        if (count == 0 || count > (size_t) width - col || n_words > end - pos) {
+            return false;
+        }
+
+        pos += n_words;
+        col += count;
+    }
+
+    return true;
+}
+
+
+bool bam_load_image(bam_image_t* image, const uint32_t* blob, size_t blob_size) {
+    BAM_ASSERT(image);
+    BAM_ASSERT(blob || blob_size == 0);
+
+    size_t n_pixels;
+
+    // blob is a header of magic number, format, width and height, followed by pixels (raw) or row index and
+    // packets (RLE), all as 32-bit words
+    if (blob_size < 4 || blob[0] != BAM_IMAGE_MAGIC) {
+        return false;
+    }
+
+    image->format = (bam_image_format_t) blob[1];
+    image->width = (int) blob[2];
+    image->height = (int) blob[3];
+
+    if (image->width <= 0 || image->height <= 0) {
+        return false;
+    }
+
+    n_pixels = (size_t) image->width * (size_t) image->height;
+
+    switch (image->format) {
+    case BAM_IMAGE_FORMAT_RAW:
+        image->row_index = NULL;
+        image->data = blob + 4;
+        return blob_size >= 4 + n_pixels;
+
+    case BAM_IMAGE_FORMAT_RLE:
+        if (blob_size < 4 + (size_t) image->height) {
+            return false;
+        }
+
+        image->row_index = blob + 4;
+        image->data = blob + 4 + image->height;
+
+        // validate each row's packets up to the start of the next row (or end of blob), so that drawing never needs
+        // to check bounds
+        for (int row = 0; row < image->height; row++) {
+            size_t data_size = blob_size - 4 - (size_t) image->height;
+            size_t end = (row + 1 < image->height) ? image->row_index[row + 1] : data_size;
+
+            if (end > data_size || image->row_index[row] >= end ||
+                !image_check_rle_row(image->data, image->row_index[row], end, image->width)) {
+                return false;
+            }
+        }
+
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+#define BAM_IMAGE_MIN_RUN               3
+
+
+static void image_put(uint32_t* blob, size_t blob_size, size_t* pos, uint32_t word) {
+    // words beyond end of blob are counted but not stored, so that required size can be found
+    if (*pos < blob_size) {
+        blob[*pos] = word;
+    }
+
+    (*pos)++;
+}
+
+
+static void image_put_literal(uint32_t* blob, size_t blob_size, size_t* pos, const bam_color_t* pixels,
+                              int count) {
+    if (count > 0) {
+        image_put(blob, blob_size, pos, (uint32_t) count);
+
+        for (int i = 0; i < count; i++) {
+            image_put(blob, blob_size, pos, pixels[i]);
+        }
+    }
+}
+
+
+static void image_encode(const bam_color_t* pixels, int width, int height, size_t pitch, uint32_t* blob,
+                         size_t blob_size, size_t* pos) {
+    size_t image_pos = *pos;
+    size_t data_pos;
+
+    image_put(blob, blob_size, pos, BAM_IMAGE_MAGIC);
+    image_put(blob, blob_size, pos, BAM_IMAGE_FORMAT_RLE);
+    image_put(blob, blob_size, pos, (uint32_t) width);
+    image_put(blob, blob_size, pos, (uint32_t) height);
+
+    // leave room for row index, which is filled in as each row is encoded
+    data_pos = *pos + (size_t) height;
+    *pos = data_pos;
+
+    for (int y = 0; y < height; y++) {
+        const bam_color_t* row = pixels + ((size_t) y * pitch);
+        size_t index_pos = image_pos + 4 + (size_t) y;
+        int literal_start = 0;
+        int x = 0;
+
+        image_put(blob, blob_size, &index_pos, (uint32_t) (*pos - data_pos));
+
+        // runs long enough to be worth a packet of their own become repeat packets, everything between them is
+        // gathered into literal packets
+        while (x < width) {
+            int run = 1;
+
+            while ((x + run) < width && row[x + run] == row[x]) {
+                run++;
+            }
+
+            if (run >= BAM_IMAGE_MIN_RUN) {
+                image_put_literal(blob, blob_size, pos, row + literal_start, x - literal_start);
+                image_put(blob, blob_size, pos, BAM_IMAGE_RLE_REPEAT | (uint32_t) run);
+                image_put(blob, blob_size, pos, row[x]);
+                literal_start = x + run;
+            }
+
+            x += run;
+        }
+
+        image_put_literal(blob, blob_size, pos, row + literal_start, width - literal_start);
+    }
+}
+
+
+size_t bam_encode_image(const bam_color_t* pixels, int width, int height, size_t pitch, uint32_t* blob,
+                        size_t blob_size) {
+    BAM_ASSERT(pixels);
+    BAM_ASSERT(width > 0);
+    BAM_ASSERT(height > 0);
+    BAM_ASSERT(pitch >= (size_t) width);
+    BAM_ASSERT(blob || blob_size == 0);
+
+    size_t pos = 0;
+
+    // image is always RLE encoded, as the point of encoding is to make it smaller
+    image_encode(pixels, width, height, pitch, blob, blob_size, &pos);
+
+    return pos;
+}
+
+
+static void image_draw_widget_func(bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds,
+                                   void* user_data) {
+    const bam_image_t* image = user_data;
+    const bam_style_t* style = widget_from_handle(bam, widget)->style;
+    int x;
+    int y;
+
+    // position image within widget according to style's alignment properties
+    switch (style->h_align) {
+    case BAM_H_ALIGN_CENTER:
+        x = bounds->x1 + ((rect_width(bounds) - image->width) / 2);
+        break;
+
+    case BAM_H_ALIGN_RIGHT:
+        x = bounds->x2 - image->width;
+        break;
+
+    default:
+        x = bounds->x1;
+    }
+
+    switch (style->v_align) {
+    case BAM_V_ALIGN_MIDDLE:
+        y = bounds->y1 + ((rect_height(bounds) - image->height) / 2);
+        break;
+
+    case BAM_V_ALIGN_BOTTOM:
+        y = bounds->y2 - image->height;
+        break;
+
+    default:
+        y = bounds->y1;
+    }
+
+    image_draw(bam, image, x, y);
+}
+
+
+void bam_set_widget_image(bam_t* bam, bam_widget_handle_t widget, const bam_image_t* image) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+    BAM_ASSERT(!image || bam->vtable->draw_pixels);
+
+    bam_set_widget_draw_callback(bam, widget, image ? image_draw_widget_func : NULL, (void*) image);
+}
+
+
+// ******** SNAPSHOT API ********
+
+#define BAM_SNAPSHOT_RECORD_SIZE        5
+
+
+static uint32_t snapshot_hash_word(uint32_t hash, uint32_t word) {
+    // FNV-1a, one byte at a time
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ (word & 0xFFu)) * 16777619ul;
+        word >>= 8;
+    }
+
+    return hash;
+}
+
+
+static uint32_t snapshot_widget_signature(const bam_widget_t* widget) {
+    const bam_style_t* style = widget->style;
+    uint32_t hash = 2166136261ul;
+
+    // signature covers everything that determines a widget's appearance, apart from style's font (which is only a
+    // handle, so can differ between the build that captured the snapshot and the one restoring it)
+    hash = snapshot_hash_word(hash, (uint32_t) widget->rect.x1);
+    hash = snapshot_hash_word(hash, (uint32_t) widget->rect.y1);
+    hash = snapshot_hash_word(hash, (uint32_t) widget->rect.x2);
+    hash = snapshot_hash_word(hash, (uint32_t) widget->rect.y2);
+    hash = snapshot_hash_word(hash, (uint32_t) widget->state);
+    hash = snapshot_hash_word(hash, widget->flags);
+    hash = snapshot_hash_word(hash, (uint32_t) style->h_align);
+    hash = snapshot_hash_word(hash, (uint32_t) style->v_align);
+    hash = snapshot_hash_word(hash, (uint32_t) style->h_padding);
+    hash = snapshot_hash_word(hash, (uint32_t) style->v_padding);
+
+    for (int state = 0; state < BAM_N_STATES; state++) {
+        hash = snapshot_hash_word(hash, style->colors[state].foreground);
+        hash = snapshot_hash_word(hash, style->colors[state].background);
+    }
+
+    if (widget->flags & BAM_WIDGET_FLAG_COLORS) {
+        hash = snapshot_hash_word(hash, widget->colors.foreground);
+        hash = snapshot_hash_word(hash, widget->colors.background);
+    }
+
+    // as with font, fill's pattern is only a pointer, so only its type and colors can be signed
+    if (style->fill) {
+        hash = snapshot_hash_word(hash, (uint32_t) style->fill->type);
+
+        for (int state = 0; state < BAM_N_STATES; state++) {
+            hash = snapshot_hash_word(hash, style->fill->end_colors[state]);
+        }
+    }
+
+    if (widget->keypad) {
+        const bam_keypad_t* keypad = widget->keypad;
+
+        hash = snapshot_hash_word(hash, keypad->shifted);
+
+        for (size_t i = 0; i < (BAM_KEYPAD_MAX_KEYS / 32); i++) {
+            hash = snapshot_hash_word(hash, keypad->disabled[i]);
+        }
+    }
+
+    if (widget->text) {
+        for (const uint8_t* text_i = (const uint8_t*) widget->text; *text_i; text_i++) {
+            hash = (hash ^ *text_i) * 16777619ul;
+        }
+    }
+
+    return hash;
+}
+
+
+size_t bam_encode_snapshot(const bam_t* bam, const bam_color_t* pixels, size_t pitch, uint32_t* blob,
+                           size_t blob_size) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(pixels);
+    BAM_ASSERT(pitch >= (size_t) bam->disp_width);
+    BAM_ASSERT(blob || blob_size == 0);
+
+    const int width = bam->disp_width;
+    const int height = bam->disp_height;
+    size_t n_widgets = (size_t) (bam->widget_buffer_ptr - bam->widget_buffer_begin);
+    size_t pos = 0;
+
+    // blob is a header of magic number and widget count, followed by a record of each widget's bounds and
+    // signature, and an RLE image blob (as read by bam_load_image) of the display
+    image_put(blob, blob_size, &pos, BAM_SNAPSHOT_MAGIC);
+    image_put(blob, blob_size, &pos, (uint32_t) n_widgets);
+
+    for (const bam_widget_t* widget_i = bam->widget_buffer_begin; widget_i < bam->widget_buffer_ptr; widget_i++) {
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->rect.x1);
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->rect.y1);
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->rect.x2);
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->rect.y2);
+        image_put(blob, blob_size, &pos, snapshot_widget_signature(widget_i));
+    }
+
+    image_encode(pixels, width, height, pitch, blob, blob_size, &pos);
+
+    return pos;
+}
+
+
+bool bam_load_snapshot(bam_snapshot_t* snapshot, const uint32_t* blob, size_t blob_size) {
+    BAM_ASSERT(snapshot);
+    BAM_ASSERT(blob || blob_size == 0);
+
+    size_t records_size;
+
+    if (blob_size < 2 || blob[0] != BAM_SNAPSHOT_MAGIC || blob[1] > (blob_size - 2) / BAM_SNAPSHOT_RECORD_SIZE) {
+        return false;
+    }
+
+    snapshot->n_widgets = blob[1];
+    snapshot->records = blob + 2;
+    records_size = snapshot->n_widgets * BAM_SNAPSHOT_RECORD_SIZE;
+
+    return bam_load_image(&snapshot->image, blob + 2 + records_size, blob_size - 2 - records_size);
+}
+
+
+bool bam_restore_snapshot(bam_t* bam, const bam_snapshot_t* snapshot) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(snapshot);
+    BAM_ASSERT(bam->vtable->draw_pixels);
+
+    const bam_vtable_t* vtable = bam->vtable;
+    size_t n_widgets = (size_t) (bam->widget_buffer_ptr - bam->widget_buffer_begin);
+    bam_rect_t rect;
+
+    // snapshot must cover whole display
+    if (snapshot->image.width != bam->disp_width || snapshot->image.height != bam->disp_height) {
+        return false;
+    }
+
+    // stream snapshot to display one tile at a time
+    rect_init(&rect, 0, 0, bam->tile_width, bam->tile_height);
+
+    for (int offset_y = 0; offset_y < bam->disp_height; offset_y += bam->tile_height) {
+        for (int offset_x = 0; offset_x < bam->disp_width; offset_x += bam->tile_width) {
+            bam_draw_state_t saved_draw_state = bam->draw_state;
+
+            draw_set_translation(bam, -offset_x, -offset_y);
+            rect_set_pos(&rect, offset_x, offset_y);
+            draw_set_clip(bam, &rect);
+
+            image_draw(bam, &snapshot->image, 0, 0);
+
+            bam->draw_state = saved_draw_state;
+            rect_set_pos(&rect, 0, 0);
+
+            vtable->blt_tile(offset_x, offset_y, bam->user_data);
+        }
+    }
+
+    // with page flipping, snapshot is presented straight away, but other buffers don't hold it, so history of
+    // what has changed in them is lost
+    if (bam->flip_history) {
+        vtable->flip(bam->user_data);
+        bam->flip_n_valid = 0;
+    }
+
+    // display now matches snapshot, so only widgets that differ from it need to be rendered (widgets with draw
+    // callbacks can't be signed, so are always rendered)
+    dirty_clear_all(bam);
+
+    for (size_t i = 0; i < n_widgets || i < snapshot->n_widgets; i++) {
+        const bam_widget_t* widget = (i < n_widgets) ? bam->widget_buffer_begin + i : NULL;
+        const uint32_t* record = (i < snapshot->n_widgets) ? snapshot->records + (i * BAM_SNAPSHOT_RECORD_SIZE) : NULL;
+
+        if (widget && record && !widget->draw_callback && record[4] == snapshot_widget_signature(widget)) {
+            continue;
+        }
+
+        if (widget) {
+            widget_make_dirty(bam, widget);
+        }
+
+        // area widget covered in snapshot must also be rendered, in case widget has since moved, shrunk or gone
+        if (record) {
+            bam_rect_t old_rect;
+
+            old_rect.x1 = (bam_coord_t) (int32_t) record[0];
+            old_rect.y1 = (bam_coord_t) (int32_t) record[1];
+            old_rect.x2 = (bam_coord_t) (int32_t) record[2];
+            old_rect.y2 = (bam_coord_t) (int32_t) record[3];
+            dirty_mark_rect(bam, &old_rect);
+        }
+    }
+
+    return true;
+}
+
+
+// ******** SUSPEND API ********
+
+#define BAM_SUSPEND_MAGIC               0x53555342ul
+
+#define BAM_SUSPEND_HEADER_SIZE         6
+#define BAM_SUSPEND_WIDGET_SIZE         13
+#define BAM_SUSPEND_TIMER_SIZE          4
+
+// flags that describe a widget, rather than transient state (busy widgets are waiting for work that doesn't survive
+// suspension, and changes held back by throttling are drawn on resume anyway)
+#define BAM_SUSPEND_WIDGET_FLAGS        (BAM_WIDGET_FLAG_COLORS | BAM_WIDGET_FLAG_LOW_PRIORITY | \
+                                         BAM_WIDGET_FLAG_BASE | BAM_WIDGET_FLAG_OVERLAY)
+
+
+static size_t suspend_find_style(const bam_style_t* const* styles, size_t n_styles, const bam_style_t* style) {
+    size_t i;
+
+    for (i = 0; i < n_styles; i++) {
+        if (styles[i] == style) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+
+static bool resume_check_widgets(const bam_t* bam, const uint32_t* blob, size_t blob_size, size_t* pos,
+                                 size_t n_styles) {
+    size_t n_widgets = blob[4];
+
+    if (n_widgets > (size_t) (bam->widget_buffer_end - bam->widget_buffer_begin)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n_widgets; i++) {
+        const uint32_t* record = blob + *pos;
+        size_t text_words;
+        bam_rect_t rect;
+
+        if (blob_size - *pos < BAM_SUSPEND_WIDGET_SIZE) {
+            return false;
+        }
+
+        rect.x1 = (int32_t) record[0];
+        rect.y1 = (int32_t) record[1];
+        rect.x2 = (int32_t) record[2];
+        rect.y2 = (int32_t) record[3];
+
+        if (rect_empty(&rect) || record[4] >= n_styles || record[5] >= BAM_N_STATES) {
+            return false;
+        }
+
+        // text is stored in blob, terminator included
+        text_words = (record[12] / sizeof(uint32_t)) + 1;
+
+        if (blob_size - *pos - BAM_SUSPEND_WIDGET_SIZE < text_words ||
+            ((const char*) (record + BAM_SUSPEND_WIDGET_SIZE))[record[12]] != '\0') {
+            return false;
+        }
+
+        *pos += BAM_SUSPEND_WIDGET_SIZE + text_words;
+    }
+
+    return true;
+}
+
+
+static void resume_widgets(bam_t* bam, const uint32_t* blob, size_t pos, const bam_style_t* const* styles) {
+    size_t n_widgets = blob[4];
+
+    for (size_t i = 0; i < n_widgets; i++) {
+        const uint32_t* record = blob + pos;
+        bam_widget_t* widget;
+
+        // widget refers to its text where it lies in blob
+        widget = widget_from_handle(bam, bam_add_widget(bam, (int32_t) record[0], (int32_t) record[1],
+                                                        (int32_t) record[2] - (int32_t) record[0],
+                                                        (int32_t) record[3] - (int32_t) record[1],
+                                                        styles[record[4]],
+                                                        (const char*) (record + BAM_SUSPEND_WIDGET_SIZE), true));
+
+        widget->state = (bam_state_t) record[5];
+        widget->flags = record[6] & BAM_SUSPEND_WIDGET_FLAGS;
+        widget->colors.foreground = record[7];
+        widget->colors.background = record[8];
+        widget->metadata = (uintptr_t) (((uint64_t) record[10] << 32) | record[9]);
+        widget->refresh_interval = (bam_tick_t) record[11];
+        widget->last_refresh = (bam_tick_t) (bam->vtable->get_monotonic_time(bam->user_data) - record[11]);
+
+        pos += BAM_SUSPEND_WIDGET_SIZE + (record[12] / sizeof(uint32_t)) + 1;
+    }
+}
+
+
+static bool resume_check_timers(const uint32_t* blob, size_t blob_size, size_t pos, bam_timer_t* const* timers,
+                                size_t n_timers) {
+    size_t n_records = blob[5];
+
+    if ((blob_size - pos) / BAM_SUSPEND_TIMER_SIZE < n_records) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n_records; i++) {
+        const uint32_t* record = blob + pos + (i * BAM_SUSPEND_TIMER_SIZE);
+
+        if (record[0] >= n_timers || !timers[record[0]]->callback || record[2] > BAM_MAX_TICK_INTERVAL ||
+            record[3] == 0 || record[3] > BAM_MAX_TICK_INTERVAL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void resume_timers(bam_t* bam, const uint32_t* blob, size_t pos, bam_timer_t* const* timers) {
+    size_t n_records = blob[5];
+
+    // timers carry on with the time they had left when suspended
+    for (size_t i = 0; i < n_records; i++) {
+        const uint32_t* record = blob + pos + (i * BAM_SUSPEND_TIMER_SIZE);
+        bam_timer_t* timer = timers[record[0]];
+
+        bam_start_timer(bam, timer, (bam_tick_t) max_int(1, (int) record[2]), record[1] != 0, timer->callback,
+                        timer->user_data);
+        timer->interval = (bam_tick_t) record[3];
+    }
+}
+
+
+size_t bam_suspend(const bam_t* bam, const bam_style_t* const* styles, size_t n_styles, bam_timer_t* const* timers,
+                   size_t n_timers, uint32_t display_checksum, uint32_t* blob, size_t blob_size) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(styles || n_styles == 0);
+    BAM_ASSERT(timers || n_timers == 0);
+    BAM_ASSERT(blob || blob_size == 0);
+
+    bam_tick_t now = bam->vtable->get_monotonic_time(bam->user_data);
+    size_t n_widgets = (size_t) (bam->widget_buffer_ptr - bam->widget_buffer_begin);
+    size_t n_active_timers = 0;
+    size_t pos = 0;
+
+    for (size_t i = 0; i < n_timers; i++) {
+        if (timers[i]->active) {
+            n_active_timers++;
+        }
+    }
+
+    // blob is a header, followed by a record of each widget (with its text) and of each active timer
+    image_put(blob, blob_size, &pos, BAM_SUSPEND_MAGIC);
+    image_put(blob, blob_size, &pos, (uint32_t) bam->disp_width);
+    image_put(blob, blob_size, &pos, (uint32_t) bam->disp_height);
+    image_put(blob, blob_size, &pos, display_checksum);
+    image_put(blob, blob_size, &pos, (uint32_t) n_widgets);
+    image_put(blob, blob_size, &pos, (uint32_t) n_active_timers);
+
+    for (const bam_widget_t* widget_i = bam->widget_buffer_begin; widget_i < bam->widget_buffer_ptr; widget_i++) {
+        size_t style = suspend_find_style(styles, n_styles, widget_i->style);
+        size_t text_length = strlen(widget_i->text);
+
+        // styles are stored by their position in table, so a widget with a style that isn't in it can't be resumed
+        if (style >= n_styles) {
+            return 0;
+        }
+
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->rect.x1);
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->rect.y1);
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->rect.x2);
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->rect.y2);
+        image_put(blob, blob_size, &pos, (uint32_t) style);
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->state);
+        image_put(blob, blob_size, &pos, widget_i->flags & BAM_SUSPEND_WIDGET_FLAGS);
+        image_put(blob, blob_size, &pos, widget_i->colors.foreground);
+        image_put(blob, blob_size, &pos, widget_i->colors.background);
+        image_put(blob, blob_size, &pos, (uint32_t) widget_i->metadata);
+        image_put(blob, blob_size, &pos, (uint32_t) ((uint64_t) widget_i->metadata >> 32));
+        image_put(blob, blob_size, &pos, widget_i->refresh_interval);
+        image_put(blob, blob_size, &pos, (uint32_t) text_length);
+
+        // text is copied as it lies in memory, so that resumed widget can refer to it in place
+        for (size_t i = 0; i <= text_length; i += sizeof(uint32_t)) {
+            uint32_t word = 0;
+
+            memcpy(&word, widget_i->text + i, min_int((int) sizeof(uint32_t), (int) (text_length + 1 - i)));
+            image_put(blob, blob_size, &pos, word);
+        }
+    }
+
+    for (size_t i = 0; i < n_timers; i++) {
+        const bam_timer_t* timer = timers[i];
+
+        if (timer->active) {
+            image_put(blob, blob_size, &pos, (uint32_t) i);
+            image_put(blob, blob_size, &pos, timer->repeat);
+            image_put(blob, blob_size, &pos, tick_until(now, timer->deadline));
+            image_put(blob, blob_size, &pos, timer->interval);
+        }
+    }
+
+    return pos;
+}
+
+
+bool bam_resume(bam_t* bam, const uint32_t* blob, size_t blob_size, const bam_style_t* const* styles,
+                size_t n_styles, bam_timer_t* const* timers, size_t n_timers, uint32_t display_checksum) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(blob || blob_size == 0);
+    BAM_ASSERT(styles || n_styles == 0);
+    BAM_ASSERT(timers || n_timers == 0);
+
+    size_t pos = BAM_SUSPEND_HEADER_SIZE;
+
+    if (blob_size < BAM_SUSPEND_HEADER_SIZE || blob[0] != BAM_SUSPEND_MAGIC ||
+        blob[1] != (uint32_t) bam->disp_width || blob[2] != (uint32_t) bam->disp_height) {
+        return false;
+    }
+
+    // whole blob is checked before anything is changed, so that a bad one leaves widgets and timers as they are
+    if (!resume_check_widgets(bam, blob, blob_size, &pos, n_styles) ||
+        !resume_check_timers(blob, blob_size, pos, timers, n_timers)) {
+        return false;
+    }
+
+    // resumed widgets replace any that exist
+    bam_delete_widgets(bam);
+    resume_widgets(bam, blob, BAM_SUSPEND_HEADER_SIZE, styles);
+    resume_timers(bam, blob, pos, timers);
+
+    // if display still shows what it did when context was suspended, nothing needs rendering
+    if (display_checksum == blob[3]) {
+        dirty_clear_all(bam);
+    } else {
+        dirty_mark_all(bam);
+    }
+
+    return true;
+}
+
+
+// ******** RECONCILIATION ********
+
+static uint32_t reconcile_hash_pointer(uint32_t hash, const void* ptr) {
+    uint64_t value = (uint64_t) (uintptr_t) ptr;
+
+    hash = snapshot_hash_word(hash, (uint32_t) value);
+    return snapshot_hash_word(hash, (uint32_t) (value >> 32));
+}
+
+
+static uint32_t reconcile_widget_signature(const bam_widget_t* widget) {
+    const bam_style_t* style = widget->style;
+    uint32_t hash = snapshot_widget_signature(widget);
+
+    // unlike a snapshot, old and new screens belong to same process, so handles that a snapshot can't sign can be
+    // compared, as can whether text is wrapped
+    hash = reconcile_hash_pointer(hash, style->font);
+    hash = snapshot_hash_word(hash, widget->lines ? widget->max_lines : 0);
+
+    if (style->fill) {
+        hash = reconcile_hash_pointer(hash, style->fill->pattern);
+    }
+
+    // snapshot signature only covers a keypad's state, so its layout, styles, label table and spacing are signed here
+    if (widget->keypad) {
+        const bam_keypad_t* keypad = widget->keypad;
+
+        hash = reconcile_hash_pointer(hash, keypad->layout);
+        hash = snapshot_hash_word(hash, (uint32_t) keypad->n_styles);
+        hash = snapshot_hash_word(hash, (uint32_t) keypad->spacing);
+
+        for (size_t i = 0; i < keypad->n_styles; i++) {
+            hash = reconcile_hash_pointer(hash, keypad->styles[i]);
+        }
+
+        hash = reconcile_hash_pointer(hash, keypad->labels);
+
+        // label table is indexed by key code, and its entries can be swapped without moving table itself
+        if (keypad->labels) {
+            for (size_t key = 0; key < keypad->layout->n_keys; key++) {
+                hash = reconcile_hash_pointer(hash, keypad->labels[keypad->layout->keys[key].code]);
+            }
+        }
+    }
+
+    return hash;
+}
+
+
+static bool reconcile_record(bam_t* bam) {
+    size_t n_widgets = (size_t) (bam->widget_buffer_ptr - bam->widget_buffer_begin);
+
+    // records of screen on display are kept if it is replaced again before being reconciled, as widgets in between
+    // were never drawn
+    if (bam->reconcile_pending) {
+        return true;
+    }
+
+    if (n_widgets > (size_t) (bam->reconcile_buffer_end - bam->reconcile_buffer_begin)) {
+        return false;
+    }
+
+    bam->reconcile_buffer_ptr = bam->reconcile_buffer_begin;
+
+    for (const bam_widget_t* widget_i = bam->widget_buffer_begin; widget_i < bam->widget_buffer_ptr; widget_i++) {
+        bam_reconcile_record_t* record = bam->reconcile_buffer_ptr++;
+
+        record->rect = widget_i->rect;
+        record->signature = reconcile_widget_signature(widget_i);
+        record->matched = false;
+
+        // widgets with draw callbacks can't be signed, so never match
+        if (widget_i->draw_callback) {
+            record->matched = true;
+            dirty_mark_rect(bam, &widget_i->rect);
+        }
+    }
+
+    // clean must run even if nothing turns out to differ, so that reconciliation happens
+    bam->reconcile_pending = true;
+    bam->dirty_pending = true;
+
+    return true;
+}
+
+
+static void reconcile_process(bam_t* bam) {
+    if (!bam->reconcile_pending) {
+        return;
+    }
+
+    bam->reconcile_pending = false;
+
+    // each new widget is matched with an identical old one, wherever it is in widget buffer, and widgets without a
+    // match are drawn along with the area of every old widget left unmatched
+    for (const bam_widget_t* widget_i = bam->widget_buffer_begin; widget_i < bam->widget_buffer_ptr; widget_i++) {
+        bool matched = false;
+
+        if (!widget_i->draw_callback) {
+            uint32_t signature = reconcile_widget_signature(widget_i);
+
+            for (bam_reconcile_record_t* record_i = bam->reconcile_buffer_begin;
+                 record_i < bam->reconcile_buffer_ptr; record_i++) {
+                if (!record_i->matched && record_i->signature == signature &&
+                    rect_equal(&record_i->rect, &widget_i->rect)) {
+                    record_i->matched = true;
+                    matched = true;
+                    break;
+                }
+            }
+        }
+
+        if (!matched) {
+            widget_make_dirty(bam, widget_i);
+        }
+    }
+
+    for (const bam_reconcile_record_t* record_i = bam->reconcile_buffer_begin; record_i < bam->reconcile_buffer_ptr;
+         record_i++) {
+        if (!record_i->matched) {
+            dirty_mark_rect(bam, &record_i->rect);
+        }
+    }
+}
+
+
+void bam_init_reconcile(bam_t* bam, bam_reconcile_record_t* record_buffer, size_t record_buffer_size) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(record_buffer || record_buffer_size == 0);
+
+    bam->reconcile_buffer_begin = record_buffer;
+    bam->reconcile_buffer_end = record_buffer + record_buffer_size;
+    bam->reconcile_buffer_ptr = record_buffer;
+    bam->reconcile_pending = false;
+}
+
+
+// ******** WIDGET CACHE ********
+
+#define BAM_WIDGET_CACHE_BACKGROUND     0xFF000000ul
+#define BAM_WIDGET_CACHE_FOREGROUND     0xFFFFFFFFul
+
+#define BAM_WIDGET_CACHE_READ_SIZE      64
+
+
+static bool widget_cache_eligible(const bam_t* bam, const bam_widget_t* widget) {
+    // only widgets whose appearance depends on nothing but their color pair can be cached, and only when coverage
+    // can be blended, as otherwise replaying it costs as much as drawing widget again
+    return bam->widget_cache_buffer_begin < bam->widget_cache_buffer_end && bam->vtable->draw_coverage &&
+           bam->quality < BAM_QUALITY_NO_ANTI_ALIASING && !widget->keypad && !widget->draw_callback &&
+           !widget->style->fill && !rect_empty(&widget->rect);
+}
+
+
+static uint32_t widget_cache_signature(const bam_widget_t* widget) {
+    const bam_style_t* style = widget->style;
+    uint32_t hash = 2166136261ul;
+
+    // signature covers everything that determines which pixels of widget are covered by its foreground color, but
+    // not its position or colors
+    hash = snapshot_hash_word(hash, (uint32_t) rect_width(&widget->rect));
+    hash = snapshot_hash_word(hash, (uint32_t) rect_height(&widget->rect));
+    hash = snapshot_hash_word(hash, (uint32_t) (uintptr_t) style->font);
+    hash = snapshot_hash_word(hash, (uint32_t) style->h_align);
+    hash = snapshot_hash_word(hash, (uint32_t) style->v_align);
+    hash = snapshot_hash_word(hash, (uint32_t) style->h_padding);
+    hash = snapshot_hash_word(hash, (uint32_t) style->v_padding);
+    hash = snapshot_hash_word(hash, widget->lines ? 1u : 0u);
+
+    for (const uint8_t* text_i = (const uint8_t*) widget->text; *text_i; text_i++) {
+        hash = (hash ^ *text_i) * 16777619ul;
+    }
+
+    return hash;
+}
+
+
+static const uint8_t* widget_cache_find(const bam_t* bam, const bam_widget_t* widget) {
+    bam_widget_handle_t handle = widget - bam->widget_buffer_begin;
+
+    if (!widget_cache_eligible(bam, widget)) {
+        return NULL;
+    }
+
+    // signature is only calculated for a widget that has an entry, and entry is stale if widget has changed since
+    for (size_t i = 0; i < bam->n_widget_cache_entries; i++) {
+        const bam_widget_cache_entry_t* entry = &bam->widget_cache[i];
+
+        if (entry->widget == handle) {
+            return (entry->signature == widget_cache_signature(widget)) ? entry->coverage : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void widget_cache_draw(bam_t* bam, const bam_widget_t* widget, const uint8_t* coverage,
+                              const bam_color_pair_t* colors) {
+    const int width = rect_width(&widget->rect);
+    const int origin_x = widget->rect.x1 + bam->draw_state.translate_x;
+    const int origin_y = widget->rect.y1 + bam->draw_state.translate_y;
+    bam_rect_t dest = widget->rect;
+    bam_span_t span;
+
+    draw_fill(bam, &widget->rect, colors->background);
+
+    rect_translate(&dest, bam->draw_state.translate_x, bam->draw_state.translate_y);
+    rect_intersect(&dest, &bam->draw_state.clip);
+
+    // coverage is emitted through foreground color a row at a time, so no glyphs need to be looked up or drawn
+    for (int y = dest.y1; y < dest.y2; y++) {
+        const uint8_t* row = coverage + ((size_t) (y - origin_y) * (size_t) width) + (dest.x1 - origin_x);
+
+        span_begin(&span, bam, dest.x1, y, colors->foreground);
+
+        for (int x = dest.x1; x < dest.x2; x++) {
+            span_push(&span, *row++);
+        }
+
+        span_flush(&span);
+    }
+}
+
+
+static void widget_cache_capture(bam_t* bam, const bam_widget_t* widget, uint8_t* coverage) {
+    static const bam_color_pair_t PROBE_COLORS = {BAM_WIDGET_CACHE_FOREGROUND, BAM_WIDGET_CACHE_BACKGROUND};
+
+    const int width = rect_width(&widget->rect);
+    bam_color_t pixels[BAM_WIDGET_CACHE_READ_SIZE];
+    bam_rect_t bounds;
+
+    memset(coverage, 0, (size_t) width * (size_t) rect_height(&widget->rect));
+
+    // only the part of widget that is on display is ever drawn, so only that part needs to be captured
+    rect_init(&bounds, 0, 0, bam->disp_width, bam->disp_height);
+    rect_intersect(&bounds, &widget->rect);
+
+    // widget is drawn alone, white on black, one tile at a time, and read back so that brightness of each pixel gives
+    // its coverage
+    for (int offset_y = bounds.y1; offset_y < bounds.y2; offset_y += bam->tile_height) {
+        for (int offset_x = bounds.x1; offset_x < bounds.x2; offset_x += bam->tile_width) {
+            bam_draw_state_t saved_draw_state = bam->draw_state;
+            bam_rect_t rect;
+
+            rect.x1 = offset_x;
+            rect.y1 = offset_y;
+            rect.x2 = min_int(offset_x + bam->tile_width, bounds.x2);
+            rect.y2 = min_int(offset_y + bam->tile_height, bounds.y2);
+
+            draw_set_translation(bam, -offset_x, -offset_y);
+            draw_set_clip(bam, &rect);
+            draw_widget_content(bam, widget, &PROBE_COLORS);
+
+            bam->draw_state = saved_draw_state;
+
+            for (int y = rect.y1; y < rect.y2; y++) {
+                for (int x = rect.x1; x < rect.x2; x += BAM_WIDGET_CACHE_READ_SIZE) {
+                    uint8_t* row = coverage + ((size_t) (y - widget->rect.y1) * (size_t) width) +
+                                   (x - widget->rect.x1);
+                    bam_rect_t read_rect;
+
+                    rect_init(&read_rect, x - offset_x, y - offset_y,
+                              min_int(BAM_WIDGET_CACHE_READ_SIZE, rect.x2 - x), 1);
+                    bam->vtable->read_tile(&read_rect, pixels, BAM_WIDGET_CACHE_READ_SIZE, bam->user_data);
+
+                    for (int i = 0; i < rect_width(&read_rect); i++) {
+                        row[i] = color_coverage(bam, pixels[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+static void widget_cache_prepare(bam_t* bam, const bam_widget_t* widget) {
+    bam_widget_handle_t handle = widget - bam->widget_buffer_begin;
+    size_t size = (size_t) rect_width(&widget->rect) * (size_t) rect_height(&widget->rect);
+    bam_widget_cache_entry_t* entry = NULL;
+
+    if (!widget_cache_eligible(bam, widget) || widget_cache_find(bam, widget)) {
+        return;
+    }
+
+    // widget cannot be cached if it is too large, so it is drawn normally instead
+    if (size > (size_t) (bam->widget_cache_buffer_end - bam->widget_cache_buffer_begin)) {
+        return;
+    }
+
+    // stale entry for widget is dropped, but its coverage stays allocated until cache is next evicted
+    for (size_t i = 0; i < bam->n_widget_cache_entries; i++) {
+        if (bam->widget_cache[i].widget == handle) {
+            entry = &bam->widget_cache[i];
+        }
+    }
+
+    // if cache is full, evict all entries
+    if (bam->n_widget_cache_entries >= BAM__WIDGET_CACHE_N_ENTRIES ||
+        size > (size_t) (bam->widget_cache_buffer_end - bam->widget_cache_buffer_ptr)) {
+        bam->widget_cache_buffer_ptr = bam->widget_cache_buffer_begin;
+        bam->n_widget_cache_entries = 0;
+        entry = NULL;
+    }
+
+    if (!entry) {
+        entry = &bam->widget_cache[bam->n_widget_cache_entries++];
+    }
+
+    entry->widget = handle;
+    entry->signature = widget_cache_signature(widget);
+    entry->coverage = bam->widget_cache_buffer_ptr;
+    bam->widget_cache_buffer_ptr += size;
+
+    widget_cache_capture(bam, widget, entry->coverage);
+}
+
+
+void bam_init_widget_cache(bam_t* bam, uint8_t* cache_buffer, size_t cache_buffer_size) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(cache_buffer || cache_buffer_size == 0);
+    BAM_ASSERT(cache_buffer_size == 0 || bam->vtable->read_tile);
+
+    bam->widget_cache_buffer_begin = cache_buffer;
+    bam->widget_cache_buffer_end = cache_buffer + cache_buffer_size;
+    bam->widget_cache_buffer_ptr = cache_buffer;
+    bam->n_widget_cache_entries = 0;
+}
+
+
+// ******** LAYER API ********
+
+void bam_set_widget_layer(bam_t* bam, bam_widget_handle_t widget, bam_layer_t layer) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    if (dirty_widget_layer(_widget) == layer) {
+        return;
+    }
+
+    // widget is made dirty both before and after the change, so that a base layer cache is discarded whether widget
+    // is joining or leaving base layer
+    widget_make_dirty(bam, _widget);
+
+    _widget->flags &= ~(BAM_WIDGET_FLAG_BASE | BAM_WIDGET_FLAG_OVERLAY);
+
+    if (layer == BAM_LAYER_BASE) {
+        _widget->flags |= BAM_WIDGET_FLAG_BASE;
+    } else if (layer == BAM_LAYER_OVERLAY) {
+        _widget->flags |= BAM_WIDGET_FLAG_OVERLAY;
+    }
+
+    widget_make_dirty(bam, _widget);
+}
+
+
+bam_layer_t bam_get_widget_layer(const bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    return dirty_widget_layer(widget_from_handle(bam, widget));
+}
+
+
+void bam_render_base_layer(bam_t* bam, bam_image_t* cache, bam_color_t* pixels) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(cache);
+    BAM_ASSERT(pixels);
+    BAM_ASSERT(bam->vtable->read_tile);
+
+    const int disp_width = bam->disp_width;
+    const int disp_height = bam->disp_height;
+    bam_rect_t rect;
+
+    // base layer is rendered one tile at a time, as for display, but read back into pixels instead of being copied
+    // to display
+    for (int offset_y = 0; offset_y < disp_height; offset_y += bam->tile_height) {
+        for (int offset_x = 0; offset_x < disp_width; offset_x += bam->tile_width) {
+            bam_draw_state_t saved_draw_state = bam->draw_state;
+
+            rect_init(&rect, offset_x, offset_y, min_int(bam->tile_width, disp_width - offset_x),
+                      min_int(bam->tile_height, disp_height - offset_y));
+
+            draw_set_translation(bam, -offset_x, -offset_y);
+            draw_set_clip(bam, &rect);
+            draw_fill(bam, &rect, bam->background_color);
+            dirty_draw_layer(bam, &rect, BAM_LAYER_BASE);
+
+            bam->draw_state = saved_draw_state;
+            rect_set_pos(&rect, 0, 0);
+
+            bam->vtable->read_tile(&rect, pixels + ((size_t) offset_y * (size_t) disp_width) + offset_x,
+                                   (size_t) disp_width, bam->user_data);
+        }
+    }
+
+    cache->format = BAM_IMAGE_FORMAT_RAW;
+    cache->width = disp_width;
+    cache->height = disp_height;
+    cache->row_index = NULL;
+    cache->data = pixels;
+}
+
+
+void bam_set_base_layer_cache(bam_t* bam, const bam_image_t* cache) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(!cache || bam->vtable->draw_pixels);
+    BAM_ASSERT(!cache || (cache->width == bam->disp_width && cache->height == bam->disp_height));
+
+    // cache is expected to match what base widgets would draw, so display doesn't need to be redrawn
+    bam->base_cache = cache;
+}
+
+
+void bam_delete_overlay_widgets(bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    // overlays (popups, toasts, etc.) are added after the widgets they cover, so are found at top of widget buffer,
+    // and removing them leaves handles of remaining widgets unchanged
+    while (bam->widget_buffer_ptr > bam->widget_buffer_begin &&
+           (bam->widget_buffer_ptr[-1].flags & BAM_WIDGET_FLAG_OVERLAY)) {
+        bam_widget_t* widget = bam->widget_buffer_ptr - 1;
+
+        if (bam->pressed_widget == widget) {
+            bam->pressed_widget = NULL;
+        }
+
+        bam_cancel_animations(bam, widget - bam->widget_buffer_begin);
+        bam->widget_buffer_ptr--;
+
+        // overlay may have moved while its changes were held back
+        if (widget->flags & BAM_WIDGET_FLAG_THROTTLED) {
+            bam->n_throttled_widgets--;
+            dirty_mark_rect(bam, &widget->throttled_rect);
+        }
+
+        // area is recomposed from base layer (or its cache) and whatever dynamic widgets are beneath
+        dirty_mark_rect(bam, &widget->rect);
+    }
+}
+
+
+// ******** OUTLINE FONTS ********
+
+#define BAM_OUTLINE_TAG(a, b, c, d)     ((((uint32_t) (a)) << 24) | (((uint32_t) (b)) << 16) | \
+                                         (((uint32_t) (c)) << 8) | ((uint32_t) (d)))
+
+#define BAM_OUTLINE_FIX_SHIFT           16
+#define BAM_OUTLINE_FIX_ONE             (((int64_t) 1) << BAM_OUTLINE_FIX_SHIFT)
+
+#define BAM_OUTLINE_MAX_DEPTH           4
+#define BAM_OUTLINE_MAX_SEGMENTS        32
+
+#define BAM_OUTLINE_FLAG_ON_CURVE       0x01u
+#define BAM_OUTLINE_FLAG_X_SHORT        0x02u
+#define BAM_OUTLINE_FLAG_Y_SHORT        0x04u
+#define BAM_OUTLINE_FLAG_REPEAT         0x08u
+#define BAM_OUTLINE_FLAG_X_SAME         0x10u
+#define BAM_OUTLINE_FLAG_Y_SAME         0x20u
+
+#define BAM_OUTLINE_COMPONENT_WORDS     0x0001u
+#define BAM_OUTLINE_COMPONENT_XY        0x0002u
+#define BAM_OUTLINE_COMPONENT_SCALE     0x0008u
+#define BAM_OUTLINE_COMPONENT_MORE      0x0020u
+#define BAM_OUTLINE_COMPONENT_XY_SCALE  0x0040u
+#define BAM_OUTLINE_COMPONENT_2X2       0x0080u
+
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    uint8_t flags;
+} bam_outline_point_t;
+
+
+typedef struct {
+    const bam_outline_font_t* font;
+    int32_t* acc;
+    int width;
+    int height;
+    int64_t scale;
+    int64_t origin_x;
+    int64_t origin_y;
+    bam_outline_point_t* points;
+    size_t max_points;
+} bam_outline_raster_t;
+
+
+static uint16_t outline_u16(const uint8_t* data) {
+    return (uint16_t) ((data[0] << 8) | data[1]);
+}
+
+
+static int16_t outline_i16(const uint8_t* data) {
+    return (int16_t) outline_u16(data);
+}
+
+
+static uint32_t outline_u32(const uint8_t* data) {
+    return (((uint32_t) data[0]) << 24) | (((uint32_t) data[1]) << 16) | (((uint32_t) data[2]) << 8) | data[3];
+}
+
+
+static int64_t outline_fix_mul(int64_t a, int64_t b) {
+    return (a * b) / BAM_OUTLINE_FIX_ONE;
+}
+
+
+static int64_t outline_fix_floor(int64_t value) {
+    return value & ~(BAM_OUTLINE_FIX_ONE - 1);
+}
+
+
+static int64_t outline_fix_ceil(int64_t value) {
+    return outline_fix_floor(value + BAM_OUTLINE_FIX_ONE - 1);
+}
+
+
+static const uint8_t* outline_find_table(const uint8_t* blob, size_t blob_size, uint32_t tag, size_t min_size,
+                                         size_t* table_size) {
+    size_t n_tables;
+
+    // blob starts with an offset table, giving number of tables, followed by a 16 byte record for each table
+    if (blob_size < 12) {
+        return NULL;
+    }
+
+    n_tables = outline_u16(blob + 4);
+
+    if (blob_size < 12 + (n_tables * 16)) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n_tables; i++) {
+        const uint8_t* record = blob + 12 + (i * 16);
+        size_t offset = outline_u32(record + 8);
+        size_t length = outline_u32(record + 12);
+
+        if (outline_u32(record) == tag) {
+            if (offset > blob_size || length > blob_size - offset || length < min_size) {
+                return NULL;
+            }
+
+            if (table_size) {
+                *table_size = length;
+            }
+
+            return blob + offset;
+        }
+    }
+
+    return NULL;
+}
+
+
+static bool outline_select_cmap(bam_outline_font_t* font, const uint8_t* cmap, size_t cmap_size) {
+    size_t n_records;
+
+    if (cmap_size < 4) {
+        return false;
+    }
+
+    n_records = outline_u16(cmap + 2);
+
+    if (cmap_size < 4 + (n_records * 8)) {
+        return false;
+    }
+
+    font->cmap = NULL;
+
+    // format 12 subtables cover all of unicode, so are preferred to format 4 subtables, which only cover the BMP
+    for (size_t i = 0; i < n_records; i++) {
+        size_t offset = outline_u32(cmap + 4 + (i * 8) + 4);
+        const uint8_t* subtable = cmap + offset;
+        size_t size;
+
+        // every subtable format considered has at least 16 bytes of header
+        if (offset > cmap_size || cmap_size - offset < 16) {
+            continue;
+        }
+
+        if (outline_u16(subtable) == 12) {
+            size = outline_u32(subtable + 4);
+
+            if (size <= cmap_size - offset && size >= 16 && (size - 16) / 12 >= outline_u32(subtable + 12)) {
+                font->cmap = subtable;
+                font->cmap_size = size;
+                font->cmap_format = 12;
+                return true;
+            }
+        } else if (outline_u16(subtable) == 4 && !font->cmap) {
+            size = outline_u16(subtable + 2);
+
+            if (size <= cmap_size - offset && size >= 16 + ((size_t) outline_u16(subtable + 6) * 4)) {
+                font->cmap = subtable;
+                font->cmap_size = size;
+                font->cmap_format = 4;
+            }
+        }
+    }
+
+    return font->cmap != NULL;
+}
+
+
+static uint16_t outline_find_glyph(const bam_outline_font_t* font, bam_unichar_t codepoint) {
+    const uint8_t* cmap = font->cmap;
+    size_t lo = 0;
+    size_t hi;
+
+    if (font->cmap_format == 12) {
+        // groups of consecutive codepoints mapping to consecutive glyphs, sorted by start codepoint
+        hi = outline_u32(cmap + 12);
+
+        while (lo < hi) {
+            size_t mid = lo + ((hi - lo) / 2);
+            const uint8_t* group = cmap + 16 + (mid * 12);
+
+            if (codepoint < outline_u32(group)) {
+                hi = mid;
+            } else if (codepoint > outline_u32(group + 4)) {
+                lo = mid + 1;
+            } else {
+                return (uint16_t) (outline_u32(group + 8) + (codepoint - outline_u32(group)));
+            }
+        }
+    } else if (codepoint <= 0xFFFFu) {
+        // segments sorted by end codepoint, stored as parallel arrays of end codes, start codes, deltas and range
+        // offsets
+        size_t n_segments = outline_u16(cmap + 6) / 2;
+        const uint8_t* end_codes = cmap + 14;
+        const uint8_t* start_codes = end_codes + (n_segments * 2) + 2;
+        const uint8_t* deltas = start_codes + (n_segments * 2);
+        const uint8_t* range_offsets = deltas + (n_segments * 2);
+        const uint8_t* index;
+        uint16_t glyph;
+
+        hi = n_segments;
+
+        while (lo < hi) {
+            size_t mid = lo + ((hi - lo) / 2);
+
+            if (outline_u16(end_codes + (mid * 2)) < codepoint) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo >= n_segments || codepoint < outline_u16(start_codes + (lo * 2))) {
+            return 0;
+        }
+
+        if (outline_u16(range_offsets + (lo * 2)) == 0) {
+            return (uint16_t) (codepoint + outline_u16(deltas + (lo * 2)));
+        }
+
+        index = range_offsets + (lo * 2) + outline_u16(range_offsets + (lo * 2)) +
+                ((codepoint - outline_u16(start_codes + (lo * 2))) * 2);
+
+        if (index + 2 > cmap + font->cmap_size) {
+            return 0;
+        }
+
+        glyph = outline_u16(index);
+
+        return glyph ? (uint16_t) (glyph + outline_u16(deltas + (lo * 2))) : 0;
+    }
+
+    return 0;
+}
+
+
+static bool outline_get_glyph_data(const bam_outline_font_t* font, uint16_t glyph, const uint8_t** data,
+                                   size_t* size) {
+    size_t offset;
+    size_t end;
+
+    if (glyph >= font->n_glyphs) {
+        return false;
+    }
+
+    if (font->long_loca) {
+        offset = outline_u32(font->loca + (glyph * 4));
+        end = outline_u32(font->loca + (glyph * 4) + 4);
+    } else {
+        offset = (size_t) outline_u16(font->loca + (glyph * 2)) * 2;
+        end = (size_t) outline_u16(font->loca + (glyph * 2) + 2) * 2;
+    }
+
+    // glyphs without outlines (e.g. space) have no data, but those with outlines have at least a header
+    if (offset > end || end > font->glyf_size || (end > offset && end - offset < 10)) {
+        return false;
+    }
+
+    *data = font->glyf + offset;
+    *size = end - offset;
+
+    return true;
+}
+
+
+static void outline_raster_line(bam_outline_raster_t* raster, int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+    const int width = raster->width;
+    int64_t dir = 1;
+    int64_t dxdy;
+    int64_t x;
+    int row_end;
+
+    // accumulates signed area covered by line into cells it crosses, for every row it spans (coordinates are
+    // in pixels, as 16.16 fixed point)
+    if (y0 == y1) {
+        return;
+    }
+
+    if (y0 > y1) {
+        int64_t temp;
+
+        temp = x0; x0 = x1; x1 = temp;
+        temp = y0; y0 = y1; y1 = temp;
+        dir = -1;
+    }
+
+    dxdy = ((x1 - x0) * BAM_OUTLINE_FIX_ONE) / (y1 - y0);
+    x = x0;
+    row_end = min_int((int) (outline_fix_ceil(y1) >> BAM_OUTLINE_FIX_SHIFT), raster->height);
+
+    for (int row = (int) (y0 >> BAM_OUTLINE_FIX_SHIFT); row < row_end; row++) {
+        int32_t* line = raster->acc + ((size_t) row * width);
+        int64_t row_top = ((int64_t) row) << BAM_OUTLINE_FIX_SHIFT;
+        int64_t dy = ((y1 < row_top + BAM_OUTLINE_FIX_ONE) ? y1 : row_top + BAM_OUTLINE_FIX_ONE) -
+                     ((y0 > row_top) ? y0 : row_top);
+        int64_t x_next = x + outline_fix_mul(dxdy, dy);
+        int64_t d = dy * dir;
+        int64_t xa = (x < x_next) ? x : x_next;
+        int64_t xb = (x < x_next) ? x_next : x;
+        int xai = (int) (xa >> BAM_OUTLINE_FIX_SHIFT);
+        int xbi = (int) (outline_fix_ceil(xb) >> BAM_OUTLINE_FIX_SHIFT);
+        int64_t xaf = xa - outline_fix_floor(xa);
+
+        if (xbi <= xai + 1) {
+            // line stays within one cell, so area is split between it and the next by line's mean position
+            int64_t xmf = ((x + x_next) / 2) - outline_fix_floor(xa);
+
+            line[xai] += (int32_t) (d - outline_fix_mul(d, xmf));
+            line[xai + 1] += (int32_t) outline_fix_mul(d, xmf);
+        } else {
+            // line crosses several cells, the first and last get triangular areas and those between get equal
+            // shares of the rest
+            int64_t s = (BAM_OUTLINE_FIX_ONE * BAM_OUTLINE_FIX_ONE) / (xb - xa);
+            int64_t xbf = xb - outline_fix_ceil(xb) + BAM_OUTLINE_FIX_ONE;
+            int64_t a0 = outline_fix_mul(s, outline_fix_mul(BAM_OUTLINE_FIX_ONE - xaf, BAM_OUTLINE_FIX_ONE - xaf)) / 2;
+            int64_t am = outline_fix_mul(s, outline_fix_mul(xbf, xbf)) / 2;
+
+            line[xai] += (int32_t) outline_fix_mul(d, a0);
+
+            if (xbi == xai + 2) {
+                line[xai + 1] += (int32_t) outline_fix_mul(d, BAM_OUTLINE_FIX_ONE - a0 - am);
+            } else {
+                int64_t a1 = outline_fix_mul(s, BAM_OUTLINE_FIX_ONE + (BAM_OUTLINE_FIX_ONE / 2) - xaf);
+                int64_t a2 = a1 + ((xbi - xai - 3) * s);
+
+                line[xai + 1] += (int32_t) outline_fix_mul(d, a1 - a0);
+
+                for (int xi = xai + 2; xi < xbi - 1; xi++) {
+                    line[xi] += (int32_t) outline_fix_mul(d, s);
+                }
+
+                line[xbi - 1] += (int32_t) outline_fix_mul(d, BAM_OUTLINE_FIX_ONE - a2 - am);
+            }
+
+            line[xbi] += (int32_t) outline_fix_mul(d, am);
+        }
+
+        x = x_next;
+    }
+}
+
+
+static void outline_raster_quad(bam_outline_raster_t* raster, int64_t x0, int64_t y0, int64_t cx, int64_t cy,
+                                int64_t x1, int64_t y1) {
+    int64_t ddx = x0 - (2 * cx) + x1;
+    int64_t ddy = y0 - (2 * cy) + y1;
+    uint64_t deviation = (uint64_t) ((ddx >> 8) * (ddx >> 8) + (ddy >> 8) * (ddy >> 8));
+    int n = 1 + (int) (prim_isqrt(prim_isqrt(deviation * 3)) / 16);
+    int64_t prev_x = x0;
+    int64_t prev_y = y0;
+
+    // curve is flattened into enough line segments that they deviate from it by a fraction of a pixel (deviation
+    // is squared distance in pixels as 16.16 fixed point, so its fourth root is in 28.4 fixed point)
+    n = min_int(n, BAM_OUTLINE_MAX_SEGMENTS);
+
+    for (int i = 1; i <= n; i++) {
+        int64_t t = (i * BAM_OUTLINE_FIX_ONE) / n;
+        int64_t mt = BAM_OUTLINE_FIX_ONE - t;
+        int64_t a = outline_fix_mul(mt, mt);
+        int64_t b = 2 * outline_fix_mul(t, mt);
+        int64_t c = outline_fix_mul(t, t);
+        int64_t x = outline_fix_mul(a, x0) + outline_fix_mul(b, cx) + outline_fix_mul(c, x1);
+        int64_t y = outline_fix_mul(a, y0) + outline_fix_mul(b, cy) + outline_fix_mul(c, y1);
+
+        outline_raster_line(raster, prev_x, prev_y, x, y);
+        prev_x = x;
+        prev_y = y;
+    }
+}
+
+
+static void outline_map_point(const bam_outline_raster_t* raster, const bam_outline_point_t* point, int dx, int dy,
+                              int64_t* x, int64_t* y) {
+    // font units (y up) to pixels within glyph's bitmap (y down), clamped so that accumulation stays in bounds
+    *x = ((point->x + dx) * raster->scale) - raster->origin_x;
+    *y = raster->origin_y - ((point->y + dy) * raster->scale);
+
+    *x = (*x < 0) ? 0 : (*x > (((int64_t) raster->width - 1) << BAM_OUTLINE_FIX_SHIFT)) ?
+         (((int64_t) raster->width - 1) << BAM_OUTLINE_FIX_SHIFT) : *x;
+    *y = (*y < 0) ? 0 : (*y > (((int64_t) raster->height) << BAM_OUTLINE_FIX_SHIFT)) ?
+         (((int64_t) raster->height) << BAM_OUTLINE_FIX_SHIFT) : *y;
+}
+
+
+static void outline_raster_contour(bam_outline_raster_t* raster, const bam_outline_point_t* first,
+                                   const bam_outline_point_t* last, int dx, int dy) {
+    const bam_outline_point_t* point_i = first;
+    const bam_outline_point_t* point_e = last + 1;
+    int64_t start_x;
+    int64_t start_y;
+    int64_t pen_x;
+    int64_t pen_y;
+    int64_t ctrl_x = 0;
+    int64_t ctrl_y = 0;
+    bool have_ctrl = false;
+
+    // contour starts at first on-curve point, or midway between first and last points if both are off-curve
+    if (first->flags & BAM_OUTLINE_FLAG_ON_CURVE) {
+        outline_map_point(raster, first, dx, dy, &start_x, &start_y);
+        point_i++;
+    } else if (last->flags & BAM_OUTLINE_FLAG_ON_CURVE) {
+        outline_map_point(raster, last, dx, dy, &start_x, &start_y);
+        point_e--;
+    } else {
+        int64_t last_x;
+        int64_t last_y;
+
+        outline_map_point(raster, first, dx, dy, &start_x, &start_y);
+        outline_map_point(raster, last, dx, dy, &last_x, &last_y);
+        start_x = (start_x + last_x) / 2;
+        start_y = (start_y + last_y) / 2;
+    }
+
+    pen_x = start_x;
+    pen_y = start_y;
+
+    // consecutive off-curve points have an implied on-curve point midway between them
+    for (; point_i < point_e; point_i++) {
+        int64_t x;
+        int64_t y;
+
+        outline_map_point(raster, point_i, dx, dy, &x, &y);
+
+        if (point_i->flags & BAM_OUTLINE_FLAG_ON_CURVE) {
+            if (have_ctrl) {
+                outline_raster_quad(raster, pen_x, pen_y, ctrl_x, ctrl_y, x, y);
+            } else {
+                outline_raster_line(raster, pen_x, pen_y, x, y);
+            }
+
+            pen_x = x;
+            pen_y = y;
+            have_ctrl = false;
+        } else {
+            if (have_ctrl) {
+                int64_t mid_x = (ctrl_x + x) / 2;
+                int64_t mid_y = (ctrl_y + y) / 2;
+
+                outline_raster_quad(raster, pen_x, pen_y, ctrl_x, ctrl_y, mid_x, mid_y);
+                pen_x = mid_x;
+                pen_y = mid_y;
+            }
+
+            ctrl_x = x;
+            ctrl_y = y;
+            have_ctrl = true;
+        }
+    }
+
+    if (have_ctrl) {
+        outline_raster_quad(raster, pen_x, pen_y, ctrl_x, ctrl_y, start_x, start_y);
+    } else {
+        outline_raster_line(raster, pen_x, pen_y, start_x, start_y);
+    }
+}
+
+
+static bool outline_raster_simple(bam_outline_raster_t* raster, const uint8_t* data, size_t size, int n_contours,
+                                  int dx, int dy) {
+    const uint8_t* data_e = data + size;
+    const uint8_t* end_points = data + 10;
+    const uint8_t* ptr;
+    bam_outline_point_t* points = raster->points;
+    size_t n_points;
+    size_t first;
+    int32_t value;
+
+    if (n_contours == 0) {
+        return true;
+    }
+
+    if (size < 12 + ((size_t) n_contours * 2)) {
+        return false;
+    }
+
+    n_points = (size_t) outline_u16(end_points + ((n_contours - 1) * 2)) + 1;
+    ptr = end_points + (n_contours * 2);
+    ptr += 2 + outline_u16(ptr);
+
+    if (n_points > raster->max_points || ptr > data_e) {
+        return false;
+    }
+
+    // flags, which may be run-length encoded
+    for (size_t i = 0; i < n_points;) {
+        uint8_t flags;
+        size_t repeat = 0;
+
+        if (ptr >= data_e) {
+            return false;
+        }
+
+        flags = *ptr++;
+
+        if (flags & BAM_OUTLINE_FLAG_REPEAT) {
+            if (ptr >= data_e) {
+                return false;
+            }
+
+            repeat = *ptr++;
+        }
+
+        for (size_t k = 0; k <= repeat && i < n_points; k++) {
+            points[i++].flags = flags;
+        }
+    }
+
+    // x then y coordinates, each as a delta from previous point's that is either a byte with sign taken from flags,
+    // a 16-bit word, or omitted if unchanged
+    value = 0;
+
+    for (size_t i = 0; i < n_points; i++) {
+        uint8_t flags = points[i].flags;
+
+        if (flags & BAM_OUTLINE_FLAG_X_SHORT) {
+            if (ptr + 1 > data_e) {
+                return false;
+            }
+
+            value += (flags & BAM_OUTLINE_FLAG_X_SAME) ? *ptr : -*ptr;
+            ptr += 1;
+        } else if (!(flags & BAM_OUTLINE_FLAG_X_SAME)) {
+            if (ptr + 2 > data_e) {
+                return false;
+            }
+
+            value += outline_i16(ptr);
+            ptr += 2;
+        }
+
+        points[i].x = (int16_t) value;
+    }
+
+    value = 0;
+
+    for (size_t i = 0; i < n_points; i++) {
+        uint8_t flags = points[i].flags;
+
+        if (flags & BAM_OUTLINE_FLAG_Y_SHORT) {
+            if (ptr + 1 > data_e) {
+                return false;
+            }
+
+            value += (flags & BAM_OUTLINE_FLAG_Y_SAME) ? *ptr : -*ptr;
+            ptr += 1;
+        } else if (!(flags & BAM_OUTLINE_FLAG_Y_SAME)) {
+            if (ptr + 2 > data_e) {
+                return false;
+            }
+
+            value += outline_i16(ptr);
+            ptr += 2;
+        }
+
+        points[i].y = (int16_t) value;
+    }
+
+    first = 0;
+
+    for (int contour = 0; contour < n_contours; contour++) {
+        size_t last = outline_u16(end_points + (contour * 2));
+
+        if (last < first || last >= n_points) {
+            return false;
+        }
+
+        outline_raster_contour(raster, points + first, points + last, dx, dy);
+        first = last + 1;
+    }
+
+    return true;
+}
+
+
+static bool outline_raster_glyph(bam_outline_raster_t* raster, uint16_t glyph, int dx, int dy, int depth) {
+    const uint8_t* data;
+    const uint8_t* ptr;
+    size_t size;
+    int n_contours;
+    uint16_t flags;
+
+    if (!outline_get_glyph_data(raster->font, glyph, &data, &size)) {
+        return false;
+    }
+
+    if (size == 0) {
+        return true;
+    }
+
+    n_contours = outline_i16(data);
+
+    if (n_contours >= 0) {
+        return outline_raster_simple(raster, data, size, n_contours, dx, dy);
+    }
+
+    // composite glyphs are built from other glyphs, each offset by a vector (transformations are not supported, so
+    // components are drawn unscaled)
+    if (depth >= BAM_OUTLINE_MAX_DEPTH) {
+        return false;
+    }
+
+    ptr = data + 10;
+
+    do {
+        int arg1;
+        int arg2;
+
+        if (ptr + 4 > data + size) {
+            return false;
+        }
+
+        flags = outline_u16(ptr);
+        glyph = outline_u16(ptr + 2);
+        ptr += 4;
+
+        if (flags & BAM_OUTLINE_COMPONENT_WORDS) {
+            if (ptr + 4 > data + size) {
+                return false;
+            }
+
+            arg1 = outline_i16(ptr);
+            arg2 = outline_i16(ptr + 2);
+            ptr += 4;
+        } else {
+            if (ptr + 2 > data + size) {
+                return false;
+            }
+
+            arg1 = (int8_t) ptr[0];
+            arg2 = (int8_t) ptr[1];
+            ptr += 2;
+        }
+
+        ptr += (flags & BAM_OUTLINE_COMPONENT_SCALE) ? 2 : (flags & BAM_OUTLINE_COMPONENT_XY_SCALE) ? 4 :
+               (flags & BAM_OUTLINE_COMPONENT_2X2) ? 8 : 0;
+
+        // components positioned by matching points are drawn without an offset
+        if (!(flags & BAM_OUTLINE_COMPONENT_XY)) {
+            arg1 = 0;
+            arg2 = 0;
+        }
+
+        if (!outline_raster_glyph(raster, glyph, dx + arg1, dy + arg2, depth + 1)) {
+            return false;
+        }
+    } while (flags & BAM_OUTLINE_COMPONENT_MORE);
+
+    return true;
+}
+
+
+static int64_t outline_calc_scale(const bam_outline_face_t* face) {
+    return (((int64_t) face->size) << BAM_OUTLINE_FIX_SHIFT) / face->font->units_per_em;
+}
+
+
+static int outline_scale_round(int64_t scale, int value) {
+    return (int) ((((int64_t) value * scale) + (BAM_OUTLINE_FIX_ONE / 2)) >> BAM_OUTLINE_FIX_SHIFT);
+}
+
+
+static void outline_cache_evict_all(bam_outline_cache_t* cache) {
+    cache->count = 0;
+    cache->buffer_ptr = cache->buffer_begin;
+    cache->stats.n_evictions++;
+}
+
+
+static bool outline_rasterize(bam_outline_cache_t* cache, bam_outline_cache_entry_t* entry,
+                              const bam_outline_face_t* face, uint16_t glyph) {
+    const bam_outline_font_t* font = face->font;
+    bam_outline_raster_t raster;
+    const uint8_t* data;
+    size_t size;
+    size_t n_pixels;
+    size_t acc_size;
+    int64_t x1;
+    int64_t y1;
+    int64_t x2;
+    int64_t y2;
+    uint32_t start_time = 0;
+    int32_t sum;
+
+    if (!outline_get_glyph_data(font, glyph, &data, &size)) {
+        return false;
+    }
+
+    raster.font = font;
+    raster.scale = outline_calc_scale(face);
+
+    entry->x_advance = (int16_t) outline_scale_round(raster.scale, outline_u16(
+            font->hmtx + ((size_t) min_int(glyph, font->n_h_metrics - 1) * 4)));
+
+    // glyph without an outline has an empty bitmap
+    if (size == 0) {
+        entry->width = 0;
+        entry->height = 0;
+        entry->x_bearing = 0;
+        entry->y_bearing = 0;
+        entry->bitmap = NULL;
+        return true;
+    }
+
+    // bitmap covers glyph's bounding box rounded out to whole pixels, plus a column for coverage of right-hand edge
+    x1 = outline_fix_floor(outline_i16(data + 2) * raster.scale);
+    y1 = outline_fix_floor(outline_i16(data + 4) * raster.scale);
+    x2 = outline_fix_ceil(outline_i16(data + 6) * raster.scale);
+    y2 = outline_fix_ceil(outline_i16(data + 8) * raster.scale);
+
+    raster.width = (int) ((x2 - x1) >> BAM_OUTLINE_FIX_SHIFT) + 1;
+    raster.height = (int) ((y2 - y1) >> BAM_OUTLINE_FIX_SHIFT);
+    raster.origin_x = x1;
+    raster.origin_y = y2;
+
+    if (raster.width <= 0 || raster.height <= 0 || raster.width > INT16_MAX || raster.height > INT16_MAX) {
+        return false;
+    }
+
+    // scratch holds an accumulator for each pixel (plus one, for edges on last pixel), followed by glyph's points
+    n_pixels = (size_t) raster.width * (size_t) raster.height;
+    acc_size = n_pixels + 1;
+
+    if (acc_size > cache->scratch_size / sizeof(int32_t) ||
+        n_pixels > (size_t) (cache->buffer_end - cache->buffer_begin)) {
+        return false;
+    }
+
+    raster.acc = cache->scratch;
+    raster.points = (bam_outline_point_t*) (cache->scratch + acc_size);
+    raster.max_points = (cache->scratch_size - (acc_size * sizeof(int32_t))) / sizeof(bam_outline_point_t);
+
+    if (cache->clock) {
+        start_time = cache->clock(cache->clock_user_data);
+    }
+
+    memset(raster.acc, 0, acc_size * sizeof(int32_t));
+
+    if (!outline_raster_glyph(&raster, glyph, 0, 0, 0)) {
+        return false;
+    }
+
+    // if cache is full, evict all entries
+    if (cache->count >= cache->capacity || n_pixels > (size_t) (cache->buffer_end - cache->buffer_ptr)) {
+        outline_cache_evict_all(cache);
+    }
+
+    entry->bitmap = cache->buffer_ptr;
+    cache->buffer_ptr += n_pixels;
+
+    // coverage of each pixel is running sum of accumulated areas
+    sum = 0;
+
+    for (size_t i = 0; i < n_pixels; i++) {
+        int32_t coverage;
+
+        sum += raster.acc[i];
+        coverage = (sum < 0) ? -sum : sum;
+        entry->bitmap[i] = (coverage >= BAM_OUTLINE_FIX_ONE) ? 255 :
+                           (uint8_t) ((coverage * 255) >> BAM_OUTLINE_FIX_SHIFT);
+    }
+
+    entry->width = (int16_t) raster.width;
+    entry->height = (int16_t) raster.height;
+    entry->x_bearing = (int16_t) (x1 >> BAM_OUTLINE_FIX_SHIFT);
+    entry->y_bearing = (int16_t) (y2 >> BAM_OUTLINE_FIX_SHIFT);
+
+    // record statistics
+    cache->stats.n_rasterized++;
+
+    if (acc_size * sizeof(int32_t) > cache->stats.scratch_peak) {
+        cache->stats.scratch_peak = acc_size * sizeof(int32_t);
+    }
+
+    if (cache->clock) {
+        cache->stats.raster_time += cache->clock(cache->clock_user_data) - start_time;
+    }
+
+    if ((size_t) (cache->buffer_ptr - cache->buffer_begin) > cache->stats.memory_peak) {
+        cache->stats.memory_peak = (size_t) (cache->buffer_ptr - cache->buffer_begin);
+    }
+
+    return true;
+}
+
+
+// ******** OUTLINE FONT API ********
+
+bool bam_load_outline_font(bam_outline_font_t* font, const uint8_t* blob, size_t blob_size) {
+    BAM_ASSERT(font);
+    BAM_ASSERT(blob || blob_size == 0);
+
+    const uint8_t* head = outline_find_table(blob, blob_size, BAM_OUTLINE_TAG('h', 'e', 'a', 'd'), 54, NULL);
+    const uint8_t* hhea = outline_find_table(blob, blob_size, BAM_OUTLINE_TAG('h', 'h', 'e', 'a'), 36, NULL);
+    const uint8_t* maxp = outline_find_table(blob, blob_size, BAM_OUTLINE_TAG('m', 'a', 'x', 'p'), 6, NULL);
+    const uint8_t* cmap;
+    size_t cmap_size;
+    size_t loca_size;
+    size_t hmtx_size;
+    uint16_t glyph;
+    const uint8_t* data;
+    size_t size;
+
+    // blob is a TrueType font, of which only tables needed to rasterize quadratic outlines are used
+    cmap = outline_find_table(blob, blob_size, BAM_OUTLINE_TAG('c', 'm', 'a', 'p'), 4, &cmap_size);
+    font->loca = outline_find_table(blob, blob_size, BAM_OUTLINE_TAG('l', 'o', 'c', 'a'), 0, &loca_size);
+    font->glyf = outline_find_table(blob, blob_size, BAM_OUTLINE_TAG('g', 'l', 'y', 'f'), 0, &font->glyf_size);
+    font->hmtx = outline_find_table(blob, blob_size, BAM_OUTLINE_TAG('h', 'm', 't', 'x'), 4, &hmtx_size);
+
+    if (!head || !hhea || !maxp || !cmap || !font->loca || !font->glyf || !font->hmtx) {
+        return false;
+    }
+
+    font->units_per_em = outline_u16(head + 18);
+    font->long_loca = outline_i16(head + 50) != 0;
+    font->ascender = outline_i16(hhea + 4);
+    font->descender = outline_i16(hhea + 6);
+    font->line_gap = outline_i16(hhea + 8);
+    font->n_h_metrics = outline_u16(hhea + 34);
+    font->n_glyphs = outline_u16(maxp + 4);
+
+    // validate tables' sizes, so that lookups never need to
+    if (font->units_per_em == 0 || font->n_h_metrics == 0 || (size_t) font->n_h_metrics * 4 > hmtx_size ||
+        ((size_t) font->n_glyphs + 1) * (font->long_loca ? 4 : 2) > loca_size ||
+        !outline_select_cmap(font, cmap, cmap_size)) {
+        return false;
+    }
+
+    // vertical center line is taken from height of capital H if font has one
+    font->cap_height = (int16_t) ((font->ascender * 2) / 3);
+    glyph = outline_find_glyph(font, 'H');
+
+    if (glyph && outline_get_glyph_data(font, glyph, &data, &size) && size > 0) {
+        font->cap_height = outline_i16(data + 8);
+    }
+
+    return true;
+}
+
+
+void bam_init_outline_cache(bam_outline_cache_t* cache, bam_outline_cache_entry_t* entries, size_t n_entries,
+                            uint8_t* buffer, size_t buffer_size, int32_t* scratch, size_t scratch_size) {
+    BAM_ASSERT(cache);
+    BAM_ASSERT(entries || n_entries == 0);
+    BAM_ASSERT(buffer || buffer_size == 0);
+    BAM_ASSERT(scratch || scratch_size == 0);
+
+    cache->entries = entries;
+    cache->capacity = n_entries;
+    cache->count = 0;
+    cache->buffer_begin = buffer;
+    cache->buffer_end = buffer + buffer_size;
+    cache->buffer_ptr = buffer;
+    cache->scratch = scratch;
+    cache->scratch_size = scratch_size;
+    cache->clock = NULL;
+    cache->clock_user_data = NULL;
+
+    bam_reset_outline_cache_stats(cache);
+}
+
+
+void bam_set_outline_cache_clock(bam_outline_cache_t* cache, bam_outline_clock_t clock, void* user_data) {
+    BAM_ASSERT(cache);
+
+    cache->clock = clock;
+    cache->clock_user_data = user_data;
+}
+
+
+void bam_get_outline_font_metrics(bam_font_metrics_t* metrics, const bam_outline_face_t* face) {
+    BAM_ASSERT(metrics);
+    BAM_ASSERT(face && face->font);
+
+    int64_t scale = outline_calc_scale(face);
+
+    metrics->ascent = outline_scale_round(scale, face->font->ascender);
+    metrics->descent = outline_scale_round(scale, -face->font->descender);
+    metrics->center = outline_scale_round(scale, face->font->cap_height / 2);
+    metrics->line_height = metrics->ascent + metrics->descent + outline_scale_round(scale, face->font->line_gap);
+}
+
+
+bool bam_get_outline_glyph_metrics(bam_outline_cache_t* cache, bam_glyph_metrics_t* metrics,
+                                   const bam_outline_face_t* face, bam_unichar_t codepoint) {
+    BAM_ASSERT(cache);
+    BAM_ASSERT(metrics);
+    BAM_ASSERT(face && face->font);
+
+    bam_outline_cache_entry_t* entry = NULL;
+    bam_outline_cache_entry_t new_entry;
+    uint16_t glyph;
+
+    // cache is keyed by font, size and codepoint, so faces of same font and size share glyphs
+    for (size_t i = 0; i < cache->count; i++) {
+        if (cache->entries[i].codepoint == codepoint && cache->entries[i].font == face->font &&
+            cache->entries[i].size == face->size) {
+            entry = &cache->entries[i];
+            cache->stats.n_hits++;
+            break;
+        }
+    }
+
+    if (!entry) {
+        cache->stats.n_misses++;
+
+        // codepoints that font doesn't cover are missing glyphs (rather than font's .notdef glyph)
+        glyph = outline_find_glyph(face->font, codepoint);
+
+        if (!glyph || cache->capacity == 0) {
+            return false;
+        }
+
+        new_entry.font = face->font;
+        new_entry.codepoint = codepoint;
+        new_entry.size = (int16_t) face->size;
+
+        if (!outline_rasterize(cache, &new_entry, face, glyph)) {
+            return false;
+        }
+
+        // rasterizing may have evicted all entries, so new entry is only added once it is complete
+        if (cache->count >= cache->capacity) {
+            outline_cache_evict_all(cache);
+        }
+
+        entry = &cache->entries[cache->count++];
+        *entry = new_entry;
+    }
+
+    // metrics' user data points at glyph's 8-bit coverage bitmap, whose pitch is its width
+    metrics->codepoint = codepoint;
+    metrics->width = entry->width;
+    metrics->height = entry->height;
+    metrics->x_bearing = entry->x_bearing;
+    metrics->y_bearing = entry->y_bearing;
+    metrics->x_advance = entry->x_advance;
+    metrics->user_data = entry->bitmap;
+
+    return true;
+}
+
+
+void bam_get_outline_cache_stats(const bam_outline_cache_t* cache, bam_outline_cache_stats_t* stats) {
+    BAM_ASSERT(cache);
+    BAM_ASSERT(stats);
+
+    *stats = cache->stats;
+    stats->n_entries = cache->count;
+    stats->entry_capacity = cache->capacity;
+    stats->memory_used = (size_t) (cache->buffer_ptr - cache->buffer_begin);
+    stats->memory_capacity = (size_t) (cache->buffer_end - cache->buffer_begin);
+    stats->scratch_capacity = cache->scratch_size;
+}
+
+
+void bam_reset_outline_cache_stats(bam_outline_cache_t* cache) {
+    BAM_ASSERT(cache);
+
+    memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
+
+// ******** WORK API ********
+
+static void work_submit(bam_t* bam, bam_widget_t* widget) {
+    bam_work_t* work = widget->work;
+
+    // ignore triggers while previous work is still in progress
+    if (work->busy) {
+        return;
+    }
+
+    work->busy = true;
+    widget->flags |= BAM_WIDGET_FLAG_BUSY;
+    widget_make_dirty(bam, widget);
+
+    // clean now, so that widget's release and busy indicator are visible while work runs, even if it runs inline
+    dirty_clean(bam);
+
+    if (bam->vtable->submit_work) {
+        bam->vtable->submit_work(work, bam->user_data);
+    } else {
+        bam_execute_work(work);
+    }
+}
+
+
+static void work_process(bam_t* bam) {
+    bam_work_t* work = atomic_exchange_explicit(&bam->completed_work, NULL, memory_order_acquire);
+    bam_work_t* ordered = NULL;
+
+    // completed work is pushed onto a stack, so reverse it to handle work in order of completion
+    while (work) {
+        bam_work_t* next = work->next;
+
+        work->next = ordered;
+        ordered = work;
+        work = next;
+    }
+
+    while (ordered) {
+        bam_widget_t* widget;
+
+        work = ordered;
+        ordered = work->next;
+        work->next = NULL;
+        work->busy = false;
+
+        // widgets may have been deleted while work was in progress, in which case there is nothing to update
+        widget = widget_from_handle(bam, work->widget);
+
+        if (widget < bam->widget_buffer_ptr && widget->work == work) {
+            widget->flags &= ~BAM_WIDGET_FLAG_BUSY;
+            widget_make_dirty(bam, widget);
+        }
+
+        if (work->done_func) {
+            work->done_func(bam, work->widget, work->user_data);
+        }
+    }
+}
+
+
+void bam_init_work(bam_work_t* work, bam_work_func_t func, bam_work_done_func_t done_func, void* user_data) {
+    BAM_ASSERT(work);
+    BAM_ASSERT(func);
+
+    work->next = NULL;
+    work->bam = NULL;
+    work->widget = 0;
+    work->func = func;
+    work->done_func = done_func;
+    work->user_data = user_data;
+    work->busy = false;
+}
+
+
+void bam_set_widget_work(bam_t* bam, bam_widget_handle_t widget, bam_work_t* work) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    if (work) {
+        BAM_ASSERT(!work->busy);
+
+        work->bam = bam;
+        work->widget = widget;
+    }
+
+    _widget->work = work;
+}
+
+
+bool bam_is_widget_busy(const bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    return (widget_from_handle(bam, widget)->flags & BAM_WIDGET_FLAG_BUSY) != 0;
+}
+
+
+void bam_execute_work(bam_work_t* work) {
+    BAM_ASSERT(work);
+    BAM_ASSERT(work->bam);
+
+    bam_t* bam = work->bam;
+    bam_work_t* head;
+
+    work->func(work->user_data);
+
+    // post work to completion stack - this is lock-free, so may be called from any thread
+    head = atomic_load_explicit(&bam->completed_work, memory_order_relaxed);
+
+    do {
+        work->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&bam->completed_work, &head, work, memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+
+// ******** KEYPAD API ********
+
+static bool keypad_key_disabled(const bam_keypad_t* keypad, size_t key) {
+    return (keypad->disabled[key / 32] & (1ul << (key % 32))) != 0;
+}
+
+
+static bool keypad_calc_pitch(const bam_widget_t* widget, int* pitch_x, int* pitch_y) {
+    const bam_keypad_t* keypad = widget->keypad;
+    const bam_keypad_layout_t* layout = keypad->layout;
+    int spacing = keypad->spacing;
+
+    // cells are laid out exactly as bam_layout_grid() would lay out individual widgets
+    *pitch_x = ((rect_width(&widget->rect) - (spacing * (layout->n_columns - 1))) / layout->n_columns) + spacing;
+    *pitch_y = ((rect_height(&widget->rect) - (spacing * (layout->n_rows - 1))) / layout->n_rows) + spacing;
+
+    return *pitch_x > spacing && *pitch_y > spacing;
+}
+
+
+static void keypad_calc_key_rect(const bam_widget_t* widget, size_t key, int pitch_x, int pitch_y,
+                                 bam_rect_t* rect) {
+    const bam_keypad_key_t* key_def = widget->keypad->layout->keys + key;
+    int spacing = widget->keypad->spacing;
+
+    rect_init(rect, widget->rect.x1 + (key_def->column * pitch_x), widget->rect.y1 + (key_def->row * pitch_y),
+              (key_def->column_span * pitch_x) - spacing, (key_def->row_span * pitch_y) - spacing);
+}
+
+
+static size_t keypad_find_key(const bam_widget_t* widget, int x, int y) {
+    const bam_keypad_t* keypad = widget->keypad;
+    const bam_keypad_layout_t* layout = keypad->layout;
+    int pitch_x;
+    int pitch_y;
+    int column;
+    int row;
+    size_t key;
+    bam_rect_t rect;
+
+    if (!keypad_calc_pitch(widget, &pitch_x, &pitch_y) || !rect_contains_point(&widget->rect, x, y)) {
+        return BAM_KEYPAD_NO_KEY;
+    }
+
+    // map coordinate to cell arithmetically, then cell to key via the cell map
+    column = (x - widget->rect.x1) / pitch_x;
+    row = (y - widget->rect.y1) / pitch_y;
+
+    if (column >= layout->n_columns || row >= layout->n_rows) {
+        return BAM_KEYPAD_NO_KEY;
+    }
+
+    key = keypad->cell_map[(row * layout->n_columns) + column];
+
+    if (key == BAM_KEYPAD_NO_KEY) {
+        return BAM_KEYPAD_NO_KEY;
+    }
+
+    // coordinate may lie in spacing between keys
+    keypad_calc_key_rect(widget, key, pitch_x, pitch_y, &rect);
+
+    return rect_contains_point(&rect, x, y) ? key : BAM_KEYPAD_NO_KEY;
+}
+
+
+static void keypad_mark_key(bam_t* bam, const bam_widget_t* widget, size_t key) {
+    int pitch_x;
+    int pitch_y;
+    bam_rect_t rect;
+
+    if (key != BAM_KEYPAD_NO_KEY && keypad_calc_pitch(widget, &pitch_x, &pitch_y)) {
+        keypad_calc_key_rect(widget, key, pitch_x, pitch_y, &rect);
+        widget_make_rect_dirty(bam, widget, &rect);
+    }
+}
+
+
+static void keypad_set_pressed_key(bam_t* bam, const bam_widget_t* widget, size_t key) {
+    bam_keypad_t* keypad = widget->keypad;
+
+    if (keypad->pressed_key != key) {
+        keypad_mark_key(bam, widget, keypad->pressed_key);
+        keypad->pressed_key = (uint8_t) key;
+        keypad_mark_key(bam, widget, keypad->pressed_key);
+    }
+}
+
+
+static const char* keypad_key_label(const bam_keypad_t* keypad, size_t key, bool shifted) {
+    const bam_keypad_key_t* key_def = keypad->layout->keys + key;
+    const char* label = (shifted && key_def->shifted_label) ? key_def->shifted_label : key_def->label;
+
+    // keys without a label of their own take it from the keypad's label table, indexed by key code
+    if (!label && keypad->labels) {
+        label = keypad->labels[key_def->code];
+    }
+
+    return label ? label : "";
+}
+
+
+static void keypad_draw_key(bam_t* bam, const bam_widget_t* widget, size_t key, int pitch_x, int pitch_y) {
+    const bam_keypad_t* keypad = widget->keypad;
+    const bam_keypad_key_t* key_def = keypad->layout->keys + key;
+    const bam_style_t* style = widget->style;
+    bam_draw_state_t saved_draw_state = bam->draw_state;
+    bam_state_t state;
+    const char* label;
+    bam_rect_t rect;
+    bam_rect_t inner;
+
+    if (key_def->style_index < keypad->n_styles) {
+        style = widget_get_style(bam, keypad->styles[key_def->style_index]);
+    }
+
+    if (widget->state == BAM_STATE_DISABLED || keypad_key_disabled(keypad, key)) {
+        state = BAM_STATE_DISABLED;
+    } else if (keypad->pressed_key == key && bam->pressed_inside) {
+        state = BAM_STATE_PRESSED;
+    } else {
+        state = BAM_STATE_ENABLED;
+    }
+
+    keypad_calc_key_rect(widget, key, pitch_x, pitch_y, &rect);
+    draw_background(bam, &rect, style, style->colors[state].background, state);
+
+    inner = rect;
+    inner.x1 += style->h_padding;
+    inner.y1 += style->v_padding;
+    inner.x2 -= style->h_padding;
+    inner.y2 -= style->v_padding;
+
+    label = keypad_key_label(keypad, key, keypad->shifted);
+
+    if (!rect_empty(&inner) && label[0]) {
+        draw_set_clip(bam, &inner);
+        draw_aligned_text(bam, style, &inner, label, &style->colors[state]);
+    }
+
+    bam->draw_state = saved_draw_state;
+}
+
+
+static void keypad_draw(bam_t* bam, const bam_widget_t* widget) {
+    const bam_keypad_t* keypad = widget->keypad;
+    const bam_keypad_layout_t* layout = keypad->layout;
+    const bam_draw_state_t* draw_state = &bam->draw_state;
+    int pitch_x;
+    int pitch_y;
+    int column_begin;
+    int column_end;
+    int row_begin;
+    int row_end;
+    bam_rect_t clip;
+
+    if (!keypad_calc_pitch(widget, &pitch_x, &pitch_y)) {
+        return;
+    }
+
+    // convert clipping rectangle back into display coordinates and restrict it to the keypad
+    clip = draw_state->clip;
+    rect_translate(&clip, -draw_state->translate_x, -draw_state->translate_y);
+    rect_intersect(&clip, &widget->rect);
+
+    if (rect_empty(&clip)) {
+        return;
+    }
+
+    // determine range of cells intersecting clipping rectangle
+    column_begin = (clip.x1 - widget->rect.x1) / pitch_x;
+    column_end = min_int(layout->n_columns, ((clip.x2 - 1 - widget->rect.x1) / pitch_x) + 1);
+    row_begin = (clip.y1 - widget->rect.y1) / pitch_y;
+    row_end = min_int(layout->n_rows, ((clip.y2 - 1 - widget->rect.y1) / pitch_y) + 1);
+
+    for (int row = row_begin; row < row_end; row++) {
+        for (int column = column_begin; column < column_end; column++) {
+            size_t key = keypad->cell_map[(row * layout->n_columns) + column];
+            const bam_keypad_key_t* key_def;
+
+            if (key == BAM_KEYPAD_NO_KEY) {
+                continue;
+            }
+
+            // keys spanning several cells are drawn once, at the first of their cells within the clipping rectangle
+            key_def = layout->keys + key;
+
+            if (row == max_int(key_def->row, row_begin) && column == max_int(key_def->column, column_begin)) {
+                keypad_draw_key(bam, widget, key, pitch_x, pitch_y);
+            }
+        }
+    }
+}
+
+
+static bam_keypad_t* keypad_from_widget(const bam_t* bam, bam_widget_handle_t widget) {
+    bam_keypad_t* keypad = widget_from_handle(bam, widget)->keypad;
+
+    BAM_ASSERT(keypad);
+
+    return keypad;
+}
+
+
+void bam_init_keypad(bam_keypad_t* keypad, const bam_keypad_layout_t* layout, const bam_style_t* const* styles,
+                     size_t n_styles, const char* const* labels, int spacing) {
+    BAM_ASSERT(keypad);
+    BAM_ASSERT(layout);
+    BAM_ASSERT(layout->n_columns > 0 && layout->n_rows > 0);
+    BAM_ASSERT((layout->n_columns * layout->n_rows) <= BAM_KEYPAD_MAX_CELLS);
+    BAM_ASSERT(layout->n_keys <= BAM_KEYPAD_MAX_KEYS);
+    BAM_ASSERT(styles || n_styles == 0);
+
+    keypad->layout = layout;
+    keypad->styles = styles;
+    keypad->n_styles = n_styles;
+    keypad->labels = labels;
+    keypad->spacing = max_int(0, spacing);
+    keypad->shifted = false;
+    keypad->pressed_key = BAM_KEYPAD_NO_KEY;
+    keypad->callback = NULL;
+    keypad->user_data = NULL;
+
+    memset(keypad->disabled, 0, sizeof(keypad->disabled));
+    memset(keypad->cell_map, BAM_KEYPAD_NO_KEY, sizeof(keypad->cell_map));
+
+    // build map of cells to the keys covering them, so that touches can be resolved without searching
+    for (size_t key = 0; key < layout->n_keys; key++) {
+        const bam_keypad_key_t* key_def = layout->keys + key;
+
+        BAM_ASSERT(key_def->column_span > 0 && key_def->row_span > 0);
+        BAM_ASSERT((key_def->column + key_def->column_span) <= layout->n_columns);
+        BAM_ASSERT((key_def->row + key_def->row_span) <= layout->n_rows);
+
+        for (int row = key_def->row; row < (key_def->row + key_def->row_span); row++) {
+            for (int column = key_def->column; column < (key_def->column + key_def->column_span); column++) {
+                keypad->cell_map[(row * layout->n_columns) + column] = (uint8_t) key;
+            }
+        }
+    }
+}
+
+
+void bam_set_widget_keypad(bam_t* bam, bam_widget_handle_t widget, bam_keypad_t* keypad,
+                           bam_keypad_callback_t callback, void* user_data) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    if (keypad) {
+        keypad->pressed_key = BAM_KEYPAD_NO_KEY;
+        keypad->callback = callback;
+        keypad->user_data = user_data;
+    }
+
+    _widget->keypad = keypad;
+    widget_make_dirty(bam, _widget);
+}
+
+
+void bam_set_keypad_shifted(bam_t* bam, bam_widget_handle_t widget, bool shifted) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    const bam_widget_t* _widget = widget_from_handle(bam, widget);
+    bam_keypad_t* keypad = keypad_from_widget(bam, widget);
+
+    if (keypad->shifted == shifted) {
+        return;
+    }
+
+    keypad->shifted = shifted;
+
+    // only redraw keys whose labels differ between shifted and unshifted states
+    for (size_t key = 0; key < keypad->layout->n_keys; key++) {
+        if (strcmp(keypad_key_label(keypad, key, false), keypad_key_label(keypad, key, true)) != 0) {
+            keypad_mark_key(bam, _widget, key);
+        }
+    }
+}
+
+
+bool bam_get_keypad_shifted(const bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    return keypad_from_widget(bam, widget)->shifted;
+}
+
+
+void bam_set_keypad_key_enabled(bam_t* bam, bam_widget_handle_t widget, size_t key, bool enabled) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    const bam_widget_t* _widget = widget_from_handle(bam, widget);
+    bam_keypad_t* keypad = keypad_from_widget(bam, widget);
+    uint32_t mask = 1ul << (key % 32);
+
+    BAM_ASSERT(key < keypad->layout->n_keys);
+
+    if (keypad_key_disabled(keypad, key) != enabled) {
+        return;
+    }
+
+    if (enabled) {
+        keypad->disabled[key / 32] &= ~mask;
+    } else {
+        keypad->disabled[key / 32] |= mask;
+
+        // a key that becomes disabled while pressed must not trigger on release
+        if (keypad->pressed_key == key) {
+            keypad->pressed_key = BAM_KEYPAD_NO_KEY;
+        }
+    }
+
+    keypad_mark_key(bam, _widget, key);
+}
+
+
+bool bam_get_keypad_key_enabled(const bam_t* bam, bam_widget_handle_t widget, size_t key) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    const bam_keypad_t* keypad = keypad_from_widget(bam, widget);
+
+    BAM_ASSERT(key < keypad->layout->n_keys);
+
+    return !keypad_key_disabled(keypad, key);
+}
+
+
+const char* bam_get_keypad_key_label(const bam_t* bam, bam_widget_handle_t widget, size_t key) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    const bam_keypad_t* keypad = keypad_from_widget(bam, widget);
+
+    BAM_ASSERT(key < keypad->layout->n_keys);
+
+    return keypad_key_label(keypad, key, keypad->shifted);
+}
+
+
+uint8_t bam_get_keypad_key_code(const bam_t* bam, bam_widget_handle_t widget, size_t key) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    const bam_keypad_t* keypad = keypad_from_widget(bam, widget);
+
+    BAM_ASSERT(key < keypad->layout->n_keys);
+
+    return keypad->layout->keys[key].code;
+}
+
+
+// ******** CHART API ********
+
+static void chart_calc_column(bam_chart_t* chart, size_t index, int height) {
+    // index is position of sample relative to oldest sample in ring buffer
+    size_t ring_index = (chart->head + index) % chart->capacity;
+    int range = chart->max_value - chart->min_value;
+    int value = chart->samples[ring_index];
+    int prev_value = (index > 0) ? chart->samples[(chart->head + index - 1) % chart->capacity] : value;
+    int y;
+    int prev_y;
+
+    if (range <= 0 || height <= 1) {
+        y = height / 2;
+        prev_y = y;
+    } else {
+        value = min_int(max_int(value, chart->min_value), chart->max_value);
+        prev_value = min_int(max_int(prev_value, chart->min_value), chart->max_value);
+        y = (height - 1) - (int) (((int64_t) (value - chart->min_value) * (height - 1)) / range);
+        prev_y = (height - 1) - (int) (((int64_t) (prev_value - chart->min_value) * (height - 1)) / range);
+    }
+
+    // column spans from previous sample's y position to this sample's, so that plot is continuous
+    chart->columns[ring_index].y1 = (bam_coord_t) min_int(y, prev_y);
+    chart->columns[ring_index].y2 = (bam_coord_t) (max_int(y, prev_y) + 1);
+}
+
+
+static void chart_update_cache(bam_chart_t* chart, int height) {
+    if (chart->cache_valid && chart->cache_height == height) {
+        return;
+    }
+
+    for (size_t i = 0; i < chart->count; i++) {
+        chart_calc_column(chart, i, height);
+    }
+
+    chart->cache_height = height;
+    chart->cache_valid = true;
+}
+
+
+static bool chart_autoscale(bam_chart_t* chart) {
+    int min_value;
+    int max_value;
+
+    if (!chart->autoscale || chart->count == 0) {
+        return false;
+    }
+
+    min_value = INT_MAX;
+    max_value = INT_MIN;
+
+    for (size_t i = 0; i < chart->count; i++) {
+        int value = chart->samples[(chart->head + i) % chart->capacity];
+
+        min_value = min_int(min_value, value);
+        max_value = max_int(max_value, value);
+    }
+
+    if (min_value == chart->min_value && max_value == chart->max_value) {
+        return false;
+    }
+
+    chart->min_value = min_value;
+    chart->max_value = max_value;
+    chart->cache_valid = false;
+
+    return true;
+}
+
+
+static bool chart_autoscale_sample(bam_chart_t* chart, int value, bool evicted, int evicted_value) {
+    int min_value;
+    int max_value;
+
+    if (!chart->autoscale) {
+        return false;
+    }
+
+    // range only needs rescanning if it is stale or the discarded sample was one of its extremes, otherwise new
+    // sample can only widen it
+    if (chart->count == 1 || (evicted && (evicted_value == chart->min_value || evicted_value == chart->max_value))) {
+        return chart_autoscale(chart);
+    }
+
+    min_value = min_int(chart->min_value, value);
+    max_value = max_int(chart->max_value, value);
+
+    if (min_value == chart->min_value && max_value == chart->max_value) {
+        return false;
+    }
+
+    chart->min_value = min_value;
+    chart->max_value = max_value;
+    chart->cache_valid = false;
+
+    return true;
+}
+
+
+static void chart_draw_widget_func(bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds,
+                                   void* user_data) {
+    bam_chart_t* chart = user_data;
+    const int column_width = chart->column_width;
+    const int clip_x1 = bam->draw_state.clip.x1 - bam->draw_state.translate_x;
+    const int clip_x2 = bam->draw_state.clip.x2 - bam->draw_state.translate_x;
+    int first;
+    int last;
+    bam_rect_t rect;
+
+    (void) widget;
+
+    // columns are only recalculated if scale or plot height have changed since they were cached
+    chart_update_cache(chart, rect_height(bounds));
+
+    // newest sample is drawn at right edge of plot, so find range of samples that intersect clip region
+    first = (int) chart->count - ((bounds->x2 - clip_x1 + column_width - 1) / column_width);
+    last = (int) chart->count - ((bounds->x2 - clip_x2) / column_width);
+    first = max_int(first, 0);
+    last = min_int(last, (int) chart->count);
+
+    for (int i = first; i < last; i++) {
+        const bam_chart_column_t* column = &chart->columns[(chart->head + i) % chart->capacity];
+        int x = bounds->x2 - (((int) chart->count - i) * column_width);
+
+        rect.x1 = x;
+        rect.y1 = bounds->y1 + column->y1;
+        rect.x2 = x + column_width;
+        rect.y2 = bounds->y1 + column->y2;
+
+        draw_fill(bam, &rect, chart->color);
+    }
+}
+
+
+static bam_chart_t* chart_from_widget(bam_t* bam, bam_widget_handle_t widget) {
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+
+    BAM_ASSERT(_widget->draw_callback == chart_draw_widget_func);
+
+    return _widget->draw_user_data;
+}
+
+
+static void chart_mark_shifted_columns(bam_t* bam, bam_widget_t* widget, const bam_chart_t* chart,
+                                      const bam_rect_t* plot, const bam_chart_column_t* evicted_column) {
+    const int column_width = chart->column_width;
+    const int n_visible = min_int((int) chart->count, (rect_width(plot) + column_width - 1) / column_width);
+    int run_first = -1;
+    int run_y1 = 0;
+    int run_y2 = 0;
+    bam_rect_t rect;
+
+    // columns are counted from right edge of plot, and each one now shows the sample that its right-hand neighbour
+    // showed before, so only those whose extents differ from that sample's are marked, merged into runs
+    for (int i = 0; i <= n_visible; i++) {
+        const bam_chart_column_t* column = NULL;
+        const bam_chart_column_t* prev = NULL;
+
+        if (i < n_visible) {
+            size_t ring_index = (chart->head + chart->count - 1 - (size_t) i) % chart->capacity;
+
+            column = &chart->columns[ring_index];
+
+            // oldest column previously showed the discarded sample (whose slot now holds the newest one), or
+            // nothing at all if no sample was discarded
+            if (i < (int) chart->count - 1) {
+                prev = &chart->columns[(ring_index + chart->capacity - 1) % chart->capacity];
+            } else {
+                prev = evicted_column;
+            }
+
+            if (prev && prev->y1 == column->y1 && prev->y2 == column->y2) {
+                column = NULL;
+            }
+        }
+
+        if (column) {
+            int y1 = prev ? min_int(column->y1, prev->y1) : column->y1;
+            int y2 = prev ? max_int(column->y2, prev->y2) : column->y2;
+
+            if (run_first < 0) {
+                run_first = i;
+                run_y1 = y1;
+                run_y2 = y2;
+            } else {
+                run_y1 = min_int(run_y1, y1);
+                run_y2 = max_int(run_y2, y2);
+            }
+        } else if (run_first >= 0) {
+            rect.x1 = plot->x2 - (i * column_width);
+            rect.y1 = plot->y1 + run_y1;
+            rect.x2 = plot->x2 - (run_first * column_width);
+            rect.y2 = plot->y1 + run_y2;
+            rect_intersect(&rect, plot);
+            widget_make_rect_dirty(bam, widget, &rect);
+            run_first = -1;
+        }
+    }
+}
+
+
+static bool chart_can_scroll(bam_t* bam, const bam_widget_t* widget, const bam_rect_t* plot) {
+    // scrolling is done by copying pixels already on the display, so the plot must be fully up-to-date, unobscured
+    // and contain nothing but columns (and its newly exposed column must be marked straight away, which it wouldn't
+    // be if widget's changes were throttled or being reconciled)
+    if (!bam->vtable->copy_region || bam->flip_history || widget->text[0] ||
+        (widget->flags & BAM_WIDGET_FLAG_COLORS) || widget->refresh_interval > 0 || bam->reconcile_pending) {
+        return false;
+    }
+
+    if (plot->x1 < 0 || plot->y1 < 0 || plot->x2 > bam->disp_width || plot->y2 > bam->disp_height) {
+        return false;
+    }
+
+    if (dirty_test_rect(bam, plot)) {
+        return false;
+    }
+
+    for (const bam_widget_t* widget_i = widget + 1; widget_i < bam->widget_buffer_ptr; widget_i++) {
+        if (rect_overlaps(&widget_i->rect, plot)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void bam_init_chart(bam_chart_t* chart, int16_t* sample_buffer, bam_chart_column_t* column_buffer,
+                    size_t buffer_size, int column_width, bam_color_t color) {
+    BAM_ASSERT(chart);
+    BAM_ASSERT(sample_buffer);
+    BAM_ASSERT(column_buffer);
+    BAM_ASSERT(buffer_size > 0);
+    BAM_ASSERT(column_width > 0);
+
+    chart->samples = sample_buffer;
+    chart->columns = column_buffer;
+    chart->capacity = buffer_size;
+    chart->head = 0;
+    chart->count = 0;
+    chart->min_value = INT16_MIN;
+    chart->max_value = INT16_MAX;
+    chart->autoscale = true;
+    chart->column_width = column_width;
+    chart->color = color;
+    chart->cache_height = 0;
+    chart->cache_valid = false;
+}
+
+
+void bam_set_widget_chart(bam_t* bam, bam_widget_handle_t widget, bam_chart_t* chart) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    if (chart) {
+        chart->cache_valid = false;
+    }
+
+    bam_set_widget_draw_callback(bam, widget, chart ? chart_draw_widget_func : NULL, chart);
+}
+
+
+void bam_set_chart_range(bam_t* bam, bam_widget_handle_t widget, int min_value, int max_value) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_chart_t* chart = chart_from_widget(bam, widget);
+
+    chart->autoscale = false;
+
+    if (chart->min_value != min_value || chart->max_value != max_value) {
+        chart->min_value = min_value;
+        chart->max_value = max_value;
+        chart->cache_valid = false;
+        widget_make_dirty(bam, widget_from_handle(bam, widget));
+    }
+}
+
+
+void bam_set_chart_autoscale(bam_t* bam, bam_widget_handle_t widget, bool autoscale) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_chart_t* chart = chart_from_widget(bam, widget);
+
+    chart->autoscale = autoscale;
+
+    if (chart_autoscale(chart)) {
+        widget_make_dirty(bam, widget_from_handle(bam, widget));
+    }
+}
+
+
+void bam_append_chart_sample(bam_t* bam, bam_widget_handle_t widget, int16_t value) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+    bam_chart_t* chart = chart_from_widget(bam, widget);
+    int column_width = chart->column_width;
+    bool evicted = chart->count == chart->capacity;
+    int evicted_value = 0;
+    bam_chart_column_t evicted_column = {0, 0};
+    bam_rect_t plot;
+    bam_rect_t src_rect;
+    bam_rect_t exposed;
+
+    // append sample to ring buffer, discarding oldest sample if buffer is full
+    if (!evicted) {
+        chart->samples[(chart->head + chart->count) % chart->capacity] = value;
+        chart->count++;
+    } else {
+        evicted_value = chart->samples[chart->head];
+        evicted_column = chart->columns[chart->head];
+        chart->samples[chart->head] = value;
+        chart->head = (chart->head + 1) % chart->capacity;
+    }
+
+    widget_calc_inner(_widget, &plot);
+
+    // a change of scale invalidates every column, so whole plot must be redrawn
+    if (chart_autoscale_sample(chart, value, evicted, evicted_value) || !chart->cache_valid ||
+        chart->cache_height != rect_height(&plot)) {
+        chart->cache_valid = false;
+        widget_make_dirty(bam, _widget);
+        return;
+    }
+
+    // only newest column needs calculating, the rest are shifted along with the plot
+    chart_calc_column(chart, chart->count - 1, chart->cache_height);
+
+    if (rect_width(&plot) <= column_width || !chart_can_scroll(bam, _widget, &plot)) {
+        // backend can't scroll the plot, so redraw columns whose contents have changed from cached columns
+        chart_mark_shifted_columns(bam, _widget, chart, &plot, evicted ? &evicted_column : NULL);
+        return;
+    }
+
+    // shift plot left by one column on the display, then mark the newly exposed column as dirty
+    src_rect = plot;
+    src_rect.x1 += column_width;
+    bam->vtable->copy_region(&src_rect, plot.x1, plot.y1, bam->user_data);
+
+    exposed = plot;
+    exposed.x1 = plot.x2 - column_width;
+    widget_make_rect_dirty(bam, _widget, &exposed);
+
+    // if oldest sample was discarded and the plot is wider than the ring buffer, its column has been shifted into
+    // the empty part of the plot and must be erased
+    if (chart->count == chart->capacity) {
+        exposed.x2 = plot.x2 - ((int) chart->count * column_width);
+        exposed.x1 = exposed.x2 - column_width;
+        rect_intersect(&exposed, &plot);
+        widget_make_rect_dirty(bam, _widget, &exposed);
+    }
+}
+
+
+void bam_clear_chart(bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    bam_chart_t* chart = chart_from_widget(bam, widget);
+
+    chart->head = 0;
+    chart->count = 0;
+    chart->cache_valid = false;
+    widget_make_dirty(bam, widget_from_handle(bam, widget));
+}
+
+
+// ******** ANIMATION API ********
+
+#define BAM_EASING_ONE                  32768l
+
+
+static long animation_ease(bam_easing_t easing, long t) {
+    long inv;
+
+    // t and return value are fixed-point fractions where BAM_EASING_ONE represents 1.0
+    switch (easing) {
+    case BAM_EASING_IN:
+        return (t * t) / BAM_EASING_ONE;
+
+    case BAM_EASING_OUT:
+        inv = BAM_EASING_ONE - t;
+        return BAM_EASING_ONE - ((inv * inv) / BAM_EASING_ONE);
+
+    case BAM_EASING_IN_OUT:
+        if (t < (BAM_EASING_ONE / 2)) {
+            return (2 * t * t) / BAM_EASING_ONE;
+        }
+
+        inv = BAM_EASING_ONE - t;
+        return BAM_EASING_ONE - ((2 * inv * inv) / BAM_EASING_ONE);
+
+    default:
+        return t;
+    }
+}
+
+
+static int animation_lerp_int(int from, int to, long k) {
+    return from + (int) ((((int64_t) to - from) * k) / BAM_EASING_ONE);
+}
+
+
+static void animation_cancel_all(bam_t* bam) {
+    for (bam_animation_t* anim_i = bam->animation_buffer_begin; anim_i < bam->animation_buffer_end; anim_i++) {
+        anim_i->active = false;
+    }
+
+    bam->n_active_animations = 0;
+}
+
+
+static bam_animation_t* animation_alloc(bam_t* bam, bam_widget_handle_t widget, bam_animation_type_t type) {
+    bam_animation_t* free_anim = NULL;
+
+    // an animation of the same type on the same widget is replaced, rather than run alongside the new one
+    for (bam_animation_t* anim_i = bam->animation_buffer_begin; anim_i < bam->animation_buffer_end; anim_i++) {
+        if (anim_i->active) {
+            if (anim_i->widget == widget && anim_i->type == type) {
+                return anim_i;
+            }
+        } else if (!free_anim) {
+            free_anim = anim_i;
+        }
+    }
+
+    if (!free_anim) {
+        panic(bam, BAM_PANIC_CODE_OUT_OF_MEMORY);
+    }
+
+    // if this is the first active animation, schedule first frame immediately
+    if (bam->n_active_animations == 0) {
+        bam->next_frame_time = bam->vtable->get_monotonic_time(bam->user_data);
+    }
+
+    free_anim->active = true;
+    free_anim->widget = widget;
+    free_anim->type = type;
+    bam->n_active_animations++;
+
+    return free_anim;
+}
+
+
+static void animation_begin(bam_t* bam, bam_animation_t* anim, bam_tick_t duration, bam_easing_t easing) {
+    anim->start_time = bam->vtable->get_monotonic_time(bam->user_data);
+    anim->duration = duration;
+    anim->easing = easing;
+}
+
+
+static void animation_apply(bam_t* bam, bam_animation_t* anim, long k) {
+    bam_widget_t* widget = widget_from_handle(bam, anim->widget);
+    bam_rect_t rect;
+    bam_color_pair_t colors;
+
+    switch (anim->type) {
+    case BAM_ANIMATION_TYPE_BOUNDS:
+        rect.x1 = animation_lerp_int(anim->params.bounds.from.x1, anim->params.bounds.to.x1, k);
+        rect.y1 = animation_lerp_int(anim->params.bounds.from.y1, anim->params.bounds.to.y1, k);
+        rect.x2 = animation_lerp_int(anim->params.bounds.from.x2, anim->params.bounds.to.x2, k);
+        rect.y2 = animation_lerp_int(anim->params.bounds.from.y2, anim->params.bounds.to.y2, k);
+
+        // mark union of old and new extents with a single dirty mark
+        if (!rect_equal(&rect, &widget->rect)) {
+            bam_rect_t extents = widget->rect;
+            bool resized = rect_width(&rect) != rect_width(&widget->rect);
+
+            rect_union(&extents, &rect);
+            widget->rect = rect;
+
+            // wrapped text only needs breaking into lines again if widget's width has changed
+            if (widget->lines && resized) {
+                text_wrap(bam, widget, false);
+            }
+
+            widget_make_rect_dirty(bam, widget, &extents);
+        }
+        break;
+
+    case BAM_ANIMATION_TYPE_COLORS:
+        colors.foreground = color_lerp(bam, anim->params.colors.from.foreground, anim->params.colors.to.foreground,
+                                       (int) k, (int) BAM_EASING_ONE);
+
+        colors.background = color_lerp(bam, anim->params.colors.from.background, anim->params.colors.to.background,
+                                       (int) k, (int) BAM_EASING_ONE);
+
+        bam_set_widget_colors(bam, anim->widget, &colors);
+        break;
+
+    case BAM_ANIMATION_TYPE_VALUE:
+        anim->params.value.callback(bam, anim->widget,
+                                    animation_lerp_int(anim->params.value.from, anim->params.value.to, k),
+                                    anim->params.value.user_data);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+static bool animation_process(bam_t* bam) {
+    bam_tick_t now;
+    bam_tick_t frame_interval;
+
+    // nothing to do if no animations are running or next frame is not yet due
+    if (bam->n_active_animations == 0) {
+        return false;
+    }
+
+    now = bam->vtable->get_monotonic_time(bam->user_data);
+
+    if (!tick_reached(now, bam->next_frame_time)) {
+        return false;
+    }
+
+    // schedule next frame relative to this one, catching up if frames have been missed entirely (frame rate is
+    // halved while governor is reducing quality)
+    frame_interval = (bam->quality >= BAM_QUALITY_REDUCED_FRAME_RATE) ? (bam_tick_t) (bam->frame_interval * 2) :
+                     bam->frame_interval;
+
+    bam->next_frame_time = (bam_tick_t) (bam->next_frame_time + frame_interval);
+
+    if (tick_reached(now, bam->next_frame_time)) {
+        bam->next_frame_time = (bam_tick_t) (now + frame_interval);
+    }
+
+    // advance all active animations
+    for (bam_animation_t* anim_i = bam->animation_buffer_begin; anim_i < bam->animation_buffer_end; anim_i++) {
+        bam_tick_t elapsed;
+        long t;
+
+        if (!anim_i->active) {
+            continue;
+        }
+
+        elapsed = tick_elapsed(now, anim_i->start_time);
+
+        if (elapsed >= anim_i->duration) {
+            t = BAM_EASING_ONE;
+            anim_i->active = false;
+            bam->n_active_animations--;
+        } else {
+            t = (long) (((uint32_t) elapsed * BAM_EASING_ONE) / anim_i->duration);
+        }
+
+        animation_apply(bam, anim_i, animation_ease(anim_i->easing, t));
+    }
+
+    return true;
+}
+
+
+static bam_tick_t animation_calc_timeout(const bam_t* bam, bam_tick_t now) {
+    if (bam->n_active_animations == 0) {
+        return BAM_IDLE_TIMEOUT;
+    }
+
+    return tick_until(now, bam->next_frame_time);
+}
+
+
+void bam_init_animations(bam_t* bam, bam_animation_t* animation_buffer, size_t animation_buffer_size,
+                         bam_tick_t frame_interval) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(animation_buffer || animation_buffer_size == 0);
+
+    bam->animation_buffer_begin = animation_buffer;
+    bam->animation_buffer_end = animation_buffer + animation_buffer_size;
+
+    animation_cancel_all(bam);
+    bam_set_animation_frame_interval(bam, frame_interval);
+}
+
+
+void bam_set_animation_frame_interval(bam_t* bam, bam_tick_t frame_interval) {
+    BAM_ASSERT_CTX(bam);
+
+    bam->frame_interval = frame_interval > 0 ? frame_interval : 1;
+}
+
+
+void bam_animate_bounds(bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds,
+                        bam_tick_t duration, bam_easing_t easing) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+    BAM_ASSERT(bounds);
+
+    bam_animation_t* anim = animation_alloc(bam, widget, BAM_ANIMATION_TYPE_BOUNDS);
+
+    // animate from widget's current bounds, which may be part way through a previous animation
+    anim->params.bounds.from = widget_from_handle(bam, widget)->rect;
+    anim->params.bounds.to = *bounds;
+    animation_begin(bam, anim, duration, easing);
+}
+
+
+void bam_animate_colors(bam_t* bam, bam_widget_handle_t widget, const bam_color_pair_t* from,
+                        const bam_color_pair_t* to, bam_tick_t duration, bam_easing_t easing) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+    BAM_ASSERT(to);
+
+    bam_widget_t* _widget = widget_from_handle(bam, widget);
+    bam_animation_t* anim = animation_alloc(bam, widget, BAM_ANIMATION_TYPE_COLORS);
+
+    // if no start colors are given, animate from widget's current colors
+    if (!from) {
+        from = (_widget->flags & BAM_WIDGET_FLAG_COLORS) ? &_widget->colors :
+               &_widget->style->colors[_widget->state];
+    }
+
+    anim->params.colors.from = *from;
+    anim->params.colors.to = *to;
+    animation_begin(bam, anim, duration, easing);
+}
+
+
+void bam_animate_value(bam_t* bam, bam_widget_handle_t widget, int from, int to, bam_tick_t duration,
+                       bam_easing_t easing, bam_animation_callback_t callback, void* user_data) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+    BAM_ASSERT(callback);
+
+    bam_animation_t* anim = animation_alloc(bam, widget, BAM_ANIMATION_TYPE_VALUE);
+
+    anim->params.value.from = from;
+    anim->params.value.to = to;
+    anim->params.value.callback = callback;
+    anim->params.value.user_data = user_data;
+    animation_begin(bam, anim, duration, easing);
+}
+
+
+void bam_cancel_animations(bam_t* bam, bam_widget_handle_t widget) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+
+    // cancelled animations are left at their current value
+    for (bam_animation_t* anim_i = bam->animation_buffer_begin; anim_i < bam->animation_buffer_end; anim_i++) {
+        if (anim_i->active && anim_i->widget == widget) {
+            anim_i->active = false;
+            bam->n_active_animations--;
+        }
+    }
+}
+
+
+bool bam_is_animating(const bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    return bam->n_active_animations > 0;
+}
+
+
+// ******** TIMER API ********
+
+static void timer_unlink(bam_t* bam, bam_timer_t* timer) {
+    bam_timer_t** link = &bam->timers;
+
+    while (*link && *link != timer) {
+        link = &((*link)->next);
+    }
+
+    if (*link) {
+        *link = timer->next;
+    }
+
+    timer->next = NULL;
+    timer->active = false;
+}
+
+
+static void timer_process(bam_t* bam) {
+    bam_tick_t now = bam->vtable->get_monotonic_time(bam->user_data);
+    bam_timer_t* timer;
+
+    // callbacks may start or stop timers, so scan list from its head again after each one fires
+    do {
+        for (timer = bam->timers; timer && !tick_reached(now, timer->deadline); timer = timer->next) {
+        }
+
+        if (timer) {
+            if (timer->repeat) {
+                // keep to original schedule unless it has fallen a whole interval behind
+                timer->deadline += timer->interval;
+
+                if (tick_reached(now, timer->deadline)) {
+                    timer->deadline = now + timer->interval;
+                }
+            } else {
+                timer_unlink(bam, timer);
+            }
+
+            timer->callback(bam, timer, timer->user_data);
+        }
+    } while (timer);
+}
+
+
+static bam_tick_t timer_calc_timeout(const bam_t* bam, bam_tick_t now, bam_tick_t timeout) {
+    for (const bam_timer_t* timer = bam->timers; timer; timer = timer->next) {
+        bam_tick_t until = tick_until(now, timer->deadline);
+
+        if (until < timeout) {
+            timeout = until;
+        }
+    }
+
+    return timeout;
+}
+
+
+void bam_init_timer(bam_timer_t* timer) {
+    BAM_ASSERT(timer);
+
+    timer->next = NULL;
+    timer->callback = NULL;
+    timer->user_data = NULL;
+    timer->deadline = 0;
+    timer->interval = 0;
+    timer->repeat = false;
+    timer->active = false;
+}
+
+
+void bam_start_timer(bam_t* bam, bam_timer_t* timer, bam_tick_t interval, bool repeat,
+                     bam_timer_callback_t callback, void* user_data) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(timer);
+    BAM_ASSERT(interval > 0 && interval <= BAM_MAX_TICK_INTERVAL);
+    BAM_ASSERT(callback);
+
+    // restarting an active timer reschedules it
+    if (timer->active) {
+        timer_unlink(bam, timer);
+    }
+
+    timer->callback = callback;
+    timer->user_data = user_data;
+    timer->deadline = bam->vtable->get_monotonic_time(bam->user_data) + interval;
+    timer->interval = interval;
+    timer->repeat = repeat;
+    timer->active = true;
+
+    timer->next = bam->timers;
+    bam->timers = timer;
+}
+
+
+void bam_stop_timer(bam_t* bam, bam_timer_t* timer) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(timer);
+
+    if (timer->active) {
+        timer_unlink(bam, timer);
+    }
+}
+
+
+bool bam_is_timer_active(const bam_timer_t* timer) {
+    BAM_ASSERT(timer);
+
+    return timer->active;
+}
+
+
+// ******** GOVERNOR API ********
+
+void bam_set_frame_budget(bam_t* bam, bam_tick_t budget) {
+    BAM_ASSERT_CTX(bam);
+
+    // governor waits whole multiples of budget, which must still be valid tick intervals
+    BAM_ASSERT(budget <= BAM_MAX_TICK_INTERVAL / BAM_GOVERNOR_RESTORE_FRAMES);
+    BAM_ASSERT(budget <= BAM_MAX_TICK_INTERVAL / BAM_GOVERNOR_DEFER_FRAMES);
+
+    // a budget of zero disables governor
+    bam->frame_budget = budget;
+
+    if (budget == 0) {
+        governor_set_quality(bam, BAM_QUALITY_FULL);
+        governor_flush_deferred(bam);
+    }
+}
+
+
+bam_quality_t bam_get_quality(const bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    return bam->quality;
+}
+
+
+void bam_get_governor_stats(const bam_t* bam, bam_governor_stats_t* stats) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(stats);
+
+    *stats = bam->governor_stats;
+}
+
+
+void bam_reset_governor_stats(bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    memset(&bam->governor_stats, 0, sizeof(bam->governor_stats));
+}
+
+
+// ******** EVENT API ********
+
+static bool event_get(bam_t* bam, bam_event_t* event, bam_tick_t timeout) {
+    const bam_vtable_t* vtable = bam->vtable;
+    bam_event_t next;
+    size_t i;
+
+    // an event that was read while coalescing moves is delivered before asking the back-end for another
+    if (bam->pending_event.type != BAM_EVENT_TYPE_NONE) {
+        *event = bam->pending_event;
+        bam->pending_event.type = BAM_EVENT_TYPE_NONE;
+        return true;
+    }
+
+    if (!vtable->get_event(event, timeout, bam->user_data)) {
+        return false;
+    }
+
+    // replace a move with any moves already queued behind it, so that only the latest position is processed (the
+    // number of events read is bounded so that a flood of moves can't hold off the next clean, and the first event
+    // that isn't a move is kept for the next iteration)
+    if (event->type == BAM_EVENT_TYPE_MOVE) {
+        for (i = 0; i < BAM_MAX_COALESCED_MOVES; i++) {
+            next.type = BAM_EVENT_TYPE_NONE;
+
+            if (!vtable->get_event(&next, 0, bam->user_data)) {
+                break;
+            }
+
+            if (next.type != BAM_EVENT_TYPE_MOVE) {
+                bam->pending_event = next;
+                break;
+            }
+
+            *event = next;
+        }
+    }
+
+    return true;
+}
+
+
+static bam_tick_t event_service(bam_t* bam, bool need_clean) {
+    const bam_vtable_t* vtable = bam->vtable;
+    bam_tick_t now;
+    bam_tick_t timeout;
+
+    // advance animations if a frame is due
+    if (animation_process(bam)) {
+        need_clean = true;
+    }
+
+    // fire any timers that are due (their callbacks mark whatever they change as dirty)
+    timer_process(bam);
+
+    // finish any offloaded work that has completed
+    work_process(bam);
+
+    // apply changes to throttled widgets whose refresh intervals have expired
+    throttle_process(bam);
+
+    // release deferred updates and restore quality once load has gone
+    governor_process(bam);
+
+    // clean dirty buffer if an event occurred that necessitates it, or if anything has been marked dirty since
+    // the last clean (e.g. by a widget callback), timing clean for the governor
+    if (need_clean || bam->dirty_pending) {
+        bam_tick_t clean_start = vtable->get_monotonic_time(bam->user_data);
+
+        dirty_clean(bam);
+        governor_update(bam, tick_elapsed(vtable->get_monotonic_time(bam->user_data), clean_start));
+    }
+
+    // time until next animation frame or timer is due, or idle period if nothing is animating and no timers are
+    // active
+    now = vtable->get_monotonic_time(bam->user_data);
+    timeout = animation_calc_timeout(bam, now);
+    timeout = timer_calc_timeout(bam, now, timeout);
+    timeout = throttle_calc_timeout(bam, now, timeout);
+    timeout = governor_calc_timeout(bam, now, timeout);
+
+    return timeout;
+}
+
+
+static bool event_dispatch(bam_t* bam, const bam_event_t* event) {
+    bam_widget_t* widget;
+    bam_widget_t* triggered_widget = NULL;
+    bam_widget_t* dragged_widget = NULL;
+    size_t triggered_key = BAM_KEYPAD_NO_KEY;
+    bool need_clean = false;
+
+    // decode event
+    switch (event->type) {
+    case BAM_EVENT_TYPE_QUIT:
+        // stop all event loops
+        bam_quit(bam, 0);
+        break;
+
+    case BAM_EVENT_TYPE_PRESS:
+        // record position, so that callbacks can find out where they were triggered
+        bam->event_x = event->x;
+        bam->event_y = event->y;
+
+        // find widget at pressed coordinate
+        widget = widget_find_at_point(bam, event->x, event->y);
+
+        // if a widget was found and is enabled, set its state to pressed (busy widgets can't be pressed)
+        if (widget && widget->state == BAM_STATE_ENABLED && !(widget->flags & BAM_WIDGET_FLAG_BUSY)) {
+            if (widget->keypad) {
+                // a keypad is only pressed if an enabled key is at the pressed coordinate
+                size_t key = keypad_find_key(widget, event->x, event->y);
+
+                if (key != BAM_KEYPAD_NO_KEY && !keypad_key_disabled(widget->keypad, key)) {
+                    widget_set_pressed(bam, widget);
+                    keypad_set_pressed_key(bam, widget, key);
+                    need_clean = true;
+                }
+            } else {
+                widget_set_pressed(bam, widget);
+                need_clean = true;
+            }
+        }
+        break;
+
+    case BAM_EVENT_TYPE_RELEASE:
+        bam->event_x = event->x;
+        bam->event_y = event->y;
+
+        // if a pressed widget exists, see if it is the same widget at release coordinate
+        if (bam->pressed_widget) {
+            // find widget at released coordinate
+            widget = widget_find_at_point(bam, event->x, event->y);
+
+            // if found widget is the pressed widget mark it as triggered (if it is a keypad, the release must
+            // also be over the pressed key, which must not have been disabled since it was pressed)
+            if (widget == bam->pressed_widget) {
+                if (!widget->keypad) {
+                    triggered_widget = widget;
+                } else if (widget->keypad->pressed_key != BAM_KEYPAD_NO_KEY &&
+                           keypad_find_key(widget, event->x, event->y) == widget->keypad->pressed_key) {
+                    triggered_widget = widget;
+                    triggered_key = widget->keypad->pressed_key;
+                }
+            }
+        }
+
+        // if a pressed widget exists, return it to enabled state
+        widget_set_pressed(bam, NULL);
+        need_clean = true;
+        break;
+
+    case BAM_EVENT_TYPE_MOVE:
+        // moves are only of interest while a widget is pressed
+        if (bam->pressed_widget) {
+            bam->event_x = event->x;
+            bam->event_y = event->y;
+
+            widget_track_pressed(bam, event->x, event->y);
+            dragged_widget = bam->pressed_widget;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    // if a widget has been triggered and it has a callback function, dispatch it
+    if (triggered_widget && triggered_widget->keypad) {
+        bam_keypad_t* keypad = triggered_widget->keypad;
+
+        if (keypad->callback) {
+            keypad->callback(bam, triggered_widget - bam->widget_buffer_begin, triggered_key, keypad->user_data);
+        }
+    } else if (triggered_widget && triggered_widget->work) {
+        work_submit(bam, triggered_widget);
+    } else if (triggered_widget && triggered_widget->callback) {
+        triggered_widget->callback(bam, triggered_widget - bam->widget_buffer_begin, triggered_widget->user_data);
+    }
+
+    // if pressed widget has been dragged and it has a drag callback, dispatch it
+    if (dragged_widget && dragged_widget->drag_callback) {
+        dragged_widget->drag_callback(bam, dragged_widget - bam->widget_buffer_begin, bam->event_x, bam->event_y,
+                                      dragged_widget->drag_user_data);
+    }
+
+    return need_clean;
+}
+
+
+int bam_start(bam_t* bam) {
+    BAM_ASSERT_CTX(bam);
+
+    bool* saved_run_flag;
+    bool run_flag;
+    bool need_clean;
+
+    // bam_step() must not block, so event loops (including those of editors) can't be started from its callbacks
+    BAM_ASSERT(!bam->stepping);
+
+    // if this is not a nested event loop, ensure quit flag is false
+    if (!bam->run_flag) {
+        bam->quit_flag = false;
+    }
+
+    // save pointer to previous run flag
+    saved_run_flag = bam->run_flag;
+
+    // point context at new run flag
+    run_flag = true;
+    bam->run_flag = &run_flag;
+
+    // set 'need_clean' flag initially to ensure screen is up-to-date when event loop starts
+    need_clean = true;
+
+    // process events
+    do {
+        bam_event_t event;
+        bam_tick_t timeout = event_service(bam, need_clean);
+
+        need_clean = false;
+
+        // clear event type so that timeouts can be detected
+        event.type = BAM_EVENT_TYPE_NONE;
+
+        // get next event, sleeping until something is due
+        if (event_get(bam, &event, timeout)) {
+            need_clean = event_dispatch(bam, &event);
+        }
+    } while (run_flag && !bam->quit_flag);
+
+    // point context at previous run flag
+    bam->run_flag = saved_run_flag;
+
+    // return event loop result (set by bam_stop)
+    return bam->run_result;
+}
+
+
+bam_tick_t bam_step(bam_t* bam, const bam_event_t* event) {
+    BAM_ASSERT_CTX(bam);
+
+    bool need_clean = false;
+    bam_tick_t timeout;
+
+    bam->stepping = true;
+
+    // event (if any) is handled first, so that whatever it changes is rendered by the same step
+    if (event) {
+        need_clean = event_dispatch(bam, event);
+    }
+
+    timeout = event_service(bam, need_clean);
+    bam->stepping = false;
+
+    return timeout;
+}
+
+
+bool bam_poll_stop(bam_t* bam, int* result) {
+    BAM_ASSERT_CTX(bam);
+
+    bool stopped = bam->step_stopped;
+
+    // reports a stop requested while no event loop was running (i.e. while stepping) once
+    if (stopped && result) {
+        *result = bam->run_result;
+    }
+
+    bam->step_stopped = false;
+
+    return stopped;
+}
+
+
+void bam_get_event_position(const bam_t* bam, int* x, int* y) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(x);
+    BAM_ASSERT(y);
+
+    *x = bam->event_x;
+    *y = bam->event_y;
+}
+
+
+void bam_stop(bam_t* bam, int result) {
+    BAM_ASSERT_CTX(bam);
+
+    // set run result
+    bam->run_result = result;
+
+    // clear current run flag if an event loop is running, otherwise stop is reported by bam_poll_stop()
+    if (bam->run_flag) {
+        *(bam->run_flag) = false;
+    } else {
+        bam->step_stopped = true;
+    }
+}
+
+
+void bam_quit(bam_t* bam, int result) {
+    // stop current event loop
+    bam_stop(bam, result);
+
+    // set quit flag - this causes all nested event loops to stop
+    bam->quit_flag = true;
+}
+
+
+// ******** LAYOUT API ********
+
+static bool layout_grid_cell_size(int n_cols, int n_rows, const bam_rect_t* bounds, int* h_spacing,
+                                  int* v_spacing, int* width, int* height) {
+    // nothing can be laid out if n_cols, n_rows or bounds are invalid
+    if (n_cols <= 0 || n_rows <= 0 || rect_empty(bounds)) {
+        return false;
+    }
+
+    // clip spacing
+    *h_spacing = max_int(0, *h_spacing);
+    *v_spacing = max_int(0, *v_spacing);
+
+    // calculate widget width and height
+    *width = (rect_width(bounds) - (*h_spacing * (n_cols - 1))) / n_cols;
+    *height = (rect_height(bounds) - (*v_spacing * (n_rows - 1))) / n_rows;
+
+    return true;
+}
+
+
+static void layout_grid_cell(const bam_rect_t* bounds, int n_cols, int h_spacing, int v_spacing, int width,
+                             int height, size_t index, bam_rect_t* rect) {
+    int col = (int) (index % (size_t) n_cols);
+    int row = (int) (index / (size_t) n_cols);
+
+    rect_init(rect, bounds->x1 + (col * (width + h_spacing)), bounds->y1 + (row * (height + v_spacing)), width,
+              height);
+}
+
+
+void bam_layout_grid(bam_t* bam, int n_cols, int n_rows, const bam_rect_t* bounds,
+                     int h_spacing, int v_spacing, const bam_style_t* style, bool enabled,
+                     bam_widget_handle_t handles[], size_t n_handles) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(bounds);
+    BAM_ASSERT(handles || n_handles == 0);
+
+    bam_rect_t dirty_rect;
+    bam_rect_t rect;
+    size_t n_cells;
+    int width;
+    int height;
+
+    // do nothing if n_cols, n_rows or bounds are invalid
+    if (!layout_grid_cell_size(n_cols, n_rows, bounds, &h_spacing, &v_spacing, &width, &height)) {
+        return;
+    }
+
+    n_cells = (size_t) (n_cols * n_rows);
+
+    if (n_cells > n_handles) {
+        n_cells = n_handles;
+    }
+
+    widget_reserve(bam, n_cells);
+    rect_init_empty(&dirty_rect);
+
+    // layout widgets row by row, marking area they cover as dirty once they have all been created
+    for (size_t i = 0; i < n_cells; i++) {
+        layout_grid_cell(bounds, n_cols, h_spacing, v_spacing, width, height, i, &rect);
+        handles[i] = widget_create(bam, &rect, style, NULL, enabled) - bam->widget_buffer_begin;
+        rect_union(&dirty_rect, &rect);
+    }
+
+    widget_make_batch_dirty(bam, &dirty_rect);
+}
+
+
+void bam_layout_grid_descs(int n_cols, int n_rows, const bam_rect_t* bounds, int h_spacing, int v_spacing,
+                           bam_widget_desc_t descs[], size_t n_descs) {
+    BAM_ASSERT(bounds);
+    BAM_ASSERT(descs || n_descs == 0);
+
+    int width;
+    int height;
+
+    if (!layout_grid_cell_size(n_cols, n_rows, bounds, &h_spacing, &v_spacing, &width, &height)) {
+        return;
+    }
+
+    // only bounds are set, so that caller can fill in the rest of each cell's descriptor before or after
+    for (size_t i = 0; i < n_descs && i < (size_t) (n_cols * n_rows); i++) {
+        layout_grid_cell(bounds, n_cols, h_spacing, v_spacing, width, height, i, &descs[i].bounds);
+    }
+}
+
+
+static bam_layout_node_t* layout_node(const bam_layout_t* layout, bam_layout_handle_t handle) {
+    BAM_ASSERT(handle < layout->count);
+    return layout->nodes + handle;
+}
+
+
+static void layout_mark_dirty(bam_layout_t* layout, bam_layout_handle_t handle) {
+    // a change to a node can affect its siblings' sizes, so every ancestor must be arranged again
+    while (handle != BAM_LAYOUT_NONE) {
+        bam_layout_node_t* node = layout_node(layout, handle);
+
+        node->dirty = true;
+        node->intrinsic_valid = false;
+        handle = node->parent;
+    }
+}
+
+
+static bam_layout_handle_t layout_alloc(bam_t* bam, bam_layout_t* layout, bam_layout_handle_t parent,
+                                        bam_layout_node_type_t type, int weight) {
+    bam_layout_handle_t handle;
+    bam_layout_node_t* node;
+
+    if (layout->count >= layout->capacity) {
+        panic(bam, BAM_PANIC_CODE_OUT_OF_MEMORY);
+    }
+
+    handle = (bam_layout_handle_t) layout->count++;
+    node = layout->nodes + handle;
+
+    node->type = type;
+    node->parent = parent;
+    node->first_child = BAM_LAYOUT_NONE;
+    node->last_child = BAM_LAYOUT_NONE;
+    node->next_sibling = BAM_LAYOUT_NONE;
+    node->hidden = false;
+    node->intrinsic_valid = false;
+    node->weight = max_int(0, weight);
+    node->size = 0;
+    node->padding = 0;
+    node->spacing = 0;
+    node->widget = 0;
+    node->intrinsic_width = 0;
+    node->intrinsic_height = 0;
+    rect_init_empty(&node->rect);
+
+    // append node to parent's list of children, or make it the root if it has no parent
+    if (parent == BAM_LAYOUT_NONE) {
+        BAM_ASSERT(layout->root == BAM_LAYOUT_NONE);
+        layout->root = handle;
+    } else {
+        bam_layout_node_t* parent_node = layout_node(layout, parent);
+
+        BAM_ASSERT(parent_node->type != BAM_LAYOUT_NODE_TYPE_WIDGET);
+
+        if (parent_node->last_child == BAM_LAYOUT_NONE) {
+            parent_node->first_child = handle;
+        } else {
+            layout_node(layout, parent_node->last_child)->next_sibling = handle;
+        }
+
+        parent_node->last_child = handle;
+    }
+
+    layout_mark_dirty(layout, handle);
+
+    return handle;
+}
+
+
+static void layout_calc_intrinsic(bam_t* bam, bam_layout_t* layout, bam_layout_node_t* node) {
+    bool is_row = node->type == BAM_LAYOUT_NODE_TYPE_ROW;
+    int main_size = 0;
+    int cross_size = 0;
+    int n_visible = 0;
 
-            word &= ~(0x80000000ul >> clz);
+    if (node->intrinsic_valid) {
+        return;
+    }
 
-            draw_fill_func(&rect, background_color, user_data);
-            draw_set_translation(bam, -offset_x, -offset_y);
-            rect_set_pos(&rect, offset_x, offset_y);
-            draw_set_clip(bam, &rect);
+    if (node->type == BAM_LAYOUT_NODE_TYPE_WIDGET) {
+        // widget's intrinsic size is that of its text, plus padding
+        const bam_widget_t* widget = widget_from_handle(bam, node->widget);
+        const bam_style_t* style = widget->style;
+        const uint8_t* text = (const uint8_t*) widget->text;
+        bam_font_metrics_t font_metrics;
 
-            for (const bam_widget_t* widget_i = widgets_begin; widget_i < widgets_end; widget_i++) {
-                if (rect_overlaps(&rect, &widget_i->rect)) {
-                    draw_widget(bam, widget_i);
-                }
-            }
+        bam->vtable->get_font_metrics(&font_metrics, style->font, bam->user_data);
 
-            bam->draw_state = saved_draw_state;
-            rect_set_pos(&rect, 0, 0);
+        node->intrinsic_width = metrics_calc_string_width(bam, text, text + strlen(widget->text), style->font) +
+                                (2 * style->h_padding);
 
-            blt_tile_func(offset_x, offset_y, user_data);
-        }
+        node->intrinsic_height = font_metrics.line_height + (2 * style->v_padding);
+    } else {
+        // container's intrinsic size is sum of its visible children's sizes along its main axis, and the largest of
+        // their sizes across it
+        for (bam_layout_handle_t child_i = node->first_child; child_i != BAM_LAYOUT_NONE;
+             child_i = layout_node(layout, child_i)->next_sibling) {
+            bam_layout_node_t* child = layout_node(layout, child_i);
+
+            if (child->hidden) {
+                continue;
+            }
 
-        dirty_i++;
+            layout_calc_intrinsic(bam, layout, child);
 
-        if (dirty_i >= dirty_m) {
-            word_x = 0;
-            offset_y += tile_height;
-            dirty_m += dirty_buffer_pitch;
-        } else {
-            word_x += 32 * tile_width;
+            main_size += is_row ? child->intrinsic_width : child->intrinsic_height;
+            cross_size = max_int(cross_size, is_row ? child->intrinsic_height : child->intrinsic_width);
+            n_visible++;
         }
-    } while (dirty_i < dirty_e);
-}
 
+        main_size += (node->spacing * max_int(0, n_visible - 1)) + (2 * node->padding);
+        cross_size += 2 * node->padding;
 
-// ******** WIDGET API ********
+        node->intrinsic_width = is_row ? main_size : cross_size;
+        node->intrinsic_height = is_row ? cross_size : main_size;
+    }
 
-static bam_widget_t* widget_from_handle(const bam_t* bam, bam_widget_handle_t handle) {
-    return bam->widget_buffer_begin + handle;
+    node->intrinsic_valid = true;
 }
 
 
-static const bam_style_t* widget_get_style(const bam_t* bam, const bam_style_t* style) {
-    return style ? style : bam->default_style;
-}
+static int layout_fixed_size(bam_t* bam, bam_layout_t* layout, bam_layout_node_t* node, bool is_row) {
+    // size of a non-flexible node along its parent's main axis
+    if (node->size > 0) {
+        return node->size;
+    }
 
+    layout_calc_intrinsic(bam, layout, node);
 
-static void widget_make_dirty(bam_t* bam, const bam_widget_t* widget) {
-    dirty_mark_rect(bam, &widget->rect);
+    return is_row ? node->intrinsic_width : node->intrinsic_height;
 }
 
 
-bam_widget_handle_t bam_add_widget(bam_t* bam, int x, int y, int width, int height,
-                                   const bam_style_t* style, const char* text, bool enabled) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT(width > 0);
-    BAM_ASSERT(height > 0);
+static void layout_arrange(bam_t* bam, bam_layout_t* layout, bam_layout_node_t* node, const bam_rect_t* rect) {
+    bool is_row = node->type == BAM_LAYOUT_NODE_TYPE_ROW;
+    bam_rect_t inner;
+    int available;
+    int total_weight = 0;
+    int n_visible = 0;
+    int weight_done = 0;
+    int flex_done = 0;
+    int flex_space;
+    int pos;
+
+    // subtrees that are clean and whose bounds haven't changed are skipped entirely
+    if (!node->dirty && rect_equal(&node->rect, rect)) {
+        return;
+    }
 
-    bam_widget_t* widget;
+    node->rect = *rect;
+    node->dirty = false;
 
-    // check if there is room in buffer for new widget
-    if (bam->widget_buffer_ptr >= bam->widget_buffer_end) {
-        panic(bam, BAM_PANIC_CODE_OUT_OF_MEMORY);
+    if (node->type == BAM_LAYOUT_NODE_TYPE_WIDGET) {
+        // only widgets whose bounds have actually changed are updated, which keeps damage to a minimum
+        if (!rect_equal(bam_get_widget_bounds(bam, node->widget), rect)) {
+            bam_set_widget_bounds(bam, node->widget, rect);
+        }
+
+        return;
     }
 
-    // allocate new widget
-    widget = bam->widget_buffer_ptr;
-    bam->widget_buffer_ptr++;
+    inner = *rect;
+    inner.x1 += node->padding;
+    inner.y1 += node->padding;
+    inner.x2 -= node->padding;
+    inner.y2 -= node->padding;
 
-    // initialise widget
-    widget->style = style ? style : bam->default_style;
-    widget->text = text ? text : "";
-    widget->state = enabled ? BAM_STATE_ENABLED : BAM_STATE_DISABLED;
-    widget->callback = NULL;
-    widget->user_data = NULL;
+    available = is_row ? rect_width(&inner) : rect_height(&inner);
 
-    rect_init(&widget->rect, x, y, width, height);
+    // first pass - subtract space taken by fixed size children and spacing to find space left for flexible children
+    for (bam_layout_handle_t child_i = node->first_child; child_i != BAM_LAYOUT_NONE;
+         child_i = layout_node(layout, child_i)->next_sibling) {
+        bam_layout_node_t* child = layout_node(layout, child_i);
 
-    // mark area of display where widget is placed as dirty
-    widget_make_dirty(bam, widget);
+        if (child->hidden) {
+            continue;
+        }
 
-    // return handle to new widget
-    return widget - bam->widget_buffer_begin;
-}
+        if (child->weight > 0) {
+            total_weight += child->weight;
+        } else {
+            available -= layout_fixed_size(bam, layout, child, is_row);
+        }
 
+        n_visible++;
+    }
 
-void bam_delete_widgets(bam_t* bam) {
-    BAM_ASSERT_CTX(bam);
+    flex_space = max_int(0, available - (node->spacing * max_int(0, n_visible - 1)));
 
-    // clear pressed widget pointer
-    bam->pressed_widget = NULL;
+    // second pass - arrange children, distributing flexible space in proportion to weights
+    pos = is_row ? inner.x1 : inner.y1;
 
-    // reset widget buffer top
-    bam->widget_buffer_ptr = bam->widget_buffer_begin;
+    for (bam_layout_handle_t child_i = node->first_child; child_i != BAM_LAYOUT_NONE;
+         child_i = layout_node(layout, child_i)->next_sibling) {
+        bam_layout_node_t* child = layout_node(layout, child_i);
+        bam_rect_t child_rect;
+        int size;
 
-    // assume widgets were covering most of the display, so mark whole display as dirty
-    dirty_mark_all(bam);
-}
+        if (child->hidden) {
+            rect_init_empty(&child_rect);
+            layout_arrange(bam, layout, child, &child_rect);
+            continue;
+        }
 
+        if (child->weight > 0) {
+            // calculate from cumulative weights, so that rounding errors don't leave a gap at the end
+            weight_done += child->weight;
+            size = ((flex_space * weight_done) / total_weight) - flex_done;
+            flex_done += size;
+        } else {
+            size = layout_fixed_size(bam, layout, child, is_row);
+        }
 
-void bam_force_widget_redraw(bam_t* bam, bam_widget_handle_t widget) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+        if (is_row) {
+            rect_init(&child_rect, pos, inner.y1, size, rect_height(&inner));
+        } else {
+            rect_init(&child_rect, inner.x1, pos, rect_width(&inner), size);
+        }
 
-    widget_make_dirty(bam, widget_from_handle(bam, widget));
+        layout_arrange(bam, layout, child, &child_rect);
+        pos += size + node->spacing;
+    }
 }
 
 
-void bam_set_widget_callback(bam_t* bam, bam_widget_handle_t widget, bam_widget_callback_t callback,
-                             void* user_data) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
-
-    bam_widget_t* _widget = widget_from_handle(bam, widget);
+void bam_init_layout(bam_layout_t* layout, bam_layout_node_t* node_buffer, size_t node_buffer_size) {
+    BAM_ASSERT(layout);
+    BAM_ASSERT(node_buffer || node_buffer_size == 0);
 
-    _widget->callback = callback;
-    _widget->user_data = user_data;
+    layout->nodes = node_buffer;
+    layout->capacity = node_buffer_size < BAM_LAYOUT_NONE ? node_buffer_size : BAM_LAYOUT_NONE;
+    layout->count = 0;
+    layout->root = BAM_LAYOUT_NONE;
 }
 
 
-void bam_set_widget_bounds(bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds) {
+bam_layout_handle_t bam_layout_add_container(bam_t* bam, bam_layout_t* layout, bam_layout_handle_t parent,
+                                             bam_layout_node_type_t type, int weight, int padding, int spacing) {
     BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+    BAM_ASSERT(layout);
+    BAM_ASSERT(type == BAM_LAYOUT_NODE_TYPE_ROW || type == BAM_LAYOUT_NODE_TYPE_COLUMN);
 
-    bam_widget_t* _widget = widget_from_handle(bam, widget);
+    bam_layout_handle_t handle = layout_alloc(bam, layout, parent, type, weight);
+    bam_layout_node_t* node = layout_node(layout, handle);
 
-    widget_make_dirty(bam, _widget);
-    _widget->rect = *bounds;
-    widget_make_dirty(bam, _widget);
+    node->padding = max_int(0, padding);
+    node->spacing = max_int(0, spacing);
+
+    return handle;
 }
 
 
-const bam_rect_t* bam_get_widget_bounds(bam_t* bam, bam_widget_handle_t widget) {
+bam_layout_handle_t bam_layout_add_widget(bam_t* bam, bam_layout_t* layout, bam_layout_handle_t parent,
+                                          bam_widget_handle_t widget, int weight, int size) {
     BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(layout);
     BAM_ASSERT_WIDGET_HANDLE(bam, widget);
 
-    return &(widget_from_handle(bam, widget)->rect);
-}
+    bam_layout_handle_t handle = layout_alloc(bam, layout, parent, BAM_LAYOUT_NODE_TYPE_WIDGET, weight);
+    bam_layout_node_t* node = layout_node(layout, handle);
 
+    node->widget = widget;
+    node->size = max_int(0, size);
 
-void bam_set_widget_style(bam_t* bam, bam_widget_handle_t widget, const bam_style_t* style) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+    return handle;
+}
 
-    bam_widget_t* _widget = widget_from_handle(bam, widget);
-    const bam_style_t* new_style = widget_get_style(bam, style);
 
-    // set widget's style if different to its current style
-    if (_widget->style != new_style) {
-        _widget->style = new_style;
-        widget_make_dirty(bam, _widget);
-    }
-}
+void bam_layout_set_weight(bam_layout_t* layout, bam_layout_handle_t node, int weight, int size) {
+    BAM_ASSERT(layout);
 
+    bam_layout_node_t* _node = layout_node(layout, node);
 
-const bam_style_t* bam_get_widget_style(const bam_t* bam, bam_widget_handle_t widget) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+    weight = max_int(0, weight);
+    size = max_int(0, size);
 
-    return widget_from_handle(bam, widget)->style;
+    if (_node->weight != weight || _node->size != size) {
+        _node->weight = weight;
+        _node->size = size;
+        layout_mark_dirty(layout, node);
+    }
 }
 
 
-void bam_set_widget_text(bam_t* bam, bam_widget_handle_t widget, const char* text) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
-
-    bam_widget_t* _widget = widget_from_handle(bam, widget);
+void bam_layout_set_hidden(bam_layout_t* layout, bam_layout_handle_t node, bool hidden) {
+    BAM_ASSERT(layout);
 
-    // set widget's text if different to its current text
-    text = text ? text : "";
+    bam_layout_node_t* _node = layout_node(layout, node);
 
-    if (strcmp(_widget->text, text) != 0) {
-        _widget->text = text;
-        widget_make_dirty(bam, _widget);
+    if (_node->hidden != hidden) {
+        _node->hidden = hidden;
+        layout_mark_dirty(layout, node);
     }
 }
 
 
-const char* bam_get_widget_text(const bam_t* bam, bam_widget_handle_t widget) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+void bam_layout_invalidate(bam_layout_t* layout, bam_layout_handle_t node) {
+    BAM_ASSERT(layout);
 
-    return widget_from_handle(bam, widget)->text;
+    // call after changing anything that affects a node's intrinsic size, such as its widget's text or style
+    layout_mark_dirty(layout, node);
 }
 
 
-void bam_set_widget_enabled(bam_t* bam, bam_widget_handle_t widget, bool enabled) {
+void bam_layout_update(bam_t* bam, bam_layout_t* layout, const bam_rect_t* bounds) {
     BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
-
-    bam_widget_t* _widget = widget_from_handle(bam, widget);
-    bam_state_t new_state = enabled ? BAM_STATE_ENABLED : BAM_STATE_DISABLED;
+    BAM_ASSERT(layout);
+    BAM_ASSERT(bounds);
 
-    // set widget's state if it has changed
-    if (_widget->state != new_state) {
-        _widget->state = new_state;
-        widget_make_dirty(bam, _widget);
+    if (layout->root != BAM_LAYOUT_NONE) {
+        layout_arrange(bam, layout, layout_node(layout, layout->root), bounds);
     }
 }
 
 
-bool bam_get_widget_enabled(const bam_t* bam, bam_widget_handle_t widget) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
-
-    return widget_from_handle(bam, widget)->state == BAM_STATE_ENABLED;
-}
+// ******** NUMBER API ********
 
+#ifndef BAM_REAL_PRECISION
+#define BAM_REAL_PRECISION              6
+#endif // BAM_REAL_PRECISION
 
-void bam_set_widget_metadata(bam_t* bam, bam_widget_handle_t widget, uintptr_t metadata) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
+#define BAM_NUMBER_MAX_PRECISION        9
+#define BAM_NUMBER_MAX_LENGTH           (1 + 20 + 1 + BAM_NUMBER_MAX_PRECISION)
 
-    widget_from_handle(bam, widget)->metadata = metadata;
-}
+#ifdef BAM_REAL_FIXED_BITS
+#if (BAM_REAL_FIXED_BITS < 1) || (BAM_REAL_FIXED_BITS > 31)
+#error "BAM_REAL_FIXED_BITS must be between 1 and 31"
+#endif
 
+#define BAM_REAL_FIXED_ONE              (((uint64_t) 1) << BAM_REAL_FIXED_BITS)
+#define BAM_REAL_FIXED_MAX              ((((uint64_t) 1) << ((8 * sizeof(bam_real_t)) - 1)) - 1)
+#endif // BAM_REAL_FIXED_BITS
 
-uintptr_t bam_get_widget_metadata(bam_t* bam, bam_widget_handle_t widget) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT_WIDGET_HANDLE(bam, widget);
 
-    return widget_from_handle(bam, widget)->metadata;
-}
+typedef struct {
+    bool negative;
+    unsigned long int_part;
+    unsigned long frac_part;
+    int frac_digits;
+} bam_number_scan_t;
 
 
-static bam_widget_t* widget_find_at_point(const bam_t* bam, int x, int y) {
-    bam_widget_t* widget_begin = bam->widget_buffer_begin;
-    bam_widget_t* widget_i = bam->widget_buffer_ptr;
+static const unsigned long NUMBER_POW10_LUT[BAM_NUMBER_MAX_PRECISION + 1] = {
+        1ul, 10ul, 100ul, 1000ul, 10000ul, 100000ul, 1000000ul, 10000000ul, 100000000ul, 1000000000ul
+};
 
-    while (widget_i != widget_begin) {
-        widget_i--;
 
-        if (rect_contains_point(&widget_i->rect, x, y)) {
-            return widget_i;
-        }
-    }
+static char* number_format_digits(char* end, unsigned long value, int min_digits) {
+    // digits are written backwards, ending just before end
+    do {
+        *(--end) = (char) ('0' + (value % 10));
+        value /= 10;
+        min_digits--;
+    } while (value || min_digits > 0);
 
-    return NULL;
+    return end;
 }
 
 
-static void widget_set_pressed(bam_t* bam, bam_widget_t* widget) {
-    if (bam->pressed_widget) {
-        bam->pressed_widget->state = BAM_STATE_ENABLED;
-        widget_make_dirty(bam, bam->pressed_widget);
-    }
-
-    bam->pressed_widget = widget;
+static size_t number_copy_out(char* buffer, size_t buffer_size, const char* str, size_t length) {
+    // like snprintf(), truncate output to fit buffer but return untruncated length
+    if (buffer_size > 0) {
+        size_t n = (length < buffer_size) ? length : (buffer_size - 1);
 
-    if (bam->pressed_widget) {
-        bam->pressed_widget->state = BAM_STATE_PRESSED;
-        widget_make_dirty(bam, bam->pressed_widget);
+        memcpy(buffer, str, n);
+        buffer[n] = '\0';
     }
-}
 
+    return length;
+}
 
-// ******** EVENT API ********
 
-int bam_start(bam_t* bam) {
-    BAM_ASSERT_CTX(bam);
+static bool number_scan(const char* str, bool allow_fraction, bam_number_scan_t* scan) {
+    bool have_digits = false;
 
-    const bam_vtable_t* vtable = bam->vtable;
-    bool* saved_run_flag;
-    bool run_flag;
-    bool need_clean;
+    scan->negative = false;
+    scan->int_part = 0;
+    scan->frac_part = 0;
+    scan->frac_digits = 0;
 
-    // if this is not a nested event loop, ensure quit flag is false
-    if (!bam->run_flag) {
-        bam->quit_flag = false;
+    if (*str == '-' || *str == '+') {
+        scan->negative = (*str == '-');
+        str++;
     }
 
-    // save pointer to previous run flag
-    saved_run_flag = bam->run_flag;
-
-    // point context at new run flag
-    run_flag = true;
-    bam->run_flag = &run_flag;
+    // accumulate integer part, saturating on overflow
+    while (lex_is_digit(*str)) {
+        unsigned long digit = (unsigned long) (*str++ - '0');
 
-    // set 'need_clean' flag initially to ensure screen is up-to-date when event loop starts
-    need_clean = true;
+        scan->int_part = (scan->int_part > ((ULONG_MAX - digit) / 10)) ? ULONG_MAX : (scan->int_part * 10) + digit;
+        have_digits = true;
+    }
 
-    // process events
-    do {
-        bam_event_t event;
-        bam_widget_t* widget;
-        bam_widget_t* triggered_widget;
+    // accumulate fractional part, ignoring digits beyond maximum supported precision
+    if (allow_fraction && *str == '.') {
+        str++;
 
-        // reset triggered_widget pointer
-        triggered_widget = NULL;
+        while (lex_is_digit(*str)) {
+            if (scan->frac_digits < BAM_NUMBER_MAX_PRECISION) {
+                scan->frac_part = (scan->frac_part * 10) + (unsigned long) (*str - '0');
+                scan->frac_digits++;
+            }
 
-        // clean dirty buffer if an event occurred that necessitates it
-        if (need_clean) {
-            need_clean = false;
-            dirty_clean(bam);
+            str++;
+            have_digits = true;
         }
+    }
 
-        // clear event type so that timeouts can be detected
-        event.type = BAM_EVENT_TYPE_NONE;
+    return have_digits && *str == '\0';
+}
 
-        // get next event
-        if (vtable->get_event(&event, 100, bam->user_data)) {
-            // decode event
-            switch (event.type) {
-            case BAM_EVENT_TYPE_QUIT:
-                // stop all event loops
-                bam_quit(bam, 0);
-                break;
 
-            case BAM_EVENT_TYPE_PRESS:
-                // find widget at pressed coordinate
-                widget = widget_find_at_point(bam, event.x, event.y);
+size_t bam_format_int(char* buffer, size_t buffer_size, long value) {
+    BAM_ASSERT(buffer || buffer_size == 0);
 
-                // if a widget was found and is enabled, set its state to pressed
-                if (widget && widget->state == BAM_STATE_ENABLED) {
-                    widget_set_pressed(bam, widget_find_at_point(bam, event.x, event.y));
-                    need_clean = true;
-                }
-                break;
+    char str[BAM_NUMBER_MAX_LENGTH];
+    char* end = str + sizeof(str);
+    unsigned long magnitude = (value < 0) ? (0ul - (unsigned long) value) : (unsigned long) value;
+    char* str_i = number_format_digits(end, magnitude, 1);
 
-            case BAM_EVENT_TYPE_RELEASE:
-                // if a pressed widget exists, see if it is the same widget at release coordinate
-                if (bam->pressed_widget) {
-                    // find widget at released coordinate
-                    widget = widget_find_at_point(bam, event.x, event.y);
+    if (value < 0) {
+        *(--str_i) = '-';
+    }
 
-                    // if found widget is the pressed widget mark it as triggered
-                    if (widget == bam->pressed_widget) {
-                        triggered_widget = widget;
-                    }
-                }
+    return number_copy_out(buffer, buffer_size, str_i, end - str_i);
+}
 
-                // if a pressed widget exists, return it to enabled state
-                widget_set_pressed(bam, NULL);
-                need_clean = true;
-                break;
 
-            default:
-                break;
-            }
-        }
+size_t bam_format_real(char* buffer, size_t buffer_size, bam_real_t value, int precision) {
+    BAM_ASSERT(buffer || buffer_size == 0);
 
-        // if a widget has been triggered and it has a callback function, dispatch it
-        if (triggered_widget && triggered_widget->callback) {
-            triggered_widget->callback(bam, triggered_widget - bam->widget_buffer_begin, triggered_widget->user_data);
-        }
-    } while (run_flag && !bam->quit_flag);
+    char str[BAM_NUMBER_MAX_LENGTH];
+    char* end = str + sizeof(str);
+    char* str_i = end;
+    bool negative = value < 0;
+    unsigned long int_part;
+    unsigned long frac_part;
 
-    // point context at previous run flag
-    bam->run_flag = saved_run_flag;
+    precision = min_int(max_int(precision, 0), BAM_NUMBER_MAX_PRECISION);
 
-    // return event loop result (set by bam_stop)
-    return bam->run_result;
-}
+#ifdef BAM_REAL_FIXED_BITS
+    // fixed-point - split into integer and fractional parts and scale fraction to precision, rounding to nearest
+    uint64_t magnitude = negative ? (((uint64_t) 0) - (uint64_t) value) : (uint64_t) value;
 
+    int_part = (unsigned long) (magnitude >> BAM_REAL_FIXED_BITS);
+    frac_part = (unsigned long) ((((magnitude & (BAM_REAL_FIXED_ONE - 1)) * NUMBER_POW10_LUT[precision]) +
+                                  (BAM_REAL_FIXED_ONE / 2)) >> BAM_REAL_FIXED_BITS);
+#else
+    // floating-point - magnitudes too large to fit integer part saturate
+    if (negative) {
+        value = -value;
+    }
 
-void bam_stop(bam_t* bam, int result) {
-    BAM_ASSERT_CTX(bam);
+    if (value >= (bam_real_t) ULONG_MAX) {
+        int_part = ULONG_MAX;
+        frac_part = 0;
+    } else {
+        int_part = (unsigned long) value;
+        frac_part = (unsigned long) (((value - (bam_real_t) int_part) * (bam_real_t) NUMBER_POW10_LUT[precision]) +
+                                     (bam_real_t) 0.5);
+    }
+#endif // BAM_REAL_FIXED_BITS
 
-    // only act if an event loop is currently running
-    if (bam->run_flag) {
-        // set run result
-        bam->run_result = result;
+    // carry rounding of fractional part into integer part
+    if (frac_part >= NUMBER_POW10_LUT[precision]) {
+        frac_part -= NUMBER_POW10_LUT[precision];
 
-        // clear current run flag
-        *(bam->run_flag) = false;
+        if (int_part < ULONG_MAX) {
+            int_part++;
+        }
     }
-}
 
+    if (precision > 0) {
+        str_i = number_format_digits(str_i, frac_part, precision);
+        *(--str_i) = '.';
+    }
 
-void bam_quit(bam_t* bam, int result) {
-    // stop current event loop
-    bam_stop(bam, result);
+    str_i = number_format_digits(str_i, int_part, 1);
 
-    // set quit flag - this causes all nested event loops to stop
-    bam->quit_flag = true;
+    // don't output negative zero
+    if (negative && (int_part || frac_part)) {
+        *(--str_i) = '-';
+    }
+
+    return number_copy_out(buffer, buffer_size, str_i, end - str_i);
 }
 
 
-// ******** LAYOUT API ********
+bool bam_parse_int(const char* str, long* value) {
+    BAM_ASSERT(str);
+    BAM_ASSERT(value);
 
-void bam_layout_grid(bam_t* bam, int n_cols, int n_rows, const bam_rect_t* bounds,
-                     int h_spacing, int v_spacing, const bam_style_t* style, bool enabled,
-                     bam_widget_handle_t handles[], size_t n_handles) {
-    BAM_ASSERT_CTX(bam);
-    BAM_ASSERT(bounds);
-    BAM_ASSERT(handles || n_handles == 0);
+    bam_number_scan_t scan;
 
-    bam_widget_handle_t* handle_i = handles;
-    bam_widget_handle_t* handle_e = handles + n_handles;
-    bam_rect_t rect = *bounds;
-    int width;
-    int height;
-    int x;
-    int y;
+    if (!number_scan(str, false, &scan)) {
+        return false;
+    }
 
-    // do nothing if n_cols, n_rows ro bounds are invalid
-    if (n_cols <= 0 || n_rows <= 0 || rect_empty(bounds)) {
-        return;
+    // saturate to range of long
+    if (scan.negative) {
+        *value = (scan.int_part > ((unsigned long) LONG_MAX)) ? LONG_MIN : -((long) scan.int_part);
+    } else {
+        *value = (scan.int_part > ((unsigned long) LONG_MAX)) ? LONG_MAX : (long) scan.int_part;
     }
 
-    // clip spacing
-    h_spacing = max_int(0, h_spacing);
-    v_spacing = max_int(0, v_spacing);
+    return true;
+}
 
-    // calculate widget width
-    width = (rect_width(&rect) - (h_spacing * (n_cols - 1))) / n_cols;
 
-    // calculate widget height
-    height = (rect_height(&rect) - (v_spacing * (n_rows - 1))) / n_rows;
+bool bam_parse_real(const char* str, bam_real_t* value) {
+    BAM_ASSERT(str);
+    BAM_ASSERT(value);
 
-    // layout widgets
-    y = rect.y1;
+    bam_number_scan_t scan;
 
-    for (int row = 0; row < n_rows; row++) {
-        x = rect.x1;
+    if (!number_scan(str, true, &scan)) {
+        return false;
+    }
 
-        for (int col = 0; col < n_cols; col++) {
-            if (handle_i >= handle_e) {
-                return;
-            }
+#ifdef BAM_REAL_FIXED_BITS
+    // fixed-point - convert decimal fraction to binary one bit at a time, so that no 64-bit division is needed
+    unsigned long denominator = NUMBER_POW10_LUT[scan.frac_digits];
+    unsigned long remainder = scan.frac_part;
+    uint64_t magnitude = ((uint64_t) scan.int_part) << BAM_REAL_FIXED_BITS;
+    uint64_t frac_bits = 0;
 
-            *handle_i = bam_add_widget(bam, x, y, width, height, style, NULL, enabled);
-            handle_i++;
+    for (int i = 0; i < BAM_REAL_FIXED_BITS; i++) {
+        remainder *= 2;
+        frac_bits <<= 1;
 
-            x += width + h_spacing;
+        if (remainder >= denominator) {
+            remainder -= denominator;
+            frac_bits |= 1;
         }
+    }
+
+    // round to nearest
+    if ((remainder * 2) >= denominator) {
+        frac_bits++;
+    }
 
-        y += height + v_spacing;
+    magnitude += frac_bits;
+
+    if (scan.int_part > (unsigned long) (BAM_REAL_FIXED_MAX >> BAM_REAL_FIXED_BITS) ||
+        magnitude > BAM_REAL_FIXED_MAX) {
+        magnitude = BAM_REAL_FIXED_MAX;
+    }
+
+    *value = (bam_real_t) magnitude;
+#else
+    *value = (bam_real_t) scan.int_part +
+             ((bam_real_t) scan.frac_part / (bam_real_t) NUMBER_POW10_LUT[scan.frac_digits]);
+#endif // BAM_REAL_FIXED_BITS
+
+    if (scan.negative) {
+        *value = -(*value);
     }
+
+    return true;
 }
 
 
@@ -969,6 +7090,16 @@ void bam_layout_grid(bam_t* bam, int n_cols, int n_rows, const bam_rect_t* bound
 
 #define BAM_EDIT_NUMBER_BUFFER_SIZE     16
 
+#ifndef BAM_EDIT_STRING_MAX_GLYPHS
+#define BAM_EDIT_STRING_MAX_GLYPHS      128
+#endif // BAM_EDIT_STRING_MAX_GLYPHS
+
+#ifndef BAM_CARET_BLINK_INTERVAL
+#define BAM_CARET_BLINK_INTERVAL        500u
+#endif // BAM_CARET_BLINK_INTERVAL
+
+#define BAM_CARET_WIDTH                 2
+
 typedef enum {
     BAM_NUMBER_TYPE_UNSIGNED_INT,
     BAM_NUMBER_TYPE_SIGNED_INT,
@@ -991,7 +7122,9 @@ typedef enum {
     BAM_EDIT_NUMBER_METADATA_BACKSPACE,
     BAM_EDIT_NUMBER_METADATA_CLEAR,
     BAM_EDIT_NUMBER_METADATA_ACCEPT,
-    BAM_EDIT_NUMBER_METADATA_CANCEL
+    BAM_EDIT_NUMBER_METADATA_CANCEL,
+    BAM_EDIT_NUMBER_METADATA_CHAR,
+    BAM_EDIT_NUMBER_METADATA_COUNT
 } bam_edit_number_metadata_t;
 
 
@@ -1001,9 +7134,7 @@ typedef enum {
     BAM_EDIT_STRING_KEY_CANCEL = 40,
     BAM_EDIT_STRING_KEY_CLEAR = 41,
     BAM_EDIT_STRING_KEY_SPACE = 42,
-    BAM_EDIT_STRING_KEY_UNUSED_BEGIN = 43,
-    BAM_EDIT_STRING_KEY_UNUSED_END = 48,
-    BAM_EDIT_STRING_KEY_ACCEPT = 49
+    BAM_EDIT_STRING_KEY_ACCEPT = 43
 } bam_edit_string_key_t;
 
 
@@ -1014,14 +7145,30 @@ typedef enum {
     BAM_EDIT_STRING_METADATA_CANCEL,
     BAM_EDIT_STRING_METADATA_CLEAR,
     BAM_EDIT_STRING_METADATA_ACCEPT,
-    BAM_EDIT_STRING_METADATA_SPACE
+    BAM_EDIT_STRING_METADATA_SPACE,
+    BAM_EDIT_STRING_METADATA_COUNT
 } bam_edit_string_metadata_t;
 
 
+typedef enum {
+    BAM_EDIT_KEY_STYLE_CHAR,
+    BAM_EDIT_KEY_STYLE_NUM,
+    BAM_EDIT_KEY_STYLE_EDIT,
+    BAM_EDIT_KEY_STYLE_ACCEPT,
+    BAM_EDIT_KEY_STYLE_CANCEL,
+    BAM_EDIT_KEY_STYLE_COUNT
+} bam_edit_key_style_t;
+
+
+#define BAM_EDIT_KEY(column, row, column_span, style, code, label, shifted_label) \
+        {(column), (row), (column_span), 1, BAM_EDIT_KEY_STYLE_##style, (code), (label), (shifted_label)}
+
+
 typedef struct {
     bam_number_type_t type;
     bam_widget_handle_t field_widget;
-    bam_widget_handle_t key_widgets[16];
+    bam_widget_handle_t keypad_widget;
+    bam_keypad_t keypad;
     char* buffer_begin;
     char* buffer_ptr;
     char* buffer_end;
@@ -1030,15 +7177,34 @@ typedef struct {
 
 typedef struct {
     bam_widget_handle_t field_widget;
-    bam_widget_handle_t key_widgets[50];
-    char* buffer_begin;
-    char* buffer_ptr;
-    char* buffer_end;
+    bam_widget_handle_t keypad_widget;
+    bam_keypad_t keypad;
+    bam_timer_t caret_timer;
+    char* buffer;
+    size_t text_end;
+    size_t gap_begin;
+    size_t gap_end;
+    size_t n_glyphs_before;
+    size_t n_glyphs_after;
+    int caret_x;
+    int text_width;
+    bool caret_visible;
     bool allow_empty;
-    bool shifted;
+    bool advances_cached;
+    uint8_t advances[BAM_EDIT_STRING_MAX_GLYPHS];
 } bam_edit_string_ctx_t;
 
 
+static void edit_init_key_styles(const bam_editor_style_t* editor_style,
+                                 const bam_style_t* styles[BAM_EDIT_KEY_STYLE_COUNT]) {
+    styles[BAM_EDIT_KEY_STYLE_CHAR] = editor_style->char_key_style;
+    styles[BAM_EDIT_KEY_STYLE_NUM] = editor_style->num_key_style;
+    styles[BAM_EDIT_KEY_STYLE_EDIT] = editor_style->edit_key_style;
+    styles[BAM_EDIT_KEY_STYLE_ACCEPT] = editor_style->accept_key_style;
+    styles[BAM_EDIT_KEY_STYLE_CANCEL] = editor_style->cancel_key_style;
+}
+
+
 static bool is_digit(char c) {
     return (c >= '0') && (c <= '9');
 }
@@ -1070,8 +7236,7 @@ static const char* validate_ip_number(const char* str_i, const char* str_e) {
 static void edit_number_enforce_format(bam_t* bam, bam_edit_number_ctx_t* ctx) {
     const char* str = ctx->buffer_begin;
     size_t length = ctx->buffer_ptr - ctx->buffer_begin;
-    bam_widget_handle_t dp_widget = ctx->key_widgets[BAM_EDIT_NUMBER_KEY_DP];
-    bam_widget_handle_t minus_widget = ctx->key_widgets[BAM_EDIT_NUMBER_KEY_MINUS];
+    bam_widget_handle_t keypad_widget = ctx->keypad_widget;
 
     if ( ctx->type == BAM_NUMBER_TYPE_IPV4_ADDRESS ) {
         int dot_count = 0;
@@ -1118,37 +7283,40 @@ static void edit_number_enforce_format(bam_t* bam, bam_edit_number_ctx_t* ctx) {
             }
         }
 
-        bam_set_widget_enabled(bam, dp_widget, length > 0 && str[length - 1] != '.' && dot_count < 3);
-        bam_set_widget_enabled(bam, ctx->key_widgets[BAM_EDIT_NUMBER_KEY_ACCEPT], valid);
-        bam_set_widget_enabled(bam, minus_widget, false);
+        bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_DP,
+                                   length > 0 && str[length - 1] != '.' && dot_count < 3);
+
+        bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_ACCEPT, valid);
+        bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_MINUS, false);
     } else {
 
         switch (length) {
         case 0:
-            bam_set_widget_enabled(bam, dp_widget, false);
-            bam_set_widget_enabled(bam, minus_widget, ctx->type != BAM_NUMBER_TYPE_UNSIGNED_INT);
+            bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_DP, false);
+            bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_MINUS,
+                                       ctx->type != BAM_NUMBER_TYPE_UNSIGNED_INT);
             break;
 
         case 1:
-            bam_set_widget_enabled(bam, dp_widget, ctx->type == BAM_NUMBER_TYPE_REAL &&
-                                                   lex_is_digit(str[0]));
+            bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_DP,
+                                       ctx->type == BAM_NUMBER_TYPE_REAL && lex_is_digit(str[0]));
 
-            bam_set_widget_enabled(bam, minus_widget, false);
+            bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_MINUS, false);
             break;
 
         default:
-            bam_set_widget_enabled(bam, dp_widget, ctx->type == BAM_NUMBER_TYPE_REAL &&
-                                                   strchr(str, '.') == NULL);
+            bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_DP,
+                                       ctx->type == BAM_NUMBER_TYPE_REAL && strchr(str, '.') == NULL);
 
-            bam_set_widget_enabled(bam, minus_widget, false);
+            bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_MINUS, false);
         }
 
-        bam_set_widget_enabled(bam, ctx->key_widgets[BAM_EDIT_NUMBER_KEY_ACCEPT], length > 0 &&
-                                                                                  lex_is_digit(ctx->buffer_ptr[-1]));
+        bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_ACCEPT,
+                                   length > 0 && lex_is_digit(ctx->buffer_ptr[-1]));
     }
 
-    bam_set_widget_enabled(bam, ctx->key_widgets[BAM_EDIT_NUMBER_KEY_BACKSPACE], length > 0);
-    bam_set_widget_enabled(bam, ctx->key_widgets[BAM_EDIT_NUMBER_KEY_CLEAR], length > 0);
+    bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_BACKSPACE, length > 0);
+    bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_NUMBER_KEY_CLEAR, length > 0);
 
     bam_force_widget_redraw(bam, ctx->field_widget);
 }
@@ -1164,11 +7332,10 @@ static void edit_number_append(bam_t* bam, bam_edit_number_ctx_t* ctx, char c) {
 }
 
 
-static void edit_number_key_func(bam_t* bam, bam_widget_handle_t widget, void* user_data) {
+static void edit_number_key_func(bam_t* bam, bam_widget_handle_t widget, size_t key, void* user_data) {
     bam_edit_number_ctx_t* ctx = user_data;
-    uintptr_t metadata = bam_get_widget_metadata(bam, widget);
 
-    switch (metadata) {
+    switch (bam_get_keypad_key_code(bam, widget, key)) {
     case BAM_EDIT_NUMBER_METADATA_BACKSPACE:
         if (ctx->buffer_ptr != ctx->buffer_begin) {
             ctx->buffer_ptr--;
@@ -1192,21 +7359,37 @@ static void edit_number_key_func(bam_t* bam, bam_widget_handle_t widget, void* u
         break;
 
     default:
-        edit_number_append(bam, ctx, (char) metadata);
+        edit_number_append(bam, ctx, bam_get_keypad_key_label(bam, widget, key)[0]);
     }
 }
 
 
 static bool edit_number(bam_t* bam, char* buffer, size_t buffer_size, bam_number_type_t type,
                         const bam_editor_style_t* editor_style) {
-    static const char* KEYPAD_TEXT[16] = {
-            "7", "8", "9", "",
-            "4", "5", "6", "",
-            "1", "2", "3", "",
-            ".", "0", "-", ""
+    static const bam_keypad_key_t KEYS[16] = {
+            BAM_EDIT_KEY(0, 0, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "7", NULL),
+            BAM_EDIT_KEY(1, 0, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "8", NULL),
+            BAM_EDIT_KEY(2, 0, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "9", NULL),
+            BAM_EDIT_KEY(3, 0, 1, EDIT, BAM_EDIT_NUMBER_METADATA_BACKSPACE, NULL, NULL),
+            BAM_EDIT_KEY(0, 1, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "4", NULL),
+            BAM_EDIT_KEY(1, 1, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "5", NULL),
+            BAM_EDIT_KEY(2, 1, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "6", NULL),
+            BAM_EDIT_KEY(3, 1, 1, EDIT, BAM_EDIT_NUMBER_METADATA_CLEAR, NULL, NULL),
+            BAM_EDIT_KEY(0, 2, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "1", NULL),
+            BAM_EDIT_KEY(1, 2, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "2", NULL),
+            BAM_EDIT_KEY(2, 2, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "3", NULL),
+            BAM_EDIT_KEY(3, 2, 1, ACCEPT, BAM_EDIT_NUMBER_METADATA_ACCEPT, NULL, NULL),
+            BAM_EDIT_KEY(0, 3, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, ".", NULL),
+            BAM_EDIT_KEY(1, 3, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "0", NULL),
+            BAM_EDIT_KEY(2, 3, 1, NUM, BAM_EDIT_NUMBER_METADATA_CHAR, "-", NULL),
+            BAM_EDIT_KEY(3, 3, 1, CANCEL, BAM_EDIT_NUMBER_METADATA_CANCEL, NULL, NULL)
     };
 
+    static const bam_keypad_layout_t LAYOUT = {4, 4, 16, KEYS};
+
     const bam_vtable_t* vtable = bam->vtable;
+    const bam_style_t* key_styles[BAM_EDIT_KEY_STYLE_COUNT];
+    const char* key_labels[BAM_EDIT_NUMBER_METADATA_COUNT];
     const bam_style_t* style;
     bool ret_val;
     int spacing = editor_style->spacing;
@@ -1257,41 +7440,22 @@ static bool edit_number(bam_t* bam, char* buffer, size_t buffer_size, bam_number
     bounds.x2 = bam->disp_width;
     bounds.y2 = bam->disp_height;
 
-    // create keypad widgets
-    bam_layout_grid(bam, 4, 4, &bounds, spacing, spacing,
-                    widget_get_style(bam, editor_style->num_key_style), true,
-                    ctx.key_widgets, 16);
-
-    // set numeric key text, metadata and callbacks
-    for (int i = 0; i < 16; i++) {
-        bam_set_widget_text(bam, ctx.key_widgets[i], KEYPAD_TEXT[i]);
-        bam_set_widget_metadata(bam, ctx.key_widgets[i], KEYPAD_TEXT[i][0]);
-        bam_set_widget_callback(bam, ctx.key_widgets[i], edit_number_key_func, &ctx);
-    }
-
-    // apply style/text/metadata to backspace key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_BACKSPACE], editor_style->edit_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_BACKSPACE], editor_style->backspace_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_BACKSPACE],
-                            BAM_EDIT_NUMBER_METADATA_BACKSPACE);
-
-    // apply style/text to clear key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_CLEAR], editor_style->edit_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_CLEAR], editor_style->clear_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_CLEAR],
-                            BAM_EDIT_NUMBER_METADATA_CLEAR);
-
-    // apply style/text to accept key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_ACCEPT], editor_style->accept_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_ACCEPT], editor_style->accept_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_ACCEPT],
-                            BAM_EDIT_NUMBER_METADATA_ACCEPT);
-
-    // apply style/text to cancel key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_CANCEL], editor_style->cancel_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_CANCEL], editor_style->cancel_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_NUMBER_KEY_CANCEL],
-                            BAM_EDIT_NUMBER_METADATA_CANCEL);
+    // set styles and text of keys, indexed by key style and key code respectively
+    edit_init_key_styles(editor_style, key_styles);
+
+    key_labels[BAM_EDIT_NUMBER_METADATA_BACKSPACE] = editor_style->backspace_text;
+    key_labels[BAM_EDIT_NUMBER_METADATA_CLEAR] = editor_style->clear_text;
+    key_labels[BAM_EDIT_NUMBER_METADATA_ACCEPT] = editor_style->accept_text;
+    key_labels[BAM_EDIT_NUMBER_METADATA_CANCEL] = editor_style->cancel_text;
+    key_labels[BAM_EDIT_NUMBER_METADATA_CHAR] = NULL;
+
+    // create keypad widget
+    bam_init_keypad(&ctx.keypad, &LAYOUT, key_styles, BAM_EDIT_KEY_STYLE_COUNT, key_labels, spacing);
+
+    ctx.keypad_widget = bam_add_widget(bam, bounds.x1, bounds.y1, rect_width(&bounds), rect_height(&bounds),
+                                       NULL, NULL, true);
+
+    bam_set_widget_keypad(bam, ctx.keypad_widget, &ctx.keypad, edit_number_key_func, &ctx);
 
     // enforce format by enabling/disabling dp/minus keys based on buffer's current content and the type of number
     // being edited
@@ -1316,14 +7480,16 @@ bool bam_edit_integer(bam_t* bam, int* value, bool is_signed, const bam_editor_s
     char buffer[BAM_EDIT_NUMBER_BUFFER_SIZE];
     bool accepted;
 
-    snprintf(buffer, BAM_EDIT_NUMBER_BUFFER_SIZE, "%i", *value);
+    bam_format_int(buffer, BAM_EDIT_NUMBER_BUFFER_SIZE, *value);
 
     accepted = edit_number(bam, buffer, BAM_EDIT_NUMBER_BUFFER_SIZE,
                            is_signed ? BAM_NUMBER_TYPE_SIGNED_INT : BAM_NUMBER_TYPE_UNSIGNED_INT,
                            editor_style);
 
     if (accepted) {
-        long lvalue = strtol(buffer, NULL, 10);
+        long lvalue = 0;
+
+        bam_parse_int(buffer, &lvalue);
 
         if (lvalue < INT_MIN) {
             lvalue = INT_MIN;
@@ -1346,13 +7512,13 @@ bool bam_edit_real(bam_t* bam, bam_real_t* value, const bam_editor_style_t* edit
     char buffer[BAM_EDIT_NUMBER_BUFFER_SIZE];
     bool accepted;
 
-    snprintf(buffer, BAM_EDIT_NUMBER_BUFFER_SIZE, "%f", *value);
+    bam_format_real(buffer, BAM_EDIT_NUMBER_BUFFER_SIZE, *value, BAM_REAL_PRECISION);
 
     accepted = edit_number(bam, buffer, BAM_EDIT_NUMBER_BUFFER_SIZE, BAM_NUMBER_TYPE_REAL,
                            editor_style);
 
     if (accepted) {
-        *value = strtod(buffer, NULL);
+        bam_parse_real(buffer, value);
     }
 
     return accepted;
@@ -1371,119 +7537,471 @@ bool bam_edit_ipv4_address(bam_t* bam, bam_editor_ipv4_address_t* address, const
 }
 
 
-static const char* EDIT_STRING_KEYPAD_TEXT_UPPER[50] = {
-        "!", "@", "#", "$", "%", "^", "&", "*", "(", ")",
-        "Q", "W", "E", "R", "T", "Y", "U", "I", "O", "P",
-        "A", "S", "D", "F", "G", "H", "J", "K", "L", ".",
-        "", "Z", "X", "C", "V", "B", "N", "M", ",", "",
-        "", "", "", "", "", "", "", "", "", ""
+static const bam_keypad_key_t EDIT_STRING_KEYS[44] = {
+        BAM_EDIT_KEY(0, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "1", "!"),
+        BAM_EDIT_KEY(1, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "2", "@"),
+        BAM_EDIT_KEY(2, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "3", "#"),
+        BAM_EDIT_KEY(3, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "4", "$"),
+        BAM_EDIT_KEY(4, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "5", "%"),
+        BAM_EDIT_KEY(5, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "6", "^"),
+        BAM_EDIT_KEY(6, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "7", "&"),
+        BAM_EDIT_KEY(7, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "8", "*"),
+        BAM_EDIT_KEY(8, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "9", "("),
+        BAM_EDIT_KEY(9, 0, 1, NUM, BAM_EDIT_STRING_METADATA_CHAR, "0", ")"),
+        BAM_EDIT_KEY(0, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "q", "Q"),
+        BAM_EDIT_KEY(1, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "w", "W"),
+        BAM_EDIT_KEY(2, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "e", "E"),
+        BAM_EDIT_KEY(3, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "r", "R"),
+        BAM_EDIT_KEY(4, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "t", "T"),
+        BAM_EDIT_KEY(5, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "y", "Y"),
+        BAM_EDIT_KEY(6, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "u", "U"),
+        BAM_EDIT_KEY(7, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "i", "I"),
+        BAM_EDIT_KEY(8, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "o", "O"),
+        BAM_EDIT_KEY(9, 1, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "p", "P"),
+        BAM_EDIT_KEY(0, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "a", "A"),
+        BAM_EDIT_KEY(1, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "s", "S"),
+        BAM_EDIT_KEY(2, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "d", "D"),
+        BAM_EDIT_KEY(3, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "f", "F"),
+        BAM_EDIT_KEY(4, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "g", "G"),
+        BAM_EDIT_KEY(5, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "h", "H"),
+        BAM_EDIT_KEY(6, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "j", "J"),
+        BAM_EDIT_KEY(7, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "k", "K"),
+        BAM_EDIT_KEY(8, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "l", "L"),
+        BAM_EDIT_KEY(9, 2, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, ".", NULL),
+        BAM_EDIT_KEY(0, 3, 1, EDIT, BAM_EDIT_STRING_METADATA_SHIFT, NULL, NULL),
+        BAM_EDIT_KEY(1, 3, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "z", "Z"),
+        BAM_EDIT_KEY(2, 3, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "x", "X"),
+        BAM_EDIT_KEY(3, 3, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "c", "C"),
+        BAM_EDIT_KEY(4, 3, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "v", "V"),
+        BAM_EDIT_KEY(5, 3, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "b", "B"),
+        BAM_EDIT_KEY(6, 3, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "n", "N"),
+        BAM_EDIT_KEY(7, 3, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, "m", "M"),
+        BAM_EDIT_KEY(8, 3, 1, CHAR, BAM_EDIT_STRING_METADATA_CHAR, ",", NULL),
+        BAM_EDIT_KEY(9, 3, 1, EDIT, BAM_EDIT_STRING_METADATA_BACKSPACE, NULL, NULL),
+        BAM_EDIT_KEY(0, 4, 1, CANCEL, BAM_EDIT_STRING_METADATA_CANCEL, NULL, NULL),
+        BAM_EDIT_KEY(1, 4, 1, EDIT, BAM_EDIT_STRING_METADATA_CLEAR, NULL, NULL),
+        BAM_EDIT_KEY(2, 4, 7, CHAR, BAM_EDIT_STRING_METADATA_SPACE, NULL, NULL),
+        BAM_EDIT_KEY(9, 4, 1, ACCEPT, BAM_EDIT_STRING_METADATA_ACCEPT, NULL, NULL)
 };
 
 
-static const char* EDIT_STRING_KEYPAD_TEXT_LOWER[50] = {
-        "1", "2", "3", "4", "5", "6", "7", "8", "9", "0",
-        "q", "w", "e", "r", "t", "y", "u", "i", "o", "p",
-        "a", "s", "d", "f", "g", "h", "j", "k", "l", ".",
-        "", "z", "x", "c", "v", "b", "n", "m", ",", "",
-        "", "", "", "", "", "", "", "", "", ""
-};
+static const bam_keypad_layout_t EDIT_STRING_LAYOUT = {10, 5, 44, EDIT_STRING_KEYS};
+
 
+static bool edit_string_is_continuation(char c) {
+    return (c & 0xC0) == 0x80;
+}
 
-static void edit_string_modify_char_keys(bam_t* bam, bam_edit_string_ctx_t* ctx) {
-    const char** text = ctx->shifted ? EDIT_STRING_KEYPAD_TEXT_UPPER : EDIT_STRING_KEYPAD_TEXT_LOWER;
 
-    for (int i = 0; i < 50; i++) {
-        if (bam_get_widget_metadata(bam, ctx->key_widgets[i]) == BAM_EDIT_STRING_METADATA_CHAR ) {
-            bam_set_widget_text(bam, ctx->key_widgets[i], text[i]);
-        }
+static int edit_string_glyph_advance(bam_t* bam, bam_font_t font, bam_unichar_t codepoint) {
+    bam_glyph_metrics_t glyph_metrics;
+
+    // advances are cached as bytes, glyphs without metrics are not drawn so take up no space
+    if (!bam->vtable->get_glyph_metrics(&glyph_metrics, font, codepoint, bam->user_data)) {
+        return 0;
     }
+
+    return min_int(max_int(glyph_metrics.x_advance, 0), UINT8_MAX);
 }
 
 
-static void edit_string_enforce_format(bam_t* bam, bam_edit_string_ctx_t* ctx) {
-    const char* str = ctx->buffer_begin;
-    size_t length = ctx->buffer_ptr - ctx->buffer_begin;
-    size_t space = ctx->buffer_end - 1 - ctx->buffer_ptr;
-    bool char_keys_changed = false;
-    bool char_keys_enabled;
-
-    if ( space == 0 && bam_get_widget_enabled(bam, ctx->key_widgets[0]) ) {
-        char_keys_changed = true;
-        char_keys_enabled = false;
-    } else if ( space > 0 && !bam_get_widget_enabled(bam, ctx->key_widgets[0]) ) {
-        char_keys_changed = true;
-        char_keys_enabled = true;
-    }
-
-    if ( char_keys_changed ) {
-        for (int i = 0; i < 50; i++) {
-            if (bam_get_widget_metadata(bam, ctx->key_widgets[i]) == BAM_EDIT_STRING_METADATA_CHAR ) {
-                bam_set_widget_enabled(bam, ctx->key_widgets[i], char_keys_enabled);
-            }
-        }
+static size_t edit_string_glyph_count(const bam_edit_string_ctx_t* ctx) {
+    return ctx->n_glyphs_before + ctx->n_glyphs_after;
+}
 
-        bam_set_widget_enabled(bam, ctx->key_widgets[BAM_EDIT_STRING_KEY_SPACE], char_keys_enabled);
+
+static size_t edit_string_glyph_start(const bam_edit_string_ctx_t* ctx, size_t pos) {
+    while (pos > 0 && edit_string_is_continuation(ctx->buffer[pos])) {
+        pos--;
     }
 
-    bam_set_widget_enabled(bam, ctx->key_widgets[BAM_EDIT_STRING_KEY_BACKSPACE], length > 0);
-    bam_set_widget_enabled(bam, ctx->key_widgets[BAM_EDIT_STRING_KEY_CLEAR], length > 0);
-    bam_set_widget_enabled(bam, ctx->key_widgets[BAM_EDIT_STRING_KEY_ACCEPT],
-                           length > 0 || ctx->allow_empty);
+    return pos;
+}
+
 
-    bam_force_widget_redraw(bam, ctx->field_widget);
+static size_t edit_string_glyph_end(const bam_edit_string_ctx_t* ctx, size_t pos, size_t limit) {
+    do {
+        pos++;
+    } while (pos < limit && edit_string_is_continuation(ctx->buffer[pos]));
+
+    return pos;
 }
 
 
-static void edit_string_append(bam_t* bam, bam_edit_string_ctx_t* ctx, const char* str) {
-    size_t str_len = strlen(str);
-    size_t space = ctx->buffer_end - 1 - ctx->buffer_ptr;
+static int edit_string_decode_advance(bam_t* bam, const bam_edit_string_ctx_t* ctx, size_t pos) {
+    bam_unichar_t codepoint = 0;
 
-    if ( space >= str_len ) {
-        memcpy(ctx->buffer_ptr, str, str_len);
-        ctx->buffer_ptr += str_len;
-        ctx->buffer_ptr[0] = '\0';
-        edit_string_enforce_format(bam, ctx);
+    unicode_decode_utf8((const uint8_t*) ctx->buffer + pos, &codepoint);
+
+    return edit_string_glyph_advance(bam, bam_get_widget_style(bam, ctx->field_widget)->font, codepoint);
+}
+
+
+// advances are cached in a gap array parallel to the text while the text has no more glyphs than the cache holds,
+// beyond that they are worked out from the text when needed
+static int edit_string_advance_before_gap(bam_t* bam, const bam_edit_string_ctx_t* ctx) {
+    if (ctx->advances_cached) {
+        return ctx->advances[ctx->n_glyphs_before - 1];
     }
+
+    return edit_string_decode_advance(bam, ctx, edit_string_glyph_start(ctx, ctx->gap_begin - 1));
 }
 
 
-static void edit_string_truncate(bam_t* bam, bam_edit_string_ctx_t* ctx) {
-    while(ctx->buffer_ptr > ctx->buffer_begin) {
-        ctx->buffer_ptr--;
+static int edit_string_advance_after_gap(bam_t* bam, const bam_edit_string_ctx_t* ctx) {
+    if (ctx->advances_cached) {
+        return ctx->advances[BAM_EDIT_STRING_MAX_GLYPHS - ctx->n_glyphs_after];
+    }
 
-        if ( (ctx->buffer_ptr[0] & 0xC0) != 0x80 ) {
-            break;
+    return edit_string_decode_advance(bam, ctx, ctx->gap_end);
+}
+
+
+static int edit_string_calc_origin(const bam_t* bam, const bam_edit_string_ctx_t* ctx, const bam_rect_t* inner,
+                                   int text_width) {
+    // calculate x coordinate of start of text based on field style's h_align property, as draw_text() would
+    switch (bam_get_widget_style(bam, ctx->field_widget)->h_align) {
+    case BAM_H_ALIGN_CENTER:
+        return ((inner->x1 + inner->x2) / 2) - (text_width / 2);
+
+    case BAM_H_ALIGN_RIGHT:
+        return inner->x2 - 1 - text_width;
+
+    default:
+        return inner->x1;
+    }
+}
+
+
+static void edit_string_calc_caret_rect(const bam_t* bam, const bam_edit_string_ctx_t* ctx, bam_rect_t* rect) {
+    bam_rect_t inner;
+
+    widget_calc_inner(widget_from_handle(bam, ctx->field_widget), &inner);
+
+    rect_init(rect, edit_string_calc_origin(bam, ctx, &inner, ctx->text_width) + ctx->caret_x, inner.y1,
+              BAM_CARET_WIDTH, rect_height(&inner));
+}
+
+
+static void edit_string_mark_caret(bam_t* bam, const bam_edit_string_ctx_t* ctx) {
+    bam_rect_t rect;
+
+    edit_string_calc_caret_rect(bam, ctx, &rect);
+    widget_make_rect_dirty(bam, widget_from_handle(bam, ctx->field_widget), &rect);
+}
+
+
+static void edit_string_mark_changes(bam_t* bam, const bam_edit_string_ctx_t* ctx, const bam_rect_t* old_caret,
+                                     int old_width, int change_x) {
+    int old_origin;
+    int new_origin;
+    bam_rect_t inner;
+    bam_rect_t rect;
+    bam_rect_t caret;
+
+    widget_calc_inner(widget_from_handle(bam, ctx->field_widget), &inner);
+
+    old_origin = edit_string_calc_origin(bam, ctx, &inner, old_width);
+    new_origin = edit_string_calc_origin(bam, ctx, &inner, ctx->text_width);
+
+    if (old_origin == new_origin) {
+        // text has not moved, so only glyphs from point of change onwards need redrawing
+        rect_init(&rect, old_origin + change_x, inner.y1, max_int(old_width, ctx->text_width) - change_x,
+                  rect_height(&inner));
+    } else {
+        // alignment has moved whole text, so redraw both old and new extents
+        rect.x1 = min_int(old_origin, new_origin);
+        rect.y1 = inner.y1;
+        rect.x2 = max_int(old_origin + old_width, new_origin + ctx->text_width);
+        rect.y2 = inner.y2;
+    }
+
+    edit_string_calc_caret_rect(bam, ctx, &caret);
+    rect_union(&rect, old_caret);
+    rect_union(&rect, &caret);
+    widget_make_rect_dirty(bam, widget_from_handle(bam, ctx->field_widget), &rect);
+}
+
+
+static void edit_string_blink_func(bam_t* bam, bam_timer_t* timer, void* user_data) {
+    bam_edit_string_ctx_t* ctx = user_data;
+
+    (void) timer;
+
+    ctx->caret_visible = !ctx->caret_visible;
+    edit_string_mark_caret(bam, ctx);
+}
+
+
+static void edit_string_reset_caret(bam_t* bam, bam_edit_string_ctx_t* ctx) {
+    // keep caret solid while editing by restarting its blink cycle
+    if (!ctx->caret_visible) {
+        ctx->caret_visible = true;
+        edit_string_mark_caret(bam, ctx);
+    }
+
+    bam_start_timer(bam, &ctx->caret_timer, BAM_CARET_BLINK_INTERVAL, true, edit_string_blink_func, ctx);
+}
+
+
+static void edit_string_enforce_format(bam_t* bam, bam_edit_string_ctx_t* ctx) {
+    size_t length = ctx->gap_begin + (ctx->text_end - ctx->gap_end);
+    bool has_space = ctx->gap_begin < ctx->gap_end;
+    bam_widget_handle_t keypad_widget = ctx->keypad_widget;
+
+    // keypad only redraws keys whose enabled state actually changes
+    for (size_t key = 0; key < EDIT_STRING_LAYOUT.n_keys; key++) {
+        if (EDIT_STRING_KEYS[key].code == BAM_EDIT_STRING_METADATA_CHAR) {
+            bam_set_keypad_key_enabled(bam, keypad_widget, key, has_space);
+        }
+    }
+
+    bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_STRING_KEY_SPACE, has_space);
+    bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_STRING_KEY_BACKSPACE, ctx->n_glyphs_before > 0);
+    bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_STRING_KEY_CLEAR, length > 0);
+    bam_set_keypad_key_enabled(bam, keypad_widget, BAM_EDIT_STRING_KEY_ACCEPT, length > 0 || ctx->allow_empty);
+
+    edit_string_reset_caret(bam, ctx);
+}
+
+
+static void edit_string_insert(bam_t* bam, bam_edit_string_ctx_t* ctx, const char* str) {
+    bam_font_t font = bam_get_widget_style(bam, ctx->field_widget)->font;
+    const uint8_t* str_i = (const uint8_t*) str;
+    const uint8_t* str_e = str_i + strlen(str);
+    size_t n_glyphs = 0;
+    int old_caret_x = ctx->caret_x;
+    int old_width = ctx->text_width;
+    bam_rect_t old_caret;
+
+    for (const uint8_t* glyph_i = str_i; glyph_i < str_e; n_glyphs++) {
+        bam_unichar_t codepoint;
+
+        glyph_i = unicode_decode_utf8(glyph_i, &codepoint);
+    }
+
+    // string must fit in gap, and advances stop being cached once text outgrows cache
+    if ((size_t) (str_e - str_i) > (ctx->gap_end - ctx->gap_begin)) {
+        return;
+    }
+
+    if (n_glyphs > BAM_EDIT_STRING_MAX_GLYPHS - edit_string_glyph_count(ctx)) {
+        ctx->advances_cached = false;
+    }
+
+    edit_string_calc_caret_rect(bam, ctx, &old_caret);
+
+    // insert bytes at caret, caching advance of each glyph
+    memcpy(ctx->buffer + ctx->gap_begin, str_i, str_e - str_i);
+    ctx->gap_begin += str_e - str_i;
+
+    while (str_i < str_e) {
+        bam_unichar_t codepoint = 0;
+        int advance;
+
+        str_i = unicode_decode_utf8(str_i, &codepoint);
+        advance = edit_string_glyph_advance(bam, font, codepoint);
+
+        if (ctx->advances_cached) {
+            ctx->advances[ctx->n_glyphs_before] = (uint8_t) advance;
         }
+
+        ctx->n_glyphs_before++;
+        ctx->caret_x += advance;
+        ctx->text_width += advance;
+    }
+
+    edit_string_mark_changes(bam, ctx, &old_caret, old_width, old_caret_x);
+    edit_string_enforce_format(bam, ctx);
+}
+
+
+static void edit_string_backspace(bam_t* bam, bam_edit_string_ctx_t* ctx) {
+    int old_width = ctx->text_width;
+    int advance;
+    bam_rect_t old_caret;
+
+    if (ctx->n_glyphs_before == 0) {
+        return;
     }
 
-    ctx->buffer_ptr[0] = '\0';
+    edit_string_calc_caret_rect(bam, ctx, &old_caret);
+
+    // grow gap backwards over glyph preceding caret
+    advance = edit_string_advance_before_gap(bam, ctx);
+    ctx->gap_begin = edit_string_glyph_start(ctx, ctx->gap_begin - 1);
+    ctx->n_glyphs_before--;
+    ctx->caret_x -= advance;
+    ctx->text_width -= advance;
+
+    edit_string_mark_changes(bam, ctx, &old_caret, old_width, ctx->caret_x);
     edit_string_enforce_format(bam, ctx);
 }
 
 
 static void edit_string_clear(bam_t* bam, bam_edit_string_ctx_t* ctx) {
-    ctx->buffer_ptr = ctx->buffer_begin;
-    ctx->buffer_ptr[0] = '\0';
+    int old_width = ctx->text_width;
+    bam_rect_t old_caret;
+
+    edit_string_calc_caret_rect(bam, ctx, &old_caret);
+
+    ctx->gap_begin = 0;
+    ctx->gap_end = ctx->text_end;
+    ctx->n_glyphs_before = 0;
+    ctx->n_glyphs_after = 0;
+    ctx->advances_cached = true;
+    ctx->caret_x = 0;
+    ctx->text_width = 0;
+
+    edit_string_mark_changes(bam, ctx, &old_caret, old_width, 0);
+    edit_string_enforce_format(bam, ctx);
+}
+
+
+static void edit_string_move_caret(bam_t* bam, bam_edit_string_ctx_t* ctx, size_t glyph_index) {
+    edit_string_mark_caret(bam, ctx);
+
+    // move glyphs preceding new caret position from before gap to after it
+    while (ctx->n_glyphs_before > glyph_index) {
+        int advance = edit_string_advance_before_gap(bam, ctx);
+        size_t length = ctx->gap_begin - edit_string_glyph_start(ctx, ctx->gap_begin - 1);
+
+        ctx->gap_begin -= length;
+        ctx->gap_end -= length;
+        memmove(ctx->buffer + ctx->gap_end, ctx->buffer + ctx->gap_begin, length);
+
+        if (ctx->advances_cached) {
+            ctx->advances[BAM_EDIT_STRING_MAX_GLYPHS - ctx->n_glyphs_after - 1] =
+                    ctx->advances[ctx->n_glyphs_before - 1];
+        }
+
+        ctx->n_glyphs_before--;
+        ctx->n_glyphs_after++;
+        ctx->caret_x -= advance;
+    }
+
+    // move glyphs following new caret position from after gap to before it
+    while (ctx->n_glyphs_before < glyph_index && ctx->n_glyphs_after > 0) {
+        int advance = edit_string_advance_after_gap(bam, ctx);
+        size_t length = edit_string_glyph_end(ctx, ctx->gap_end, ctx->text_end) - ctx->gap_end;
+
+        memmove(ctx->buffer + ctx->gap_begin, ctx->buffer + ctx->gap_end, length);
+        ctx->gap_begin += length;
+        ctx->gap_end += length;
+
+        if (ctx->advances_cached) {
+            ctx->advances[ctx->n_glyphs_before] = ctx->advances[BAM_EDIT_STRING_MAX_GLYPHS - ctx->n_glyphs_after];
+        }
+
+        ctx->n_glyphs_before++;
+        ctx->n_glyphs_after--;
+        ctx->caret_x += advance;
+    }
+
+    edit_string_mark_caret(bam, ctx);
     edit_string_enforce_format(bam, ctx);
 }
 
 
-static void edit_string_key_func(bam_t* bam, bam_widget_handle_t widget, void* user_data) {
+static void edit_string_field_func(bam_t* bam, bam_widget_handle_t widget, void* user_data) {
+    bam_edit_string_ctx_t* ctx = user_data;
+    size_t n_glyphs = edit_string_glyph_count(ctx);
+    size_t glyph_index = 0;
+    size_t pos = 0;
+    int event_x;
+    int event_y;
+    int x;
+    bam_rect_t inner;
+
+    bam_get_event_position(bam, &event_x, &event_y);
+    widget_calc_inner(widget_from_handle(bam, widget), &inner);
+
+    // find glyph boundary nearest to touch using cached advances (or text, if it has outgrown cache)
+    x = edit_string_calc_origin(bam, ctx, &inner, ctx->text_width);
+
+    while (glyph_index < n_glyphs) {
+        int advance;
+
+        if (pos == ctx->gap_begin) {
+            pos = ctx->gap_end;
+        }
+
+        if (!ctx->advances_cached) {
+            advance = edit_string_decode_advance(bam, ctx, pos);
+        } else if (glyph_index < ctx->n_glyphs_before) {
+            advance = ctx->advances[glyph_index];
+        } else {
+            advance = ctx->advances[BAM_EDIT_STRING_MAX_GLYPHS - ctx->n_glyphs_after +
+                                    (glyph_index - ctx->n_glyphs_before)];
+        }
+
+        if (event_x < (x + (advance / 2))) {
+            break;
+        }
+
+        x += advance;
+        pos = edit_string_glyph_end(ctx, pos, (pos < ctx->gap_begin) ? ctx->gap_begin : ctx->text_end);
+        glyph_index++;
+    }
+
+    edit_string_move_caret(bam, ctx, glyph_index);
+}
+
+
+static void edit_string_draw_field(bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds,
+                                   void* user_data) {
+    const bam_edit_string_ctx_t* ctx = user_data;
+    const bam_style_t* style = bam_get_widget_style(bam, widget);
+    const bam_color_pair_t* colors = &style->colors[BAM_STATE_DISABLED];
+    const uint8_t* text = (const uint8_t*) ctx->buffer;
+    int origin = edit_string_calc_origin(bam, ctx, bounds, ctx->text_width);
+    int baseline;
+    bam_font_metrics_t font_metrics;
+
+    bam->vtable->get_font_metrics(&font_metrics, style->font, bam->user_data);
+
+    // calculate baseline based on field style's v_align property, as draw_aligned_text() would
+    switch (style->v_align) {
+    case BAM_V_ALIGN_MIDDLE:
+        baseline = ((bounds->y1 + bounds->y2) / 2) + font_metrics.center;
+        break;
+
+    case BAM_V_ALIGN_BOTTOM:
+        baseline = bounds->y2 - 1 - font_metrics.descent;
+        break;
+
+    default:
+        baseline = bounds->y1 + font_metrics.ascent;
+    }
+
+    // draw text either side of gap, then caret
+    draw_text_run(bam, origin, baseline, text, text + ctx->gap_begin, style->font, colors);
+    draw_text_run(bam, origin + ctx->caret_x, baseline, text + ctx->gap_end, text + ctx->text_end, style->font,
+                  colors);
+
+    if (ctx->caret_visible) {
+        bam_rect_t caret;
+
+        edit_string_calc_caret_rect(bam, ctx, &caret);
+        draw_fill(bam, &caret, colors->foreground);
+    }
+}
+
+
+static void edit_string_key_func(bam_t* bam, bam_widget_handle_t widget, size_t key, void* user_data) {
     bam_edit_string_ctx_t* ctx = user_data;
-    uintptr_t metadata = bam_get_widget_metadata(bam, widget);
 
-    switch(metadata) {
+    switch(bam_get_keypad_key_code(bam, widget, key)) {
     case BAM_EDIT_STRING_METADATA_CHAR:
-        edit_string_append(bam, ctx, bam_get_widget_text(bam, widget));
+        edit_string_insert(bam, ctx, bam_get_keypad_key_label(bam, widget, key));
         break;
 
     case BAM_EDIT_STRING_METADATA_SHIFT:
-        ctx->shifted = !(ctx->shifted);
-        edit_string_modify_char_keys(bam, ctx);
+        bam_set_keypad_shifted(bam, widget, !bam_get_keypad_shifted(bam, widget));
         break;
 
     case BAM_EDIT_STRING_METADATA_BACKSPACE:
-        edit_string_truncate(bam, ctx);
+        edit_string_backspace(bam, ctx);
         break;
 
     case BAM_EDIT_STRING_METADATA_CANCEL:
@@ -1499,7 +8017,7 @@ static void edit_string_key_func(bam_t* bam, bam_widget_handle_t widget, void* u
         break;
 
     case BAM_EDIT_STRING_METADATA_SPACE:
-        edit_string_append(bam, ctx, " ");
+        edit_string_insert(bam, ctx, " ");
         break;
 
     default:
@@ -1522,18 +8040,29 @@ bool bam_edit_string(bam_t* bam, char* buffer, size_t buffer_size, bool allow_em
     bam_font_metrics_t font_metrics;
     int field_height;
     bam_rect_t bounds;
-    const bam_rect_t* bounds_ptr;
+    const bam_style_t* key_styles[BAM_EDIT_KEY_STYLE_COUNT];
+    const char* key_labels[BAM_EDIT_STRING_METADATA_COUNT];
+    const uint8_t* text_i;
+    const uint8_t* text_e;
+    size_t text_length;
     bam_edit_string_ctx_t ctx;
 
     // ensure end of buffer is null-terminated
     buffer[buffer_size - 1] = '\0';
 
-    // initialise editor context
-    ctx.buffer_begin = buffer;
-    ctx.buffer_ptr = buffer + strlen(buffer);
-    ctx.buffer_end = buffer + buffer_size;
+    // initialise editor context - buffer is used as a gap buffer whose gap initially lies between the existing text
+    // and the terminator, with the last byte reserved for the terminator
+    ctx.buffer = buffer;
+    ctx.text_end = buffer_size - 1;
+    ctx.n_glyphs_before = 0;
+    ctx.n_glyphs_after = 0;
+    ctx.caret_x = 0;
+    ctx.text_width = 0;
+    ctx.caret_visible = true;
     ctx.allow_empty = allow_empty;
-    ctx.shifted = false;
+    ctx.advances_cached = true;
+
+    bam_init_timer(&ctx.caret_timer);
 
     // clear any existing widgets
     bam_delete_widgets(bam);
@@ -1545,9 +8074,38 @@ bool bam_edit_string(bam_t* bam, char* buffer, size_t buffer_size, bool allow_em
     // calculate field height
     field_height = font_metrics.line_height + (2 * style->v_padding);
 
-    // create field widget
-    ctx.field_widget = bam_add_widget(bam, 0, 0, bam->disp_width, field_height,
-                                      style, buffer, false);
+    // cache advance of each glyph of existing text, unless it has more glyphs than cache holds
+    text_length = strlen(buffer);
+    text_i = (const uint8_t*) buffer;
+    text_e = text_i + text_length;
+
+    while (text_i < text_e) {
+        bam_unichar_t codepoint = 0;
+        int advance;
+
+        text_i = unicode_decode_utf8(text_i, &codepoint);
+        advance = edit_string_glyph_advance(bam, style->font, codepoint);
+
+        if (ctx.n_glyphs_before < BAM_EDIT_STRING_MAX_GLYPHS) {
+            ctx.advances[ctx.n_glyphs_before] = (uint8_t) advance;
+        } else {
+            ctx.advances_cached = false;
+        }
+
+        ctx.n_glyphs_before++;
+        ctx.text_width += advance;
+    }
+
+    ctx.gap_begin = text_length;
+    ctx.gap_end = ctx.text_end;
+    ctx.caret_x = ctx.text_width;
+
+    // create field widget, which is enabled so that it can be touched to position caret, but keeps colors of a
+    // disabled widget
+    ctx.field_widget = bam_add_widget(bam, 0, 0, bam->disp_width, field_height, style, NULL, true);
+    bam_set_widget_colors(bam, ctx.field_widget, &style->colors[BAM_STATE_DISABLED]);
+    bam_set_widget_draw_callback(bam, ctx.field_widget, edit_string_draw_field, &ctx);
+    bam_set_widget_callback(bam, ctx.field_widget, edit_string_field_func, &ctx);
 
     // define keypad bounds
     bounds.x1 = 0;
@@ -1555,80 +8113,38 @@ bool bam_edit_string(bam_t* bam, char* buffer, size_t buffer_size, bool allow_em
     bounds.x2 = bam->disp_width;
     bounds.y2 = bam->disp_height;
 
-    // create keypad widgets
-    bam_layout_grid(bam, 10, 5, &bounds, spacing, spacing,
-                    widget_get_style(bam, editor_style->char_key_style), true,
-                    ctx.key_widgets, 50);
-
-    // set letter/symbol key text, metadata and callbacks
-    for (int i = 0; i < 50; i++) {
-        bam_set_widget_metadata(bam, ctx.key_widgets[i], BAM_EDIT_STRING_METADATA_CHAR);
-        bam_set_widget_callback(bam, ctx.key_widgets[i], edit_string_key_func, &ctx);
-    }
-
-    // apply num key style to top row of keys
-    for (int i = 0; i < 10; i++) {
-        bam_set_widget_style(bam, ctx.key_widgets[i], editor_style->num_key_style);
-    }
-
-    edit_string_modify_char_keys(bam, &ctx);
-    
-    // apply style/text/metadata to shift key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_SHIFT], editor_style->edit_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_SHIFT], editor_style->shift_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_SHIFT], 
-                            BAM_EDIT_STRING_METADATA_SHIFT);
-    
-    // apply style/text/metadata to backspace key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_BACKSPACE], editor_style->edit_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_BACKSPACE], editor_style->backspace_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_BACKSPACE],
-                            BAM_EDIT_STRING_METADATA_BACKSPACE);
-
-    // apply style/text/metadata to cancel key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_CANCEL], editor_style->cancel_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_CANCEL], editor_style->cancel_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_CANCEL],
-                            BAM_EDIT_STRING_METADATA_CANCEL);
-
-    // apply style/text/metadata to clear key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_CLEAR], editor_style->edit_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_CLEAR], editor_style->clear_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_CLEAR],
-                            BAM_EDIT_STRING_METADATA_CLEAR);
-
-    // apply style/text/metadata to accept key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_ACCEPT], editor_style->accept_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_ACCEPT], editor_style->accept_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_ACCEPT],
-                            BAM_EDIT_STRING_METADATA_ACCEPT);
-
-    // apply style/text/metadata to space key
-    bam_set_widget_style(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_SPACE], editor_style->char_key_style);
-    bam_set_widget_text(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_SPACE], editor_style->space_text);
-    bam_set_widget_metadata(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_SPACE],
-                            BAM_EDIT_STRING_METADATA_SPACE);
-
-    // stretch space key to span across unused widgets
-    bounds_ptr = bam_get_widget_bounds(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_SPACE]);
-    bounds.x1 = bounds_ptr->x1;
-    bounds.y1 = bounds_ptr->y1;
-    bounds_ptr = bam_get_widget_bounds(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_UNUSED_END]);
-    bounds.x2 = bounds_ptr->x2;
-    bounds.y2 = bounds_ptr->y2;
-
-    bam_set_widget_bounds(bam, ctx.key_widgets[BAM_EDIT_STRING_KEY_SPACE], &bounds);
-
-    // invalidate unused widgets
-    rect_init_empty(&bounds);
-
-    for (int i = BAM_EDIT_STRING_KEY_UNUSED_BEGIN; i <= BAM_EDIT_STRING_KEY_UNUSED_END; i++) {
-        bam_set_widget_bounds(bam, ctx.key_widgets[i], &bounds);
-    }
+    // set styles and text of keys, indexed by key style and key code respectively
+    edit_init_key_styles(editor_style, key_styles);
+
+    key_labels[BAM_EDIT_STRING_METADATA_CHAR] = NULL;
+    key_labels[BAM_EDIT_STRING_METADATA_SHIFT] = editor_style->shift_text;
+    key_labels[BAM_EDIT_STRING_METADATA_BACKSPACE] = editor_style->backspace_text;
+    key_labels[BAM_EDIT_STRING_METADATA_CANCEL] = editor_style->cancel_text;
+    key_labels[BAM_EDIT_STRING_METADATA_CLEAR] = editor_style->clear_text;
+    key_labels[BAM_EDIT_STRING_METADATA_ACCEPT] = editor_style->accept_text;
+    key_labels[BAM_EDIT_STRING_METADATA_SPACE] = editor_style->space_text;
+
+    // create keypad widget
+    bam_init_keypad(&ctx.keypad, &EDIT_STRING_LAYOUT, key_styles, BAM_EDIT_KEY_STYLE_COUNT, key_labels, spacing);
+
+    ctx.keypad_widget = bam_add_widget(bam, bounds.x1, bounds.y1, rect_width(&bounds), rect_height(&bounds),
+                                       NULL, NULL, true);
+
+    bam_set_widget_keypad(bam, ctx.keypad_widget, &ctx.keypad, edit_string_key_func, &ctx);
+
+    // enable/disable keys based on buffer's current content
+    edit_string_enforce_format(bam, &ctx);
 
     // start event loop
     ret_val = bam_start(bam);
 
+    // stop caret blinking and close gap, leaving text null-terminated at start of buffer
+    bam_stop_timer(bam, &ctx.caret_timer);
+
+    text_length = ctx.text_end - ctx.gap_end;
+    memmove(buffer + ctx.gap_begin, buffer + ctx.gap_end, text_length);
+    buffer[ctx.gap_begin + text_length] = '\0';
+
     // delete all widgets
     bam_delete_widgets(bam);
 
@@ -1676,6 +8192,11 @@ void bam_init(bam_t* bam, uint32_t* dirty_buffer, size_t dirty_buffer_size,
     bam->widget_buffer_end = widget_buffer + widget_buffer_size;
     bam->widget_buffer_ptr = widget_buffer;
 
+    bam->reconcile_buffer_begin = NULL;
+    bam->reconcile_buffer_end = NULL;
+    bam->reconcile_buffer_ptr = NULL;
+    bam->reconcile_pending = false;
+
     bam->disp_width = disp_width;
     bam->disp_height = disp_height;
     bam->tile_width = tile_width;
@@ -1690,6 +8211,20 @@ void bam_init(bam_t* bam, uint32_t* dirty_buffer, size_t dirty_buffer_size,
     bam->draw_state.clip.y1 = 0;
     bam->draw_state.clip.x2 = disp_width;
     bam->draw_state.clip.y2 = disp_height;
+    bam->dirty_pending = false;
+
+    bam->base_cache = NULL;
+
+    bam->damage_nodes = NULL;
+    bam->damage_free = BAM_DAMAGE_NONE;
+    bam->damage_min_width = 0;
+    bam->damage_min_height = 0;
+
+    bam->flip_history = NULL;
+    bam->flip_frame_size = 0;
+    bam->flip_n_frames = 0;
+    bam->flip_newest = 0;
+    bam->flip_n_valid = 0;
 
     bam->vtable = vtable;
     bam->user_data = user_data;
@@ -1697,8 +8232,50 @@ void bam_init(bam_t* bam, uint32_t* dirty_buffer, size_t dirty_buffer_size,
     bam->quit_flag = false;
     bam->run_flag = NULL;
     bam->run_result = 0;
+    bam->step_stopped = false;
+    bam->stepping = false;
 
     bam->pressed_widget = NULL;
+    bam->pressed_inside = false;
+    bam->event_x = 0;
+    bam->event_y = 0;
+    bam->pending_event.type = BAM_EVENT_TYPE_NONE;
+
+    bam->timers = NULL;
+
+    atomic_init(&bam->completed_work, NULL);
+
+    bam->frame_budget = 0;
+    bam->quality = BAM_QUALITY_FULL;
+    bam->calm_frames = 0;
+    bam->governor_settling = false;
+    bam->last_frame_end = 0;
+    rect_init_empty(&bam->deferred_rect);
+    bam->deferred_deadline = 0;
+    memset(&bam->governor_stats, 0, sizeof(bam->governor_stats));
+
+    bam->n_throttled_widgets = 0;
+
+    bam->animation_buffer_begin = NULL;
+    bam->animation_buffer_end = NULL;
+    bam->n_active_animations = 0;
+    bam->frame_interval = 1;
+    bam->next_frame_time = 0;
+
+    bam->mask_buffer_begin = NULL;
+    bam->mask_buffer_end = NULL;
+    bam->mask_buffer_ptr = NULL;
+    bam->n_mask_cache_entries = 0;
+
+    bam->widget_cache_buffer_begin = NULL;
+    bam->widget_cache_buffer_end = NULL;
+    bam->widget_cache_buffer_ptr = NULL;
+    bam->n_widget_cache_entries = 0;
+
+    bam->fill_buffer_begin = NULL;
+    bam->fill_buffer_end = NULL;
+    bam->fill_buffer_ptr = NULL;
+    bam->n_fill_cache_entries = 0;
 
     // check dirty buffer size
     if (dirty_buffer_size < BAM_DIRTY_BUFFER_SIZE(disp_width, disp_height, tile_width, tile_height)) {
@@ -1713,3 +8290,57 @@ void bam_init(bam_t* bam, uint32_t* dirty_buffer, size_t dirty_buffer_size,
     // mark whole display as dirty
     dirty_mark_all(bam);
 }
+
+
+void bam_init_damage_tree(bam_t* bam, bam_damage_node_t* node_buffer, size_t node_buffer_size, int min_width,
+                          int min_height) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(node_buffer);
+    BAM_ASSERT(node_buffer_size > 0 && node_buffer_size <= UINT16_MAX);
+    BAM_ASSERT(min_width > 0);
+    BAM_ASSERT(min_height > 0);
+    BAM_ASSERT(bam->vtable->blt_region);
+    BAM_ASSERT(!bam->flip_history);
+
+    bam->damage_nodes = node_buffer;
+    bam->damage_min_width = min_width;
+    bam->damage_min_height = min_height;
+
+    // node 0 is root, remaining nodes are linked into free list in groups of four
+    bam->damage_free = BAM_DAMAGE_NONE;
+
+    for (size_t i = 1; i + 4 <= node_buffer_size; i += 4) {
+        node_buffer[i].children = bam->damage_free;
+        bam->damage_free = (uint16_t) i;
+    }
+
+    node_buffer[0].state = BAM_DAMAGE_STATE_CLEAN;
+
+    // mark whole display as dirty
+    dirty_mark_all(bam);
+}
+
+
+void bam_init_page_flip(bam_t* bam, uint32_t* history_buffer, size_t history_buffer_size) {
+    BAM_ASSERT_CTX(bam);
+    BAM_ASSERT(history_buffer);
+    BAM_ASSERT(bam->vtable->get_buffer_age);
+    BAM_ASSERT(bam->vtable->flip);
+    BAM_ASSERT(!bam->damage_nodes);
+
+    size_t frame_size = BAM__DIRTY_BUFFER_SIZE(bam->disp_width, bam->disp_height, bam->tile_width, bam->tile_height);
+
+    // history must hold at least one frame's damage
+    if (history_buffer_size < frame_size) {
+        panic(bam, BAM_PANIC_CODE_DIRTY_BUFFER_TOO_SMALL);
+    }
+
+    bam->flip_history = history_buffer;
+    bam->flip_frame_size = frame_size;
+    bam->flip_n_frames = history_buffer_size / frame_size;
+    bam->flip_newest = 0;
+    bam->flip_n_valid = 0;
+
+    // mark whole display as dirty
+    dirty_mark_all(bam);
+}
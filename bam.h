@@ -25,6 +25,7 @@
 #ifndef _BAM_H_
 #define _BAM_H_
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -37,10 +38,19 @@ typedef struct bam bam_t;
 
 // ******** PLATFORM TYPES ********
 
-#ifndef BAM_REAL_TYPE
+// if BAM_REAL_FIXED_BITS is also defined, BAM_REAL_TYPE must be a signed integer type and is treated as fixed-point
+#ifdef BAM_REAL_TYPE
+#define bam_real_t      BAM_REAL_TYPE
+#else
 #define bam_real_t      double
 #endif // BAM_REAL_TYPE
 
+#ifdef BAM_COORD_TYPE
+#define bam_coord_t     BAM_COORD_TYPE
+#else
+#define bam_coord_t     int32_t
+#endif // BAM_COORD_TYPE
+
 
 // ******** ERROR TYPES ********
 
@@ -114,6 +124,9 @@ typedef struct {
 } bam_color_pair_t;
 
 
+typedef struct bam_fill bam_fill_t;
+
+
 typedef struct {
     bam_font_t font;
     bam_h_align_t h_align;
@@ -121,24 +134,219 @@ typedef struct {
     int h_padding;
     int v_padding;
     bam_color_pair_t colors[BAM_N_STATES];
+    const bam_fill_t* fill;
 } bam_style_t;
 
 
 typedef struct {
-    int x1;
-    int y1;
-    int x2;
-    int y2;
+    bam_coord_t x1;
+    bam_coord_t y1;
+    bam_coord_t x2;
+    bam_coord_t y2;
 } bam_rect_t;
 
 
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    bam_coord_t width;
+    uint32_t hash;
+} bam_text_line_t;
+
+
+// ******** IMAGE TYPES ********
+
+#define BAM_IMAGE_MAGIC                 0x494D4142ul
+
+#define BAM_IMAGE_RLE_REPEAT            0x80000000ul
+
+#define BAM_IMAGE_RLE_COUNT_MASK        0x7FFFFFFFul
+
+
+typedef enum {
+    BAM_IMAGE_FORMAT_RAW,
+    BAM_IMAGE_FORMAT_RLE
+} bam_image_format_t;
+
+
+typedef struct {
+    bam_image_format_t format;
+    int width;
+    int height;
+    const uint32_t* row_index;
+    const uint32_t* data;
+} bam_image_t;
+
+
+// ******** FILL TYPES ********
+
+typedef enum {
+    BAM_FILL_TYPE_VERTICAL_GRADIENT,
+    BAM_FILL_TYPE_HORIZONTAL_GRADIENT,
+    BAM_FILL_TYPE_PATTERN
+} bam_fill_type_t;
+
+
+struct bam_fill {
+    bam_fill_type_t type;
+    bam_color_t end_colors[BAM_N_STATES];
+    const bam_image_t* pattern;
+};
+
+
+// ******** SNAPSHOT TYPES ********
+
+#define BAM_SNAPSHOT_MAGIC              0x534E4142ul
+
+
+typedef struct {
+    bam_image_t image;
+    size_t n_widgets;
+    const uint32_t* records;
+} bam_snapshot_t;
+
+
+// ******** LAYER TYPES ********
+
+typedef enum {
+    BAM_LAYER_BASE,
+    BAM_LAYER_DYNAMIC,
+    BAM_LAYER_OVERLAY
+} bam_layer_t;
+
+
+// ******** OUTLINE FONT TYPES ********
+
+typedef uint32_t (*bam_outline_clock_t) (void* user_data);
+
+
+typedef struct {
+    const uint8_t* cmap;
+    const uint8_t* loca;
+    const uint8_t* glyf;
+    const uint8_t* hmtx;
+    size_t cmap_size;
+    size_t glyf_size;
+    uint16_t cmap_format;
+    uint16_t units_per_em;
+    uint16_t n_glyphs;
+    uint16_t n_h_metrics;
+    bool long_loca;
+    int16_t ascender;
+    int16_t descender;
+    int16_t line_gap;
+    int16_t cap_height;
+} bam_outline_font_t;
+
+
+typedef struct {
+    const bam_outline_font_t* font;
+    int size;
+} bam_outline_face_t;
+
+
+typedef struct {
+    const bam_outline_font_t* font;
+    bam_unichar_t codepoint;
+    int16_t size;
+    int16_t width;
+    int16_t height;
+    int16_t x_bearing;
+    int16_t y_bearing;
+    int16_t x_advance;
+    uint8_t* bitmap;
+} bam_outline_cache_entry_t;
+
+
+typedef struct {
+    uint32_t n_hits;
+    uint32_t n_misses;
+    uint32_t n_evictions;
+    uint32_t n_rasterized;
+    uint32_t raster_time;
+    size_t n_entries;
+    size_t entry_capacity;
+    size_t memory_used;
+    size_t memory_peak;
+    size_t memory_capacity;
+    size_t scratch_peak;
+    size_t scratch_capacity;
+} bam_outline_cache_stats_t;
+
+
+typedef struct {
+    bam_outline_cache_entry_t* entries;
+    size_t capacity;
+    size_t count;
+    uint8_t* buffer_begin;
+    uint8_t* buffer_end;
+    uint8_t* buffer_ptr;
+    int32_t* scratch;
+    size_t scratch_size;
+    bam_outline_clock_t clock;
+    void* clock_user_data;
+    bam_outline_cache_stats_t stats;
+} bam_outline_cache_t;
+
+
+// ******** CHART TYPES ********
+
+typedef struct {
+    bam_coord_t y1;
+    bam_coord_t y2;
+} bam_chart_column_t;
+
+
+typedef struct {
+    int16_t* samples;
+    bam_chart_column_t* columns;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    int min_value;
+    int max_value;
+    bool autoscale;
+    int column_width;
+    bam_color_t color;
+    int cache_height;
+    bool cache_valid;
+} bam_chart_t;
+
+
+// ******** LAYOUT TREE TYPES ********
+
+#define BAM_LAYOUT_NONE                 0xFFFFu
+
+
+typedef enum {
+    BAM_LAYOUT_NODE_TYPE_ROW,
+    BAM_LAYOUT_NODE_TYPE_COLUMN,
+    BAM_LAYOUT_NODE_TYPE_WIDGET
+} bam_layout_node_type_t;
+
+
+typedef uint16_t bam_layout_handle_t;
+
+
+typedef struct bam_layout_node bam_layout_node_t;
+
+
+typedef struct {
+    bam_layout_node_t* nodes;
+    size_t capacity;
+    size_t count;
+    bam_layout_handle_t root;
+} bam_layout_t;
+
+
 // ******** EVENT TYPES ********
 
 typedef enum {
     BAM_EVENT_TYPE_NONE,
     BAM_EVENT_TYPE_QUIT,
     BAM_EVENT_TYPE_PRESS,
-    BAM_EVENT_TYPE_RELEASE
+    BAM_EVENT_TYPE_RELEASE,
+    BAM_EVENT_TYPE_MOVE
 } bam_event_type_t;
 
 
@@ -151,6 +359,37 @@ typedef struct {
 
 typedef uint16_t bam_tick_t;
 
+// deadlines are compared modulo 2^16, so intervals must be no longer than half the tick range
+#define BAM_MAX_TICK_INTERVAL           INT16_MAX
+
+
+// ******** ANIMATION TYPES ********
+
+typedef enum {
+    BAM_EASING_LINEAR,
+    BAM_EASING_IN,
+    BAM_EASING_OUT,
+    BAM_EASING_IN_OUT
+} bam_easing_t;
+
+
+typedef enum {
+    BAM_ANIMATION_TYPE_BOUNDS,
+    BAM_ANIMATION_TYPE_COLORS,
+    BAM_ANIMATION_TYPE_VALUE
+} bam_animation_type_t;
+
+
+typedef struct bam_animation bam_animation_t;
+
+
+// ******** TIMER TYPES ********
+
+typedef struct bam_timer bam_timer_t;
+
+
+typedef void (*bam_timer_callback_t) (bam_t* bam, bam_timer_t* timer, void* user_data);
+
 
 // ******** WIDGET TYPES ********
 
@@ -160,6 +399,112 @@ typedef void (*bam_widget_callback_t) (bam_t* bam, bam_widget_handle_t widget, v
 
 typedef struct bam_widget bam_widget_t;
 
+typedef void (*bam_animation_callback_t) (bam_t* bam, bam_widget_handle_t widget, int value, void* user_data);
+
+typedef void (*bam_widget_draw_callback_t) (bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds,
+                                            void* user_data);
+
+typedef void (*bam_widget_drag_callback_t) (bam_t* bam, bam_widget_handle_t widget, int x, int y, void* user_data);
+
+typedef struct bam_reconcile_record bam_reconcile_record_t;
+
+
+typedef struct {
+    bam_rect_t bounds;
+    const bam_style_t* style;
+    const char* text;
+    bool enabled;
+    uintptr_t metadata;
+    bam_widget_callback_t callback;
+    void* user_data;
+} bam_widget_desc_t;
+
+
+// ******** WORK TYPES ********
+
+typedef struct bam_work bam_work_t;
+
+
+typedef void (*bam_work_func_t) (void* user_data);
+
+
+typedef void (*bam_work_done_func_t) (bam_t* bam, bam_widget_handle_t widget, void* user_data);
+
+
+// ******** KEYPAD TYPES ********
+
+#define BAM_KEYPAD_MAX_KEYS             64
+#define BAM_KEYPAD_MAX_CELLS            64
+#define BAM_KEYPAD_NO_KEY               0xFFu
+
+
+typedef struct {
+    uint8_t column;
+    uint8_t row;
+    uint8_t column_span;
+    uint8_t row_span;
+    uint8_t style_index;
+    uint8_t code;
+    const char* label;
+    const char* shifted_label;
+} bam_keypad_key_t;
+
+
+typedef struct {
+    uint8_t n_columns;
+    uint8_t n_rows;
+    uint8_t n_keys;
+    const bam_keypad_key_t* keys;
+} bam_keypad_layout_t;
+
+
+typedef void (*bam_keypad_callback_t) (bam_t* bam, bam_widget_handle_t widget, size_t key, void* user_data);
+
+
+typedef struct {
+    const bam_keypad_layout_t* layout;
+    const bam_style_t* const* styles;
+    size_t n_styles;
+    const char* const* labels;
+    int spacing;
+    bool shifted;
+    uint8_t pressed_key;
+    uint32_t disabled[BAM_KEYPAD_MAX_KEYS / 32];
+    uint8_t cell_map[BAM_KEYPAD_MAX_CELLS];
+    bam_keypad_callback_t callback;
+    void* user_data;
+} bam_keypad_t;
+
+
+// ******** DAMAGE TREE TYPES ********
+
+typedef struct bam_damage_node bam_damage_node_t;
+
+
+// ******** GOVERNOR TYPES ********
+
+#define BAM_N_QUALITY_LEVELS            4
+
+
+typedef enum {
+    BAM_QUALITY_FULL,
+    BAM_QUALITY_REDUCED_FRAME_RATE,
+    BAM_QUALITY_DEFER_LOW_PRIORITY,
+    BAM_QUALITY_NO_ANTI_ALIASING
+} bam_quality_t;
+
+
+typedef struct {
+    uint32_t n_frames;
+    uint32_t n_overruns;
+    uint32_t n_degrades;
+    uint32_t n_restores;
+    uint32_t n_entries[BAM_N_QUALITY_LEVELS];
+    bam_tick_t last_frame_time;
+    bam_tick_t max_frame_time;
+    bam_tick_t last_transition_time;
+} bam_governor_stats_t;
+
 
 // ******** VTABLE ********
 
@@ -168,6 +513,7 @@ typedef struct {
 
     bam_tick_t (* get_monotonic_time) (void* user_data);
 
+    // a timeout of zero must return an event that is already queued without waiting for one
     bool (* get_event) (bam_event_t* event, bam_tick_t timeout, void* user_data);
 
     void (* get_font_metrics) (bam_font_metrics_t* metrics, bam_font_t font, void* user_data);
@@ -181,6 +527,47 @@ typedef struct {
     void (* draw_fill) (const bam_rect_t* dest_rect, bam_color_t color, void* user_data);
 
     void (* blt_tile) (int x, int y, void* user_data);
+
+    // optional, blends color over one row of pixels using 8-bit coverage values (primitives fall back to
+    // thresholded draw_fill calls if NULL)
+    void (* draw_coverage) (const bam_rect_t* dest_rect, const uint8_t* coverage, bam_color_t color,
+            void* user_data);
+
+    // optional, copies pixels (pitch is in pixels) to tile, required only if images are drawn
+    void (* draw_pixels) (const bam_rect_t* dest_rect, const bam_color_t* pixels, size_t pitch, void* user_data);
+
+    // optional, copies a region of the display to another position on the display (regions may overlap)
+    void (* copy_region) (const bam_rect_t* src_rect, int dest_x, int dest_y, void* user_data);
+
+    // optional, arranges for bam_execute_work() to be called on a worker thread and for get_event to return once it
+    // has, work runs inline in event loop if not provided
+    void (* submit_work) (bam_work_t* work, void* user_data);
+
+    // optional, copies top-left region of tile, of same size as rect, to rect's position on display (required only
+    // if a damage tree is used)
+    void (* blt_region) (const bam_rect_t* rect, void* user_data);
+
+    // optional, copies rect of tile into pixels (required only to render a base layer cache, or to use a widget
+    // cache)
+    void (* read_tile) (const bam_rect_t* rect, bam_color_t* pixels, size_t pitch, void* user_data);
+
+    // optional, returns how many frames ago back buffer was presented (1 if it holds previous frame), or 0 if its
+    // contents are unknown (required only if page flipping is used)
+    int (* get_buffer_age) (void* user_data);
+
+    // optional, presents back buffer once a frame has been rendered to it (required only if page flipping is used)
+    void (* flip) (void* user_data);
+
+    // optional, switches glyph rendering between anti-aliased and 1-bit threshold (called by quality governor)
+    void (* set_anti_aliasing) (bool enabled, void* user_data);
+
+    // optional, returns color weight/scale of the way from one color to another (used by gradient fills and color
+    // animations, colors are treated as four 8-bit channels if NULL)
+    bam_color_t (* lerp_color) (bam_color_t from, bam_color_t to, int weight, int scale, void* user_data);
+
+    // optional, returns coverage of a pixel read back from a tile on which white (0xFFFFFFFF) was drawn over black
+    // (0xFF000000), used by widget cache (lowest 8 bits of pixel are used if NULL)
+    uint8_t (* get_coverage) (bam_color_t color, void* user_data);
 } bam_vtable_t;
 
 
@@ -189,6 +576,9 @@ typedef struct {
 #define BAM_DIRTY_BUFFER_SIZE(disp_width, disp_height, tile_width, tile_height) \
         BAM__DIRTY_BUFFER_SIZE((disp_width), (disp_height), (tile_width), (tile_height))
 
+#define BAM_PAGE_FLIP_HISTORY_SIZE(disp_width, disp_height, tile_width, tile_height, n_frames) \
+        (BAM__DIRTY_BUFFER_SIZE((disp_width), (disp_height), (tile_width), (tile_height)) * (n_frames))
+
 
 void bam_init(bam_t* bam, uint32_t* dirty_buffer, size_t dirty_buffer_size,
               bam_widget_t* widget_buffer, size_t widget_buffer_size,
@@ -196,14 +586,23 @@ void bam_init(bam_t* bam, uint32_t* dirty_buffer, size_t dirty_buffer_size,
               bam_color_t background_color, const bam_style_t* default_style,
               const bam_vtable_t* vtable, void* user_data);
 
+void bam_init_damage_tree(bam_t* bam, bam_damage_node_t* node_buffer, size_t node_buffer_size, int min_width,
+                          int min_height);
+
+void bam_init_page_flip(bam_t* bam, uint32_t* history_buffer, size_t history_buffer_size);
+
 
 // ******** WIDGET API ********
 
 bam_widget_handle_t bam_add_widget(bam_t* bam, int x, int y, int width, int height,
                                    const bam_style_t* style, const char* text, bool enabled);
 
+bam_widget_handle_t bam_add_widgets(bam_t* bam, const bam_widget_desc_t* descs, size_t n_descs);
+
 void bam_delete_widgets(bam_t* bam);
 
+void bam_init_reconcile(bam_t* bam, bam_reconcile_record_t* record_buffer, size_t record_buffer_size);
+
 void bam_force_widget_redraw(bam_t* bam, bam_widget_handle_t widget);
 
 void bam_set_widget_callback(bam_t* bam, bam_widget_handle_t widget, bam_widget_callback_t callback,
@@ -229,11 +628,207 @@ void bam_set_widget_metadata(bam_t* bam, bam_widget_handle_t widget, uintptr_t m
 
 uintptr_t bam_get_widget_metadata(bam_t* bam, bam_widget_handle_t widget);
 
+void bam_set_widget_colors(bam_t* bam, bam_widget_handle_t widget, const bam_color_pair_t* colors);
+
+void bam_set_widget_draw_callback(bam_t* bam, bam_widget_handle_t widget, bam_widget_draw_callback_t callback,
+                                  void* user_data);
+
+void bam_set_widget_drag_callback(bam_t* bam, bam_widget_handle_t widget, bam_widget_drag_callback_t callback,
+                                  void* user_data);
+
+void bam_set_widget_low_priority(bam_t* bam, bam_widget_handle_t widget, bool low_priority);
+
+void bam_set_widget_refresh_interval(bam_t* bam, bam_widget_handle_t widget, bam_tick_t interval);
+
+void bam_set_widget_wrap(bam_t* bam, bam_widget_handle_t widget, bam_text_line_t* line_buffer,
+                         size_t line_buffer_size);
+
+size_t bam_get_widget_line_count(const bam_t* bam, bam_widget_handle_t widget);
+
+
+// ******** DRAWING API ********
+
+void bam_init_mask_cache(bam_t* bam, uint8_t* mask_buffer, size_t mask_buffer_size);
+
+void bam_init_widget_cache(bam_t* bam, uint8_t* cache_buffer, size_t cache_buffer_size);
+
+void bam_init_fill_cache(bam_t* bam, bam_color_t* fill_buffer, size_t fill_buffer_size);
+
+void bam_draw_fill(bam_t* bam, const bam_rect_t* rect, bam_color_t color);
+
+void bam_draw_line(bam_t* bam, int x1, int y1, int x2, int y2, int thickness, bam_color_t color);
+
+void bam_draw_arc(bam_t* bam, int cx, int cy, int radius, int thickness, int start_angle, int end_angle,
+                  bam_color_t color);
+
+void bam_draw_round_rect(bam_t* bam, const bam_rect_t* rect, int radius, bam_color_t color);
+
+void bam_draw_image(bam_t* bam, const bam_image_t* image, int x, int y);
+
+
+// ******** IMAGE API ********
+
+bool bam_load_image(bam_image_t* image, const uint32_t* blob, size_t blob_size);
+
+size_t bam_encode_image(const bam_color_t* pixels, int width, int height, size_t pitch, uint32_t* blob,
+                        size_t blob_size);
+
+void bam_set_widget_image(bam_t* bam, bam_widget_handle_t widget, const bam_image_t* image);
+
+
+// ******** SNAPSHOT API ********
+
+size_t bam_encode_snapshot(const bam_t* bam, const bam_color_t* pixels, size_t pitch, uint32_t* blob,
+                           size_t blob_size);
+
+bool bam_load_snapshot(bam_snapshot_t* snapshot, const uint32_t* blob, size_t blob_size);
+
+bool bam_restore_snapshot(bam_t* bam, const bam_snapshot_t* snapshot);
+
+
+// ******** SUSPEND API ********
+
+size_t bam_suspend(const bam_t* bam, const bam_style_t* const* styles, size_t n_styles, bam_timer_t* const* timers,
+                   size_t n_timers, uint32_t display_checksum, uint32_t* blob, size_t blob_size);
+
+bool bam_resume(bam_t* bam, const uint32_t* blob, size_t blob_size, const bam_style_t* const* styles,
+                size_t n_styles, bam_timer_t* const* timers, size_t n_timers, uint32_t display_checksum);
+
+
+// ******** LAYER API ********
+
+void bam_set_widget_layer(bam_t* bam, bam_widget_handle_t widget, bam_layer_t layer);
+
+bam_layer_t bam_get_widget_layer(const bam_t* bam, bam_widget_handle_t widget);
+
+void bam_render_base_layer(bam_t* bam, bam_image_t* cache, bam_color_t* pixels);
+
+void bam_set_base_layer_cache(bam_t* bam, const bam_image_t* cache);
+
+void bam_delete_overlay_widgets(bam_t* bam);
+
+
+// ******** OUTLINE FONT API ********
+
+bool bam_load_outline_font(bam_outline_font_t* font, const uint8_t* blob, size_t blob_size);
+
+void bam_init_outline_cache(bam_outline_cache_t* cache, bam_outline_cache_entry_t* entries, size_t n_entries,
+                            uint8_t* buffer, size_t buffer_size, int32_t* scratch, size_t scratch_size);
+
+void bam_set_outline_cache_clock(bam_outline_cache_t* cache, bam_outline_clock_t clock, void* user_data);
+
+void bam_get_outline_font_metrics(bam_font_metrics_t* metrics, const bam_outline_face_t* face);
+
+bool bam_get_outline_glyph_metrics(bam_outline_cache_t* cache, bam_glyph_metrics_t* metrics,
+                                   const bam_outline_face_t* face, bam_unichar_t codepoint);
+
+void bam_get_outline_cache_stats(const bam_outline_cache_t* cache, bam_outline_cache_stats_t* stats);
+
+void bam_reset_outline_cache_stats(bam_outline_cache_t* cache);
+
+
+// ******** WORK API ********
+
+void bam_init_work(bam_work_t* work, bam_work_func_t func, bam_work_done_func_t done_func, void* user_data);
+
+void bam_set_widget_work(bam_t* bam, bam_widget_handle_t widget, bam_work_t* work);
+
+bool bam_is_widget_busy(const bam_t* bam, bam_widget_handle_t widget);
+
+void bam_execute_work(bam_work_t* work);
+
+
+// ******** KEYPAD API ********
+
+void bam_init_keypad(bam_keypad_t* keypad, const bam_keypad_layout_t* layout, const bam_style_t* const* styles,
+                     size_t n_styles, const char* const* labels, int spacing);
+
+void bam_set_widget_keypad(bam_t* bam, bam_widget_handle_t widget, bam_keypad_t* keypad,
+                           bam_keypad_callback_t callback, void* user_data);
+
+void bam_set_keypad_shifted(bam_t* bam, bam_widget_handle_t widget, bool shifted);
+
+bool bam_get_keypad_shifted(const bam_t* bam, bam_widget_handle_t widget);
+
+void bam_set_keypad_key_enabled(bam_t* bam, bam_widget_handle_t widget, size_t key, bool enabled);
+
+bool bam_get_keypad_key_enabled(const bam_t* bam, bam_widget_handle_t widget, size_t key);
+
+const char* bam_get_keypad_key_label(const bam_t* bam, bam_widget_handle_t widget, size_t key);
+
+uint8_t bam_get_keypad_key_code(const bam_t* bam, bam_widget_handle_t widget, size_t key);
+
+
+// ******** CHART API ********
+
+void bam_init_chart(bam_chart_t* chart, int16_t* sample_buffer, bam_chart_column_t* column_buffer,
+                    size_t buffer_size, int column_width, bam_color_t color);
+
+void bam_set_widget_chart(bam_t* bam, bam_widget_handle_t widget, bam_chart_t* chart);
+
+void bam_set_chart_range(bam_t* bam, bam_widget_handle_t widget, int min_value, int max_value);
+
+void bam_set_chart_autoscale(bam_t* bam, bam_widget_handle_t widget, bool autoscale);
+
+void bam_append_chart_sample(bam_t* bam, bam_widget_handle_t widget, int16_t value);
+
+void bam_clear_chart(bam_t* bam, bam_widget_handle_t widget);
+
+
+// ******** ANIMATION API ********
+
+void bam_init_animations(bam_t* bam, bam_animation_t* animation_buffer, size_t animation_buffer_size,
+                         bam_tick_t frame_interval);
+
+void bam_set_animation_frame_interval(bam_t* bam, bam_tick_t frame_interval);
+
+void bam_animate_bounds(bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds,
+                        bam_tick_t duration, bam_easing_t easing);
+
+void bam_animate_colors(bam_t* bam, bam_widget_handle_t widget, const bam_color_pair_t* from,
+                        const bam_color_pair_t* to, bam_tick_t duration, bam_easing_t easing);
+
+void bam_animate_value(bam_t* bam, bam_widget_handle_t widget, int from, int to, bam_tick_t duration,
+                       bam_easing_t easing, bam_animation_callback_t callback, void* user_data);
+
+void bam_cancel_animations(bam_t* bam, bam_widget_handle_t widget);
+
+bool bam_is_animating(const bam_t* bam);
+
+
+// ******** TIMER API ********
+
+void bam_init_timer(bam_timer_t* timer);
+
+void bam_start_timer(bam_t* bam, bam_timer_t* timer, bam_tick_t interval, bool repeat,
+                     bam_timer_callback_t callback, void* user_data);
+
+void bam_stop_timer(bam_t* bam, bam_timer_t* timer);
+
+bool bam_is_timer_active(const bam_timer_t* timer);
+
+
+// ******** GOVERNOR API ********
+
+void bam_set_frame_budget(bam_t* bam, bam_tick_t budget);
+
+bam_quality_t bam_get_quality(const bam_t* bam);
+
+void bam_get_governor_stats(const bam_t* bam, bam_governor_stats_t* stats);
+
+void bam_reset_governor_stats(bam_t* bam);
+
 
 // ******** EVENT API ********
 
 int bam_start(bam_t* bam);
 
+bam_tick_t bam_step(bam_t* bam, const bam_event_t* event);
+
+bool bam_poll_stop(bam_t* bam, int* result);
+
+void bam_get_event_position(const bam_t* bam, int* x, int* y);
+
 void bam_stop(bam_t* bam, int result);
 
 void bam_quit(bam_t* bam, int result);
@@ -245,6 +840,36 @@ void bam_layout_grid(bam_t* bam, int n_cols, int n_rows, const bam_rect_t* bound
                      int h_spacing, int v_spacing, const bam_style_t* style, bool enabled,
                      bam_widget_handle_t handles[], size_t n_handles);
 
+void bam_layout_grid_descs(int n_cols, int n_rows, const bam_rect_t* bounds, int h_spacing, int v_spacing,
+                           bam_widget_desc_t descs[], size_t n_descs);
+
+void bam_init_layout(bam_layout_t* layout, bam_layout_node_t* node_buffer, size_t node_buffer_size);
+
+bam_layout_handle_t bam_layout_add_container(bam_t* bam, bam_layout_t* layout, bam_layout_handle_t parent,
+                                             bam_layout_node_type_t type, int weight, int padding, int spacing);
+
+bam_layout_handle_t bam_layout_add_widget(bam_t* bam, bam_layout_t* layout, bam_layout_handle_t parent,
+                                          bam_widget_handle_t widget, int weight, int size);
+
+void bam_layout_set_weight(bam_layout_t* layout, bam_layout_handle_t node, int weight, int size);
+
+void bam_layout_set_hidden(bam_layout_t* layout, bam_layout_handle_t node, bool hidden);
+
+void bam_layout_invalidate(bam_layout_t* layout, bam_layout_handle_t node);
+
+void bam_layout_update(bam_t* bam, bam_layout_t* layout, const bam_rect_t* bounds);
+
+
+// ******** NUMBER API ********
+
+size_t bam_format_int(char* buffer, size_t buffer_size, long value);
+
+size_t bam_format_real(char* buffer, size_t buffer_size, bam_real_t value, int precision);
+
+bool bam_parse_int(const char* str, long* value);
+
+bool bam_parse_real(const char* str, bam_real_t* value);
+
 
 // ******** EDITOR API ********
 
@@ -294,6 +919,12 @@ bool bam_edit_string(bam_t* bam, char* buffer, size_t buffer_size, bool allow_em
 #define BAM__DIRTY_BUFFER_SIZE(disp_width, disp_height, tile_width, tile_height) \
         (BAM__TILE_PITCH(BAM__TILE_COUNT((disp_width), (tile_width))) * BAM__TILE_COUNT((disp_height), (tile_height)))
 
+#define BAM__MASK_CACHE_N_ENTRIES       8
+
+#define BAM__WIDGET_CACHE_N_ENTRIES     16
+
+#define BAM__FILL_CACHE_N_ENTRIES       8
+
 
 struct bam_widget {
     const bam_style_t* style;
@@ -303,16 +934,136 @@ struct bam_widget {
     bam_widget_callback_t callback;
     void* user_data;
     uintptr_t metadata;
+    uint32_t flags;
+    bam_color_pair_t colors;
+    bam_widget_draw_callback_t draw_callback;
+    void* draw_user_data;
+    bam_widget_drag_callback_t drag_callback;
+    void* drag_user_data;
+    bam_text_line_t* lines;
+    uint16_t max_lines;
+    uint16_t n_lines;
+    bam_keypad_t* keypad;
+    bam_work_t* work;
+    bam_tick_t refresh_interval;
+    bam_tick_t last_refresh;
+    bam_rect_t throttled_rect;
+};
+
+
+struct bam_work {
+    bam_work_t* next;
+    bam_t* bam;
+    bam_widget_handle_t widget;
+    bam_work_func_t func;
+    bam_work_done_func_t done_func;
+    void* user_data;
+    bool busy;
+};
+
+
+struct bam_timer {
+    bam_timer_t* next;
+    bam_timer_callback_t callback;
+    void* user_data;
+    bam_tick_t deadline;
+    bam_tick_t interval;
+    bool repeat;
+    bool active;
+};
+
+
+struct bam_layout_node {
+    bam_layout_node_type_t type;
+    bam_layout_handle_t parent;
+    bam_layout_handle_t first_child;
+    bam_layout_handle_t last_child;
+    bam_layout_handle_t next_sibling;
+    bool hidden;
+    bool dirty;
+    bool intrinsic_valid;
+    int weight;
+    int size;
+    int padding;
+    int spacing;
+    bam_widget_handle_t widget;
+    int intrinsic_width;
+    int intrinsic_height;
+    bam_rect_t rect;
+};
+
+
+struct bam_animation {
+    bam_animation_type_t type;
+    bam_easing_t easing;
+    bool active;
+    bam_widget_handle_t widget;
+    bam_tick_t start_time;
+    bam_tick_t duration;
+
+    union {
+        struct {
+            bam_rect_t from;
+            bam_rect_t to;
+        } bounds;
+
+        struct {
+            bam_color_pair_t from;
+            bam_color_pair_t to;
+        } colors;
+
+        struct {
+            int from;
+            int to;
+            bam_animation_callback_t callback;
+            void* user_data;
+        } value;
+    } params;
 };
 
 
 typedef struct {
-    int translate_x;
-    int translate_y;
+    bam_coord_t translate_x;
+    bam_coord_t translate_y;
     bam_rect_t clip;
 } bam_draw_state_t;
 
 
+typedef struct {
+    uint16_t outer_radius;
+    uint16_t inner_radius;
+    uint8_t* mask;
+} bam_mask_cache_entry_t;
+
+
+typedef struct {
+    bam_widget_handle_t widget;
+    uint32_t signature;
+    uint8_t* coverage;
+} bam_widget_cache_entry_t;
+
+
+typedef struct {
+    bam_color_t from;
+    bam_color_t to;
+    int length;
+    bam_color_t* colors;
+} bam_fill_cache_entry_t;
+
+
+struct bam_reconcile_record {
+    bam_rect_t rect;
+    uint32_t signature;
+    bool matched;
+};
+
+
+struct bam_damage_node {
+    uint16_t children;
+    uint8_t state;
+};
+
+
 struct bam {
 #ifdef BAM_DEBUG
     uint32_t magic;
@@ -322,10 +1073,28 @@ struct bam {
     uint32_t* dirty_buffer_end;
     size_t dirty_buffer_pitch;
 
+    const bam_image_t* base_cache;
+
+    bam_damage_node_t* damage_nodes;
+    uint16_t damage_free;
+    int damage_min_width;
+    int damage_min_height;
+
+    uint32_t* flip_history;
+    size_t flip_frame_size;
+    size_t flip_n_frames;
+    size_t flip_newest;
+    size_t flip_n_valid;
+
     bam_widget_t* widget_buffer_begin;
     bam_widget_t* widget_buffer_end;
     bam_widget_t* widget_buffer_ptr;
 
+    bam_reconcile_record_t* reconcile_buffer_begin;
+    bam_reconcile_record_t* reconcile_buffer_end;
+    bam_reconcile_record_t* reconcile_buffer_ptr;
+    bool reconcile_pending;
+
     int disp_width;
     int disp_height;
     int tile_width;
@@ -338,12 +1107,58 @@ struct bam {
     void* user_data;
 
     bam_draw_state_t draw_state;
+    bool dirty_pending;
 
     bool quit_flag;
     bool* run_flag;
     int run_result;
+    bool step_stopped;
+    bool stepping;
 
     bam_widget_t* pressed_widget;
+    bool pressed_inside;
+    int event_x;
+    int event_y;
+    bam_event_t pending_event;
+
+    bam_timer_t* timers;
+
+    _Atomic(bam_work_t*) completed_work;
+
+    bam_tick_t frame_budget;
+    bam_quality_t quality;
+    uint8_t calm_frames;
+    bool governor_settling;
+    bam_tick_t last_frame_end;
+    bam_rect_t deferred_rect;
+    bam_tick_t deferred_deadline;
+    bam_governor_stats_t governor_stats;
+
+    size_t n_throttled_widgets;
+
+    bam_animation_t* animation_buffer_begin;
+    bam_animation_t* animation_buffer_end;
+    size_t n_active_animations;
+    bam_tick_t frame_interval;
+    bam_tick_t next_frame_time;
+
+    uint8_t* mask_buffer_begin;
+    uint8_t* mask_buffer_end;
+    uint8_t* mask_buffer_ptr;
+    bam_mask_cache_entry_t mask_cache[BAM__MASK_CACHE_N_ENTRIES];
+    size_t n_mask_cache_entries;
+
+    uint8_t* widget_cache_buffer_begin;
+    uint8_t* widget_cache_buffer_end;
+    uint8_t* widget_cache_buffer_ptr;
+    bam_widget_cache_entry_t widget_cache[BAM__WIDGET_CACHE_N_ENTRIES];
+    size_t n_widget_cache_entries;
+
+    bam_color_t* fill_buffer_begin;
+    bam_color_t* fill_buffer_end;
+    bam_color_t* fill_buffer_ptr;
+    bam_fill_cache_entry_t fill_cache[BAM__FILL_CACHE_N_ENTRIES];
+    size_t n_fill_cache_entries;
 };
 
 
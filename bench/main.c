@@ -0,0 +1,592 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Benchmark - renders workloads to a headless display and reports what each costs.
+ *
+ * usage: bam-bench [case] [n_frames]
+ *
+ * If no case is given, every case is run. Cases are:
+ *
+ *   gauge      full-screen gauge (round rect, arcs, tick lines, needle and reading) redrawn every frame, reporting
+ *              cost per tile with and without mask cache
+ *   text       grid of readings and a ticker whose long string runs far beyond its widget, redrawn every frame
+ *   damage     workload traces (blinking indicator, single reading, dragged widget, every reading) replayed with
+ *              tile bitmap and with damage tree, reporting regions and pixels presented per frame
+ *   fill       grid of buttons redrawn every frame with flat fills, and with vertical and horizontal gradients
+ *              with and without fill cache
+ *
+ * bam-bench-mcu is same benchmark built with 16-bit coordinates (BAM_COORD_TYPE=int16_t), as MCU builds would be,
+ * so comparing its text case with bam-bench's shows whether 16-bit coordinates cost anything (and its hash of the
+ * last frame shows that both builds drew the same pixels).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <bam.h>
+#include <font2c-types.h>
+
+#include "headless.h"
+
+
+// ******** BENCH CONSTANTS ********
+
+#define BENCH_DISPLAY_WIDTH         480
+#define BENCH_DISPLAY_HEIGHT        272
+#define BENCH_TILE_WIDTH            32
+#define BENCH_TILE_HEIGHT           32
+#define BENCH_N_PIXELS              (BENCH_DISPLAY_WIDTH * BENCH_DISPLAY_HEIGHT)
+
+#define BENCH_DIRTY_BUFFER_SIZE     BAM_DIRTY_BUFFER_SIZE(BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT, \
+                                        BENCH_TILE_WIDTH, BENCH_TILE_HEIGHT)
+
+#define BENCH_N_WIDGETS             32
+#define BENCH_MASK_BUFFER_SIZE      (64 * 1024)
+
+#define BENCH_DEFAULT_N_FRAMES      200
+
+#define BENCH_GAUGE_N_TICKS         11
+#define BENCH_GAUGE_THICKNESS       20
+#define BENCH_GAUGE_START_ANGLE     135
+#define BENCH_GAUGE_SWEEP           270
+
+#define BENCH_TEXT_N_COLS           4
+#define BENCH_TEXT_N_ROWS           3
+#define BENCH_TEXT_N_READINGS       (BENCH_TEXT_N_COLS * BENCH_TEXT_N_ROWS)
+#define BENCH_TEXT_TICKER_HEIGHT    64
+#define BENCH_TEXT_TICKER_LENGTH    240
+
+#define BENCH_DAMAGE_N_NODES        1025
+#define BENCH_DAMAGE_MIN_WIDTH      8
+#define BENCH_DAMAGE_MIN_HEIGHT     8
+
+#define BENCH_FILL_BUFFER_SIZE      1024
+
+
+// ******** STYLE DATA ********
+
+// defined in font-deja-vu-sans-48.c
+extern const font2c_font_t font_deja_vu_sans_48;
+
+static const bam_style_t BENCH_TICKER_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_LEFT,
+        .v_align = BAM_V_ALIGN_MIDDLE,
+        .h_padding = 4,
+        .v_padding = 4,
+        .colors = {
+                {0xFF808080ul, 0xFF000040ul},
+                {0xFFFFFF00ul, 0xFF000040ul},
+                {0xFFFFFF00ul, 0xFF000080ul}
+        }
+};
+
+static const bam_style_t BENCH_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_CENTER,
+        .v_align = BAM_V_ALIGN_MIDDLE,
+        .h_padding = 4,
+        .v_padding = 4,
+        .colors = {
+                {0xFF808080ul, 0xFF202020ul},
+                {0xFFFFFFFFul, 0xFF202020ul},
+                {0xFFFFFFFFul, 0xFF404040ul}
+        }
+};
+
+
+static const bam_fill_t BENCH_VERTICAL_FILL = {
+        .type = BAM_FILL_TYPE_VERTICAL_GRADIENT,
+        .end_colors = {0xFF000000ul, 0xFF000060ul, 0xFF0000A0ul}
+};
+
+static const bam_fill_t BENCH_HORIZONTAL_FILL = {
+        .type = BAM_FILL_TYPE_HORIZONTAL_GRADIENT,
+        .end_colors = {0xFF000000ul, 0xFF000060ul, 0xFF0000A0ul}
+};
+
+static const bam_style_t BENCH_FLAT_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .colors = {
+                {0xFF808080ul, 0xFF101030ul},
+                {0xFFFFFFFFul, 0xFF2020C0ul},
+                {0xFFFFFFFFul, 0xFF4040FFul}
+        }
+};
+
+static const bam_style_t BENCH_VERTICAL_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .colors = {
+                {0xFF808080ul, 0xFF101030ul},
+                {0xFFFFFFFFul, 0xFF2020C0ul},
+                {0xFFFFFFFFul, 0xFF4040FFul}
+        },
+        .fill = &BENCH_VERTICAL_FILL
+};
+
+static const bam_style_t BENCH_HORIZONTAL_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .colors = {
+                {0xFF808080ul, 0xFF101030ul},
+                {0xFFFFFFFFul, 0xFF2020C0ul},
+                {0xFFFFFFFFul, 0xFF4040FFul}
+        },
+        .fill = &BENCH_HORIZONTAL_FILL
+};
+
+
+// ******** DISPLAY ********
+
+typedef struct {
+    bam_t bam;
+    headless_t hl;
+    uint32_t dirty_buffer[BENCH_DIRTY_BUFFER_SIZE];
+    bam_widget_t widget_buffer[BENCH_N_WIDGETS];
+    bam_color_t tile[BENCH_TILE_WIDTH * BENCH_TILE_HEIGHT];
+    bam_color_t pixels[BENCH_N_PIXELS];
+    uint8_t mask_buffer[BENCH_MASK_BUFFER_SIZE];
+    bam_damage_node_t damage_nodes[BENCH_DAMAGE_N_NODES];
+    bam_color_t fill_buffer[BENCH_FILL_BUFFER_SIZE];
+} bench_display_t;
+
+
+static bench_display_t m_display;
+
+
+static void display_init(bench_display_t* display) {
+    headless_init(&display->hl, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT, BENCH_TILE_WIDTH, BENCH_TILE_HEIGHT,
+                  display->tile, display->pixels);
+
+    bam_init(&display->bam, display->dirty_buffer, BENCH_DIRTY_BUFFER_SIZE, display->widget_buffer,
+             BENCH_N_WIDGETS, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT, BENCH_TILE_WIDTH, BENCH_TILE_HEIGHT,
+             0xFF000000ul, &BENCH_STYLE, &HEADLESS_VTABLE, &display->hl);
+}
+
+
+static uint64_t get_monotonic_time(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t) ts.tv_sec * 1000000000ull) + (uint64_t) ts.tv_nsec;
+}
+
+
+static void report(const char* label, int n_frames, uint64_t elapsed, unsigned long n_blts) {
+    printf("  %-28s %9.1f us/frame %7.1f tiles/frame %9.1f ns/tile\n", label,
+           (double) elapsed / 1e3 / n_frames, (double) n_blts / n_frames,
+           n_blts ? (double) elapsed / (double) n_blts : 0.0);
+}
+
+
+static uint32_t hash_display(const bench_display_t* display) {
+    // FNV-1a, so that runs of differently configured builds can be checked to have drawn same pixels
+    uint32_t hash = 2166136261ul;
+
+    for (size_t i = 0; i < BENCH_N_PIXELS; i++) {
+        hash = (hash ^ display->pixels[i]) * 16777619ul;
+    }
+
+    return hash;
+}
+
+
+// ******** GAUGE CASE ********
+
+typedef struct {
+    int value;
+    char reading[8];
+    int tick_x[BENCH_GAUGE_N_TICKS][2];
+    int tick_y[BENCH_GAUGE_N_TICKS][2];
+} bench_gauge_t;
+
+
+static void gauge_point(const bam_rect_t* bounds, int radius, int angle_x10, int* x, int* y) {
+    double angle = (double) angle_x10 * 3.14159265358979 / 1800.0;
+
+    *x = ((bounds->x1 + bounds->x2) / 2) + (int) lround(cos(angle) * radius);
+    *y = ((bounds->y1 + bounds->y2) / 2) + (int) lround(sin(angle) * radius);
+}
+
+
+static void gauge_draw(bam_t* bam, bam_widget_handle_t widget, const bam_rect_t* bounds, void* user_data) {
+    const bench_gauge_t* gauge = user_data;
+    int cx = (bounds->x1 + bounds->x2) / 2;
+    int cy = (bounds->y1 + bounds->y2) / 2;
+    int radius = (((bounds->y2 - bounds->y1) < (bounds->x2 - bounds->x1)) ?
+                  (bounds->y2 - bounds->y1) : (bounds->x2 - bounds->x1)) / 2;
+    int needle_x;
+    int needle_y;
+
+    (void) widget;
+
+    bam_draw_round_rect(bam, bounds, 24, 0xFF303030ul);
+    bam_draw_arc(bam, cx, cy, radius, BENCH_GAUGE_THICKNESS, BENCH_GAUGE_START_ANGLE,
+                 BENCH_GAUGE_START_ANGLE + BENCH_GAUGE_SWEEP, 0xFF505050ul);
+    bam_draw_arc(bam, cx, cy, radius, BENCH_GAUGE_THICKNESS, BENCH_GAUGE_START_ANGLE,
+                 BENCH_GAUGE_START_ANGLE + ((gauge->value * BENCH_GAUGE_SWEEP) / 100), 0xFF20A0FFul);
+
+    for (int i = 0; i < BENCH_GAUGE_N_TICKS; i++) {
+        bam_draw_line(bam, gauge->tick_x[i][0], gauge->tick_y[i][0], gauge->tick_x[i][1], gauge->tick_y[i][1], 3,
+                      0xFFC0C0C0ul);
+    }
+
+    gauge_point(bounds, radius - 40, (BENCH_GAUGE_START_ANGLE * 10) + (gauge->value * BENCH_GAUGE_SWEEP / 10),
+                &needle_x, &needle_y);
+    bam_draw_line(bam, cx, cy, needle_x, needle_y, 6, 0xFFFF4020ul);
+}
+
+
+static void gauge_run(int n_frames, bool mask_cache) {
+    static bench_gauge_t gauge;
+    bam_rect_t bounds = {0, 0, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT};
+    bam_widget_handle_t widget;
+    int radius = (BENCH_DISPLAY_HEIGHT - (2 * BENCH_STYLE.v_padding)) / 2;
+    uint64_t start;
+
+    display_init(&m_display);
+
+    if (mask_cache) {
+        bam_init_mask_cache(&m_display.bam, m_display.mask_buffer, sizeof(m_display.mask_buffer));
+    }
+
+    // tick marks are worked out once, as a real gauge would
+    bounds.x1 += BENCH_STYLE.h_padding;
+    bounds.y1 += BENCH_STYLE.v_padding;
+    bounds.x2 -= BENCH_STYLE.h_padding;
+    bounds.y2 -= BENCH_STYLE.v_padding;
+
+    for (int i = 0; i < BENCH_GAUGE_N_TICKS; i++) {
+        int angle = (BENCH_GAUGE_START_ANGLE * 10) + ((i * BENCH_GAUGE_SWEEP * 10) / (BENCH_GAUGE_N_TICKS - 1));
+
+        gauge_point(&bounds, radius - BENCH_GAUGE_THICKNESS - 4, angle, &gauge.tick_x[i][0], &gauge.tick_y[i][0]);
+        gauge_point(&bounds, radius - BENCH_GAUGE_THICKNESS - 16, angle, &gauge.tick_x[i][1],
+                    &gauge.tick_y[i][1]);
+    }
+
+    widget = bam_add_widget(&m_display.bam, 0, 0, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT, NULL, gauge.reading,
+                            true);
+    bam_set_widget_draw_callback(&m_display.bam, widget, gauge_draw, &gauge);
+    bam_step(&m_display.bam, NULL);
+
+    m_display.hl.n_blts = 0;
+    start = get_monotonic_time();
+
+    // every frame, reading changes and whole gauge is redrawn
+    for (int frame = 0; frame < n_frames; frame++) {
+        gauge.value = frame % 101;
+        snprintf(gauge.reading, sizeof(gauge.reading), "%i", gauge.value);
+        bam_set_widget_text(&m_display.bam, widget, gauge.reading);
+        bam_force_widget_redraw(&m_display.bam, widget);
+        bam_step(&m_display.bam, NULL);
+    }
+
+    report(mask_cache ? "with mask cache" : "without mask cache", n_frames, get_monotonic_time() - start,
+           m_display.hl.n_blts);
+}
+
+
+static void gauge_case(int n_frames) {
+    gauge_run(n_frames, false);
+    gauge_run(n_frames, true);
+}
+
+
+// ******** TEXT CASE ********
+
+static void text_case(int n_frames) {
+    static char readings[BENCH_TEXT_N_READINGS][8];
+    static char ticker[BENCH_TEXT_TICKER_LENGTH + 1];
+    bam_widget_desc_t descs[BENCH_TEXT_N_READINGS];
+    bam_rect_t bounds = {0, 0, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT - BENCH_TEXT_TICKER_HEIGHT};
+    bam_widget_handle_t ticker_widget;
+    uint64_t start;
+
+    display_init(&m_display);
+
+    bam_layout_grid_descs(BENCH_TEXT_N_COLS, BENCH_TEXT_N_ROWS, &bounds, 4, 4, descs, BENCH_TEXT_N_READINGS);
+
+    for (int i = 0; i < BENCH_TEXT_N_READINGS; i++) {
+        descs[i].style = NULL;
+        descs[i].text = readings[i];
+        descs[i].enabled = true;
+        descs[i].metadata = 0;
+        descs[i].callback = NULL;
+        descs[i].user_data = NULL;
+    }
+
+    bam_add_widgets(&m_display.bam, descs, BENCH_TEXT_N_READINGS);
+
+    // most of ticker's glyphs lie beyond its widget, so are clipped
+    for (int i = 0; i < BENCH_TEXT_TICKER_LENGTH; i++) {
+        ticker[i] = (char) ('A' + (i % 26));
+    }
+
+    ticker_widget = bam_add_widget(&m_display.bam, 0, BENCH_DISPLAY_HEIGHT - BENCH_TEXT_TICKER_HEIGHT,
+                                   BENCH_DISPLAY_WIDTH, BENCH_TEXT_TICKER_HEIGHT, &BENCH_TICKER_STYLE, ticker, true);
+    bam_step(&m_display.bam, NULL);
+
+    m_display.hl.n_blts = 0;
+    start = get_monotonic_time();
+
+    // every frame, every reading changes and ticker is redrawn
+    for (int frame = 0; frame < n_frames; frame++) {
+        for (int i = 0; i < BENCH_TEXT_N_READINGS; i++) {
+            snprintf(readings[i], sizeof(readings[i]), "%i", (frame * 7 + i * 13) % 1000);
+            bam_force_widget_redraw(&m_display.bam, (bam_widget_handle_t) i);
+        }
+
+        bam_force_widget_redraw(&m_display.bam, ticker_widget);
+        bam_step(&m_display.bam, NULL);
+    }
+
+    report("readings and ticker", n_frames, get_monotonic_time() - start, m_display.hl.n_blts);
+    printf("  last frame's pixels hash to %08lx\n", (unsigned long) hash_display(&m_display));
+}
+
+
+// ******** DAMAGE CASE ********
+
+typedef struct {
+    const char* name;
+    void (* step) (int frame);
+} bench_trace_t;
+
+
+static char m_readings[BENCH_TEXT_N_READINGS][8];
+static bam_widget_handle_t m_indicator;
+static bam_widget_handle_t m_dragged;
+
+
+static void trace_change_reading(int index, int frame) {
+    snprintf(m_readings[index], sizeof(m_readings[index]), "%i", (frame * 7 + index * 13) % 1000);
+    bam_force_widget_redraw(&m_display.bam, (bam_widget_handle_t) index);
+}
+
+
+static void trace_blink(int frame) {
+    bam_set_widget_enabled(&m_display.bam, m_indicator, (frame % 2) != 0);
+}
+
+
+static void trace_reading(int frame) {
+    trace_change_reading(frame % BENCH_TEXT_N_READINGS, frame);
+}
+
+
+static void trace_drag(int frame) {
+    bam_rect_t bounds;
+    int x = (frame * 3) % (BENCH_DISPLAY_WIDTH - 80);
+
+    bounds.x1 = x;
+    bounds.y1 = BENCH_DISPLAY_HEIGHT - 64;
+    bounds.x2 = x + 80;
+    bounds.y2 = BENCH_DISPLAY_HEIGHT;
+
+    bam_set_widget_bounds(&m_display.bam, m_dragged, &bounds);
+}
+
+
+static void trace_every_reading(int frame) {
+    for (int i = 0; i < BENCH_TEXT_N_READINGS; i++) {
+        trace_change_reading(i, frame);
+    }
+}
+
+
+static const bench_trace_t BENCH_TRACES[] = {
+        {"blinking indicator", trace_blink},
+        {"single reading", trace_reading},
+        {"dragged widget", trace_drag},
+        {"every reading", trace_every_reading}
+};
+
+
+static void damage_run(const bench_trace_t* trace, int n_frames, bool tree) {
+    bam_widget_desc_t descs[BENCH_TEXT_N_READINGS];
+    bam_rect_t bounds = {0, 0, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT - 64};
+    char label[64];
+    uint64_t elapsed;
+
+    display_init(&m_display);
+
+    if (tree) {
+        bam_init_damage_tree(&m_display.bam, m_display.damage_nodes, BENCH_DAMAGE_N_NODES, BENCH_DAMAGE_MIN_WIDTH,
+                             BENCH_DAMAGE_MIN_HEIGHT);
+    }
+
+    // screen is a grid of readings, with a small indicator in its corner and a widget that is dragged along its
+    // bottom
+    bam_layout_grid_descs(BENCH_TEXT_N_COLS, BENCH_TEXT_N_ROWS, &bounds, 4, 4, descs, BENCH_TEXT_N_READINGS);
+
+    for (int i = 0; i < BENCH_TEXT_N_READINGS; i++) {
+        trace_change_reading(i, 0);
+        descs[i].style = NULL;
+        descs[i].text = m_readings[i];
+        descs[i].enabled = true;
+        descs[i].metadata = 0;
+        descs[i].callback = NULL;
+        descs[i].user_data = NULL;
+    }
+
+    bam_add_widgets(&m_display.bam, descs, BENCH_TEXT_N_READINGS);
+    m_indicator = bam_add_widget(&m_display.bam, BENCH_DISPLAY_WIDTH - 20, BENCH_DISPLAY_HEIGHT - 56, 12, 12, NULL,
+                                 NULL, true);
+    m_dragged = bam_add_widget(&m_display.bam, 0, BENCH_DISPLAY_HEIGHT - 64, 80, 64, NULL, "<>", true);
+    bam_step(&m_display.bam, NULL);
+
+    m_display.hl.n_blts = 0;
+    m_display.hl.n_blt_pixels = 0;
+    elapsed = get_monotonic_time();
+
+    for (int frame = 1; frame <= n_frames; frame++) {
+        trace->step(frame);
+        bam_step(&m_display.bam, NULL);
+    }
+
+    elapsed = get_monotonic_time() - elapsed;
+
+    snprintf(label, sizeof(label), "%s, %s", trace->name, tree ? "tree" : "bitmap");
+    printf("  %-32s %9.1f us/frame %7.1f regions/frame %9.0f pixels/frame   %08lx\n", label,
+           (double) elapsed / 1e3 / n_frames, (double) m_display.hl.n_blts / n_frames,
+           (double) m_display.hl.n_blt_pixels / n_frames, (unsigned long) hash_display(&m_display));
+}
+
+
+static void damage_case(int n_frames) {
+    // both kinds of damage tracking must leave display with same pixels, so last frame's hash is printed too
+    for (size_t i = 0; i < sizeof(BENCH_TRACES) / sizeof(BENCH_TRACES[0]); i++) {
+        damage_run(&BENCH_TRACES[i], n_frames, false);
+        damage_run(&BENCH_TRACES[i], n_frames, true);
+    }
+}
+
+
+// ******** FILL CASE ********
+
+static void fill_run(const char* label, int n_frames, const bam_style_t* style, bool fill_cache) {
+    bam_widget_desc_t descs[BENCH_TEXT_N_READINGS];
+    bam_rect_t bounds = {0, 0, BENCH_DISPLAY_WIDTH, BENCH_DISPLAY_HEIGHT};
+    uint64_t start;
+
+    display_init(&m_display);
+
+    if (fill_cache) {
+        bam_init_fill_cache(&m_display.bam, m_display.fill_buffer, BENCH_FILL_BUFFER_SIZE);
+    }
+
+    // buttons have no text, so that only their fills are measured
+    bam_layout_grid_descs(BENCH_TEXT_N_COLS, BENCH_TEXT_N_ROWS, &bounds, 4, 4, descs, BENCH_TEXT_N_READINGS);
+
+    for (int i = 0; i < BENCH_TEXT_N_READINGS; i++) {
+        descs[i].style = style;
+        descs[i].text = NULL;
+        descs[i].enabled = true;
+        descs[i].metadata = 0;
+        descs[i].callback = NULL;
+        descs[i].user_data = NULL;
+    }
+
+    bam_add_widgets(&m_display.bam, descs, BENCH_TEXT_N_READINGS);
+    bam_step(&m_display.bam, NULL);
+
+    m_display.hl.n_blts = 0;
+    start = get_monotonic_time();
+
+    for (int frame = 0; frame < n_frames; frame++) {
+        for (int i = 0; i < BENCH_TEXT_N_READINGS; i++) {
+            bam_force_widget_redraw(&m_display.bam, (bam_widget_handle_t) i);
+        }
+
+        bam_step(&m_display.bam, NULL);
+    }
+
+    report(label, n_frames, get_monotonic_time() - start, m_display.hl.n_blts);
+}
+
+
+static void fill_case(int n_frames) {
+    fill_run("flat", n_frames, &BENCH_FLAT_STYLE, false);
+    fill_run("vertical gradient, uncached", n_frames, &BENCH_VERTICAL_STYLE, false);
+    fill_run("vertical gradient, cached", n_frames, &BENCH_VERTICAL_STYLE, true);
+    fill_run("horizontal gradient, uncached", n_frames, &BENCH_HORIZONTAL_STYLE, false);
+    fill_run("horizontal gradient, cached", n_frames, &BENCH_HORIZONTAL_STYLE, true);
+}
+
+
+// ******** CASES ********
+
+typedef struct {
+    const char* name;
+    void (* run) (int n_frames);
+} bench_case_t;
+
+
+static const bench_case_t BENCH_CASES[] = {
+        {"gauge", gauge_case},
+        {"text", text_case},
+        {"damage", damage_case},
+        {"fill", fill_case}
+};
+
+#define BENCH_N_CASES               (sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]))
+
+
+// ******** EXECUTION ENTRY POINT ********
+
+int main(int argc, char* argv[]) {
+    const char* name = (argc > 1) ? argv[1] : "all";
+    int n_frames = (argc > 2) ? atoi(argv[2]) : BENCH_DEFAULT_N_FRAMES;
+    bool found = false;
+
+    if (n_frames < 1) {
+        fprintf(stderr, "usage: %s [case] [n_frames]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("display %ix%i, tiles %ix%i, coordinates %zu-bit, %i frames per run\n", BENCH_DISPLAY_WIDTH,
+           BENCH_DISPLAY_HEIGHT, BENCH_TILE_WIDTH, BENCH_TILE_HEIGHT, 8 * sizeof(bam_coord_t), n_frames);
+
+    for (size_t i = 0; i < BENCH_N_CASES; i++) {
+        if (strcmp(name, "all") == 0 || strcmp(name, BENCH_CASES[i].name) == 0) {
+            printf("%s:\n", BENCH_CASES[i].name);
+            BENCH_CASES[i].run(n_frames);
+            found = true;
+        }
+    }
+
+    if (!found) {
+        fprintf(stderr, "unknown case '%s'\n", name);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -25,6 +25,7 @@
 #include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <bam.h>
 #include <font2c-types.h>
 #include <SDL.h>
@@ -42,6 +43,15 @@
 
 #define APP_WIDGET_BUFFER_SIZE      64
 
+#define APP_FRAME_BUDGET            20
+
+#define APP_DAMAGE_NODE_BUFFER_SIZE 1025
+#define APP_DAMAGE_MIN_WIDTH        8
+#define APP_DAMAGE_MIN_HEIGHT       8
+
+#define APP_WIDGET_CACHE_BUFFER_SIZE (256 * 1024)
+#define APP_FILL_BUFFER_SIZE        1024
+
 
 // ******** STYLE DATA ********
 
@@ -140,6 +150,16 @@ static const bam_style_t APP_EDIT_STYLE = { // NOLINT(cppcoreguidelines-interfac
 };
 
 
+static const bam_fill_t APP_ACCEPT_FILL = {
+        .type = BAM_FILL_TYPE_VERTICAL_GRADIENT,
+        .end_colors = {
+                APP_COLOR_DARK_GREEN,   // disabled
+                APP_COLOR_DARK_GREEN,   // enabled
+                APP_COLOR_GREEN         // pressed
+        }
+};
+
+
 static const bam_style_t APP_ACCEPT_STYLE = { // NOLINT(cppcoreguidelines-interfaces-global-init)
         .font = &font_material_icons_48,
         .h_align = BAM_H_ALIGN_CENTER,
@@ -160,6 +180,17 @@ static const bam_style_t APP_ACCEPT_STYLE = { // NOLINT(cppcoreguidelines-interf
                         .foreground = APP_COLOR_WHITE,
                         .background = APP_COLOR_LIGHT_GREEN
                 }
+        },
+        .fill = &APP_ACCEPT_FILL
+};
+
+
+static const bam_fill_t APP_CANCEL_FILL = {
+        .type = BAM_FILL_TYPE_VERTICAL_GRADIENT,
+        .end_colors = {
+                APP_COLOR_DARK_RED,     // disabled
+                APP_COLOR_DARK_RED,     // enabled
+                APP_COLOR_RED           // pressed
         }
 };
 
@@ -184,7 +215,8 @@ static const bam_style_t APP_CANCEL_STYLE = { // NOLINT(cppcoreguidelines-interf
                         .foreground = APP_COLOR_WHITE,
                         .background = APP_COLOR_LIGHT_RED
                 }
-        }
+        },
+        .fill = &APP_CANCEL_FILL
 };
 
 
@@ -212,6 +244,7 @@ static SDL_Surface* m_tile;
 static jmp_buf m_panic_jmp;
 static bam_t m_bam;
 static bool m_update_surface;
+static bool m_anti_aliasing = true;
 
 
 // ******** VTABLE FUNCTION IMPLEMENTATIONS ********
@@ -257,15 +290,17 @@ static bool v_get_event(bam_event_t* event, bam_tick_t timeout, void* user_data)
         // calculate time that has elapsed since function was called
         elapsed_ms = (uint32_t) (now - start_time);
 
-        // timeout if elapsed time is greater than or equal to specified timeout period
+        // once elapsed time is greater than or equal to specified timeout period, only take events that are already
+        // queued (BaM polls with a timeout of zero when coalescing moves), otherwise wait for input event up until
+        // timeout is due
+        s_event.type = SDL_FIRSTEVENT;
+
         if ( elapsed_ms >= timeout ) {
-            return false;
+            SDL_PollEvent(&s_event);
+        } else {
+            SDL_WaitEventTimeout(&s_event, (int) (timeout - elapsed_ms));
         }
 
-        // wait for input event up until timoue is due
-        s_event.type = SDL_FIRSTEVENT;
-        SDL_WaitEventTimeout(&s_event, (int) (timeout - elapsed_ms));
-
         // translate SDL event into BaM event or ignore if not relevant
         switch(s_event.type) {
         case SDL_FIRSTEVENT:
@@ -276,6 +311,10 @@ static bool v_get_event(bam_event_t* event, bam_tick_t timeout, void* user_data)
             event->type = BAM_EVENT_TYPE_QUIT;
             return true;
 
+        case SDL_USEREVENT:
+            // offloaded work has completed, return so that event loop can process it
+            return false;
+
         case SDL_MOUSEBUTTONDOWN:
             if ( s_event.button.button == SDL_BUTTON_LEFT ) {
                 event->type = BAM_EVENT_TYPE_PRESS;
@@ -294,6 +333,16 @@ static bool v_get_event(bam_event_t* event, bam_tick_t timeout, void* user_data)
             }
             break;
 
+        case SDL_MOUSEMOTION:
+            // only report movement while left button is held, as a touch screen would
+            if ( s_event.motion.state & SDL_BUTTON_LMASK ) {
+                event->type = BAM_EVENT_TYPE_MOVE;
+                event->x = s_event.motion.x;
+                event->y = s_event.motion.y;
+                return true;
+            }
+            break;
+
         default:
             break;
         }
@@ -372,6 +421,15 @@ static void gen_color_lut(bam_color_t* lut, bam_color_t fg_color, bam_color_t bg
     bg.word = bg_color;
     inter.channels[3] = 0xFF;
 
+    // without anti-aliasing, glyph pixels are thresholded to either background or foreground color
+    if ( !m_anti_aliasing ) {
+        for (unsigned int k = 0; k < 16; k++) {
+            lut[k] = (k < 8) ? bg_color : fg_color;
+        }
+
+        return;
+    }
+
     // calculate 16 step linear gradient between foreground color and background color
     for (unsigned int k = 0; k < 16; k++) {
         inter.channels[0] = interpolate_u8(bg.channels[0], fg.channels[0], k);
@@ -387,6 +445,7 @@ static void v_draw_glyph(const bam_rect_t* dest_rect, const bam_rect_t* src_rect
                          const bam_color_pair_t* colors, void* user_data) {
     static bam_color_t prev_foreground;
     static bam_color_t prev_background;
+    static bool prev_anti_aliasing;
     static bam_color_t lut[16];
 
     bam_color_t foreground = colors->foreground;
@@ -395,10 +454,11 @@ static void v_draw_glyph(const bam_rect_t* dest_rect, const bam_rect_t* src_rect
     (void) user_data;
 
     // regenerate color interpolation LUT if requests colors have changed since last call
-    if (foreground != prev_foreground || background != prev_background) {
+    if (foreground != prev_foreground || background != prev_background || m_anti_aliasing != prev_anti_aliasing) {
         gen_color_lut(lut, foreground, background);
         prev_foreground = foreground;
         prev_background = background;
+        prev_anti_aliasing = m_anti_aliasing;
     }
 
     // precalculate blt parameters
@@ -478,6 +538,130 @@ static void v_draw_fill(const bam_rect_t* dest_rect, bam_color_t color, void* us
 }
 
 
+static void v_draw_coverage(const bam_rect_t* dest_rect, const uint8_t* coverage, bam_color_t color, void* user_data) {
+    // unused arguments
+    (void) user_data;
+
+    size_t dest_pitch = (m_tile->pitch) / sizeof(uint32_t);
+    uint32_t* dest_rows_i = ((uint32_t*) m_tile->pixels) + dest_rect->x1 + (dest_pitch * dest_rect->y1);
+    uint32_t* dest_rows_e = ((uint32_t*) m_tile->pixels) + dest_rect->x1 + (dest_pitch * dest_rect->y2);
+    size_t dest_width = dest_rect->x2 - dest_rect->x1;
+
+    // blend color over each pixel in proportion to its coverage
+    while (dest_rows_i < dest_rows_e) {
+        for (size_t i = 0; i < dest_width; i++) {
+            uint32_t k = coverage[i];
+            uint32_t dest = dest_rows_i[i];
+            uint32_t rb = ((((color & 0x00FF00FFul) * k) + ((dest & 0x00FF00FFul) * (255 - k))) >> 8) & 0x00FF00FFul;
+            uint32_t g = ((((color & 0x0000FF00ul) * k) + ((dest & 0x0000FF00ul) * (255 - k))) >> 8) & 0x0000FF00ul;
+
+            dest_rows_i[i] = 0xFF000000ul | rb | g;
+        }
+
+        coverage += dest_width;
+        dest_rows_i += dest_pitch;
+    }
+}
+
+
+static void v_draw_pixels(const bam_rect_t* dest_rect, const bam_color_t* pixels, size_t pitch, void* user_data) {
+    // unused arguments
+    (void) user_data;
+
+    size_t dest_pitch = (m_tile->pitch) / sizeof(uint32_t);
+    size_t dest_width = dest_rect->x2 - dest_rect->x1;
+    uint32_t* dest_rows_i = ((uint32_t*) m_tile->pixels) + dest_rect->x1 + (dest_pitch * dest_rect->y1);
+    uint32_t* dest_rows_e = ((uint32_t*) m_tile->pixels) + dest_rect->x1 + (dest_pitch * dest_rect->y2);
+
+    // BaM colors are already in tile surface's pixel format, so rows can be copied directly
+    while (dest_rows_i < dest_rows_e) {
+        memcpy(dest_rows_i, pixels, dest_width * sizeof(uint32_t));
+        pixels += pitch;
+        dest_rows_i += dest_pitch;
+    }
+}
+
+
+static void v_read_tile(const bam_rect_t* rect, bam_color_t* pixels, size_t pitch, void* user_data) {
+    // unused arguments
+    (void) user_data;
+
+    size_t src_pitch = (m_tile->pitch) / sizeof(uint32_t);
+    size_t src_width = rect->x2 - rect->x1;
+    const uint32_t* src_rows_i = ((const uint32_t*) m_tile->pixels) + rect->x1 + (src_pitch * rect->y1);
+    const uint32_t* src_rows_e = ((const uint32_t*) m_tile->pixels) + rect->x1 + (src_pitch * rect->y2);
+
+    // tile surface's pixel format is already that of BaM colors, so rows can be copied directly
+    while (src_rows_i < src_rows_e) {
+        memcpy(pixels, src_rows_i, src_width * sizeof(uint32_t));
+        pixels += pitch;
+        src_rows_i += src_pitch;
+    }
+}
+
+
+static void v_copy_region(const bam_rect_t* src_rect, int dest_x, int dest_y, void* user_data) {
+    // unused arguments
+    (void) user_data;
+
+    size_t bpp = m_surface->format->BytesPerPixel;
+    size_t row_size = (src_rect->x2 - src_rect->x1) * bpp;
+    int n_rows = src_rect->y2 - src_rect->y1;
+    uint8_t* pixels = m_surface->pixels;
+
+    // copy rows in an order that doesn't overwrite source rows before they have been copied
+    for (int i = 0; i < n_rows; i++) {
+        int row = (dest_y > src_rect->y1) ? (n_rows - 1 - i) : i;
+        uint8_t* src = pixels + ((src_rect->y1 + row) * m_surface->pitch) + (src_rect->x1 * bpp);
+        uint8_t* dest = pixels + ((dest_y + row) * m_surface->pitch) + (dest_x * bpp);
+
+        memmove(dest, src, row_size);
+    }
+
+    // flag window surface as requiring update (handled in v_get_event)
+    m_update_surface = true;
+}
+
+
+static int work_thread_func(void* data) {
+    SDL_Event s_event;
+
+    // run offloaded work, then wake event loop so that it can handle completion
+    bam_execute_work((bam_work_t*) data);
+
+    s_event.type = SDL_USEREVENT;
+    SDL_PushEvent(&s_event);
+
+    return 0;
+}
+
+
+static void v_submit_work(bam_work_t* work, void* user_data) {
+    SDL_Thread* thread;
+
+    // unused arguments
+    (void) user_data;
+
+    // run each piece of work on its own thread, falling back to running it inline if a thread can't be created
+    thread = SDL_CreateThread(work_thread_func, "bam-work", work);
+
+    if ( thread ) {
+        SDL_DetachThread(thread);
+    } else {
+        work_thread_func(work);
+    }
+}
+
+
+static void v_set_anti_aliasing(bool enabled, void* user_data) {
+    // unused arguments
+    (void) user_data;
+
+    // glyph color LUT is regenerated on next call to v_draw_glyph
+    m_anti_aliasing = enabled;
+}
+
+
 static void v_blt_tile(int x, int y, void* user_data) {
     SDL_Rect src_rect;
     SDL_Rect dest_rect;
@@ -503,6 +687,31 @@ static void v_blt_tile(int x, int y, void* user_data) {
 }
 
 
+static void v_blt_region(const bam_rect_t* rect, void* user_data) {
+    SDL_Rect src_rect;
+    SDL_Rect dest_rect;
+
+    // unused arguments
+    (void) user_data;
+
+    // copy top-left region of tile surface to display surface at specified position
+    src_rect.x = 0;
+    src_rect.y = 0;
+    src_rect.w = rect->x2 - rect->x1;
+    src_rect.h = rect->y2 - rect->y1;
+
+    dest_rect.x = rect->x1;
+    dest_rect.y = rect->y1;
+    dest_rect.w = src_rect.w;
+    dest_rect.h = src_rect.h;
+
+    SDL_BlitSurface(m_tile, &src_rect, m_surface, &dest_rect);
+
+    // flag window surface as requiring update (handled in v_get_event)
+    m_update_surface = true;
+}
+
+
 // ******** MENU SCREEN ********
 
 typedef enum
@@ -541,7 +750,10 @@ static void menu_screen_func(bam_t* bam, bam_widget_handle_t widget, void* user_
         accepted = bam_edit_real(&m_bam, &real_value, &APP_EDITOR_STYLE);
 
         if ( accepted ) {
-            printf("Accepted real: %g\n", real_value);
+            char real_str[32];
+
+            bam_format_real(real_str, sizeof(real_str), real_value, 6);
+            printf("Accepted real: %s\n", real_str);
         }
         break;
 
@@ -579,27 +791,31 @@ static void menu_screen(void) {
             "Edit IPv4 Address"
     };
 
-    bam_widget_handle_t menu_items[APP_MENU_N_ITEMS];
+    bam_widget_desc_t menu_items[APP_MENU_N_ITEMS];
     bam_rect_t bounds;
 
     // ensure any existing widgets are destroyed
     bam_delete_widgets(&m_bam);
 
-    // create menu widgets
+    // describe menu widgets, with their captions, metadata and callback functions
     bounds.x1 = 0;
     bounds.y1 = 0;
     bounds.x2 = APP_DISPLAY_WIDTH;
     bounds.y2 = APP_DISPLAY_HEIGHT;
 
-    bam_layout_grid(&m_bam, 1, APP_MENU_N_ITEMS, &bounds, 8, 8,
-                    &APP_DEFAULT_STYLE, true, menu_items, APP_MENU_N_ITEMS);
+    bam_layout_grid_descs(1, APP_MENU_N_ITEMS, &bounds, 8, 8, menu_items, APP_MENU_N_ITEMS);
 
-    // set widget captions, metadata and callback functions
     for (int i = 0; i < APP_MENU_N_ITEMS; i++) {
-        bam_set_widget_text(&m_bam, menu_items[i], MENU_CAPTIONS[i]);
-        bam_set_widget_metadata(&m_bam, menu_items[i], i);
-        bam_set_widget_callback(&m_bam, menu_items[i], menu_screen_func, NULL);
+        menu_items[i].style = &APP_DEFAULT_STYLE;
+        menu_items[i].text = MENU_CAPTIONS[i];
+        menu_items[i].enabled = true;
+        menu_items[i].metadata = i;
+        menu_items[i].callback = menu_screen_func;
+        menu_items[i].user_data = NULL;
     }
+
+    // create menu widgets
+    bam_add_widgets(&m_bam, menu_items, APP_MENU_N_ITEMS);
 }
 
 
@@ -614,11 +830,22 @@ int main(int argc, char* argv[]) {
             .get_glyph_metrics = v_get_glyph_metrics,
             .draw_glyph = v_draw_glyph,
             .draw_fill = v_draw_fill,
-            .blt_tile = v_blt_tile
+            .blt_tile = v_blt_tile,
+            .draw_coverage = v_draw_coverage,
+            .draw_pixels = v_draw_pixels,
+            .copy_region = v_copy_region,
+            .submit_work = v_submit_work,
+            .set_anti_aliasing = v_set_anti_aliasing,
+            .blt_region = v_blt_region,
+            .read_tile = v_read_tile
     };
 
     static uint32_t dirty_buffer[APP_DIRTY_BUFFER_SIZE];
     static bam_widget_t widget_buffer[APP_WIDGET_BUFFER_SIZE];
+    static bam_damage_node_t damage_nodes[APP_DAMAGE_NODE_BUFFER_SIZE];
+    static uint8_t widget_cache_buffer[APP_WIDGET_CACHE_BUFFER_SIZE];
+    static bam_color_t fill_buffer[APP_FILL_BUFFER_SIZE];
+    static bam_reconcile_record_t reconcile_records[APP_WIDGET_BUFFER_SIZE];
 
     int exit_code = EXIT_FAILURE;
 
@@ -692,6 +919,22 @@ int main(int argc, char* argv[]) {
             &VTABLE,
             NULL);
 
+    // track damage at pixel-region granularity, rather than whole tiles
+    bam_init_damage_tree(&m_bam, damage_nodes, APP_DAMAGE_NODE_BUFFER_SIZE, APP_DAMAGE_MIN_WIDTH,
+                         APP_DAMAGE_MIN_HEIGHT);
+
+    // cache appearance of pressed widgets, so that press feedback only has to recolor them
+    bam_init_widget_cache(&m_bam, widget_cache_buffer, APP_WIDGET_CACHE_BUFFER_SIZE);
+
+    // only redraw what differs when a screen is rebuilt (e.g. menu screen after an editor returns)
+    bam_init_reconcile(&m_bam, reconcile_records, APP_WIDGET_BUFFER_SIZE);
+
+    // cache gradient color tables, so that gradient fills cost no more than flat fills
+    bam_init_fill_cache(&m_bam, fill_buffer, APP_FILL_BUFFER_SIZE);
+
+    // let governor trade rendering quality for responsiveness when frames overrun their budget
+    bam_set_frame_budget(&m_bam, APP_FRAME_BUDGET);
+
     // create menu screen
     menu_screen();
 
@@ -0,0 +1,505 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Fleet simulator - runs thousands of headless BaM contexts in one process, each standing in for a device with its
+ * own screen. Every simulated frame, some devices' screens change, and only those devices are rendered, by a pool of
+ * worker threads that steal work from each other. Fonts and styles are shared read-only by every device, and a
+ * device only borrows a tile surface from the worker rendering it.
+ *
+ * usage: bam-fleet [n_devices] [n_threads] [n_frames] [verify]
+ *
+ * If 'verify' is given, the fleet is run again on a single thread and the checksums of every device's presented
+ * pixels are compared.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <bam.h>
+#include <font2c-types.h>
+
+#include "headless.h"
+
+
+// ******** FLEET CONSTANTS ********
+
+#define FLEET_DISPLAY_WIDTH         320
+#define FLEET_DISPLAY_HEIGHT        240
+#define FLEET_TILE_WIDTH            32
+#define FLEET_TILE_HEIGHT           32
+
+#define FLEET_DIRTY_BUFFER_SIZE     BAM_DIRTY_BUFFER_SIZE(FLEET_DISPLAY_WIDTH, FLEET_DISPLAY_HEIGHT, \
+                                        FLEET_TILE_WIDTH, FLEET_TILE_HEIGHT)
+
+#define FLEET_N_COLS                4
+#define FLEET_N_ROWS                3
+#define FLEET_N_WIDGETS             (FLEET_N_COLS * FLEET_N_ROWS)
+
+#define FLEET_MAX_THREADS           64
+#define FLEET_FRAME_PERIOD          20
+#define FLEET_CHANGE_PERCENT        25
+
+#define FLEET_DEFAULT_N_DEVICES     4096
+#define FLEET_DEFAULT_N_THREADS     4
+#define FLEET_DEFAULT_N_FRAMES      100
+
+
+// ******** STYLE DATA ********
+
+// defined in font-deja-vu-sans-48.c
+extern const font2c_font_t font_deja_vu_sans_48;
+
+static const bam_style_t FLEET_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_CENTER,
+        .v_align = BAM_V_ALIGN_MIDDLE,
+        .h_padding = 4,
+        .v_padding = 4,
+        .colors = {
+                {0xFFFFFFFFul, 0xFF303030ul},
+                {0xFF606060ul, 0xFF202020ul},
+                {0xFFFFFFFFul, 0xFFA00000ul}
+        }
+};
+
+
+// ******** DEVICES ********
+
+typedef struct {
+    bam_t bam;
+    headless_t hl;
+    uint32_t dirty_buffer[FLEET_DIRTY_BUFFER_SIZE];
+    bam_widget_t widget_buffer[FLEET_N_WIDGETS];
+    char values[2][FLEET_N_WIDGETS][4];
+    uint32_t rng;
+} fleet_device_t;
+
+
+static uint32_t device_random(fleet_device_t* device) {
+    // xorshift32, seeded per device so that every run of fleet simulates the same changes
+    uint32_t x = device->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    device->rng = x;
+
+    return x;
+}
+
+
+static void device_init(fleet_device_t* device, uint32_t index) {
+    bam_rect_t bounds;
+    bam_widget_desc_t descs[FLEET_N_WIDGETS];
+
+    // device has no tile surface until it is rendered, and no display buffer, as its display is only checksummed
+    headless_init(&device->hl, FLEET_DISPLAY_WIDTH, FLEET_DISPLAY_HEIGHT, FLEET_TILE_WIDTH, FLEET_TILE_HEIGHT, NULL,
+                  NULL);
+
+    bam_init(&device->bam, device->dirty_buffer, FLEET_DIRTY_BUFFER_SIZE, device->widget_buffer, FLEET_N_WIDGETS,
+             FLEET_DISPLAY_WIDTH, FLEET_DISPLAY_HEIGHT, FLEET_TILE_WIDTH, FLEET_TILE_HEIGHT, 0xFF000000ul,
+             &FLEET_STYLE, &HEADLESS_VTABLE, &device->hl);
+
+    device->rng = 2463534242ul + (index * 2654435761ul);
+
+    // readings are laid out in a grid filling device's screen
+    bounds.x1 = 0;
+    bounds.y1 = 0;
+    bounds.x2 = FLEET_DISPLAY_WIDTH;
+    bounds.y2 = FLEET_DISPLAY_HEIGHT;
+
+    bam_layout_grid_descs(FLEET_N_COLS, FLEET_N_ROWS, &bounds, 4, 4, descs, FLEET_N_WIDGETS);
+
+    for (int i = 0; i < FLEET_N_WIDGETS; i++) {
+        snprintf(device->values[0][i], sizeof(device->values[0][i]), "%u",
+                 (unsigned int) (device_random(device) % 100));
+
+        descs[i].style = NULL;
+        descs[i].text = device->values[0][i];
+        descs[i].enabled = true;
+        descs[i].metadata = 0;
+        descs[i].callback = NULL;
+        descs[i].user_data = NULL;
+    }
+
+    bam_add_widgets(&device->bam, descs, FLEET_N_WIDGETS);
+}
+
+
+static bool device_update(fleet_device_t* device, bam_tick_t now) {
+    int index;
+    char* value;
+
+    device->hl.now = now;
+
+    if ((device_random(device) % 100) >= FLEET_CHANGE_PERCENT) {
+        return false;
+    }
+
+    // one reading on device's screen changes, written to whichever of reading's two buffers widget isn't showing, so
+    // that it can tell whether reading's text has changed
+    index = (int) (device_random(device) % FLEET_N_WIDGETS);
+    value = device->values[bam_get_widget_text(&device->bam, (bam_widget_handle_t) index) == device->values[0][index]]
+            [index];
+
+    snprintf(value, sizeof(device->values[0][index]), "%u", (unsigned int) (device_random(device) % 100));
+    bam_set_widget_text(&device->bam, (bam_widget_handle_t) index, value);
+
+    return true;
+}
+
+
+// ******** SCHEDULER ********
+
+// each worker has a deque of devices to render - it takes work from back of its own deque, and when that is empty,
+// steals from front of others' deques
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t* items;
+    size_t head;
+    size_t tail;
+} fleet_deque_t;
+
+
+typedef struct fleet_scheduler_t fleet_scheduler_t;
+
+typedef struct {
+    fleet_scheduler_t* scheduler;
+    int index;
+    pthread_t thread;
+    unsigned long n_rendered;
+    unsigned long n_stolen;
+} fleet_worker_t;
+
+
+struct fleet_scheduler_t {
+    fleet_device_t* devices;
+    fleet_deque_t deques[FLEET_MAX_THREADS];
+    fleet_worker_t workers[FLEET_MAX_THREADS];
+    int n_workers;
+    atomic_size_t n_pending;
+    atomic_bool done;
+    pthread_barrier_t start_barrier;
+    pthread_barrier_t end_barrier;
+};
+
+
+static bool deque_pop_back(fleet_deque_t* deque, uint32_t* item) {
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->tail > deque->head) {
+        *item = deque->items[--deque->tail];
+        found = true;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+
+static bool deque_steal_front(fleet_deque_t* deque, uint32_t* item) {
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->tail > deque->head) {
+        *item = deque->items[deque->head++];
+        found = true;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+
+static bool scheduler_take(fleet_scheduler_t* scheduler, fleet_worker_t* worker, uint32_t* item) {
+    if (deque_pop_back(&scheduler->deques[worker->index], item)) {
+        return true;
+    }
+
+    // victims are tried in turn, starting with next worker along so that thieves spread out
+    for (int i = 1; i < scheduler->n_workers; i++) {
+        int victim = (worker->index + i) % scheduler->n_workers;
+
+        if (deque_steal_front(&scheduler->deques[victim], item)) {
+            worker->n_stolen++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void* worker_func(void* arg) {
+    fleet_worker_t* worker = arg;
+    fleet_scheduler_t* scheduler = worker->scheduler;
+    static _Thread_local bam_color_t tile[FLEET_TILE_WIDTH * FLEET_TILE_HEIGHT];
+
+    for (;;) {
+        pthread_barrier_wait(&scheduler->start_barrier);
+
+        if (atomic_load(&scheduler->done)) {
+            break;
+        }
+
+        // devices are rendered until none are left to render or steal
+        while (atomic_load(&scheduler->n_pending) > 0) {
+            uint32_t item;
+            fleet_device_t* device;
+
+            // nothing left to take, but other workers are still rendering, so give up CPU to them rather than spin
+            if (!scheduler_take(scheduler, worker, &item)) {
+                sched_yield();
+                continue;
+            }
+
+            device = &scheduler->devices[item];
+            device->hl.tile = tile;
+            bam_step(&device->bam, NULL);
+            device->hl.tile = NULL;
+
+            worker->n_rendered++;
+            atomic_fetch_sub(&scheduler->n_pending, 1);
+        }
+
+        pthread_barrier_wait(&scheduler->end_barrier);
+    }
+
+    return NULL;
+}
+
+
+static void scheduler_init(fleet_scheduler_t* scheduler, fleet_device_t* devices, uint32_t n_devices, int n_workers) {
+    scheduler->devices = devices;
+    scheduler->n_workers = n_workers;
+    atomic_init(&scheduler->n_pending, 0);
+    atomic_init(&scheduler->done, false);
+
+    pthread_barrier_init(&scheduler->start_barrier, NULL, (unsigned int) n_workers + 1);
+    pthread_barrier_init(&scheduler->end_barrier, NULL, (unsigned int) n_workers + 1);
+
+    for (int i = 0; i < n_workers; i++) {
+        fleet_deque_t* deque = &scheduler->deques[i];
+        fleet_worker_t* worker = &scheduler->workers[i];
+
+        pthread_mutex_init(&deque->lock, NULL);
+        deque->items = calloc(n_devices, sizeof(uint32_t));
+        deque->head = 0;
+        deque->tail = 0;
+
+        worker->scheduler = scheduler;
+        worker->index = i;
+        worker->n_rendered = 0;
+        worker->n_stolen = 0;
+        pthread_create(&worker->thread, NULL, worker_func, worker);
+    }
+}
+
+
+static void scheduler_push(fleet_scheduler_t* scheduler, int worker, uint32_t item) {
+    fleet_deque_t* deque = &scheduler->deques[worker];
+
+    // only called between frames, while workers are waiting at barrier
+    deque->items[deque->tail++] = item;
+    atomic_fetch_add(&scheduler->n_pending, 1);
+}
+
+
+static void scheduler_run_frame(fleet_scheduler_t* scheduler) {
+    pthread_barrier_wait(&scheduler->start_barrier);
+    pthread_barrier_wait(&scheduler->end_barrier);
+
+    for (int i = 0; i < scheduler->n_workers; i++) {
+        scheduler->deques[i].head = 0;
+        scheduler->deques[i].tail = 0;
+    }
+}
+
+
+static void scheduler_destroy(fleet_scheduler_t* scheduler) {
+    atomic_store(&scheduler->done, true);
+    pthread_barrier_wait(&scheduler->start_barrier);
+
+    for (int i = 0; i < scheduler->n_workers; i++) {
+        pthread_join(scheduler->workers[i].thread, NULL);
+        pthread_mutex_destroy(&scheduler->deques[i].lock);
+        free(scheduler->deques[i].items);
+    }
+
+    pthread_barrier_destroy(&scheduler->start_barrier);
+    pthread_barrier_destroy(&scheduler->end_barrier);
+}
+
+
+// ******** FLEET ********
+
+typedef struct {
+    double init_time;
+    double run_time;
+    unsigned long n_rendered;
+    unsigned long n_stolen;
+    uint32_t checksum;
+} fleet_result_t;
+
+
+static double clock_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+
+static bool run_fleet(uint32_t n_devices, int n_threads, int n_frames, fleet_result_t* result) {
+    static fleet_scheduler_t scheduler;
+    fleet_device_t* devices = calloc(n_devices, sizeof(fleet_device_t));
+    bam_color_t tile[FLEET_TILE_WIDTH * FLEET_TILE_HEIGHT];
+    double start;
+
+    if (!devices) {
+        return false;
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    // every device's first frame is rendered up front
+    start = clock_seconds();
+
+    for (uint32_t i = 0; i < n_devices; i++) {
+        device_init(&devices[i], i);
+        devices[i].hl.tile = tile;
+        bam_step(&devices[i].bam, NULL);
+        devices[i].hl.tile = NULL;
+    }
+
+    result->init_time = clock_seconds() - start;
+
+    // each frame, devices whose screens change are dealt out to workers round-robin, and workers balance any
+    // unevenness by stealing
+    scheduler_init(&scheduler, devices, n_devices, n_threads);
+    start = clock_seconds();
+
+    for (int frame = 1; frame <= n_frames; frame++) {
+        bam_tick_t now = (bam_tick_t) (frame * FLEET_FRAME_PERIOD);
+        int next_worker = 0;
+
+        for (uint32_t i = 0; i < n_devices; i++) {
+            if (device_update(&devices[i], now)) {
+                scheduler_push(&scheduler, next_worker, i);
+                next_worker = (next_worker + 1) % n_threads;
+            }
+        }
+
+        scheduler_run_frame(&scheduler);
+    }
+
+    result->run_time = clock_seconds() - start;
+
+    for (int i = 0; i < n_threads; i++) {
+        result->n_rendered += scheduler.workers[i].n_rendered;
+        result->n_stolen += scheduler.workers[i].n_stolen;
+    }
+
+    scheduler_destroy(&scheduler);
+
+    result->checksum = 2166136261ul;
+
+    for (uint32_t i = 0; i < n_devices; i++) {
+        result->checksum = (result->checksum ^ devices[i].hl.checksum) * 16777619ul;
+    }
+
+    free(devices);
+
+    return true;
+}
+
+
+// ******** EXECUTION ENTRY POINT ********
+
+int main(int argc, char* argv[]) {
+    uint32_t n_devices = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 10) : FLEET_DEFAULT_N_DEVICES;
+    int n_threads = (argc > 2) ? atoi(argv[2]) : FLEET_DEFAULT_N_THREADS;
+    int n_frames = (argc > 3) ? atoi(argv[3]) : FLEET_DEFAULT_N_FRAMES;
+    bool verify = (argc > 4) && strcmp(argv[4], "verify") == 0;
+    size_t device_size = sizeof(fleet_device_t);
+    fleet_result_t result;
+
+    if (n_devices < 1 || n_threads < 1 || n_threads > FLEET_MAX_THREADS || n_frames < 0) {
+        fprintf(stderr, "usage: %s [n_devices] [n_threads (1-%i)] [n_frames] [verify]\n", argv[0],
+                FLEET_MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    if (!run_fleet(n_devices, n_threads, n_frames, &result)) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // memory per device is everything a device holds while idle (fonts, styles and tile surfaces are shared)
+    printf("devices:            %u\n", (unsigned int) n_devices);
+    printf("threads:            %i\n", n_threads);
+    printf("frames:             %i\n", n_frames);
+    printf("bytes per device:   %zu (bam_t %zu, dirty buffer %zu, widgets %zu, backend %zu)\n", device_size,
+           sizeof(bam_t), sizeof(uint32_t) * FLEET_DIRTY_BUFFER_SIZE, sizeof(bam_widget_t) * FLEET_N_WIDGETS,
+           sizeof(headless_t));
+    printf("devices per GB:     %.0f\n", 1073741824.0 / (double) device_size);
+    printf("initial renders/s:  %.0f\n", n_devices / result.init_time);
+    printf("renders:            %lu (%lu stolen)\n", result.n_rendered, result.n_stolen);
+    printf("renders/s:          %.0f\n", (result.run_time > 0.0) ? result.n_rendered / result.run_time : 0.0);
+    printf("fleet frames/s:     %.1f\n", (result.run_time > 0.0) ? n_frames / result.run_time : 0.0);
+    printf("checksum:           %08lx\n", (unsigned long) result.checksum);
+
+    if (verify) {
+        fleet_result_t reference;
+
+        if (!run_fleet(n_devices, 1, n_frames, &reference)) {
+            fprintf(stderr, "out of memory\n");
+            return EXIT_FAILURE;
+        }
+
+        if (reference.checksum != result.checksum || reference.n_rendered != result.n_rendered) {
+            fprintf(stderr, "checksum mismatch with single-threaded run (%08lx)\n",
+                    (unsigned long) reference.checksum);
+            return EXIT_FAILURE;
+        }
+
+        printf("verified against single-threaded run\n");
+    }
+
+    return EXIT_SUCCESS;
+}
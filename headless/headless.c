@@ -0,0 +1,395 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <font2c-types.h>
+
+#include "headless.h"
+
+
+// ******** HELPERS ********
+
+static int min_int(int a, int b) {
+    return (a < b) ? a : b;
+}
+
+
+static uint32_t hash_pixels(uint32_t hash, const bam_color_t* pixels, int n_pixels) {
+    // FNV-1a, a word at a time
+    for (int i = 0; i < n_pixels; i++) {
+        hash = (hash ^ pixels[i]) * 16777619ul;
+    }
+
+    return hash;
+}
+
+
+static bam_color_t* tile_row(const headless_t* hl, int x, int y) {
+    return hl->tile + ((size_t) y * (size_t) hl->tile_width) + x;
+}
+
+
+static bam_color_t* display_row(const headless_t* hl, int x, int y) {
+    return hl->buffers[hl->back] + ((size_t) y * (size_t) hl->width) + x;
+}
+
+
+static const font2c_glyph_t* find_glyph(const font2c_font_t* font, bam_unichar_t codepoint) {
+    const font2c_glyph_t* glyph = font2c_find_glyph(font, codepoint);
+
+    // font2c_find_glyph() returns glyph after where codepoint would be if font doesn't have it
+    if (glyph == font->glyphs + font->n_glyphs || glyph->codepoint != codepoint) {
+        return NULL;
+    }
+
+    return glyph;
+}
+
+
+static bam_color_t blend(bam_color_t background, bam_color_t foreground, unsigned int k, unsigned int scale) {
+    bam_color_t color = 0xFF000000ul;
+
+    // colors are 0xAARRGGBB, blended a channel at a time
+    for (int shift = 0; shift < 24; shift += 8) {
+        unsigned int b = (background >> shift) & 0xFFu;
+        unsigned int f = (foreground >> shift) & 0xFFu;
+
+        color |= (bam_color_t) (((b * (scale - k)) + (f * k)) / scale) << shift;
+    }
+
+    return color;
+}
+
+
+// ******** VTABLE ********
+
+static void v_panic(bam_panic_code_t code, void* user_data) {
+    (void) user_data;
+
+    fprintf(stderr, "BaM panic: %i\n", (int) code);
+    abort();
+}
+
+
+static bam_tick_t v_get_monotonic_time(void* user_data) {
+    return ((const headless_t*) user_data)->now;
+}
+
+
+static bool v_get_event(bam_event_t* event, bam_tick_t timeout, void* user_data) {
+    headless_t* hl = user_data;
+
+    // an event of type none stands for nothing happening until timeout
+    if (hl->next_event < hl->n_events) {
+        *event = hl->events[hl->next_event++];
+
+        if (event->type == BAM_EVENT_TYPE_NONE) {
+            hl->now = (bam_tick_t) (hl->now + timeout);
+            return false;
+        }
+
+        return true;
+    }
+
+    event->type = BAM_EVENT_TYPE_QUIT;
+    return true;
+}
+
+
+static void v_get_font_metrics(bam_font_metrics_t* metrics, bam_font_t font, void* user_data) {
+    const font2c_font_t* f2c_font = font;
+
+    (void) user_data;
+
+    metrics->ascent = f2c_font->ascent;
+    metrics->descent = f2c_font->descent;
+    metrics->center = f2c_font->center;
+    metrics->line_height = f2c_font->line_height;
+}
+
+
+static bool v_get_glyph_metrics(bam_glyph_metrics_t* metrics, bam_font_t font, bam_unichar_t codepoint,
+                                void* user_data) {
+    const font2c_font_t* f2c_font = font;
+    const font2c_glyph_t* f2c_glyph = find_glyph(f2c_font, codepoint);
+
+    (void) user_data;
+
+    if (!f2c_glyph) {
+        return false;
+    }
+
+    metrics->codepoint = codepoint;
+    metrics->width = f2c_glyph->width;
+    metrics->height = f2c_glyph->height;
+    metrics->x_bearing = f2c_glyph->x_bearing;
+    metrics->y_bearing = f2c_glyph->y_bearing;
+    metrics->x_advance = f2c_glyph->x_advance;
+    metrics->user_data = (void*) (f2c_font->pixels + f2c_glyph->offset);
+
+    return true;
+}
+
+
+static void v_draw_glyph(const bam_rect_t* dest_rect, const bam_rect_t* src_rect, const bam_glyph_metrics_t* metrics,
+                         const bam_color_pair_t* colors, void* user_data) {
+    const headless_t* hl = user_data;
+    const uint8_t* src_pixels = metrics->user_data;
+    size_t src_pitch = ((size_t) metrics->width + 1) / 2;
+    int width = dest_rect->x2 - dest_rect->x1;
+    bam_color_t lut[16];
+
+    // glyphs are 4-bit coverage, thresholded without anti-aliasing
+    for (unsigned int k = 0; k < 16; k++) {
+        if (hl->anti_aliasing) {
+            lut[k] = blend(colors->background, colors->foreground, k, 15);
+        } else {
+            lut[k] = (k < 8) ? colors->background : colors->foreground;
+        }
+    }
+
+    for (int y = 0; y < dest_rect->y2 - dest_rect->y1; y++) {
+        const uint8_t* src_row = src_pixels + ((size_t) (src_rect->y1 + y) * src_pitch);
+        bam_color_t* dest = tile_row(hl, dest_rect->x1, dest_rect->y1 + y);
+
+        // two pixels per byte, left-most in low nibble
+        for (int x = 0; x < width; x++) {
+            int src_x = src_rect->x1 + x;
+            uint8_t packed = src_row[src_x / 2];
+
+            dest[x] = lut[(src_x & 1) ? (packed >> 4) : (packed & 0x0F)];
+        }
+    }
+}
+
+
+static void v_draw_fill(const bam_rect_t* dest_rect, bam_color_t color, void* user_data) {
+    const headless_t* hl = user_data;
+
+    for (int y = dest_rect->y1; y < dest_rect->y2; y++) {
+        bam_color_t* dest = tile_row(hl, dest_rect->x1, y);
+
+        for (int x = 0; x < dest_rect->x2 - dest_rect->x1; x++) {
+            dest[x] = color;
+        }
+    }
+}
+
+
+static void v_blt_tile(int x, int y, void* user_data) {
+    headless_t* hl = user_data;
+    int width = min_int(hl->tile_width, hl->width - x);
+    int height = min_int(hl->tile_height, hl->height - y);
+
+    hl->n_blts++;
+    hl->n_blt_pixels += (unsigned long) width * (unsigned long) height;
+
+    // only part of tile that is on display is presented
+    for (int row = 0; row < height; row++) {
+        if (hl->n_buffers > 0) {
+            memcpy(display_row(hl, x, y + row), tile_row(hl, 0, row), (size_t) width * sizeof(bam_color_t));
+        } else {
+            hl->checksum = hash_pixels(hl->checksum, tile_row(hl, 0, row), width);
+        }
+    }
+}
+
+
+static void v_draw_coverage(const bam_rect_t* dest_rect, const uint8_t* coverage, bam_color_t color,
+                            void* user_data) {
+    const headless_t* hl = user_data;
+    bam_color_t* dest = tile_row(hl, dest_rect->x1, dest_rect->y1);
+
+    for (int x = 0; x < dest_rect->x2 - dest_rect->x1; x++) {
+        dest[x] = blend(dest[x], color, coverage[x], 255);
+    }
+}
+
+
+static void v_draw_pixels(const bam_rect_t* dest_rect, const bam_color_t* pixels, size_t pitch, void* user_data) {
+    const headless_t* hl = user_data;
+    size_t width = (size_t) (dest_rect->x2 - dest_rect->x1);
+
+    for (int y = dest_rect->y1; y < dest_rect->y2; y++) {
+        memcpy(tile_row(hl, dest_rect->x1, y), pixels, width * sizeof(bam_color_t));
+        pixels += pitch;
+    }
+}
+
+
+static void v_copy_region(const bam_rect_t* src_rect, int dest_x, int dest_y, void* user_data) {
+    headless_t* hl = user_data;
+    size_t width = (size_t) (src_rect->x2 - src_rect->x1);
+    int n_rows = src_rect->y2 - src_rect->y1;
+
+    // a display that is only checksummed records that region was copied
+    if (hl->n_buffers == 0) {
+        bam_color_t record[6] = {0xC0C0C0C0ul, (bam_color_t) src_rect->x1, (bam_color_t) src_rect->y1,
+                                 (bam_color_t) n_rows, (bam_color_t) dest_x, (bam_color_t) dest_y};
+
+        hl->checksum = hash_pixels(hl->checksum, record, 6);
+        return;
+    }
+
+    // rows are copied in an order that doesn't overwrite source rows before they have been copied
+    for (int i = 0; i < n_rows; i++) {
+        int row = (dest_y > src_rect->y1) ? (n_rows - 1 - i) : i;
+
+        memmove(display_row(hl, dest_x, dest_y + row), display_row(hl, src_rect->x1, src_rect->y1 + row),
+                width * sizeof(bam_color_t));
+    }
+}
+
+
+static void v_blt_region(const bam_rect_t* rect, void* user_data) {
+    headless_t* hl = user_data;
+    int width = rect->x2 - rect->x1;
+
+    hl->n_blts++;
+    hl->n_blt_pixels += (unsigned long) width * (unsigned long) (rect->y2 - rect->y1);
+
+    for (int row = 0; row < rect->y2 - rect->y1; row++) {
+        if (hl->n_buffers > 0) {
+            memcpy(display_row(hl, rect->x1, rect->y1 + row), tile_row(hl, 0, row),
+                   (size_t) width * sizeof(bam_color_t));
+        } else {
+            hl->checksum = hash_pixels(hl->checksum, tile_row(hl, 0, row), width);
+        }
+    }
+}
+
+
+static void v_read_tile(const bam_rect_t* rect, bam_color_t* pixels, size_t pitch, void* user_data) {
+    const headless_t* hl = user_data;
+    size_t width = (size_t) (rect->x2 - rect->x1);
+
+    for (int y = rect->y1; y < rect->y2; y++) {
+        memcpy(pixels, tile_row(hl, rect->x1, y), width * sizeof(bam_color_t));
+        pixels += pitch;
+    }
+}
+
+
+static int v_get_buffer_age(void* user_data) {
+    const headless_t* hl = user_data;
+
+    return hl->ages[hl->back];
+}
+
+
+static void v_flip(void* user_data) {
+    headless_t* hl = user_data;
+
+    hl->n_flips++;
+
+    // every buffer whose contents are known gets a frame older, and the one just rendered becomes the newest
+    for (int i = 0; i < hl->n_buffers; i++) {
+        if (hl->ages[i] > 0) {
+            hl->ages[i]++;
+        }
+    }
+
+    hl->ages[hl->back] = 1;
+    hl->front = hl->back;
+    hl->back = (hl->back + 1) % hl->n_buffers;
+}
+
+
+static void v_set_anti_aliasing(bool enabled, void* user_data) {
+    ((headless_t*) user_data)->anti_aliasing = enabled;
+}
+
+
+const bam_vtable_t HEADLESS_VTABLE = {
+        .panic = v_panic,
+        .get_monotonic_time = v_get_monotonic_time,
+        .get_event = v_get_event,
+        .get_font_metrics = v_get_font_metrics,
+        .get_glyph_metrics = v_get_glyph_metrics,
+        .draw_glyph = v_draw_glyph,
+        .draw_fill = v_draw_fill,
+        .blt_tile = v_blt_tile,
+        .draw_coverage = v_draw_coverage,
+        .draw_pixels = v_draw_pixels,
+        .copy_region = v_copy_region,
+        .blt_region = v_blt_region,
+        .read_tile = v_read_tile,
+        .get_buffer_age = v_get_buffer_age,
+        .flip = v_flip,
+        .set_anti_aliasing = v_set_anti_aliasing
+};
+
+
+// ******** HEADLESS API ********
+
+void headless_init(headless_t* hl, int width, int height, int tile_width, int tile_height, bam_color_t* tile,
+                   bam_color_t* display) {
+    memset(hl, 0, sizeof(*hl));
+
+    hl->width = width;
+    hl->height = height;
+    hl->tile_width = tile_width;
+    hl->tile_height = tile_height;
+    hl->tile = tile;
+    hl->checksum = 2166136261ul;
+    hl->anti_aliasing = true;
+
+    // a single display buffer is always the front buffer
+    if (display) {
+        hl->buffers[0] = display;
+        hl->ages[0] = 1;
+        hl->n_buffers = 1;
+    }
+}
+
+
+void headless_init_page_flip(headless_t* hl, bam_color_t* const* buffers, int n_buffers) {
+    assert(n_buffers >= 2 && n_buffers <= HEADLESS_MAX_BUFFERS);
+
+    // contents of buffers are unknown until they have been rendered to
+    for (int i = 0; i < n_buffers; i++) {
+        hl->buffers[i] = buffers[i];
+        hl->ages[i] = 0;
+    }
+
+    hl->n_buffers = n_buffers;
+    hl->back = 0;
+    hl->front = n_buffers - 1;
+}
+
+
+void headless_set_events(headless_t* hl, const bam_event_t* events, size_t n_events) {
+    hl->events = events;
+    hl->n_events = n_events;
+    hl->next_event = 0;
+}
+
+
+const bam_color_t* headless_get_display(const headless_t* hl) {
+    return (hl->n_buffers > 0) ? hl->buffers[hl->front] : NULL;
+}
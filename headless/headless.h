@@ -0,0 +1,92 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BAM_HEADLESS_H
+#define BAM_HEADLESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bam.h>
+
+
+// ******** HEADLESS CONSTANTS ********
+
+#define HEADLESS_MAX_BUFFERS            3
+
+
+// ******** HEADLESS TYPES ********
+
+// headless display, rendered to in memory rather than to a screen - fonts are font2c fonts, which are read-only so
+// can be shared by any number of displays
+typedef struct {
+    int width;
+    int height;
+    int tile_width;
+    int tile_height;
+
+    // tile surface, which a display only needs while it is being rendered, so may be handed between displays
+    bam_color_t* tile;
+
+    // display buffers (none if display is only checksummed, more than one if page flipping)
+    bam_color_t* buffers[HEADLESS_MAX_BUFFERS];
+    int ages[HEADLESS_MAX_BUFFERS];
+    int n_buffers;
+    int back;
+    int front;
+
+    // hash of every pixel presented, in the order it was presented
+    uint32_t checksum;
+
+    // clock only moves when get_event() is asked to wait, or when moved by hand
+    bam_tick_t now;
+
+    // events returned by get_event(), after which it returns a quit event
+    const bam_event_t* events;
+    size_t n_events;
+    size_t next_event;
+
+    bool anti_aliasing;
+
+    unsigned long n_blts;
+    unsigned long n_blt_pixels;
+    unsigned long n_flips;
+} headless_t;
+
+
+// ******** HEADLESS API ********
+
+extern const bam_vtable_t HEADLESS_VTABLE;
+
+void headless_init(headless_t* hl, int width, int height, int tile_width, int tile_height, bam_color_t* tile,
+                   bam_color_t* display);
+
+void headless_init_page_flip(headless_t* hl, bam_color_t* const* buffers, int n_buffers);
+
+void headless_set_events(headless_t* hl, const bam_event_t* events, size_t n_events);
+
+const bam_color_t* headless_get_display(const headless_t* hl);
+
+#endif // BAM_HEADLESS_H
@@ -0,0 +1,198 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/*
+ * Chart test - appends samples to charts whose ring buffers are narrower and wider than their plots, with a fixed
+ * range and autoscaled, on a display that can scroll plots and on one that can't, and checks after every frame that
+ * display shows exactly what chart's columns describe, however little of it was redrawn.
+ */
+
+#include <bam.h>
+#include <font2c-types.h>
+
+#include "headless.h"
+#include "test.h"
+
+
+#define TEST_DISPLAY_WIDTH          200
+#define TEST_DISPLAY_HEIGHT         140
+#define TEST_TILE_WIDTH             32
+#define TEST_TILE_HEIGHT            32
+#define TEST_N_PIXELS               (TEST_DISPLAY_WIDTH * TEST_DISPLAY_HEIGHT)
+
+#define TEST_DIRTY_BUFFER_SIZE      BAM_DIRTY_BUFFER_SIZE(TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, \
+                                        TEST_TILE_WIDTH, TEST_TILE_HEIGHT)
+
+#define TEST_N_WIDGETS              1
+#define TEST_PLOT_X                 10
+#define TEST_PLOT_Y                 20
+#define TEST_PLOT_WIDTH             181
+#define TEST_PLOT_HEIGHT            100
+#define TEST_COLUMN_WIDTH           3
+#define TEST_MAX_SAMPLES            100
+#define TEST_N_APPENDS              250
+#define TEST_CHART_COLOR            0xFF00FF00ul
+
+
+// defined in font-deja-vu-sans-48.c
+extern const font2c_font_t font_deja_vu_sans_48;
+
+static const bam_style_t TEST_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_CENTER,
+        .v_align = BAM_V_ALIGN_MIDDLE,
+        .colors = {
+                {0xFF808080ul, 0xFF202020ul},
+                {0xFFFFFFFFul, 0xFF303030ul},
+                {0xFFFFFFFFul, 0xFFA00000ul}
+        }
+};
+
+
+static bam_t m_bam;
+static headless_t m_hl;
+static bam_vtable_t m_vtable;
+static uint32_t m_dirty_buffer[TEST_DIRTY_BUFFER_SIZE];
+static bam_widget_t m_widget_buffer[TEST_N_WIDGETS];
+static bam_color_t m_tile[TEST_TILE_WIDTH * TEST_TILE_HEIGHT];
+static bam_color_t m_display[TEST_N_PIXELS];
+static int16_t m_samples[TEST_MAX_SAMPLES];
+static bam_chart_column_t m_columns[TEST_MAX_SAMPLES];
+static bam_chart_t m_chart;
+static uint32_t m_seed;
+
+
+static int16_t next_sample(int i, bool flat) {
+    if (flat) {
+        return 7;
+    }
+
+    // mostly a noisy ramp, with occasional spikes that become range's extremes until they are discarded
+    m_seed = (m_seed * 1103515245ul) + 12345ul;
+
+    if ((i % 37) == 0) {
+        return (int16_t) (((i / 37) % 2) ? 900 : -900);
+    }
+
+    return (int16_t) ((i % 50) * 4 + (int) ((m_seed >> 16) % 40u) - 100);
+}
+
+
+static bool check_display(void) {
+    const int plot_x2 = TEST_PLOT_X + TEST_PLOT_WIDTH;
+
+    // expected pixels are worked out from chart's columns, newest of which is at right edge of plot
+    for (int y = 0; y < TEST_DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < TEST_DISPLAY_WIDTH; x++) {
+            bam_color_t expected = 0xFF000000ul;
+
+            if (x >= TEST_PLOT_X && x < plot_x2 && y >= TEST_PLOT_Y && y < TEST_PLOT_Y + TEST_PLOT_HEIGHT) {
+                size_t column = (size_t) ((plot_x2 - 1 - x) / TEST_COLUMN_WIDTH);
+
+                expected = TEST_STYLE.colors[BAM_STATE_ENABLED].background;
+
+                if (column < m_chart.count) {
+                    const bam_chart_column_t* c = &m_columns[(m_chart.head + m_chart.count - 1 - column) %
+                                                             m_chart.capacity];
+
+                    if (y - TEST_PLOT_Y >= c->y1 && y - TEST_PLOT_Y < c->y2) {
+                        expected = TEST_CHART_COLOR;
+                    }
+                }
+            }
+
+            if (m_display[(y * TEST_DISPLAY_WIDTH) + x] != expected) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static void run_chart(bool scroll, size_t n_samples, bool autoscale, bool flat) {
+    bam_widget_handle_t widget;
+    bool all_exact = true;
+    unsigned long n_flat_pixels = 0;
+
+    m_vtable = HEADLESS_VTABLE;
+
+    if (!scroll) {
+        m_vtable.copy_region = NULL;
+    }
+
+    m_seed = 1;
+    headless_init(&m_hl, TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, m_tile,
+                  m_display);
+
+    bam_init(&m_bam, m_dirty_buffer, TEST_DIRTY_BUFFER_SIZE, m_widget_buffer, TEST_N_WIDGETS, TEST_DISPLAY_WIDTH,
+             TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, 0xFF000000ul, &TEST_STYLE, &m_vtable, &m_hl);
+
+    bam_init_chart(&m_chart, m_samples, m_columns, n_samples, TEST_COLUMN_WIDTH, TEST_CHART_COLOR);
+    widget = bam_add_widget(&m_bam, TEST_PLOT_X, TEST_PLOT_Y, TEST_PLOT_WIDTH, TEST_PLOT_HEIGHT, NULL, NULL, true);
+    bam_set_widget_chart(&m_bam, widget, &m_chart);
+
+    if (!autoscale) {
+        bam_set_chart_range(&m_bam, widget, -200, 200);
+    }
+
+    bam_step(&m_bam, NULL);
+
+    for (int i = 0; i < TEST_N_APPENDS; i++) {
+        unsigned long n_blt_pixels = m_hl.n_blt_pixels;
+
+        bam_append_chart_sample(&m_bam, widget, next_sample(i, flat));
+        bam_step(&m_bam, NULL);
+
+        if (!check_display()) {
+            all_exact = false;
+        }
+
+        // once ring buffer is full, a flat signal shifts onto identical columns
+        if ((size_t) i >= n_samples) {
+            n_flat_pixels += m_hl.n_blt_pixels - n_blt_pixels;
+        }
+    }
+
+    TEST_CHECK(all_exact);
+
+    if (flat && !scroll) {
+        TEST_CHECK(n_flat_pixels == 0);
+    }
+}
+
+
+int main(void) {
+    for (int scroll = 0; scroll < 2; scroll++) {
+        for (int autoscale = 0; autoscale < 2; autoscale++) {
+            for (int flat = 0; flat < 2; flat++) {
+                // ring buffer narrower than plot, so that discarded columns are erased, then wider than it
+                run_chart(scroll, 40, autoscale, flat);
+                run_chart(scroll, TEST_MAX_SAMPLES, autoscale, flat);
+            }
+        }
+    }
+
+    return TEST_EXIT_CODE();
+}
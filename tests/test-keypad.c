@@ -0,0 +1,169 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Keypad test - presses and releases keys of a keypad with a gap in its layout, and checks which releases trigger
+ * its callback, in particular that a key disabled while it is pressed never triggers, wherever it is released.
+ */
+
+#include <bam.h>
+#include <font2c-types.h>
+
+#include "headless.h"
+#include "test.h"
+
+
+#define TEST_DISPLAY_WIDTH          200
+#define TEST_DISPLAY_HEIGHT         200
+#define TEST_TILE_WIDTH             32
+#define TEST_TILE_HEIGHT            32
+
+#define TEST_DIRTY_BUFFER_SIZE      BAM_DIRTY_BUFFER_SIZE(TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, \
+                                        TEST_TILE_WIDTH, TEST_TILE_HEIGHT)
+
+#define TEST_N_WIDGETS              1
+#define TEST_NO_TRIGGER             -1
+
+
+// defined in font-deja-vu-sans-48.c
+extern const font2c_font_t font_deja_vu_sans_48;
+
+static const bam_style_t TEST_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_CENTER,
+        .v_align = BAM_V_ALIGN_MIDDLE,
+        .colors = {
+                {0xFF808080ul, 0xFF202020ul},
+                {0xFFFFFFFFul, 0xFF303030ul},
+                {0xFFFFFFFFul, 0xFFA00000ul}
+        }
+};
+
+// three keys in a 2x2 grid, leaving bottom-right cell empty
+static const bam_keypad_key_t TEST_KEYS[] = {
+        {0, 0, 1, 1, 0, 'a', "a", "A"},
+        {1, 0, 1, 1, 0, 'b', "b", "B"},
+        {0, 1, 1, 1, 0, 'c', "c", "C"}
+};
+
+static const bam_keypad_layout_t TEST_LAYOUT = {2, 2, 3, TEST_KEYS};
+
+static const bam_style_t* const TEST_STYLES[] = {&TEST_STYLE};
+
+
+static bam_t m_bam;
+static headless_t m_hl;
+static uint32_t m_dirty_buffer[TEST_DIRTY_BUFFER_SIZE];
+static bam_widget_t m_widget_buffer[TEST_N_WIDGETS];
+static bam_color_t m_tile[TEST_TILE_WIDTH * TEST_TILE_HEIGHT];
+static bam_keypad_t m_keypad;
+static bam_widget_handle_t m_widget;
+static int m_triggered_key;
+static int m_triggered_code;
+
+
+static void keypad_callback(bam_t* bam, bam_widget_handle_t widget, size_t key, void* user_data) {
+    (void) user_data;
+
+    // key must be one of keypad's, or looking up its code would assert
+    TEST_CHECK(key < TEST_LAYOUT.n_keys);
+
+    if (key < TEST_LAYOUT.n_keys) {
+        m_triggered_key = (int) key;
+        m_triggered_code = bam_get_keypad_key_code(bam, widget, key);
+    }
+}
+
+
+static void send(bam_event_type_t type, int x, int y) {
+    bam_event_t event = {type, x, y};
+
+    bam_step(&m_bam, &event);
+}
+
+
+static int press_and_release(int press_x, int press_y, int move_x, int move_y, int release_x, int release_y,
+                             bool disable_pressed) {
+    m_triggered_key = TEST_NO_TRIGGER;
+    m_triggered_code = 0;
+
+    send(BAM_EVENT_TYPE_PRESS, press_x, press_y);
+
+    // disabling key (whichever was pressed, found by position) while it is held
+    if (disable_pressed) {
+        bam_set_keypad_key_enabled(&m_bam, m_widget, (press_x < 100) ? ((press_y < 100) ? 0 : 2) : 1, false);
+        bam_step(&m_bam, NULL);
+    }
+
+    send(BAM_EVENT_TYPE_MOVE, move_x, move_y);
+    send(BAM_EVENT_TYPE_RELEASE, release_x, release_y);
+
+    for (size_t key = 0; key < TEST_LAYOUT.n_keys; key++) {
+        bam_set_keypad_key_enabled(&m_bam, m_widget, key, true);
+    }
+
+    bam_step(&m_bam, NULL);
+
+    return m_triggered_key;
+}
+
+
+int main(void) {
+    headless_init(&m_hl, TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, m_tile, NULL);
+
+    bam_init(&m_bam, m_dirty_buffer, TEST_DIRTY_BUFFER_SIZE, m_widget_buffer, TEST_N_WIDGETS, TEST_DISPLAY_WIDTH,
+             TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, 0xFF000000ul, &TEST_STYLE, &HEADLESS_VTABLE,
+             &m_hl);
+
+    bam_init_keypad(&m_keypad, &TEST_LAYOUT, TEST_STYLES, 1, NULL, 10);
+    m_widget = bam_add_widget(&m_bam, 0, 0, TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, NULL, NULL, true);
+    bam_set_widget_keypad(&m_bam, m_widget, &m_keypad, keypad_callback, NULL);
+    bam_step(&m_bam, NULL);
+
+    // release over pressed key triggers it, release over another key, the empty cell or spacing between keys
+    // doesn't
+    TEST_CHECK(press_and_release(50, 50, 50, 50, 50, 50, false) == 0 && m_triggered_code == 'a');
+    TEST_CHECK(press_and_release(150, 50, 150, 50, 150, 50, false) == 1 && m_triggered_code == 'b');
+    TEST_CHECK(press_and_release(50, 50, 50, 50, 150, 50, false) == TEST_NO_TRIGGER);
+    TEST_CHECK(press_and_release(50, 50, 50, 50, 150, 150, false) == TEST_NO_TRIGGER);
+    TEST_CHECK(press_and_release(50, 50, 50, 50, 100, 50, false) == TEST_NO_TRIGGER);
+
+    // key disabled while pressed doesn't trigger, whether released over empty cell, spacing, or key itself
+    TEST_CHECK(press_and_release(50, 50, 50, 50, 150, 150, true) == TEST_NO_TRIGGER);
+    TEST_CHECK(press_and_release(50, 50, 150, 150, 150, 150, true) == TEST_NO_TRIGGER);
+    TEST_CHECK(press_and_release(50, 50, 100, 50, 100, 50, true) == TEST_NO_TRIGGER);
+    TEST_CHECK(press_and_release(50, 150, 50, 150, 50, 150, true) == TEST_NO_TRIGGER);
+
+    // pressing disabled key does nothing, but keys work again once re-enabled
+    bam_set_keypad_key_enabled(&m_bam, m_widget, 0, false);
+    m_triggered_key = TEST_NO_TRIGGER;
+    send(BAM_EVENT_TYPE_PRESS, 50, 50);
+    send(BAM_EVENT_TYPE_RELEASE, 50, 50);
+    TEST_CHECK(m_triggered_key == TEST_NO_TRIGGER);
+    bam_set_keypad_key_enabled(&m_bam, m_widget, 0, true);
+    TEST_CHECK(press_and_release(50, 50, 50, 50, 50, 50, false) == 0);
+
+    return TEST_EXIT_CODE();
+}
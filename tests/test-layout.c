@@ -0,0 +1,223 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/*
+ * Layout tree test - builds a nested flex layout, then changes one node at a time and checks that widgets are
+ * arranged where they should be, and that subtrees the change can't affect aren't arranged again at all (which is
+ * detected by moving one of their widgets behind layout's back, and checking that it is left where it was put).
+ */
+
+#include <bam.h>
+#include <font2c-types.h>
+
+#include "headless.h"
+#include "test.h"
+
+
+#define TEST_DISPLAY_WIDTH          240
+#define TEST_DISPLAY_HEIGHT         160
+#define TEST_TILE_WIDTH             32
+#define TEST_TILE_HEIGHT            32
+
+#define TEST_DIRTY_BUFFER_SIZE      BAM_DIRTY_BUFFER_SIZE(TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, \
+                                        TEST_TILE_WIDTH, TEST_TILE_HEIGHT)
+
+#define TEST_N_WIDGETS              6
+#define TEST_N_NODES                12
+
+
+// defined in font-deja-vu-sans-48.c
+extern const font2c_font_t font_deja_vu_sans_48;
+
+static const bam_style_t TEST_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_CENTER,
+        .v_align = BAM_V_ALIGN_MIDDLE,
+        .colors = {
+                {0xFF808080ul, 0xFF202020ul},
+                {0xFFFFFFFFul, 0xFF303030ul},
+                {0xFFFFFFFFul, 0xFFA00000ul}
+        }
+};
+
+// widgets, in order they are added
+enum {
+    TEST_WIDGET_A,
+    TEST_WIDGET_B,
+    TEST_WIDGET_C,
+    TEST_WIDGET_D,
+    TEST_WIDGET_E,
+    TEST_WIDGET_F
+};
+
+
+static bam_t m_bam;
+static headless_t m_hl;
+static uint32_t m_dirty_buffer[TEST_DIRTY_BUFFER_SIZE];
+static bam_widget_t m_widget_buffer[TEST_N_WIDGETS];
+static bam_color_t m_tile[TEST_TILE_WIDTH * TEST_TILE_HEIGHT];
+static bam_layout_node_t m_nodes[TEST_N_NODES];
+static bam_layout_t m_layout;
+static bam_rect_t m_bounds;
+
+
+static bool widget_at(bam_widget_handle_t widget, int x1, int y1, int x2, int y2) {
+    const bam_rect_t* rect = bam_get_widget_bounds(&m_bam, widget);
+
+    return rect->x1 == x1 && rect->y1 == y1 && rect->x2 == x2 && rect->y2 == y2;
+}
+
+
+static bool widget_unchanged(bam_widget_handle_t widget, const bam_rect_t* before) {
+    const bam_rect_t* rect = bam_get_widget_bounds(&m_bam, widget);
+
+    return rect->x1 == before->x1 && rect->y1 == before->y1 && rect->x2 == before->x2 && rect->y2 == before->y2;
+}
+
+
+static void move_behind_layouts_back(bam_widget_handle_t widget) {
+    bam_rect_t rect = {1, 1, 2, 2};
+
+    bam_set_widget_bounds(&m_bam, widget, &rect);
+}
+
+
+int main(void) {
+    bam_layout_handle_t root;
+    bam_layout_handle_t top;
+    bam_layout_handle_t bottom;
+    bam_layout_handle_t column;
+    bam_layout_handle_t node_a;
+    bam_layout_handle_t node_d;
+    bam_layout_handle_t node_f;
+    bam_rect_t before_a;
+    bam_rect_t before_c;
+    int width_f;
+
+    headless_init(&m_hl, TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, m_tile, NULL);
+
+    bam_init(&m_bam, m_dirty_buffer, TEST_DIRTY_BUFFER_SIZE, m_widget_buffer, TEST_N_WIDGETS, TEST_DISPLAY_WIDTH,
+             TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, 0xFF000000ul, &TEST_STYLE, &HEADLESS_VTABLE,
+             &m_hl);
+
+    for (int i = 0; i < TEST_N_WIDGETS; i++) {
+        bam_add_widget(&m_bam, 0, 0, 1, 1, NULL, (i == TEST_WIDGET_F) ? "i" : "", true);
+    }
+
+    // column of a 40 pixel high row of two equal widgets, above a row of a fixed 60 pixel wide widget, a column of
+    // two equal widgets and a widget sized to fit its text
+    bam_init_layout(&m_layout, m_nodes, TEST_N_NODES);
+    root = bam_layout_add_container(&m_bam, &m_layout, BAM_LAYOUT_NONE, BAM_LAYOUT_NODE_TYPE_COLUMN, 1, 4, 4);
+    top = bam_layout_add_container(&m_bam, &m_layout, root, BAM_LAYOUT_NODE_TYPE_ROW, 0, 0, 8);
+    bam_layout_set_weight(&m_layout, top, 0, 40);
+    node_a = bam_layout_add_widget(&m_bam, &m_layout, top, TEST_WIDGET_A, 1, 0);
+    bam_layout_add_widget(&m_bam, &m_layout, top, TEST_WIDGET_B, 1, 0);
+    bottom = bam_layout_add_container(&m_bam, &m_layout, root, BAM_LAYOUT_NODE_TYPE_ROW, 1, 0, 8);
+    bam_layout_add_widget(&m_bam, &m_layout, bottom, TEST_WIDGET_C, 0, 60);
+    column = bam_layout_add_container(&m_bam, &m_layout, bottom, BAM_LAYOUT_NODE_TYPE_COLUMN, 1, 0, 0);
+    node_d = bam_layout_add_widget(&m_bam, &m_layout, column, TEST_WIDGET_D, 1, 0);
+    bam_layout_add_widget(&m_bam, &m_layout, column, TEST_WIDGET_E, 1, 0);
+    node_f = bam_layout_add_widget(&m_bam, &m_layout, bottom, TEST_WIDGET_F, 0, 0);
+
+    m_bounds.x1 = 0;
+    m_bounds.y1 = 0;
+    m_bounds.x2 = TEST_DISPLAY_WIDTH;
+    m_bounds.y2 = TEST_DISPLAY_HEIGHT;
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+
+    width_f = bam_get_widget_bounds(&m_bam, TEST_WIDGET_F)->x2 - bam_get_widget_bounds(&m_bam, TEST_WIDGET_F)->x1;
+
+    TEST_CHECK(widget_at(TEST_WIDGET_A, 4, 4, 116, 44));
+    TEST_CHECK(widget_at(TEST_WIDGET_B, 124, 4, 236, 44));
+    TEST_CHECK(widget_at(TEST_WIDGET_C, 4, 48, 64, 156));
+    TEST_CHECK(width_f > 0 && widget_at(TEST_WIDGET_F, 236 - width_f, 48, 236, 156));
+    TEST_CHECK(widget_at(TEST_WIDGET_D, 72, 48, 228 - width_f, 102));
+    TEST_CHECK(widget_at(TEST_WIDGET_E, 72, 102, 228 - width_f, 156));
+
+    // updating a clean layout with same bounds arranges nothing
+    move_behind_layouts_back(TEST_WIDGET_A);
+    move_behind_layouts_back(TEST_WIDGET_D);
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_at(TEST_WIDGET_A, 1, 1, 2, 2));
+    TEST_CHECK(widget_at(TEST_WIDGET_D, 1, 1, 2, 2));
+
+    // invalidating a node arranges it again, but not other subtrees, nor its container's children whose bounds
+    // stay the same
+    bam_layout_invalidate(&m_layout, node_d);
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_at(TEST_WIDGET_A, 1, 1, 2, 2));
+    TEST_CHECK(widget_at(TEST_WIDGET_D, 72, 48, 228 - width_f, 102));
+    bam_layout_invalidate(&m_layout, top);
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_at(TEST_WIDGET_A, 1, 1, 2, 2));
+    bam_layout_invalidate(&m_layout, node_a);
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_at(TEST_WIDGET_A, 4, 4, 116, 44));
+
+    // reweighting a widget in nested column only moves it and its sibling, and top row isn't arranged again
+    before_a = *bam_get_widget_bounds(&m_bam, TEST_WIDGET_A);
+    before_c = *bam_get_widget_bounds(&m_bam, TEST_WIDGET_C);
+    move_behind_layouts_back(TEST_WIDGET_B);
+    bam_layout_set_weight(&m_layout, node_d, 2, 0);
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_unchanged(TEST_WIDGET_A, &before_a));
+    TEST_CHECK(widget_at(TEST_WIDGET_B, 1, 1, 2, 2));
+    TEST_CHECK(widget_unchanged(TEST_WIDGET_C, &before_c));
+    TEST_CHECK(widget_at(TEST_WIDGET_D, 72, 48, 228 - width_f, 120));
+    TEST_CHECK(widget_at(TEST_WIDGET_E, 72, 120, 228 - width_f, 156));
+
+    // hiding a widget gives its space to its siblings, and showing it again takes it back
+    bam_layout_set_hidden(&m_layout, node_d, true);
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_at(TEST_WIDGET_E, 72, 48, 228 - width_f, 156));
+    TEST_CHECK(widget_at(TEST_WIDGET_B, 1, 1, 2, 2));
+    bam_layout_set_hidden(&m_layout, node_d, false);
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_at(TEST_WIDGET_D, 72, 48, 228 - width_f, 120));
+    TEST_CHECK(widget_at(TEST_WIDGET_E, 72, 120, 228 - width_f, 156));
+
+    // widget sized to fit its text grows once it is invalidated after its text changes, squeezing flexible column
+    bam_set_widget_text(&m_bam, TEST_WIDGET_F, "iii");
+    bam_layout_invalidate(&m_layout, node_f);
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(bam_get_widget_bounds(&m_bam, TEST_WIDGET_F)->x1 < 236 - width_f);
+    TEST_CHECK(bam_get_widget_bounds(&m_bam, TEST_WIDGET_D)->x2 ==
+               bam_get_widget_bounds(&m_bam, TEST_WIDGET_F)->x1 - 8);
+    TEST_CHECK(widget_unchanged(TEST_WIDGET_C, &before_c));
+    TEST_CHECK(widget_at(TEST_WIDGET_B, 1, 1, 2, 2));
+
+    // shorter bounds only change bottom row's height, so top row still isn't arranged again
+    m_bounds.y2 = TEST_DISPLAY_HEIGHT - 20;
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_at(TEST_WIDGET_B, 1, 1, 2, 2));
+    TEST_CHECK(widget_at(TEST_WIDGET_C, 4, 48, 64, 136));
+    TEST_CHECK(widget_at(TEST_WIDGET_E, 72, 106, bam_get_widget_bounds(&m_bam, TEST_WIDGET_D)->x2, 136));
+
+    // narrower bounds change every container's width, so everything is arranged again
+    m_bounds.x2 = TEST_DISPLAY_WIDTH - 40;
+    bam_layout_update(&m_bam, &m_layout, &m_bounds);
+    TEST_CHECK(widget_at(TEST_WIDGET_A, 4, 4, 96, 44));
+    TEST_CHECK(widget_at(TEST_WIDGET_B, 104, 4, 196, 44));
+
+    return TEST_EXIT_CODE();
+}
@@ -0,0 +1,246 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Number formatting test - checks bam_format_int(), bam_format_real(), bam_parse_int() and bam_parse_real() against
+ * expected strings, at limits of long, when saturating, and at every precision, and checks that numbers formatted and
+ * parsed back again round-trip. Built once with floating-point reals and once with fixed-point ones.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <bam.h>
+
+#include "test.h"
+
+
+#define TEST_MAX_PRECISION          9
+#define TEST_BUFFER_SIZE            64
+#define TEST_N_RANDOM               100000
+
+#ifdef BAM_REAL_FIXED_BITS
+#define TEST_REAL(x)                ((bam_real_t) ((x) * (1 << BAM_REAL_FIXED_BITS)))
+#define TEST_REAL_MAX               ((bam_real_t) ((((uint64_t) 1) << ((8 * sizeof(bam_real_t)) - 1)) - 1))
+#else
+#define TEST_REAL(x)                ((bam_real_t) (x))
+#endif // BAM_REAL_FIXED_BITS
+
+
+static uint32_t m_rng = 2463534242ul;
+
+
+static uint32_t test_random(void) {
+    // xorshift32, so that every run checks same numbers
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 17;
+    m_rng ^= m_rng << 5;
+
+    return m_rng;
+}
+
+
+static void check_format_int(long value, const char* expected) {
+    char buffer[TEST_BUFFER_SIZE];
+    size_t length = bam_format_int(buffer, sizeof(buffer), value);
+    long parsed;
+
+    TEST_CHECK(strcmp(buffer, expected) == 0);
+    TEST_CHECK(length == strlen(expected));
+    TEST_CHECK(bam_parse_int(buffer, &parsed) && parsed == value);
+}
+
+
+static void check_parse_int(const char* str, bool expected_valid, long expected) {
+    long value = 12345;
+    bool valid = bam_parse_int(str, &value);
+
+    TEST_CHECK(valid == expected_valid);
+
+    if (expected_valid) {
+        TEST_CHECK(value == expected);
+    }
+}
+
+
+static void check_format_real(bam_real_t value, int precision, const char* expected) {
+    char buffer[TEST_BUFFER_SIZE];
+    size_t length = bam_format_real(buffer, sizeof(buffer), value, precision);
+
+    TEST_CHECK(strcmp(buffer, expected) == 0);
+    TEST_CHECK(length == strlen(expected));
+}
+
+
+static void check_parse_real(const char* str, bool expected_valid, bam_real_t expected) {
+    bam_real_t value = TEST_REAL(12345);
+    bool valid = bam_parse_real(str, &value);
+
+    TEST_CHECK(valid == expected_valid);
+
+    if (expected_valid) {
+        TEST_CHECK(value == expected);
+    }
+}
+
+
+static void test_int(void) {
+    char buffer[TEST_BUFFER_SIZE];
+    char expected[TEST_BUFFER_SIZE];
+    long value;
+
+    check_format_int(0, "0");
+    check_format_int(7, "7");
+    check_format_int(-7, "-7");
+    check_format_int(1000000, "1000000");
+
+    // limits of long, whatever its width
+    snprintf(expected, sizeof(expected), "%ld", LONG_MAX);
+    check_format_int(LONG_MAX, expected);
+    snprintf(expected, sizeof(expected), "%ld", LONG_MIN);
+    check_format_int(LONG_MIN, expected);
+
+    // one beyond limits of long, and far beyond them, saturate
+    snprintf(buffer, sizeof(buffer), "%lu", ((unsigned long) LONG_MAX) + 1);
+    check_parse_int(buffer, true, LONG_MAX);
+    snprintf(buffer, sizeof(buffer), "-%lu", ((unsigned long) LONG_MAX) + 2);
+    check_parse_int(buffer, true, LONG_MIN);
+    check_parse_int("123456789012345678901234567890", true, LONG_MAX);
+    check_parse_int("-123456789012345678901234567890", true, LONG_MIN);
+
+    check_parse_int("+42", true, 42);
+    check_parse_int("-0", true, 0);
+    check_parse_int("007", true, 7);
+    check_parse_int("", false, 0);
+    check_parse_int("-", false, 0);
+    check_parse_int("12a", false, 0);
+    check_parse_int("1.5", false, 0);
+    check_parse_int(" 1", false, 0);
+
+    // output is truncated to fit buffer, as snprintf() would, but untruncated length is returned
+    TEST_CHECK(bam_format_int(buffer, 4, -12345) == 6 && strcmp(buffer, "-12") == 0);
+    TEST_CHECK(bam_format_int(NULL, 0, -12345) == 6);
+
+    for (int i = 0; i < TEST_N_RANDOM; i++) {
+        value = (long) (((unsigned long) test_random() << 16) ^ test_random());
+        snprintf(expected, sizeof(expected), "%ld", value);
+        check_format_int(value, expected);
+    }
+}
+
+
+static void test_real(void) {
+    char buffer[TEST_BUFFER_SIZE];
+
+    check_format_real(TEST_REAL(0), 2, "0.00");
+    check_format_real(TEST_REAL(1.5), 1, "1.5");
+    check_format_real(TEST_REAL(-2.25), 2, "-2.25");
+    check_format_real(TEST_REAL(-2.25), 0, "-2");
+    check_format_real(TEST_REAL(3), 0, "3");
+
+    // rounding carries into integer part, and values that round to zero aren't output as negative zero
+    check_format_real(TEST_REAL(0.999), 2, "1.00");
+    check_format_real(TEST_REAL(-9.9996), 3, "-10.000");
+    check_format_real(TEST_REAL(-0.0001), 2, "0.00");
+
+    // precision is clamped to range supported
+    check_format_real(TEST_REAL(0.5), -1, "1");
+    check_format_real(TEST_REAL(0.5), 20, "0.500000000");
+
+    // output is truncated to fit buffer, but untruncated length is returned
+    TEST_CHECK(bam_format_real(buffer, 3, TEST_REAL(1.25), 2) == 4 && strcmp(buffer, "1.") == 0);
+
+    check_parse_real("1.5", true, TEST_REAL(1.5));
+    check_parse_real("-2.25", true, TEST_REAL(-2.25));
+    check_parse_real("+.5", true, TEST_REAL(0.5));
+    check_parse_real("3.", true, TEST_REAL(3));
+    check_parse_real("", false, 0);
+    check_parse_real(".", false, 0);
+    check_parse_real("-", false, 0);
+    check_parse_real("1.2.3", false, 0);
+    check_parse_real("1e3", false, 0);
+
+    // digits beyond maximum precision are ignored
+    check_parse_real("0.2500000009", true, TEST_REAL(0.25));
+
+#ifdef BAM_REAL_FIXED_BITS
+    // smallest fixed-point value (test is built with 16 fractional bits), and value largest magnitudes saturate to
+    check_format_real((bam_real_t) 1, TEST_MAX_PRECISION, "0.000015259");
+    check_parse_real("1000000000", true, TEST_REAL_MAX);
+    check_parse_real("-1000000000", true, -TEST_REAL_MAX);
+    check_parse_real("123456789012345678901234567890.5", true, TEST_REAL_MAX);
+#else
+    // magnitudes beyond range of integer part saturate
+    snprintf(buffer, sizeof(buffer), "%lu.0", ULONG_MAX);
+    check_format_real(TEST_REAL(1e30), 1, buffer);
+    check_format_real(TEST_REAL(0.000000001), TEST_MAX_PRECISION, "0.000000001");
+    check_parse_real("0.000000001", true, TEST_REAL(0.000000001));
+#endif // BAM_REAL_FIXED_BITS
+}
+
+
+static void test_real_round_trip(void) {
+    char buffer[TEST_BUFFER_SIZE];
+    bam_real_t value;
+    bam_real_t parsed;
+
+    for (int i = 0; i < TEST_N_RANDOM; i++) {
+#ifdef BAM_REAL_FIXED_BITS
+        // enough decimal places to tell every fixed-point value apart round-trip exactly, at any magnitude
+        value = (bam_real_t) test_random();
+
+        for (int precision = 5; precision <= TEST_MAX_PRECISION; precision++) {
+            bam_format_real(buffer, sizeof(buffer), value, precision);
+            TEST_CHECK(bam_parse_real(buffer, &parsed) && parsed == value);
+        }
+#else
+        // floating-point values round-trip to within half of last decimal place output
+        value = ((bam_real_t) (int32_t) test_random()) / ((bam_real_t) (1u + (test_random() % 100000u)));
+
+        double tolerance = 0.5;
+
+        for (int precision = 0; precision <= TEST_MAX_PRECISION; precision++) {
+            double error;
+
+            bam_format_real(buffer, sizeof(buffer), value, precision);
+            TEST_CHECK(bam_parse_real(buffer, &parsed));
+            error = (parsed > value) ? (parsed - value) : (value - parsed);
+            TEST_CHECK(error <= tolerance + ((value < 0 ? -value : value) * 1e-12));
+
+            tolerance /= 10.0;
+        }
+#endif // BAM_REAL_FIXED_BITS
+    }
+}
+
+
+int main(void) {
+    test_int();
+    test_real();
+    test_real_round_trip();
+
+    return TEST_EXIT_CODE();
+}
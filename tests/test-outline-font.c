@@ -0,0 +1,656 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Outline font test - builds small TrueType fonts in memory, one with a format 4 cmap and short loca and one that
+ * also has a format 12 cmap and long loca, then checks their metrics, glyph lookups, rasterization of simple,
+ * curved, composite and empty glyphs, eviction from glyph cache, and rejection of truncated or inconsistent tables.
+ */
+
+#include <string.h>
+
+#include <bam.h>
+
+#include "test.h"
+
+
+#define TEST_FONT_MAX_SIZE          1024
+#define TEST_MAX_TABLES             8
+#define TEST_N_GLYPHS               6
+#define TEST_UNITS_PER_EM           1000
+#define TEST_SIZE                   100
+#define TEST_N_CACHE_ENTRIES        4
+#define TEST_CACHE_BUFFER_SIZE      32768
+#define TEST_SCRATCH_SIZE           131072
+
+#define TEST_FLAG_ON_CURVE          0x01u
+#define TEST_FLAG_X_SHORT           0x02u
+#define TEST_FLAG_Y_SHORT           0x04u
+#define TEST_FLAG_REPEAT            0x08u
+#define TEST_FLAG_X_SAME            0x10u
+#define TEST_FLAG_Y_SAME            0x20u
+
+#define TEST_COMPONENT_WORDS        0x0001u
+#define TEST_COMPONENT_XY           0x0002u
+#define TEST_COMPONENT_SCALE        0x0008u
+#define TEST_COMPONENT_MORE         0x0020u
+
+// glyphs of test fonts, and codepoints that map to them
+#define TEST_GLYPH_SQUARE           1
+#define TEST_GLYPH_BAR              2
+#define TEST_GLYPH_COMPOSITE        3
+#define TEST_GLYPH_SPACE            4
+#define TEST_GLYPH_ARCH             5
+
+#define TEST_CODEPOINT_SQUARE       0x41u
+#define TEST_CODEPOINT_BAR          0x48u
+#define TEST_CODEPOINT_COMPOSITE    0xC4u
+#define TEST_CODEPOINT_SPACE        0x20u
+#define TEST_CODEPOINT_ARCH         0x1F600u
+
+
+typedef struct {
+    uint8_t data[TEST_FONT_MAX_SIZE];
+    size_t size;
+    size_t n_tables;
+    size_t table_offsets[TEST_MAX_TABLES];
+    size_t table_sizes[TEST_MAX_TABLES];
+} test_blob_t;
+
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    bool on_curve;
+} test_point_t;
+
+
+static const test_point_t TEST_SQUARE_POINTS[] = {{0, 0, true}, {0, 1000, true}, {1000, 1000, true}, {1000, 0, true}};
+static const test_point_t TEST_BAR_POINTS[] = {{0, 0, true}, {0, 700, true}, {500, 700, true}, {500, 0, true}};
+static const test_point_t TEST_ARCH_POINTS[] = {{0, 0, true}, {500, 1000, false}, {1000, 0, true}};
+
+static const uint16_t TEST_ADVANCES[TEST_N_GLYPHS] = {500, 1000, 600, 1500, 300, 1000};
+
+
+static test_blob_t m_blob;
+static bam_outline_font_t m_font;
+static bam_outline_cache_entry_t m_entries[TEST_N_CACHE_ENTRIES];
+static uint8_t m_cache_buffer[TEST_CACHE_BUFFER_SIZE];
+static int32_t m_scratch[TEST_SCRATCH_SIZE / sizeof(int32_t)];
+static bam_outline_cache_t m_cache;
+static uint8_t m_bitmap_copy[TEST_CACHE_BUFFER_SIZE];
+
+
+// ******** FONT BUILDER ********
+
+static void put_u8(test_blob_t* blob, unsigned int value) {
+    blob->data[blob->size++] = (uint8_t) value;
+}
+
+
+static void put_u16(test_blob_t* blob, unsigned int value) {
+    put_u8(blob, value >> 8);
+    put_u8(blob, value);
+}
+
+
+static void put_u32(test_blob_t* blob, uint32_t value) {
+    put_u16(blob, value >> 16);
+    put_u16(blob, value);
+}
+
+
+static void set_u16(test_blob_t* blob, size_t offset, unsigned int value) {
+    blob->data[offset] = (uint8_t) (value >> 8);
+    blob->data[offset + 1] = (uint8_t) value;
+}
+
+
+static void set_u32(test_blob_t* blob, size_t offset, uint32_t value) {
+    set_u16(blob, offset, value >> 16);
+    set_u16(blob, offset + 2, value);
+}
+
+
+static void begin_table(test_blob_t* blob, const char* tag) {
+    size_t record = 12 + (blob->n_tables * 16);
+
+    // tables are 4-byte aligned
+    while (blob->size % 4) {
+        put_u8(blob, 0);
+    }
+
+    memcpy(blob->data + record, tag, 4);
+    set_u32(blob, record + 8, (uint32_t) blob->size);
+    blob->table_offsets[blob->n_tables] = blob->size;
+}
+
+
+static void end_table(test_blob_t* blob) {
+    size_t record = 12 + (blob->n_tables * 16);
+
+    blob->table_sizes[blob->n_tables] = blob->size - blob->table_offsets[blob->n_tables];
+    set_u32(blob, record + 12, (uint32_t) blob->table_sizes[blob->n_tables]);
+    blob->n_tables++;
+}
+
+
+static void put_simple_glyph(test_blob_t* blob, const test_point_t* points, size_t n_points, int x_min, int y_min,
+                             int x_max, int y_max) {
+    uint8_t flags[8];
+    int prev;
+
+    put_u16(blob, 1);
+    put_u16(blob, (unsigned int) x_min);
+    put_u16(blob, (unsigned int) y_min);
+    put_u16(blob, (unsigned int) x_max);
+    put_u16(blob, (unsigned int) y_max);
+    put_u16(blob, (unsigned int) (n_points - 1));
+    put_u16(blob, 0);
+
+    // coordinate deltas are omitted if zero, bytes if small enough, otherwise words
+    for (size_t i = 0; i < n_points; i++) {
+        int dx = points[i].x - ((i > 0) ? points[i - 1].x : 0);
+        int dy = points[i].y - ((i > 0) ? points[i - 1].y : 0);
+
+        flags[i] = points[i].on_curve ? TEST_FLAG_ON_CURVE : 0;
+        flags[i] |= (dx == 0) ? TEST_FLAG_X_SAME : (dx >= -255 && dx <= 255) ?
+                    (TEST_FLAG_X_SHORT | ((dx > 0) ? TEST_FLAG_X_SAME : 0)) : 0;
+        flags[i] |= (dy == 0) ? TEST_FLAG_Y_SAME : (dy >= -255 && dy <= 255) ?
+                    (TEST_FLAG_Y_SHORT | ((dy > 0) ? TEST_FLAG_Y_SAME : 0)) : 0;
+    }
+
+    // runs of identical flags are run-length encoded
+    for (size_t i = 0; i < n_points;) {
+        size_t run = 1;
+
+        while (i + run < n_points && flags[i + run] == flags[i]) {
+            run++;
+        }
+
+        if (run > 1) {
+            put_u8(blob, flags[i] | TEST_FLAG_REPEAT);
+            put_u8(blob, (unsigned int) (run - 1));
+        } else {
+            put_u8(blob, flags[i]);
+        }
+
+        i += run;
+    }
+
+    prev = 0;
+
+    for (size_t i = 0; i < n_points; i++) {
+        int d = points[i].x - prev;
+
+        if (flags[i] & TEST_FLAG_X_SHORT) {
+            put_u8(blob, (unsigned int) ((d < 0) ? -d : d));
+        } else if (!(flags[i] & TEST_FLAG_X_SAME)) {
+            put_u16(blob, (unsigned int) d);
+        }
+
+        prev = points[i].x;
+    }
+
+    prev = 0;
+
+    for (size_t i = 0; i < n_points; i++) {
+        int d = points[i].y - prev;
+
+        if (flags[i] & TEST_FLAG_Y_SHORT) {
+            put_u8(blob, (unsigned int) ((d < 0) ? -d : d));
+        } else if (!(flags[i] & TEST_FLAG_Y_SAME)) {
+            put_u16(blob, (unsigned int) d);
+        }
+
+        prev = points[i].y;
+    }
+}
+
+
+static void put_composite_glyph(test_blob_t* blob) {
+    // square, with bar (at unit scale) to its right
+    put_u16(blob, 0xFFFFu);
+    put_u16(blob, 0);
+    put_u16(blob, 0);
+    put_u16(blob, 1500);
+    put_u16(blob, 1000);
+
+    put_u16(blob, TEST_COMPONENT_XY | TEST_COMPONENT_MORE);
+    put_u16(blob, TEST_GLYPH_SQUARE);
+    put_u8(blob, 0);
+    put_u8(blob, 0);
+
+    put_u16(blob, TEST_COMPONENT_WORDS | TEST_COMPONENT_XY | TEST_COMPONENT_SCALE);
+    put_u16(blob, TEST_GLYPH_BAR);
+    put_u16(blob, 1000);
+    put_u16(blob, 0);
+    put_u16(blob, 0x4000u);
+}
+
+
+static void put_cmap_4(test_blob_t* blob) {
+    // one segment per codepoint, bar's mapped through glyph ID array and rest by delta, then terminating segment
+    static const uint16_t CODEPOINTS[] = {TEST_CODEPOINT_SPACE, TEST_CODEPOINT_SQUARE, TEST_CODEPOINT_BAR,
+                                          TEST_CODEPOINT_COMPOSITE, 0xFFFFu};
+    static const uint16_t GLYPHS[] = {TEST_GLYPH_SPACE, TEST_GLYPH_SQUARE, TEST_GLYPH_BAR, TEST_GLYPH_COMPOSITE, 0};
+    const size_t n_segments = sizeof(CODEPOINTS) / sizeof(CODEPOINTS[0]);
+
+    put_u16(blob, 4);
+    put_u16(blob, (unsigned int) (16 + (n_segments * 8) + 2));
+    put_u16(blob, 0);
+    put_u16(blob, (unsigned int) (n_segments * 2));
+    put_u16(blob, 8);
+    put_u16(blob, 2);
+    put_u16(blob, (unsigned int) ((n_segments * 2) - 8));
+
+    for (size_t i = 0; i < n_segments; i++) {
+        put_u16(blob, CODEPOINTS[i]);
+    }
+
+    put_u16(blob, 0);
+
+    for (size_t i = 0; i < n_segments; i++) {
+        put_u16(blob, CODEPOINTS[i]);
+    }
+
+    for (size_t i = 0; i < n_segments; i++) {
+        put_u16(blob, (CODEPOINTS[i] == TEST_CODEPOINT_BAR) ? 0 : (unsigned int) (GLYPHS[i] - CODEPOINTS[i]));
+    }
+
+    for (size_t i = 0; i < n_segments; i++) {
+        put_u16(blob, (CODEPOINTS[i] == TEST_CODEPOINT_BAR) ? (unsigned int) ((n_segments - i) * 2) : 0);
+    }
+
+    put_u16(blob, TEST_GLYPH_BAR);
+}
+
+
+static void put_cmap_12(test_blob_t* blob) {
+    static const uint32_t CODEPOINTS[] = {TEST_CODEPOINT_SPACE, TEST_CODEPOINT_SQUARE, TEST_CODEPOINT_BAR,
+                                          TEST_CODEPOINT_COMPOSITE, TEST_CODEPOINT_ARCH};
+    static const uint32_t GLYPHS[] = {TEST_GLYPH_SPACE, TEST_GLYPH_SQUARE, TEST_GLYPH_BAR, TEST_GLYPH_COMPOSITE,
+                                      TEST_GLYPH_ARCH};
+    const size_t n_groups = sizeof(CODEPOINTS) / sizeof(CODEPOINTS[0]);
+
+    put_u16(blob, 12);
+    put_u16(blob, 0);
+    put_u32(blob, (uint32_t) (16 + (n_groups * 12)));
+    put_u32(blob, 0);
+    put_u32(blob, (uint32_t) n_groups);
+
+    for (size_t i = 0; i < n_groups; i++) {
+        put_u32(blob, CODEPOINTS[i]);
+        put_u32(blob, CODEPOINTS[i]);
+        put_u32(blob, GLYPHS[i]);
+    }
+}
+
+
+static void build_font(test_blob_t* blob, bool with_cmap_12) {
+    const bool long_loca = with_cmap_12;
+    const size_t n_tables = 7;
+    size_t glyph_offsets[TEST_N_GLYPHS + 1];
+    size_t cmap_offset;
+    size_t glyf_offset;
+
+    memset(blob, 0, sizeof(*blob));
+
+    // offset table, followed by table records filled in as tables are written
+    put_u32(blob, 0x00010000ul);
+    put_u16(blob, (unsigned int) n_tables);
+    put_u16(blob, 0);
+    put_u16(blob, 0);
+    put_u16(blob, 0);
+    blob->size += n_tables * 16;
+
+    begin_table(blob, "cmap");
+    cmap_offset = blob->size;
+    put_u16(blob, 0);
+    put_u16(blob, with_cmap_12 ? 2 : 1);
+    put_u16(blob, 3);
+    put_u16(blob, 1);
+    put_u32(blob, 0);
+
+    if (with_cmap_12) {
+        put_u16(blob, 3);
+        put_u16(blob, 10);
+        put_u32(blob, 0);
+    }
+
+    set_u32(blob, cmap_offset + 8, (uint32_t) (blob->size - cmap_offset));
+    put_cmap_4(blob);
+
+    if (with_cmap_12) {
+        set_u32(blob, cmap_offset + 16, (uint32_t) (blob->size - cmap_offset));
+        put_cmap_12(blob);
+    }
+
+    end_table(blob);
+
+    // .notdef and space have no outlines, glyphs' bounding boxes include their off-curve points (as font tools
+    // calculate them), and glyphs are padded to even lengths so that short loca can address them
+    begin_table(blob, "glyf");
+    glyf_offset = blob->size;
+
+    for (int glyph = 0; glyph < TEST_N_GLYPHS; glyph++) {
+        glyph_offsets[glyph] = blob->size - glyf_offset;
+
+        switch (glyph) {
+        case TEST_GLYPH_SQUARE:
+            put_simple_glyph(blob, TEST_SQUARE_POINTS, 4, 0, 0, 1000, 1000);
+            break;
+
+        case TEST_GLYPH_BAR:
+            put_simple_glyph(blob, TEST_BAR_POINTS, 4, 0, 0, 500, 700);
+            break;
+
+        case TEST_GLYPH_COMPOSITE:
+            put_composite_glyph(blob);
+            break;
+
+        case TEST_GLYPH_ARCH:
+            put_simple_glyph(blob, TEST_ARCH_POINTS, 3, 0, 0, 1000, 1000);
+            break;
+
+        default:
+            break;
+        }
+
+        if (blob->size % 2) {
+            put_u8(blob, 0);
+        }
+    }
+
+    glyph_offsets[TEST_N_GLYPHS] = blob->size - glyf_offset;
+    end_table(blob);
+
+    begin_table(blob, "head");
+    blob->size += 54;
+    set_u16(blob, blob->size - 54 + 18, TEST_UNITS_PER_EM);
+    set_u16(blob, blob->size - 54 + 50, long_loca ? 1 : 0);
+    end_table(blob);
+
+    begin_table(blob, "hhea");
+    blob->size += 36;
+    set_u16(blob, blob->size - 36 + 4, 800);
+    set_u16(blob, blob->size - 36 + 6, (unsigned int) -200);
+    set_u16(blob, blob->size - 36 + 8, 100);
+    set_u16(blob, blob->size - 36 + 34, TEST_N_GLYPHS);
+    end_table(blob);
+
+    begin_table(blob, "hmtx");
+
+    for (int glyph = 0; glyph < TEST_N_GLYPHS; glyph++) {
+        put_u16(blob, TEST_ADVANCES[glyph]);
+        put_u16(blob, 0);
+    }
+
+    end_table(blob);
+
+    begin_table(blob, "loca");
+
+    for (int glyph = 0; glyph <= TEST_N_GLYPHS; glyph++) {
+        if (long_loca) {
+            put_u32(blob, (uint32_t) glyph_offsets[glyph]);
+        } else {
+            put_u16(blob, (unsigned int) (glyph_offsets[glyph] / 2));
+        }
+    }
+
+    end_table(blob);
+
+    begin_table(blob, "maxp");
+    put_u32(blob, 0x00005000ul);
+    put_u16(blob, TEST_N_GLYPHS);
+    end_table(blob);
+}
+
+
+static size_t find_table(const test_blob_t* blob, const char* tag) {
+    for (size_t i = 0; i < blob->n_tables; i++) {
+        if (memcmp(blob->data + 12 + (i * 16), tag, 4) == 0) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+
+// ******** TESTS ********
+
+static void init_cache(size_t n_entries, size_t buffer_size) {
+    bam_init_outline_cache(&m_cache, m_entries, n_entries, m_cache_buffer, buffer_size, m_scratch,
+                           sizeof(m_scratch));
+}
+
+
+static bool get_glyph(bam_glyph_metrics_t* metrics, bam_unichar_t codepoint) {
+    const bam_outline_face_t face = {&m_font, TEST_SIZE};
+
+    return bam_get_outline_glyph_metrics(&m_cache, metrics, &face, codepoint);
+}
+
+
+static uint8_t get_pixel(const bam_glyph_metrics_t* metrics, int x, int y) {
+    // pixels of a glyph that failed to rasterize read as empty, so that its checks fail rather than crash
+    if (!metrics->user_data || x >= metrics->width || y >= metrics->height) {
+        return 0;
+    }
+
+    return ((const uint8_t*) metrics->user_data)[(y * metrics->width) + x];
+}
+
+
+static bool is_full(const bam_glyph_metrics_t* metrics, int x, int y) {
+    // edges on pixel boundaries may still leave a pixel marginally short of full coverage, as scale is fixed-point
+    return get_pixel(metrics, x, y) >= 250;
+}
+
+
+static bool is_empty(const bam_glyph_metrics_t* metrics, int x, int y) {
+    return get_pixel(metrics, x, y) <= 5;
+}
+
+
+static void test_load(bool with_cmap_12) {
+    const bam_outline_face_t face = {&m_font, TEST_SIZE};
+    bam_font_metrics_t font_metrics;
+    bam_glyph_metrics_t metrics;
+
+    build_font(&m_blob, with_cmap_12);
+    TEST_CHECK(bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+    TEST_CHECK(m_font.cmap_format == (with_cmap_12 ? 12 : 4));
+    TEST_CHECK(m_font.long_loca == with_cmap_12);
+    TEST_CHECK(m_font.n_glyphs == TEST_N_GLYPHS);
+
+    // capital H is bar, whose top is center line's height
+    bam_get_outline_font_metrics(&font_metrics, &face);
+    TEST_CHECK(font_metrics.ascent == 80);
+    TEST_CHECK(font_metrics.descent == 20);
+    TEST_CHECK(font_metrics.line_height == 110);
+    TEST_CHECK(font_metrics.center == 35);
+
+    init_cache(TEST_N_CACHE_ENTRIES, TEST_CACHE_BUFFER_SIZE);
+
+    // square's bitmap has an extra column for coverage of its right-hand edge, which is empty
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_SQUARE));
+    TEST_CHECK(metrics.width == 101 && metrics.height == 100);
+    TEST_CHECK(metrics.x_bearing == 0 && metrics.y_bearing == 100 && metrics.x_advance == 100);
+    TEST_CHECK(is_full(&metrics, 0, 0) && is_full(&metrics, 50, 50));
+    TEST_CHECK(is_full(&metrics, 99, 99) && is_empty(&metrics, 100, 50));
+
+    // bar is mapped through format 4 cmap's glyph ID array
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_BAR));
+    TEST_CHECK(metrics.width == 51 && metrics.height == 70 && metrics.x_advance == 60);
+    TEST_CHECK(is_full(&metrics, 25, 35));
+
+    // composite's left half is square and its right half is bar, sitting on baseline
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_COMPOSITE));
+    TEST_CHECK(metrics.width == 151 && metrics.height == 100 && metrics.x_advance == 150);
+    TEST_CHECK(is_full(&metrics, 50, 10) && is_full(&metrics, 125, 60));
+    TEST_CHECK(is_empty(&metrics, 125, 10) && is_empty(&metrics, 150, 60));
+
+    // space has an advance but no bitmap
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_SPACE));
+    TEST_CHECK(metrics.width == 0 && metrics.height == 0 && metrics.x_advance == 30 && !metrics.user_data);
+
+    // codepoints outside BMP are only covered by format 12 cmap - arch's curve peaks at half height of its control
+    // point, so is empty above that and in its upper corners, and covered beneath
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_ARCH) == with_cmap_12);
+
+    if (with_cmap_12) {
+        TEST_CHECK(metrics.width == 101 && metrics.height == 100);
+        TEST_CHECK(is_empty(&metrics, 50, 45) && is_full(&metrics, 50, 55) && is_full(&metrics, 50, 99));
+        TEST_CHECK(is_empty(&metrics, 5, 80) && is_full(&metrics, 5, 97) && is_empty(&metrics, 95, 80));
+    }
+
+    TEST_CHECK(!get_glyph(&metrics, 'Z'));
+    TEST_CHECK(!get_glyph(&metrics, 0xFFFFu));
+}
+
+
+static void test_cache(void) {
+    bam_outline_cache_stats_t stats;
+    bam_glyph_metrics_t metrics;
+    size_t square_size = 101 * 100;
+
+    build_font(&m_blob, false);
+    TEST_CHECK(bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+
+    // repeated lookups hit cache
+    init_cache(2, TEST_CACHE_BUFFER_SIZE);
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_SQUARE));
+    memcpy(m_bitmap_copy, metrics.user_data, square_size);
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_SQUARE));
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_BAR));
+
+    bam_get_outline_cache_stats(&m_cache, &stats);
+    TEST_CHECK(stats.n_hits == 1 && stats.n_misses == 2 && stats.n_rasterized == 2 && stats.n_evictions == 0);
+    TEST_CHECK(stats.n_entries == 2 && stats.memory_used == square_size + (51 * 70));
+
+    // running out of entries evicts all of them, after which glyphs are rasterized again, identically
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_SPACE));
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_SQUARE));
+    TEST_CHECK(memcmp(m_bitmap_copy, metrics.user_data, square_size) == 0);
+
+    bam_get_outline_cache_stats(&m_cache, &stats);
+    TEST_CHECK(stats.n_evictions == 1 && stats.n_misses == 4 && stats.n_rasterized == 3 && stats.n_entries == 2);
+    TEST_CHECK(stats.memory_peak == square_size + (51 * 70));
+
+    // running out of bitmap memory does too
+    init_cache(TEST_N_CACHE_ENTRIES, square_size + 100);
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_SQUARE));
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_BAR));
+    TEST_CHECK(is_full(&metrics, 25, 35));
+
+    bam_get_outline_cache_stats(&m_cache, &stats);
+    TEST_CHECK(stats.n_evictions == 1 && stats.n_entries == 1 && stats.memory_used == 51 * 70);
+
+    // as do glyphs too big to ever fit fail, without disturbing cache
+    init_cache(TEST_N_CACHE_ENTRIES, 51 * 70);
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_BAR));
+    TEST_CHECK(!get_glyph(&metrics, TEST_CODEPOINT_SQUARE));
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_BAR));
+
+    bam_get_outline_cache_stats(&m_cache, &stats);
+    TEST_CHECK(stats.n_evictions == 0 && stats.n_entries == 1 && stats.n_hits == 1);
+
+    bam_reset_outline_cache_stats(&m_cache);
+    bam_get_outline_cache_stats(&m_cache, &stats);
+    TEST_CHECK(stats.n_hits == 0 && stats.n_misses == 0 && stats.n_entries == 1);
+}
+
+
+static void test_malformed(void) {
+    bam_glyph_metrics_t metrics;
+    size_t cmap;
+    size_t cmap_offset;
+    size_t glyf;
+
+    build_font(&m_blob, true);
+    cmap = find_table(&m_blob, "cmap");
+    cmap_offset = m_blob.table_offsets[cmap];
+
+    // blob too short for its offset table, or its table records
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, 11));
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, 12 + (3 * 16)));
+
+    // table extending beyond end of blob
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, m_blob.size - 1));
+
+    // cmap too short for its header, or for its encoding records
+    set_u32(&m_blob, 12 + (cmap * 16) + 12, 3);
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+    set_u32(&m_blob, 12 + (cmap * 16) + 12, 12);
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+
+    // cmap too short for any subtable
+    set_u32(&m_blob, 12 + (cmap * 16) + 12, 20);
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+
+    // subtable offsets beyond end of cmap
+    build_font(&m_blob, true);
+    set_u32(&m_blob, cmap_offset + 8, 0xFFFFFFF0ul);
+    set_u32(&m_blob, cmap_offset + 16, (uint32_t) m_blob.table_sizes[cmap] - 8);
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+
+    // format 12 subtable with more groups than it has room for falls back to format 4 subtable
+    build_font(&m_blob, true);
+    set_u32(&m_blob, cmap_offset + m_blob.data[cmap_offset + 19] + 12, 6);
+    TEST_CHECK(bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+    TEST_CHECK(m_font.cmap_format == 4);
+
+    // format 4 subtable whose length exceeds cmap
+    build_font(&m_blob, false);
+    set_u16(&m_blob, cmap_offset + 12 + 2, 0xFFF0u);
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+
+    // loca too short for number of glyphs
+    build_font(&m_blob, false);
+    set_u16(&m_blob, m_blob.table_offsets[find_table(&m_blob, "maxp")] + 4, 100);
+    TEST_CHECK(!bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+
+    // glyph whose data extends beyond glyf fails to rasterize, but others still do
+    build_font(&m_blob, true);
+    glyf = find_table(&m_blob, "glyf");
+    set_u32(&m_blob, m_blob.table_offsets[find_table(&m_blob, "loca")] + ((TEST_GLYPH_BAR + 1) * 4),
+            (uint32_t) m_blob.table_sizes[glyf] + 4);
+    TEST_CHECK(bam_load_outline_font(&m_font, m_blob.data, m_blob.size));
+    init_cache(TEST_N_CACHE_ENTRIES, TEST_CACHE_BUFFER_SIZE);
+    TEST_CHECK(!get_glyph(&metrics, TEST_CODEPOINT_BAR));
+    TEST_CHECK(get_glyph(&metrics, TEST_CODEPOINT_SQUARE));
+}
+
+
+int main(void) {
+    test_load(false);
+    test_load(true);
+    test_cache();
+    test_malformed();
+
+    return TEST_EXIT_CODE();
+}
@@ -0,0 +1,231 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Page flipping test - renders same sequence of changes to a page-flipped display and to a single-buffered one,
+ * and checks that every frame presented by page-flipped display is pixel-exact with single-buffered one, whatever
+ * the number of buffers, the length of the damage history, or the age of the back buffer.
+ */
+
+#include <string.h>
+
+#include <bam.h>
+#include <font2c-types.h>
+
+#include "headless.h"
+#include "test.h"
+
+
+#define TEST_DISPLAY_WIDTH          320
+#define TEST_DISPLAY_HEIGHT         240
+#define TEST_TILE_WIDTH             32
+#define TEST_TILE_HEIGHT            32
+#define TEST_N_PIXELS               (TEST_DISPLAY_WIDTH * TEST_DISPLAY_HEIGHT)
+#define TEST_N_TILES                (((TEST_DISPLAY_WIDTH + TEST_TILE_WIDTH - 1) / TEST_TILE_WIDTH) * \
+                                        ((TEST_DISPLAY_HEIGHT + TEST_TILE_HEIGHT - 1) / TEST_TILE_HEIGHT))
+
+#define TEST_DIRTY_BUFFER_SIZE      BAM_DIRTY_BUFFER_SIZE(TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, \
+                                        TEST_TILE_WIDTH, TEST_TILE_HEIGHT)
+
+#define TEST_MAX_HISTORY_FRAMES     4
+#define TEST_HISTORY_BUFFER_SIZE    BAM_PAGE_FLIP_HISTORY_SIZE(TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, \
+                                        TEST_TILE_WIDTH, TEST_TILE_HEIGHT, TEST_MAX_HISTORY_FRAMES)
+
+#define TEST_N_WIDGETS              8
+#define TEST_N_FRAMES               300
+
+
+// defined in font-deja-vu-sans-48.c
+extern const font2c_font_t font_deja_vu_sans_48;
+
+static const bam_style_t TEST_STYLE = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_CENTER,
+        .v_align = BAM_V_ALIGN_MIDDLE,
+        .h_padding = 2,
+        .v_padding = 2,
+        .colors = {
+                {0xFFFFFFFFul, 0xFF303030ul},
+                {0xFF606060ul, 0xFF202020ul},
+                {0xFFFFFFFFul, 0xFFA00000ul}
+        }
+};
+
+static const char* TEST_TEXTS[] = {"1", "22", "333", "x"};
+
+
+typedef struct {
+    bam_t bam;
+    headless_t hl;
+    uint32_t dirty_buffer[TEST_DIRTY_BUFFER_SIZE];
+    bam_widget_t widget_buffer[TEST_N_WIDGETS];
+    bam_color_t tile[TEST_TILE_WIDTH * TEST_TILE_HEIGHT];
+} test_display_t;
+
+
+static test_display_t m_flipped;
+static test_display_t m_reference;
+static uint32_t m_history[TEST_HISTORY_BUFFER_SIZE];
+static bam_color_t m_buffers[HEADLESS_MAX_BUFFERS][TEST_N_PIXELS];
+static bam_color_t m_reference_buffer[TEST_N_PIXELS];
+static uint32_t m_rng;
+
+
+static int test_random(int n) {
+    // xorshift32, so that every run makes same changes
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 17;
+    m_rng ^= m_rng << 5;
+
+    return (int) (m_rng % (uint32_t) n);
+}
+
+
+static void display_init(test_display_t* display, bam_color_t* buffer) {
+    headless_init(&display->hl, TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT,
+                  display->tile, buffer);
+
+    bam_init(&display->bam, display->dirty_buffer, TEST_DIRTY_BUFFER_SIZE, display->widget_buffer, TEST_N_WIDGETS,
+             TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, 0xFF000000ul, &TEST_STYLE,
+             &HEADLESS_VTABLE, &display->hl);
+}
+
+
+static void add_widgets(void) {
+    bam_delete_widgets(&m_flipped.bam);
+    bam_delete_widgets(&m_reference.bam);
+
+    for (int i = 0; i < TEST_N_WIDGETS; i++) {
+        int x = test_random(TEST_DISPLAY_WIDTH - 80);
+        int y = test_random(TEST_DISPLAY_HEIGHT - 60);
+
+        bam_add_widget(&m_flipped.bam, x, y, 80, 60, NULL, TEST_TEXTS[i % 4], true);
+        bam_add_widget(&m_reference.bam, x, y, 80, 60, NULL, TEST_TEXTS[i % 4], true);
+    }
+}
+
+
+static void make_change(void) {
+    bam_widget_handle_t widget = (bam_widget_handle_t) test_random(TEST_N_WIDGETS);
+    const char* text;
+    bool enabled;
+    bam_rect_t bounds;
+
+    // same change is made to both displays
+    switch (test_random(3)) {
+    case 0:
+        text = TEST_TEXTS[test_random(4)];
+        bam_set_widget_text(&m_flipped.bam, widget, text);
+        bam_set_widget_text(&m_reference.bam, widget, text);
+        break;
+
+    case 1:
+        enabled = test_random(2) != 0;
+        bam_set_widget_enabled(&m_flipped.bam, widget, enabled);
+        bam_set_widget_enabled(&m_reference.bam, widget, enabled);
+        break;
+
+    default:
+        bounds.x1 = test_random(TEST_DISPLAY_WIDTH - 80);
+        bounds.y1 = test_random(TEST_DISPLAY_HEIGHT - 60);
+        bounds.x2 = bounds.x1 + 80;
+        bounds.y2 = bounds.y1 + 60;
+        bam_set_widget_bounds(&m_flipped.bam, widget, &bounds);
+        bam_set_widget_bounds(&m_reference.bam, widget, &bounds);
+        break;
+    }
+}
+
+
+static void test_page_flip(int n_buffers, int n_history_frames) {
+    bam_color_t* buffers[HEADLESS_MAX_BUFFERS];
+    unsigned long n_blts_full;
+    int n_mismatches = 0;
+
+    m_rng = 2463534242ul;
+
+    // page-flipped buffers start out holding garbage, which must never be presented
+    for (int i = 0; i < n_buffers; i++) {
+        buffers[i] = m_buffers[i];
+
+        for (int j = 0; j < TEST_N_PIXELS; j++) {
+            m_buffers[i][j] = 0xDEAD0000ul + (bam_color_t) i;
+        }
+    }
+
+    display_init(&m_flipped, NULL);
+    headless_init_page_flip(&m_flipped.hl, buffers, n_buffers);
+    bam_init_page_flip(&m_flipped.bam, m_history, BAM_PAGE_FLIP_HISTORY_SIZE(TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT,
+                       TEST_TILE_WIDTH, TEST_TILE_HEIGHT, n_history_frames));
+
+    display_init(&m_reference, m_reference_buffer);
+
+    add_widgets();
+
+    for (int frame = 0; frame < TEST_N_FRAMES; frame++) {
+        make_change();
+
+        // screen is occasionally replaced, and back buffer's contents are occasionally lost (as happens when a
+        // compositor reallocates buffers)
+        if (frame == TEST_N_FRAMES / 2) {
+            add_widgets();
+        }
+
+        if (frame % 97 == 50) {
+            m_flipped.hl.ages[m_flipped.hl.back] = 0;
+        }
+
+        bam_step(&m_flipped.bam, NULL);
+        bam_step(&m_reference.bam, NULL);
+
+        if (memcmp(headless_get_display(&m_flipped.hl), m_reference_buffer, sizeof(m_reference_buffer)) != 0) {
+            n_mismatches++;
+        }
+    }
+
+    n_blts_full = m_flipped.hl.n_flips * TEST_N_TILES;
+
+    printf("%i buffers, %i frames of history: %i mismatched frames, %lu blts (%lu if every frame were redrawn)\n",
+           n_buffers, n_history_frames, n_mismatches, m_flipped.hl.n_blts, n_blts_full);
+
+    TEST_CHECK(n_mismatches == 0);
+    TEST_CHECK(m_flipped.hl.n_flips > 0);
+
+    // history includes frame being rendered, so covers back buffer's age once it holds as many frames as there are
+    // buffers, after which only stale areas are redrawn
+    if (n_history_frames >= n_buffers) {
+        TEST_CHECK(m_flipped.hl.n_blts < n_blts_full / 2);
+    }
+}
+
+
+int main(void) {
+    test_page_flip(2, 1);
+    test_page_flip(2, 4);
+    test_page_flip(3, 1);
+    test_page_flip(3, 2);
+    test_page_flip(3, 4);
+
+    return TEST_EXIT_CODE();
+}
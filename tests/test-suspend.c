@@ -0,0 +1,200 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/*
+ * Suspend test - suspends a context with widgets and timers, resumes it into a fresh context, and checks that the
+ * resumed one renders pixel-exact with the original and has the same timers running. Then checks that a damaged
+ * blob is rejected without touching the widgets or timers of the context it was resumed into.
+ */
+
+#include <string.h>
+
+#include <bam.h>
+#include <font2c-types.h>
+
+#include "headless.h"
+#include "test.h"
+
+
+#define TEST_DISPLAY_WIDTH          240
+#define TEST_DISPLAY_HEIGHT         160
+#define TEST_TILE_WIDTH             32
+#define TEST_TILE_HEIGHT            32
+#define TEST_N_PIXELS               (TEST_DISPLAY_WIDTH * TEST_DISPLAY_HEIGHT)
+
+#define TEST_DIRTY_BUFFER_SIZE      BAM_DIRTY_BUFFER_SIZE(TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, \
+                                        TEST_TILE_WIDTH, TEST_TILE_HEIGHT)
+
+#define TEST_N_WIDGETS              8
+#define TEST_N_TIMERS               3
+#define TEST_BLOB_SIZE              256
+#define TEST_CHECKSUM               0x1234ul
+
+
+// defined in font-deja-vu-sans-48.c
+extern const font2c_font_t font_deja_vu_sans_48;
+
+static const bam_style_t TEST_STYLE_A = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_CENTER,
+        .v_align = BAM_V_ALIGN_MIDDLE,
+        .colors = {
+                {0xFF808080ul, 0xFF202020ul},
+                {0xFFFFFFFFul, 0xFF303030ul},
+                {0xFFFFFFFFul, 0xFFA00000ul}
+        }
+};
+
+static const bam_style_t TEST_STYLE_B = {
+        .font = &font_deja_vu_sans_48,
+        .h_align = BAM_H_ALIGN_LEFT,
+        .v_align = BAM_V_ALIGN_TOP,
+        .h_padding = 4,
+        .v_padding = 2,
+        .colors = {
+                {0xFF404040ul, 0xFF000040ul},
+                {0xFF00FFFFul, 0xFF000080ul},
+                {0xFFFFFF00ul, 0xFF0000C0ul}
+        }
+};
+
+static const bam_style_t* const TEST_STYLES[] = {&TEST_STYLE_A, &TEST_STYLE_B};
+
+
+typedef struct {
+    bam_t bam;
+    headless_t hl;
+    uint32_t dirty_buffer[TEST_DIRTY_BUFFER_SIZE];
+    bam_widget_t widget_buffer[TEST_N_WIDGETS];
+    bam_color_t display[TEST_N_PIXELS];
+    bam_timer_t timer_storage[TEST_N_TIMERS];
+    bam_timer_t* timers[TEST_N_TIMERS];
+} test_context_t;
+
+
+static bam_color_t m_tile[TEST_TILE_WIDTH * TEST_TILE_HEIGHT];
+static test_context_t m_original;
+static test_context_t m_resumed;
+static uint32_t m_blob[TEST_BLOB_SIZE];
+static uint32_t m_bad_blob[TEST_BLOB_SIZE];
+
+
+static void timer_callback(bam_t* bam, bam_timer_t* timer, void* user_data) {
+    (void) bam;
+    (void) timer;
+    (void) user_data;
+}
+
+
+static void init_context(test_context_t* ctx) {
+    headless_init(&ctx->hl, TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, m_tile,
+                  ctx->display);
+
+    bam_init(&ctx->bam, ctx->dirty_buffer, TEST_DIRTY_BUFFER_SIZE, ctx->widget_buffer, TEST_N_WIDGETS,
+             TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT, TEST_TILE_WIDTH, TEST_TILE_HEIGHT, 0xFF000000ul, &TEST_STYLE_A,
+             &HEADLESS_VTABLE, &ctx->hl);
+
+    // timers are resumed by their position in table, and keep the callback they were initialised with
+    for (int i = 0; i < TEST_N_TIMERS; i++) {
+        bam_init_timer(&ctx->timer_storage[i]);
+        ctx->timer_storage[i].callback = timer_callback;
+        ctx->timers[i] = &ctx->timer_storage[i];
+    }
+}
+
+
+static size_t n_widgets(const test_context_t* ctx) {
+    return (size_t) (ctx->bam.widget_buffer_ptr - ctx->bam.widget_buffer_begin);
+}
+
+
+int main(void) {
+    const bam_color_pair_t colors = {0xFFFF8000ul, 0xFF004000ul};
+    bam_widget_handle_t widget;
+    size_t blob_size;
+
+    init_context(&m_original);
+
+    bam_add_widget(&m_original.bam, 0, 0, TEST_DISPLAY_WIDTH, 60, &TEST_STYLE_A, "Suspended", true);
+    bam_add_widget(&m_original.bam, 10, 70, 100, 80, &TEST_STYLE_B, "Off", false);
+    widget = bam_add_widget(&m_original.bam, 120, 70, 110, 80, &TEST_STYLE_B, "", true);
+    bam_set_widget_colors(&m_original.bam, widget, &colors);
+    bam_set_widget_metadata(&m_original.bam, widget, (uintptr_t) 0xCAFEu);
+
+    bam_start_timer(&m_original.bam, m_original.timers[0], 500, true, timer_callback, NULL);
+    bam_start_timer(&m_original.bam, m_original.timers[2], 1000, false, timer_callback, NULL);
+    bam_step(&m_original.bam, NULL);
+
+    blob_size = bam_suspend(&m_original.bam, TEST_STYLES, 2, m_original.timers, TEST_N_TIMERS, TEST_CHECKSUM, m_blob,
+                            TEST_BLOB_SIZE);
+    TEST_CHECK(blob_size > 0 && blob_size <= TEST_BLOB_SIZE);
+
+    // widget whose style isn't in table can't be suspended
+    TEST_CHECK(bam_suspend(&m_original.bam, TEST_STYLES, 1, m_original.timers, TEST_N_TIMERS, TEST_CHECKSUM,
+                           m_bad_blob, TEST_BLOB_SIZE) == 0);
+
+    // resuming onto a display that no longer shows what it did renders everything, pixel-exact with original
+    init_context(&m_resumed);
+    TEST_CHECK(bam_resume(&m_resumed.bam, m_blob, blob_size, TEST_STYLES, 2, m_resumed.timers, TEST_N_TIMERS, 0));
+    bam_step(&m_resumed.bam, NULL);
+    TEST_CHECK(memcmp(m_resumed.display, m_original.display, sizeof(m_original.display)) == 0);
+
+    TEST_CHECK(n_widgets(&m_resumed) == 3);
+    TEST_CHECK(strcmp(bam_get_widget_text(&m_resumed.bam, 0), "Suspended") == 0);
+    TEST_CHECK(!bam_get_widget_enabled(&m_resumed.bam, 1));
+    TEST_CHECK(bam_get_widget_style(&m_resumed.bam, 2) == &TEST_STYLE_B);
+    TEST_CHECK(bam_get_widget_metadata(&m_resumed.bam, 2) == (uintptr_t) 0xCAFEu);
+
+    TEST_CHECK(bam_is_timer_active(m_resumed.timers[0]) && m_resumed.timers[0]->repeat &&
+               m_resumed.timers[0]->interval == 500);
+    TEST_CHECK(!bam_is_timer_active(m_resumed.timers[1]));
+    TEST_CHECK(bam_is_timer_active(m_resumed.timers[2]) && !m_resumed.timers[2]->repeat);
+
+    // resuming onto a display that still shows what it did renders nothing
+    init_context(&m_resumed);
+    TEST_CHECK(bam_resume(&m_resumed.bam, m_blob, blob_size, TEST_STYLES, 2, m_resumed.timers, TEST_N_TIMERS,
+                          TEST_CHECKSUM));
+    bam_step(&m_resumed.bam, NULL);
+    TEST_CHECK(m_resumed.hl.n_blts == 0);
+
+    // blob that is truncated, has a bad style, or a bad timer (which comes after every widget) is rejected, and
+    // leaves context it was resumed into as it was
+    init_context(&m_resumed);
+    bam_add_widget(&m_resumed.bam, 0, 0, 50, 50, &TEST_STYLE_A, "Live", true);
+    bam_start_timer(&m_resumed.bam, m_resumed.timers[1], 200, true, timer_callback, NULL);
+
+    TEST_CHECK(!bam_resume(&m_resumed.bam, m_blob, blob_size - 1, TEST_STYLES, 2, m_resumed.timers, TEST_N_TIMERS,
+                           0));
+    TEST_CHECK(!bam_resume(&m_resumed.bam, m_blob, blob_size, TEST_STYLES, 1, m_resumed.timers, TEST_N_TIMERS, 0));
+
+    memcpy(m_bad_blob, m_blob, blob_size * sizeof(uint32_t));
+    m_bad_blob[blob_size - 4] = TEST_N_TIMERS;
+    TEST_CHECK(!bam_resume(&m_resumed.bam, m_bad_blob, blob_size, TEST_STYLES, 2, m_resumed.timers, TEST_N_TIMERS,
+                           0));
+
+    TEST_CHECK(n_widgets(&m_resumed) == 1 && strcmp(bam_get_widget_text(&m_resumed.bam, 0), "Live") == 0);
+    TEST_CHECK(!bam_is_timer_active(m_resumed.timers[0]) && bam_is_timer_active(m_resumed.timers[1]) &&
+               !bam_is_timer_active(m_resumed.timers[2]));
+
+    return TEST_EXIT_CODE();
+}
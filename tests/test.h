@@ -0,0 +1,44 @@
+/*
+ *  ___     _     __  __   _
+ * | _ )   /_\   |  \/  | | |
+ * | _ \  / _ \  | |\/| | |_|
+ * |___/ /_/ \_\ |_|  |_| (_)
+ *
+ * A lightweight hardware agnostic touchscreen GUI library for embedded systems.
+ *
+ * https://github.com/mattbucknall/bam
+ *
+ * Copyright (C) 2022 Matthew T. Bucknall
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+ * IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BAM_TEST_H
+#define BAM_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// each test program counts failed checks, and exits with failure if there were any
+static int test_n_failures;
+
+#define TEST_CHECK(expr)                do { \
+                                            if (!(expr)) { \
+                                                fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, \
+                                                        #expr); \
+                                                test_n_failures++; \
+                                            } \
+                                        } while (0)
+
+#define TEST_EXIT_CODE()                ((test_n_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif // BAM_TEST_H